@@ -37,15 +37,9 @@ CHECK(, const);
 #undef CHECK2
 #undef CHECK1
 
-class WaylandBufferRefPrivate
-{
-public:
-    Internal::ClientBuffer *buffer = nullptr;
-
-    bool nullOrDestroyed() {
-        return !buffer || buffer->isDestroyed();
-    }
-};
+// Refs are passed around on every commit, moving them must not touch the reference count
+static_assert(std::is_nothrow_move_constructible_v<WaylandBufferRef>);
+static_assert(std::is_nothrow_move_assignable_v<WaylandBufferRef>);
 
 /*!
  * \class WaylandBufferRef
@@ -58,44 +52,46 @@ public:
  */
 
 /*!
+ * \fn WaylandBufferRef::WaylandBufferRef()
+ *
  * Constructs a null buffer ref.
  */
-WaylandBufferRef::WaylandBufferRef()
-                 : d(new WaylandBufferRefPrivate)
-{
-    d->buffer = nullptr;
-}
 
 /*!
  * Constructs a reference to \a buffer.
  */
 WaylandBufferRef::WaylandBufferRef(Internal::ClientBuffer *buffer)
-                 : d(new WaylandBufferRefPrivate)
+                 : m_buffer(buffer)
 {
-    d->buffer = buffer;
-    if (buffer)
-        buffer->ref();
+    if (m_buffer)
+        m_buffer->ref();
 }
 
 /*!
  * Creates a new reference to the buffer referenced by \a ref.
  */
 WaylandBufferRef::WaylandBufferRef(const WaylandBufferRef &ref)
-                 : d(new WaylandBufferRefPrivate)
+                 : m_buffer(ref.m_buffer)
 {
-    d->buffer = ref.d->buffer;
-    if (d->buffer)
-        d->buffer->ref();
+    if (m_buffer)
+        m_buffer->ref();
 }
 
+/*!
+ * \fn WaylandBufferRef::WaylandBufferRef(WaylandBufferRef &&other)
+ * \since 0.0
+ *
+ * Move-constructs a buffer ref from \a other, which becomes null.
+ * The reference count of the buffer is not touched.
+ */
+
 /*!
  * Dereferences the buffer.
  */
 WaylandBufferRef::~WaylandBufferRef()
 {
-    if (d->buffer)
-        d->buffer->deref();
-    delete d;
+    if (m_buffer)
+        m_buffer->deref();
 }
 
 /*!
@@ -104,17 +100,31 @@ WaylandBufferRef::~WaylandBufferRef()
  */
 WaylandBufferRef &WaylandBufferRef::operator=(const WaylandBufferRef &ref)
 {
-    if (ref.d->buffer)
-        ref.d->buffer->ref();
+    if (ref.m_buffer)
+        ref.m_buffer->ref();
 
-    if (d->buffer)
-        d->buffer->deref();
+    if (m_buffer)
+        m_buffer->deref();
 
-    d->buffer = ref.d->buffer;
+    m_buffer = ref.m_buffer;
 
     return *this;
 }
 
+/*!
+ * \fn WaylandBufferRef &WaylandBufferRef::operator=(WaylandBufferRef &&other)
+ * \since 0.0
+ *
+ * Move-assigns \a other to this buffer ref.
+ */
+
+/*!
+ * \fn void WaylandBufferRef::swap(WaylandBufferRef &other)
+ * \since 0.0
+ *
+ * Swaps this buffer ref with \a other. This operation is very fast and never fails.
+ */
+
 /*!
     \fn bool WaylandBufferRef::operator==(const WaylandBufferRef &lhs, const WaylandBufferRef &rhs)
 
@@ -123,7 +133,7 @@ WaylandBufferRef &WaylandBufferRef::operator=(const WaylandBufferRef &ref)
  */
 bool operator==(const WaylandBufferRef &lhs, const WaylandBufferRef &rhs) noexcept
 {
-    return lhs.d->buffer == rhs.d->buffer;
+    return lhs.m_buffer == rhs.m_buffer;
 }
 
 /*!
@@ -141,7 +151,7 @@ bool operator==(const WaylandBufferRef &lhs, const WaylandBufferRef &rhs) noexce
  */
 bool WaylandBufferRef::isNull() const
 {
-    return !d->buffer;
+    return !m_buffer;
 }
 
 /*!
@@ -151,7 +161,7 @@ bool WaylandBufferRef::isNull() const
  */
 bool WaylandBufferRef::hasBuffer() const
 {
-    return d->buffer;
+    return m_buffer;
 }
 /*!
  * Returns true if this WaylandBufferRef references a buffer that has content. Otherwise returns false.
@@ -160,7 +170,7 @@ bool WaylandBufferRef::hasBuffer() const
  */
 bool WaylandBufferRef::hasContent() const
 {
-    return Internal::ClientBuffer::hasContent(d->buffer);
+    return Internal::ClientBuffer::hasContent(m_buffer);
 }
 /*!
  * Returns true if this WaylandBufferRef references a buffer that has protected content. Otherwise returns false.
@@ -173,7 +183,7 @@ bool WaylandBufferRef::hasContent() const
  */
 bool WaylandBufferRef::hasProtectedContent() const
 {
-    return Internal::ClientBuffer::hasProtectedContent(d->buffer);
+    return Internal::ClientBuffer::hasProtectedContent(m_buffer);
 }
 
 /*!
@@ -182,7 +192,7 @@ bool WaylandBufferRef::hasProtectedContent() const
  */
 bool WaylandBufferRef::isDestroyed() const
 {
-    return d->buffer && d->buffer->isDestroyed();
+    return m_buffer && m_buffer->isDestroyed();
 }
 
 /*!
@@ -190,7 +200,7 @@ bool WaylandBufferRef::isDestroyed() const
  */
 struct ::wl_resource *WaylandBufferRef::wl_buffer() const
 {
-    return d->buffer ? d->buffer->waylandBufferHandle() : nullptr;
+    return m_buffer ? m_buffer->waylandBufferHandle() : nullptr;
 }
 
 /*!
@@ -198,7 +208,12 @@ struct ::wl_resource *WaylandBufferRef::wl_buffer() const
  */
 Internal::ClientBuffer *WaylandBufferRef::buffer() const
 {
-    return d->buffer;
+    return m_buffer;
+}
+
+bool WaylandBufferRef::nullOrDestroyed() const
+{
+    return !m_buffer || m_buffer->isDestroyed();
 }
 
 /*!
@@ -207,10 +222,10 @@ Internal::ClientBuffer *WaylandBufferRef::buffer() const
  */
 QSize WaylandBufferRef::size() const
 {
-    if (d->nullOrDestroyed())
+    if (nullOrDestroyed())
         return QSize();
 
-    return d->buffer->size();
+    return m_buffer->size();
 }
 
 /*!
@@ -220,15 +235,15 @@ QSize WaylandBufferRef::size() const
  */
 WaylandSurface::Origin WaylandBufferRef::origin() const
 {
-    if (d->buffer)
-        return d->buffer->origin();
+    if (m_buffer)
+        return m_buffer->origin();
 
     return WaylandSurface::OriginBottomLeft;
 }
 
 WaylandBufferRef::BufferType WaylandBufferRef::bufferType() const
 {
-    if (d->nullOrDestroyed())
+    if (nullOrDestroyed())
         return BufferType_Null;
 
     if (isSharedMemory())
@@ -239,10 +254,10 @@ WaylandBufferRef::BufferType WaylandBufferRef::bufferType() const
 
 WaylandBufferRef::BufferFormatEgl WaylandBufferRef::bufferFormatEgl() const
 {
-    if (d->nullOrDestroyed())
+    if (nullOrDestroyed())
         return BufferFormatEgl_Null;
 
-    return d->buffer->bufferFormatEgl();
+    return m_buffer->bufferFormatEgl();
 }
 
 /*!
@@ -250,10 +265,10 @@ WaylandBufferRef::BufferFormatEgl WaylandBufferRef::bufferFormatEgl() const
  */
 bool WaylandBufferRef::isSharedMemory() const
 {
-    if (d->nullOrDestroyed())
+    if (nullOrDestroyed())
         return false;
 
-    return d->buffer->isSharedMemory();
+    return m_buffer->isSharedMemory();
 }
 
 /*!
@@ -261,10 +276,10 @@ bool WaylandBufferRef::isSharedMemory() const
  */
 QImage WaylandBufferRef::image() const
 {
-    if (d->nullOrDestroyed())
+    if (nullOrDestroyed())
         return QImage();
 
-    return d->buffer->image();
+    return m_buffer->image();
 }
 
 #if QT_CONFIG(opengl)
@@ -279,10 +294,10 @@ QImage WaylandBufferRef::image() const
  */
 QOpenGLTexture *WaylandBufferRef::toOpenGLTexture(int plane) const
 {
-    if (d->nullOrDestroyed())
+    if (nullOrDestroyed())
         return nullptr;
 
-    return d->buffer->toOpenGlTexture(plane);
+    return m_buffer->toOpenGlTexture(plane);
 }
 
 /*!
@@ -293,7 +308,7 @@ QOpenGLTexture *WaylandBufferRef::toOpenGLTexture(int plane) const
  */
 quintptr WaylandBufferRef::lockNativeBuffer()
 {
-    return d->buffer->lockNativeBuffer();
+    return m_buffer->lockNativeBuffer();
 }
 
 /*!
@@ -302,7 +317,7 @@ quintptr WaylandBufferRef::lockNativeBuffer()
  */
 void WaylandBufferRef::unlockNativeBuffer(quintptr handle)
 {
-    d->buffer->unlockNativeBuffer(handle);
+    m_buffer->unlockNativeBuffer(handle);
 }
 
 #endif
@@ -6,6 +6,8 @@
 #include <LiriAuroraCompositor/liriauroracompositorglobal.h>
 #include <QtGui/QImage>
 
+#include <utility>
+
 #if QT_CONFIG(opengl)
 #include <QtGui/qopengl.h>
 #endif
@@ -28,11 +30,16 @@ namespace Internal
 class LIRIAURORACOMPOSITOR_EXPORT WaylandBufferRef
 {
 public:
-    WaylandBufferRef();
+    WaylandBufferRef() noexcept = default;
     WaylandBufferRef(const WaylandBufferRef &ref);
+    WaylandBufferRef(WaylandBufferRef &&other) noexcept
+        : m_buffer(std::exchange(other.m_buffer, nullptr)) {}
     ~WaylandBufferRef();
 
     WaylandBufferRef &operator=(const WaylandBufferRef &ref);
+    QT_MOVE_ASSIGNMENT_OPERATOR_IMPL_VIA_PURE_SWAP(WaylandBufferRef)
+    void swap(WaylandBufferRef &other) noexcept { qt_ptr_swap(m_buffer, other.m_buffer); }
+
     bool isNull() const;
     bool hasBuffer() const;
     bool hasContent() const;
@@ -76,9 +83,11 @@ public:
 private:
     explicit WaylandBufferRef(Internal::ClientBuffer *buffer);
     Internal::ClientBuffer *buffer() const;
-    class WaylandBufferRefPrivate *const d;
-    friend class WaylandBufferRefPrivate;
+    bool nullOrDestroyed() const;
+    // Referenced through the reference count of the client buffer itself
+    Internal::ClientBuffer *m_buffer = nullptr;
     friend class WaylandSurfacePrivate;
+    friend class Internal::ClientBuffer;
 
     friend LIRIAURORACOMPOSITOR_EXPORT
     bool operator==(const WaylandBufferRef &lhs, const WaylandBufferRef &rhs) noexcept;
@@ -87,7 +96,14 @@ private:
     { return !(lhs == rhs); }
 };
 
+inline void swap(WaylandBufferRef &lhs, WaylandBufferRef &rhs) noexcept
+{
+    lhs.swap(rhs);
+}
+
 } // namespace Compositor
 
 } // namespace Aurora
 
+Q_DECLARE_TYPEINFO(Aurora::Compositor::WaylandBufferRef, Q_RELOCATABLE_TYPE);
+
@@ -14,6 +14,10 @@
 #include <LiriAuroraCompositor/private/aurorawaylandutils_p.h>
 #include <LiriAuroraCompositor/private/aurorawaylandxdgoutputv1_p.h>
 
+#if LIRI_FEATURE_aurora_qpa
+#include <LiriAuroraPlatformHeaders/lirieglfsfunctions.h>
+#endif
+
 #include <QtCore/QCoreApplication>
 #include <QtCore/QtMath>
 #include <QtGui/QWindow>
@@ -113,6 +117,129 @@ void WaylandOutputPrivate::_q_handleWindowDestroyed()
     emit q->windowDestroyed();
 }
 
+void WaylandOutputPrivate::_q_sendThrottledFrameCallbacks()
+{
+    const uint time = compositor->currentTimeMsecs();
+    for (const WaylandSurfaceViewMapper &surfacemapper : std::as_const(surfaceViews)) {
+        if (!surfacemapper.surface || !surfacemapper.surface->hasContent())
+            continue;
+        auto primaryView = surfacemapper.maybePrimaryView();
+        if (!primaryView || WaylandViewPrivate::get(primaryView)->independentFrameCallback)
+            continue;
+        if (surfacemapper.surface->frameCallbackHoldReason() != WaylandSurface::FrameCallbackNotHeld)
+            throttleFrameCallbacks(surfacemapper.surface, time);
+    }
+    wl_display_flush_clients(compositor->display());
+}
+
+/*
+    Sends frame callbacks of the surfaces presented by the frame that was
+    rendered, with the time it's expected on screen as \a presentationTime.
+    Held surfaces are throttled against the current time.
+*/
+void WaylandOutputPrivate::sendFrameCallbacks(uint presentationTime)
+{
+    Q_Q(WaylandOutput);
+    const uint time = compositor->currentTimeMsecs();
+    for (int i = 0; i < surfaceViews.size(); i++) {
+        const WaylandSurfaceViewMapper &surfacemapper = surfaceViews.at(i);
+        if (surfacemapper.surface && surfacemapper.surface->hasContent()) {
+            if (!surfacemapper.has_entered) {
+                q->surfaceEnter(surfacemapper.surface);
+                surfaceViews[i].has_entered = true;
+            }
+            if (auto primaryView = surfacemapper.maybePrimaryView()) {
+                if (!WaylandViewPrivate::get(primaryView)->independentFrameCallback) {
+                    const auto reason = frameCallbackHoldReason(surfacemapper);
+                    auto *surfacePrivate = WaylandSurfacePrivate::get(surfacemapper.surface);
+                    surfacePrivate->setFrameCallbackHoldReason(reason);
+                    if (reason == WaylandSurface::FrameCallbackNotHeld)
+                        surfacePrivate->sendFrameCallbacks(presentationTime);
+                    else
+                        throttleFrameCallbacks(surfacemapper.surface, time);
+                }
+            }
+        }
+    }
+    wl_display_flush_clients(compositor->display());
+}
+
+/*
+    Asks the screen of the window to follow fullscreen clients, or not.
+*/
+void WaylandOutputPrivate::updateVariableRefreshRate()
+{
+    Q_Q(WaylandOutput);
+
+    bool active = false;
+#if LIRI_FEATURE_aurora_qpa
+    QScreen *screen = window ? window->screen() : nullptr;
+
+    // The window moved to another screen, or it's turned off
+    if (variableRefreshRateScreen && (variableRefreshRateScreen != screen || !variableRefreshRate))
+        PlatformSupport::EglFSFunctions::setVariableRefreshRate(variableRefreshRateScreen, false);
+    variableRefreshRateScreen = nullptr;
+
+    if (screen && variableRefreshRate) {
+        active = PlatformSupport::EglFSFunctions::setVariableRefreshRate(screen, true);
+        if (active)
+            variableRefreshRateScreen = screen;
+    }
+#endif
+
+    if (variableRefreshRateActive != active) {
+        variableRefreshRateActive = active;
+        emit q->variableRefreshRateActiveChanged();
+    }
+}
+
+/*
+    Returns why frame callbacks of the surface of \a mapper should be held
+    back, according to the visibility of its views on this output, as
+    determined by the last frame.
+*/
+WaylandSurface::FrameCallbackHoldReason WaylandOutputPrivate::frameCallbackHoldReason(const WaylandSurfaceViewMapper &mapper) const
+{
+    if (!frameCallbackThrottling)
+        return WaylandSurface::FrameCallbackNotHeld;
+
+    // Presented by any view is good enough
+    WaylandSurface::FrameCallbackHoldReason reason = WaylandSurface::FrameCallbackNotHeld;
+    for (WaylandView *view : mapper.views) {
+        const auto viewReason = WaylandViewPrivate::get(view)->frameCallbackHoldReason;
+        if (viewReason == WaylandSurface::FrameCallbackNotHeld)
+            return WaylandSurface::FrameCallbackNotHeld;
+        if (reason == WaylandSurface::FrameCallbackNotHeld || view == mapper.surface->primaryView())
+            reason = viewReason;
+    }
+    return reason;
+}
+
+/*
+    Sends the frame callbacks of the held \a surface if the last ones were
+    sent at least throttledFrameCallbackInterval milliseconds before \a time,
+    otherwise schedules another attempt.
+*/
+void WaylandOutputPrivate::throttleFrameCallbacks(WaylandSurface *surface, uint time)
+{
+    if (throttledFrameCallbackInterval <= 0)
+        return;
+
+    auto *surfacePrivate = WaylandSurfacePrivate::get(surface);
+    if (surfacePrivate->frameCallbacks.isEmpty())
+        return;
+
+    const uint elapsed = time - surfacePrivate->lastFrameCallbackTime;
+    if (elapsed >= uint(throttledFrameCallbackInterval)) {
+        surface->sendFrameCallbacks();
+        return;
+    }
+
+    const int remaining = throttledFrameCallbackInterval - int(elapsed);
+    if (!throttleTimer.isActive() || throttleTimer.remainingTime() > remaining)
+        throttleTimer.start(remaining);
+}
+
 void WaylandOutputPrivate::sendGeometry(const Resource *resource)
 {
     send_geometry(resource->handle,
@@ -189,33 +316,49 @@ void WaylandOutputPrivate::handleWindowPixelSizeChanged()
 
 void WaylandOutputPrivate::addView(WaylandView *view, WaylandSurface *surface)
 {
-    for (int i = 0; i < surfaceViews.size(); i++) {
-        if (surface == surfaceViews.at(i).surface) {
-            if (!surfaceViews.at(i).views.contains(view)) {
-                surfaceViews[i].views.append(view);
-            }
-            return;
-        }
+    auto it = surfaceViewIndex.constFind(surface);
+    if (it != surfaceViewIndex.constEnd()) {
+        QList<WaylandView *> &views = surfaceViews[it.value()].views;
+        if (!views.contains(view))
+            views.append(view);
+        return;
     }
 
+    surfaceViewIndex.insert(surface, surfaceViews.size());
     surfaceViews.append(WaylandSurfaceViewMapper(surface,view));
 }
 
 void WaylandOutputPrivate::removeView(WaylandView *view, WaylandSurface *surface)
 {
     Q_Q(WaylandOutput);
-    for (int i = 0; i < surfaceViews.size(); i++) {
-        if (surface == surfaceViews.at(i).surface) {
-            bool removed = surfaceViews[i].views.removeOne(view);
-            if (surfaceViews.at(i).views.isEmpty() && removed) {
-                if (surfaceViews.at(i).has_entered)
-                    q->surfaceLeave(surface);
-                surfaceViews.remove(i);
-            }
-            return;
-        }
+    auto it = surfaceViewIndex.find(surface);
+    if (it == surfaceViewIndex.end()) {
+        qWarning("%s Could not find view %p for surface %p to remove. Possible invalid state", Q_FUNC_INFO, view, surface);
+        return;
     }
-    qWarning("%s Could not find view %p for surface %p to remove. Possible invalid state", Q_FUNC_INFO, view, surface);
+
+    const qsizetype index = it.value();
+    QList<WaylandView *> &views = surfaceViews[index].views;
+    const qsizetype viewIndex = views.indexOf(view);
+    if (viewIndex < 0)
+        return;
+
+    // Order doesn't matter, swap with the last one rather than shifting the others
+    views.swapItemsAt(viewIndex, views.size() - 1);
+    views.removeLast();
+    if (!views.isEmpty())
+        return;
+
+    const bool hasEntered = surfaceViews.at(index).has_entered;
+    surfaceViewIndex.erase(it);
+    if (index != surfaceViews.size() - 1) {
+        surfaceViews.swapItemsAt(index, surfaceViews.size() - 1);
+        surfaceViewIndex[surfaceViews.at(index).surface] = index;
+    }
+    surfaceViews.removeLast();
+
+    if (hasEntered)
+        q->surfaceLeave(surface);
 }
 
 WaylandOutput::WaylandOutput()
@@ -316,11 +459,17 @@ void WaylandOutput::initialize()
         QObjectPrivate::connect(d->window, &QWindow::heightChanged, d, &WaylandOutputPrivate::_q_handleMaybeWindowPixelSizeChanged);
         QObjectPrivate::connect(d->window, &QWindow::screenChanged, d, &WaylandOutputPrivate::_q_handleMaybeWindowPixelSizeChanged);
         QObjectPrivate::connect(d->window, &QObject::destroyed, d, &WaylandOutputPrivate::_q_handleWindowDestroyed);
+        QObjectPrivate::connect(d->window, &QWindow::screenChanged, d, &WaylandOutputPrivate::updateVariableRefreshRate);
     }
 
+    d->throttleTimer.setSingleShot(true);
+    QObjectPrivate::connect(&d->throttleTimer, &QTimer::timeout, d, &WaylandOutputPrivate::_q_sendThrottledFrameCallbacks);
+
     d->init(d->compositor->display(), 2);
 
     d->initialized = true;
+
+    d->updateVariableRefreshRate();
 }
 
 /*!
@@ -861,6 +1010,197 @@ void WaylandOutput::setSizeFollowsWindow(bool follow)
     }
 }
 
+/*!
+ * \qmlproperty bool AuroraCompositor::WaylandOutput::frameCallbackThrottling
+ *
+ * This property controls whether frame callbacks are held back for surfaces
+ * that were not presented by the last frame of this output, because they were
+ * hidden, outside of the output or covered by opaque surfaces.
+ *
+ * Held frame callbacks are sent at the pace set by throttledFrameCallbackInterval.
+ * The reason is reported by WaylandSurface::frameCallbackHoldReason.
+ *
+ * The default is false.
+ */
+
+/*!
+ * \property WaylandOutput::frameCallbackThrottling
+ *
+ * This property controls whether frame callbacks are held back for surfaces
+ * that were not presented by the last frame of this output, because they were
+ * hidden, outside of the output or covered by opaque surfaces.
+ *
+ * Held frame callbacks are sent at the pace set by throttledFrameCallbackInterval.
+ * The reason is reported by WaylandSurface::frameCallbackHoldReason.
+ *
+ * The default is false.
+ */
+bool WaylandOutput::frameCallbackThrottling() const
+{
+    return d_func()->frameCallbackThrottling;
+}
+
+void WaylandOutput::setFrameCallbackThrottling(bool throttling)
+{
+    Q_D(WaylandOutput);
+
+    if (throttling != d->frameCallbackThrottling) {
+        d->frameCallbackThrottling = throttling;
+        if (!throttling)
+            d->throttleTimer.stop();
+        Q_EMIT frameCallbackThrottlingChanged();
+        if (d->initialized)
+            update();
+    }
+}
+
+/*!
+ * \qmlproperty int AuroraCompositor::WaylandOutput::throttledFrameCallbackInterval
+ *
+ * This property holds the minimum interval, in milliseconds, between frame
+ * callbacks of surfaces held back by frameCallbackThrottling.
+ *
+ * A value of 0 holds frame callbacks until the surface is presented again.
+ *
+ * The default is 1000.
+ */
+
+/*!
+ * \property WaylandOutput::throttledFrameCallbackInterval
+ *
+ * This property holds the minimum interval, in milliseconds, between frame
+ * callbacks of surfaces held back by frameCallbackThrottling.
+ *
+ * A value of 0 holds frame callbacks until the surface is presented again.
+ *
+ * The default is 1000.
+ */
+int WaylandOutput::throttledFrameCallbackInterval() const
+{
+    return d_func()->throttledFrameCallbackInterval;
+}
+
+void WaylandOutput::setThrottledFrameCallbackInterval(int msecs)
+{
+    Q_D(WaylandOutput);
+
+    msecs = qMax(0, msecs);
+    if (msecs != d->throttledFrameCallbackInterval) {
+        d->throttledFrameCallbackInterval = msecs;
+        d->throttleTimer.stop();
+        Q_EMIT throttledFrameCallbackIntervalChanged();
+        if (d->initialized && d->frameCallbackThrottling && msecs > 0)
+            d->_q_sendThrottledFrameCallbacks();
+    }
+}
+
+/*!
+ * \qmlproperty bool AuroraCompositor::WaylandOutput::variableRefreshRate
+ *
+ * This property controls whether the output may use variable refresh rate,
+ * also known as adaptive sync.
+ *
+ * The refresh rate then follows a fullscreen client shown directly on the
+ * display, within the range of the monitor. Otherwise the output refreshes
+ * at the rate of its mode. Whether it's supported is reported by
+ * variableRefreshRateActive.
+ *
+ * The default is false.
+ */
+
+/*!
+ * \property WaylandOutput::variableRefreshRate
+ *
+ * This property controls whether the output may use variable refresh rate,
+ * also known as adaptive sync.
+ *
+ * The refresh rate then follows a fullscreen client shown directly on the
+ * display, within the range of the monitor. Otherwise the output refreshes
+ * at the rate of its mode. Whether it's supported is reported by
+ * variableRefreshRateActive.
+ *
+ * The default is false.
+ */
+bool WaylandOutput::variableRefreshRate() const
+{
+    return d_func()->variableRefreshRate;
+}
+
+void WaylandOutput::setVariableRefreshRate(bool enabled)
+{
+    Q_D(WaylandOutput);
+
+    if (enabled != d->variableRefreshRate) {
+        d->variableRefreshRate = enabled;
+        Q_EMIT variableRefreshRateChanged();
+        if (d->initialized)
+            d->updateVariableRefreshRate();
+    }
+}
+
+/*!
+ * \qmlproperty bool AuroraCompositor::WaylandOutput::variableRefreshRateActive
+ * \readonly
+ *
+ * This property holds whether variableRefreshRate is enabled and supported
+ * by the screen of the window.
+ */
+
+/*!
+ * \property WaylandOutput::variableRefreshRateActive
+ *
+ * This property holds whether variableRefreshRate is enabled and supported
+ * by the screen of the window.
+ */
+bool WaylandOutput::isVariableRefreshRateActive() const
+{
+    return d_func()->variableRefreshRateActive;
+}
+
+/*!
+ * \qmlproperty bool AuroraCompositor::WaylandOutput::allowTearing
+ *
+ * This property controls whether surfaces that allow tearing may be
+ * presented without waiting for the vertical blank.
+ *
+ * Only a fullscreen client shown directly on the display is presented this
+ * way, and only with a driver that supports it. Otherwise frames wait for
+ * the vertical blank as usual.
+ *
+ * The default is false.
+ *
+ * \sa WaylandSurface::allowsTearing
+ */
+
+/*!
+ * \property WaylandOutput::allowTearing
+ *
+ * This property controls whether surfaces that allow tearing may be
+ * presented without waiting for the vertical blank.
+ *
+ * Only a fullscreen client shown directly on the display is presented this
+ * way, and only with a driver that supports it. Otherwise frames wait for
+ * the vertical blank as usual.
+ *
+ * The default is false.
+ *
+ * \sa WaylandSurface::allowsTearing
+ */
+bool WaylandOutput::allowTearing() const
+{
+    return d_func()->allowTearing;
+}
+
+void WaylandOutput::setAllowTearing(bool allow)
+{
+    Q_D(WaylandOutput);
+
+    if (allow != d->allowTearing) {
+        d->allowTearing = allow;
+        Q_EMIT allowTearingChanged();
+    }
+}
+
 /*!
  * \qmlproperty Window AuroraCompositor::WaylandOutput::window
  *
@@ -912,20 +1252,7 @@ void WaylandOutput::frameStarted()
 void WaylandOutput::sendFrameCallbacks()
 {
     Q_D(WaylandOutput);
-    for (int i = 0; i < d->surfaceViews.size(); i++) {
-        const WaylandSurfaceViewMapper &surfacemapper = d->surfaceViews.at(i);
-        if (surfacemapper.surface && surfacemapper.surface->hasContent()) {
-            if (!surfacemapper.has_entered) {
-                surfaceEnter(surfacemapper.surface);
-                d->surfaceViews[i].has_entered = true;
-            }
-            if (auto primaryView = surfacemapper.maybePrimaryView()) {
-                if (!WaylandViewPrivate::get(primaryView)->independentFrameCallback)
-                    surfacemapper.surface->sendFrameCallbacks();
-            }
-        }
-    }
-    wl_display_flush_clients(d->compositor->display());
+    d->sendFrameCallbacks(d->compositor->currentTimeMsecs());
 }
 
 /*!
@@ -41,6 +41,11 @@ class LIRIAURORACOMPOSITOR_EXPORT WaylandOutput : public WaylandObject
     Q_PROPERTY(Aurora::Compositor::WaylandOutput::Transform transform READ transform WRITE setTransform NOTIFY transformChanged)
     Q_PROPERTY(int scaleFactor READ scaleFactor WRITE setScaleFactor NOTIFY scaleFactorChanged)
     Q_PROPERTY(bool sizeFollowsWindow READ sizeFollowsWindow WRITE setSizeFollowsWindow NOTIFY sizeFollowsWindowChanged)
+    Q_PROPERTY(bool frameCallbackThrottling READ frameCallbackThrottling WRITE setFrameCallbackThrottling NOTIFY frameCallbackThrottlingChanged)
+    Q_PROPERTY(int throttledFrameCallbackInterval READ throttledFrameCallbackInterval WRITE setThrottledFrameCallbackInterval NOTIFY throttledFrameCallbackIntervalChanged)
+    Q_PROPERTY(bool variableRefreshRate READ variableRefreshRate WRITE setVariableRefreshRate NOTIFY variableRefreshRateChanged)
+    Q_PROPERTY(bool variableRefreshRateActive READ isVariableRefreshRateActive NOTIFY variableRefreshRateActiveChanged)
+    Q_PROPERTY(bool allowTearing READ allowTearing WRITE setAllowTearing NOTIFY allowTearingChanged)
 
     QML_NAMED_ELEMENT(WaylandOutputBase)
     QML_ADDED_IN_VERSION(1, 0)
@@ -120,6 +125,19 @@ public:
     bool physicalSizeFollowsSize() const;
     void setPhysicalSizeFollowsSize(bool follow);
 
+    bool frameCallbackThrottling() const;
+    void setFrameCallbackThrottling(bool throttling);
+
+    int throttledFrameCallbackInterval() const;
+    void setThrottledFrameCallbackInterval(int msecs);
+
+    bool variableRefreshRate() const;
+    void setVariableRefreshRate(bool enabled);
+    bool isVariableRefreshRateActive() const;
+
+    bool allowTearing() const;
+    void setAllowTearing(bool allow);
+
     void frameStarted();
     void sendFrameCallbacks();
 
@@ -142,6 +160,11 @@ Q_SIGNALS:
     void transformChanged();
     void sizeFollowsWindowChanged();
     void physicalSizeFollowsSizeChanged();
+    void frameCallbackThrottlingChanged();
+    void throttledFrameCallbackIntervalChanged();
+    void variableRefreshRateChanged();
+    void variableRefreshRateActiveChanged();
+    void allowTearingChanged();
     void manufacturerChanged();
     void modelChanged();
     void windowDestroyed();
@@ -154,6 +177,7 @@ protected:
 private:
     Q_PRIVATE_SLOT(d_func(), void _q_handleMaybeWindowPixelSizeChanged())
     Q_PRIVATE_SLOT(d_func(), void _q_handleWindowDestroyed())
+    Q_PRIVATE_SLOT(d_func(), void _q_sendThrottledFrameCallbacks())
 };
 
 } // namespace Compositor
@@ -24,8 +24,12 @@
 
 #include <LiriAuroraCompositor/private/aurora-server-wayland.h>
 
+#include <QtCore/QHash>
 #include <QtCore/QList>
 #include <QtCore/QRect>
+#include <QtCore/QTimer>
+#include <QtGui/QRegion>
+#include <QtGui/QScreen>
 
 #include <QtCore/private/qobject_p.h>
 #include <QtCore/qpointer.h>
@@ -34,6 +38,15 @@ namespace Aurora {
 
 namespace Compositor {
 
+// What frames changed in a region of the output since a screen capture
+// client last copied it, in output pixels
+struct WaylandCapturedRegion
+{
+    WaylandClient *client = nullptr;
+    QRect rect;
+    QRegion damage;
+};
+
 struct WaylandSurfaceViewMapper
 {
     WaylandSurfaceViewMapper()
@@ -79,14 +92,24 @@ public:
 
     void handleWindowPixelSizeChanged();
 
+    WaylandSurface::FrameCallbackHoldReason frameCallbackHoldReason(const WaylandSurfaceViewMapper &mapper) const;
+    void throttleFrameCallbacks(WaylandSurface *surface, uint time);
+    void sendFrameCallbacks(uint presentationTime);
+    void updateVariableRefreshRate();
+
     QPointer<WaylandXdgOutputV1> xdgOutput;
 
+    // Regions copied by screen capture clients, captures of different
+    // regions by the same client don't share their damage
+    QList<WaylandCapturedRegion> capturedDamage;
+
 protected:
     void output_bind_resource(Resource *resource) override;
 
 private:
     void _q_handleMaybeWindowPixelSizeChanged();
     void _q_handleWindowDestroyed();
+    void _q_sendThrottledFrameCallbacks();
 
     WaylandCompositor *compositor = nullptr;
     QWindow *window = nullptr;
@@ -97,18 +120,30 @@ private:
     int currentMode = -1;
     int preferredMode = -1;
     QRect availableGeometry;
+    // Dense array for iteration, indexed by surface for lookups
     QList<WaylandSurfaceViewMapper> surfaceViews;
+    QHash<WaylandSurface *, qsizetype> surfaceViewIndex;
     QSize physicalSize;
     WaylandOutput::Subpixel subpixel = WaylandOutput::SubpixelUnknown;
     WaylandOutput::Transform transform = WaylandOutput::TransformNormal;
     int scaleFactor = 1;
     bool sizeFollowsWindow = false;
+    bool frameCallbackThrottling = false;
+    int throttledFrameCallbackInterval = 1000;
+    bool variableRefreshRate = false;
+    // The screen of the window accepted variable refresh rate
+    bool variableRefreshRateActive = false;
+    QPointer<QScreen> variableRefreshRateScreen;
+    bool allowTearing = false;
+    // Wakes up held surfaces when nothing else is rendered
+    QTimer throttleTimer;
     bool initialized = false;
     QSize windowPixelSize;
 
     Q_DISABLE_COPY(WaylandOutputPrivate)
 
     friend class WaylandXdgOutputManagerV1Private;
+    friend class WaylandQuickOutput;
 };
 
 
@@ -0,0 +1,331 @@
+// SPDX-FileCopyrightText: 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "aurorawaylandquickhardwarecursor_p.h"
+#include "aurorawaylandquickitem_p.h"
+
+#include <LiriAuroraCompositor/WaylandSurface>
+#include <LiriAuroraCompositor/WaylandView>
+
+#if LIRI_FEATURE_aurora_qpa
+#include <LiriAuroraPlatformHeaders/lirieglfsfunctions.h>
+
+#include <time.h>
+#endif
+
+#include <QtCore/QTimer>
+#include <QtCore/private/qobject_p.h>
+#include <QtGui/QScreen>
+#include <QtQuick/QQuickWindow>
+
+namespace Aurora {
+
+namespace Compositor {
+
+class WaylandQuickHardwareCursorPrivate : public QObjectPrivate
+{
+    Q_DECLARE_PUBLIC(WaylandQuickHardwareCursor)
+public:
+    void setActive(bool value);
+    void setScreen(QScreen *value);
+    void scheduleFrameCallbacks();
+    void sendFrameCallbacks();
+
+    WaylandQuickItem *waylandItem = nullptr;
+    QPointer<WaylandSurface> surface;
+    QPointer<QScreen> screen;
+    bool enabled = true;
+    QPoint hotspot;
+    bool active = false;
+    // The item has a buffer to render once the cursor plane gives it back
+    bool itemDirty = false;
+    // A buffer was uploaded, its frame callbacks wait for the vblank
+    bool framePending = false;
+    QTimer vblankTimer;
+};
+
+void WaylandQuickHardwareCursorPrivate::setActive(bool value)
+{
+    Q_Q(WaylandQuickHardwareCursor);
+
+    if (active == value)
+        return;
+
+#if LIRI_FEATURE_aurora_qpa
+    // Give the cursor back to the window
+    if (!value && screen)
+        PlatformSupport::EglFSFunctions::setCursorImage(screen, QImage(), QPoint());
+#endif
+
+    active = value;
+
+    // The scene graph presents the surface from now on
+    if (!active)
+        sendFrameCallbacks();
+
+    emit q->activeChanged();
+}
+
+void WaylandQuickHardwareCursorPrivate::setScreen(QScreen *value)
+{
+    Q_Q(WaylandQuickHardwareCursor);
+
+    if (screen == value)
+        return;
+
+    // Page flips of the screen are reported with events
+    if (screen)
+        screen->removeEventFilter(q);
+    screen = value;
+    if (screen)
+        screen->installEventFilter(q);
+}
+
+/*
+    Sends the frame callbacks of the buffer that was just uploaded with the
+    next flip of the screen, or the next vblank when the scene is not
+    rendered: the cursor plane shows it from then on, and clients animating
+    the cursor are paced by the refresh rate.
+*/
+void WaylandQuickHardwareCursorPrivate::scheduleFrameCallbacks()
+{
+    surface->frameStarted();
+    framePending = true;
+
+    if (vblankTimer.isActive())
+        return;
+
+    qint64 delay = 16667;
+#if LIRI_FEATURE_aurora_qpa
+    const PlatformSupport::FrameTiming timing = PlatformSupport::EglFSFunctions::getFrameTiming(screen);
+    if (timing.refreshInterval > 0) {
+        delay = timing.refreshInterval;
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        const qint64 now = qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+        if (timing.lastPresentationTime > 0 && now >= timing.lastPresentationTime)
+            delay -= (now - timing.lastPresentationTime) % timing.refreshInterval;
+    }
+#endif
+    vblankTimer.start(int((delay + 999) / 1000));
+}
+
+void WaylandQuickHardwareCursorPrivate::sendFrameCallbacks()
+{
+    vblankTimer.stop();
+
+    if (!framePending)
+        return;
+
+    framePending = false;
+    if (surface)
+        surface->sendFrameCallbacks();
+}
+
+/*!
+ * \qmltype WaylandHardwareCursor
+ * \inqmlmodule Aurora.Compositor
+ * \preliminary
+ * \brief Shows the cursor surface of a parent WaylandQuickItem on the hardware cursor.
+ *
+ * This item needs to be a descendant of a WaylandQuickItem, such as WaylandCursorItem.
+ *
+ * Each buffer committed by the client is uploaded to the cursor plane of the
+ * screen, which follows the pointer without the scene being redrawn. While
+ * \l active is \c true the WaylandQuickItem should not paint the surface, and
+ * should not be moved with the pointer, otherwise every move still renders a
+ * frame.
+ *
+ * The hardware cursor is only available with the eglfs_kms platform and a
+ * hardware cursor enabled. Buffers that are not shared memory, larger than the
+ * cursor plane or scaled differently than the screen are left to the scene graph.
+ */
+
+WaylandQuickHardwareCursor::WaylandQuickHardwareCursor(QObject *parent)
+    : QObject(*new WaylandQuickHardwareCursorPrivate(), parent)
+{
+    Q_D(WaylandQuickHardwareCursor);
+    d->vblankTimer.setSingleShot(true);
+    d->vblankTimer.setTimerType(Qt::PreciseTimer);
+    connect(&d->vblankTimer, &QTimer::timeout, this, [d] {
+        d->sendFrameCallbacks();
+    });
+}
+
+WaylandQuickHardwareCursor::~WaylandQuickHardwareCursor()
+{
+    Q_D(WaylandQuickHardwareCursor);
+    d->setActive(false);
+}
+
+/*!
+ * \qmlproperty bool AuroraCompositor::WaylandHardwareCursor::enabled
+ *
+ * This property holds whether the hardware cursor may be used.
+ *
+ * The default is \c true.
+ */
+bool WaylandQuickHardwareCursor::isEnabled() const
+{
+    Q_D(const WaylandQuickHardwareCursor);
+    return d->enabled;
+}
+
+void WaylandQuickHardwareCursor::setEnabled(bool enabled)
+{
+    Q_D(WaylandQuickHardwareCursor);
+    if (d->enabled == enabled)
+        return;
+
+    d->enabled = enabled;
+    emit enabledChanged();
+    updateCursor();
+}
+
+/*!
+ * \qmlproperty point AuroraCompositor::WaylandHardwareCursor::hotspot
+ *
+ * This property holds the hot spot of the cursor, in surface coordinates.
+ */
+QPoint WaylandQuickHardwareCursor::hotspot() const
+{
+    Q_D(const WaylandQuickHardwareCursor);
+    return d->hotspot;
+}
+
+void WaylandQuickHardwareCursor::setHotspot(const QPoint &hotspot)
+{
+    Q_D(WaylandQuickHardwareCursor);
+    if (d->hotspot == hotspot)
+        return;
+
+    d->hotspot = hotspot;
+    emit hotspotChanged();
+    updateCursor();
+}
+
+/*!
+ * \qmlproperty bool AuroraCompositor::WaylandHardwareCursor::active
+ * \readonly
+ *
+ * This property holds whether the surface is shown by the hardware cursor.
+ */
+bool WaylandQuickHardwareCursor::isActive() const
+{
+    Q_D(const WaylandQuickHardwareCursor);
+    return d->active;
+}
+
+WaylandQuickItem *WaylandQuickHardwareCursor::waylandItem() const
+{
+    Q_D(const WaylandQuickHardwareCursor);
+    return d->waylandItem;
+}
+
+void WaylandQuickHardwareCursor::classBegin()
+{
+    Q_D(WaylandQuickHardwareCursor);
+    for (QObject *p = parent(); p != nullptr; p = p->parent()) {
+        if (auto *waylandItem = qobject_cast<WaylandQuickItem *>(p)) {
+            d->waylandItem = waylandItem;
+            break;
+        }
+    }
+}
+
+void WaylandQuickHardwareCursor::componentComplete()
+{
+    Q_D(WaylandQuickHardwareCursor);
+    Q_ASSERT(d->waylandItem);
+
+    connect(d->waylandItem, &WaylandQuickItem::surfaceChanged,
+            this, &WaylandQuickHardwareCursor::handleSurfaceChanged);
+    connect(d->waylandItem, &QQuickItem::visibleChanged,
+            this, &WaylandQuickHardwareCursor::updateCursor);
+    connect(d->waylandItem, &QQuickItem::windowChanged,
+            this, &WaylandQuickHardwareCursor::updateCursor);
+    handleSurfaceChanged();
+}
+
+void WaylandQuickHardwareCursor::handleSurfaceChanged()
+{
+    Q_D(WaylandQuickHardwareCursor);
+
+    if (d->surface)
+        disconnect(d->surface, &WaylandSurface::redraw, this, &WaylandQuickHardwareCursor::updateCursor);
+
+    d->surface = d->waylandItem->surface();
+    d->framePending = false;
+    d->vblankTimer.stop();
+
+    if (d->surface)
+        connect(d->surface, &WaylandSurface::redraw, this, &WaylandQuickHardwareCursor::updateCursor);
+
+    updateCursor();
+}
+
+void WaylandQuickHardwareCursor::updateCursor()
+{
+    Q_D(WaylandQuickHardwareCursor);
+
+    bool active = false;
+
+#if LIRI_FEATURE_aurora_qpa
+    // The item doesn't advance its view while the scene is not rendered,
+    // it's told about the new buffer as it would have been
+    WaylandView *view = d->waylandItem->view();
+    if (view->advance()) {
+        auto *itemPrivate = WaylandQuickItemPrivate::get(d->waylandItem);
+        itemPrivate->newTexture = true;
+        itemPrivate->textureDamage |= view->currentDamage();
+        d->itemDirty = true;
+    }
+
+    QQuickWindow *window = d->waylandItem->window();
+    QScreen *screen = window ? window->screen() : nullptr;
+    if (d->screen && d->screen != screen)
+        d->setActive(false);
+    d->setScreen(screen);
+
+    const WaylandBufferRef buffer = view->currentBuffer();
+    if (d->enabled && d->surface && screen && d->waylandItem->isVisible()
+            && buffer.hasContent() && buffer.isSharedMemory()
+            && qFuzzyCompare(window->effectiveDevicePixelRatio(), qreal(d->surface->bufferScale()))) {
+        const QPoint hotspot = d->hotspot * d->surface->bufferScale();
+        active = PlatformSupport::EglFSFunctions::setCursorImage(screen, buffer.image(), hotspot);
+    }
+
+    // Nothing else presents the surface while the cursor plane does
+    if (active)
+        d->scheduleFrameCallbacks();
+#endif
+
+    d->setActive(active);
+
+    // Rendered by the scene graph as usual
+    if (!active && d->itemDirty) {
+        d->itemDirty = false;
+        d->waylandItem->update();
+    }
+}
+
+/*!
+ * \internal
+ */
+bool WaylandQuickHardwareCursor::eventFilter(QObject *watched, QEvent *event)
+{
+#if LIRI_FEATURE_aurora_qpa
+    Q_D(WaylandQuickHardwareCursor);
+
+    if (watched == d->screen && event->type() == PlatformSupport::PresentationEvent::registeredType())
+        d->sendFrameCallbacks();
+#endif
+
+    return QObject::eventFilter(watched, event);
+}
+
+} // namespace Compositor
+
+} // namespace Aurora
+
+#include "moc_aurorawaylandquickhardwarecursor_p.cpp"
@@ -0,0 +1,68 @@
+// SPDX-FileCopyrightText: 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Aurora API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <LiriAuroraCompositor/WaylandQuickItem>
+#include <QtCore/private/qglobal_p.h>
+
+namespace Aurora {
+
+namespace Compositor {
+
+class WaylandQuickHardwareCursorPrivate;
+
+class LIRIAURORACOMPOSITOR_EXPORT WaylandQuickHardwareCursor : public QObject, public QQmlParserStatus
+{
+    Q_OBJECT
+    Q_INTERFACES(QQmlParserStatus)
+    Q_DECLARE_PRIVATE(WaylandQuickHardwareCursor)
+    Q_PROPERTY(bool enabled READ isEnabled WRITE setEnabled NOTIFY enabledChanged)
+    Q_PROPERTY(QPoint hotspot READ hotspot WRITE setHotspot NOTIFY hotspotChanged)
+    Q_PROPERTY(bool active READ isActive NOTIFY activeChanged)
+    QML_NAMED_ELEMENT(WaylandHardwareCursor)
+    QML_ADDED_IN_VERSION(1, 0)
+public:
+    explicit WaylandQuickHardwareCursor(QObject *parent = nullptr);
+    ~WaylandQuickHardwareCursor() override;
+
+    bool isEnabled() const;
+    void setEnabled(bool enabled);
+
+    QPoint hotspot() const;
+    void setHotspot(const QPoint &hotspot);
+
+    bool isActive() const;
+
+    WaylandQuickItem *waylandItem() const;
+
+    void classBegin() override;
+    void componentComplete() override;
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+Q_SIGNALS:
+    void enabledChanged();
+    void hotspotChanged();
+    void activeChanged();
+
+private:
+    void handleSurfaceChanged();
+    void updateCursor();
+};
+
+} // namespace Compositor
+
+} // namespace Aurora
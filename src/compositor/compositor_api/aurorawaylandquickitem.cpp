@@ -31,6 +31,8 @@
 #include <QtQuick/QQuickWindow>
 #include <QtQuick/qsgtexture.h>
 
+#include <rhi/qrhi.h>
+
 #include <QtCore/QFile>
 #include <QtCore/QMutexLocker>
 #include <QtCore/QMutex>
@@ -371,6 +373,102 @@ void WaylandBufferMaterial::setBufferRef(WaylandQuickItem *surfaceItem, const Wa
 
 QMutex *WaylandQuickItemPrivate::mutex = nullptr;
 
+/*
+    Scene graph texture for shared memory buffers that keeps its RHI texture
+    for as long as size and format stay the same, and only uploads the
+    regions that were damaged since the previous frame.
+*/
+class WaylandShmTexture : public QSGTexture
+{
+public:
+    ~WaylandShmTexture() override
+    {
+        delete m_texture;
+    }
+
+    qint64 comparisonKey() const override
+    {
+        if (m_texture)
+            return qint64(qintptr(m_texture));
+        return qint64(qintptr(this));
+    }
+
+    QRhiTexture *rhiTexture() const override { return m_texture; }
+    QSize textureSize() const override { return m_image.isNull() ? m_textureSize : m_image.size(); }
+    bool hasAlphaChannel() const override { return m_hasAlpha; }
+    bool hasMipmaps() const override { return false; }
+
+    // \a damage is in buffer coordinates
+    void setImage(const QImage &image, const QRegion &damage)
+    {
+        m_image = image;
+        m_hasAlpha = image.hasAlphaChannel();
+        m_pendingDamage |= damage;
+    }
+
+    void commitTextureOperations(QRhi *rhi, QRhiResourceUpdateBatch *resourceUpdates) override
+    {
+        if (m_image.isNull())
+            return;
+
+        // ARGB32 is BGRA in memory and can be uploaded as is when supported
+        const QImage::Format imageFormat = m_image.format();
+        const bool canUploadBgra = rhi->isTextureFormatSupported(QRhiTexture::BGRA8)
+                && (imageFormat == QImage::Format_ARGB32_Premultiplied || imageFormat == QImage::Format_RGB32);
+        const QRhiTexture::Format format = canUploadBgra ? QRhiTexture::BGRA8 : QRhiTexture::RGBA8;
+
+        QRegion region = m_pendingDamage.intersected(m_image.rect());
+        if (!m_texture || m_textureSize != m_image.size() || m_textureFormat != format) {
+            if (m_texture)
+                m_texture->deleteLater();
+            m_texture = rhi->newTexture(format, m_image.size());
+            if (!m_texture->create()) {
+                qCWarning(gLcAuroraCompositor) << "Failed to create texture for shm buffer of size" << m_image.size();
+                delete m_texture;
+                m_texture = nullptr;
+                return;
+            }
+            m_textureSize = m_image.size();
+            m_textureFormat = format;
+            region = m_image.rect();
+        }
+
+        if (region.rectCount() > MaxUploadRects)
+            region = region.boundingRect();
+
+        QVarLengthArray<QRhiTextureUploadEntry, MaxUploadRects> entries;
+        for (const QRect &rect : std::as_const(region)) {
+            QRhiTextureSubresourceUploadDescription description;
+            if (canUploadBgra) {
+                // RHI takes the rectangle straight from the shm pool
+                description.setImage(m_image);
+                description.setSourceTopLeft(rect.topLeft());
+                description.setSourceSize(rect.size());
+            } else {
+                description.setImage(m_image.copy(rect).convertToFormat(QImage::Format_RGBA8888_Premultiplied));
+            }
+            description.setDestinationTopLeft(rect.topLeft());
+            entries.append(QRhiTextureUploadEntry(0, 0, description));
+        }
+        if (!entries.isEmpty())
+            resourceUpdates->uploadTexture(m_texture, QRhiTextureUploadDescription(entries.cbegin(), entries.cend()));
+
+        m_image = QImage();
+        m_pendingDamage = QRegion();
+    }
+
+private:
+    // Above this many rectangles it's cheaper to upload the bounding rectangle
+    static const int MaxUploadRects = 8;
+
+    QRhiTexture *m_texture = nullptr;
+    QSize m_textureSize;
+    QRhiTexture::Format m_textureFormat = QRhiTexture::RGBA8;
+    QImage m_image;
+    QRegion m_pendingDamage;
+    bool m_hasAlpha = false;
+};
+
 class WaylandSurfaceTextureProvider : public QSGTextureProvider
 {
 public:
@@ -383,14 +481,36 @@ public:
         delete m_sgTex;
     }
 
-    void setBufferRef(WaylandQuickItem *surfaceItem, const WaylandBufferRef &buffer)
+    // \a damage is in buffer coordinates
+    void setBufferRef(WaylandQuickItem *surfaceItem, const WaylandBufferRef &buffer, const QRegion &damage)
     {
         Q_ASSERT(QThread::currentThread() == thread());
         m_ref = buffer;
+
+        // Textures uploaded by ShmUploader are used like any other OpenGL texture
+        bool uploadedAsync = false;
+#if QT_CONFIG(opengl)
+        if (buffer.isSharedMemory())
+            uploadedAsync = static_cast<Internal::SharedMemoryBuffer *>(buffer.buffer())->isUploadedAsync();
+#endif
+
+        // With RHI the shm texture is kept and updated in place
+        if (m_ref.hasBuffer() && buffer.isSharedMemory() && !uploadedAsync && surfaceItem->window()->rhi()) {
+            if (!m_shmTex) {
+                delete m_sgTex;
+                m_shmTex = new WaylandShmTexture;
+                m_sgTex = m_shmTex;
+            }
+            m_shmTex->setImage(buffer.image(), damage);
+            emit textureChanged();
+            return;
+        }
+
         delete m_sgTex;
         m_sgTex = nullptr;
+        m_shmTex = nullptr;
         if (m_ref.hasBuffer()) {
-            if (buffer.isSharedMemory()) {
+            if (buffer.isSharedMemory() && !uploadedAsync) {
                 m_sgTex = surfaceItem->window()->createTextureFromImage(buffer.image());
             } else {
 #if QT_CONFIG(opengl)
@@ -400,10 +520,11 @@ public:
                     opt |= QQuickWindow::TextureHasAlphaChannel;
                 }
 
-                auto texture = buffer.toOpenGLTexture();
-                GLuint textureId = texture->textureId();
-                auto size = surface->bufferSize();
-                m_sgTex = QNativeInterface::QSGOpenGLTexture::fromNative(textureId, surfaceItem->window(), size, opt);
+                if (auto texture = buffer.toOpenGLTexture()) {
+                    GLuint textureId = texture->textureId();
+                    auto size = buffer.size();
+                    m_sgTex = QNativeInterface::QSGOpenGLTexture::fromNative(textureId, surfaceItem->window(), size, opt);
+                }
 #else
                 qCWarning(gLcAuroraCompositor) << "Without OpenGL support only shared memory textures are supported";
 #endif
@@ -423,6 +544,7 @@ public:
 private:
     bool m_smooth = false;
     QSGTexture *m_sgTex = nullptr;
+    WaylandShmTexture *m_shmTex = nullptr;
     WaylandBufferRef m_ref;
 };
 
@@ -1120,6 +1242,7 @@ void WaylandQuickItem::handleSurfaceChanged()
 
         updateSize();
     }
+    d->textureFullUpdate = true;
     surfaceChangedEvent(d->view->surface(), d->oldSurface);
     d->oldSurface = d->view->surface();
 #if QT_CONFIG(im)
@@ -1443,6 +1566,7 @@ void WaylandQuickItem::beforeSync()
     Q_D(WaylandQuickItem);
     if (d->view->advance()) {
         d->newTexture = true;
+        d->textureDamage |= d->view->currentDamage();
         update();
     }
 }
@@ -1493,7 +1617,7 @@ QSGNode *WaylandQuickItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData
     if (d->view->isBufferLocked() && d->paintEnabled)
         return oldNode;
 
-    if (!bufferHasContent || !d->paintEnabled || !surface()) {
+    if (!bufferHasContent || !d->paintEnabled || d->directScanout || !surface()) {
         delete oldNode;
         return nullptr;
     }
@@ -1547,7 +1671,12 @@ QSGNode *WaylandQuickItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData
 
         if (d->newTexture) {
             d->newTexture = false;
-            d->provider->setBufferRef(this, ref);
+            QRegion damage = QRect(QPoint(), ref.size());
+            if (!d->textureFullUpdate)
+                damage = WaylandSurfacePrivate::get(surface())->toBufferDamage(d->textureDamage);
+            d->textureDamage = QRegion();
+            d->textureFullUpdate = false;
+            d->provider->setBufferRef(this, ref, damage);
             node->setTexture(d->provider->texture());
         }
 
@@ -1589,6 +1718,7 @@ QSGNode *WaylandQuickItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData
 
     if (d->newTexture) {
         d->newTexture = false;
+        d->textureDamage = QRegion();
         material->setBufferRef(this, ref);
     }
 
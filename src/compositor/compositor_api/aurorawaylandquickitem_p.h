@@ -106,6 +106,7 @@ public:
     }
 
     static const WaylandQuickItemPrivate* get(const WaylandQuickItem *item) { return item->d_func(); }
+    static WaylandQuickItemPrivate* get(WaylandQuickItem *item) { return item->d_func(); }
 
     void setInputEventsEnabled(bool enable)
     {
@@ -139,6 +140,8 @@ public:
     mutable WaylandSurfaceTextureProvider *provider = nullptr;
     QMetaObject::Connection texProviderConnection;
     bool paintEnabled = true;
+    // The output shows the buffer without composition, nothing to paint
+    bool directScanout = false;
     bool touchEventsEnabled = true;
     bool inputEventsEnabled = true;
     bool isDragging = false;
@@ -150,6 +153,9 @@ public:
 #endif
     QPointF hoverPos;
     QMatrix4x4 lastMatrix;
+    // Surface damage accumulated since the texture was last updated
+    QRegion textureDamage;
+    bool textureFullUpdate = true;
 
     QQuickWindow *connectedWindow = nullptr;
     WaylandOutput *connectedOutput = nullptr;
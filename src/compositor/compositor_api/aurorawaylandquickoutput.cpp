@@ -6,6 +6,23 @@
 #include "aurorawaylandquickcompositor.h"
 #include "aurorawaylandquickitem_p.h"
 
+#include <LiriAuroraCompositor/private/aurorawaylandoutput_p.h>
+#include <LiriAuroraCompositor/private/aurorawaylandsurface_p.h>
+#include <LiriAuroraCompositor/private/aurorawaylandview_p.h>
+
+#include <QtCore/QtMath>
+#include <QtGui/QScreen>
+#include <QtQuick/private/qquickanimatorcontroller_p.h>
+#include <QtQuick/private/qquickwindow_p.h>
+
+#if LIRI_FEATURE_aurora_qpa
+#include <LiriAuroraCompositor/private/aurorawlclientbuffer_p.h>
+#include <LiriAuroraCompositor/private/aurorawlscanoutbuffer_p.h>
+#include <LiriAuroraPlatformHeaders/lirieglfsfunctions.h>
+
+#include <time.h>
+#endif
+
 namespace Aurora {
 
 namespace Compositor {
@@ -34,6 +51,23 @@ void WaylandQuickOutput::initialize()
 
     connect(quickWindow, &QQuickWindow::afterRendering,
             this, &WaylandQuickOutput::doFrameCallbacks);
+
+    // Page flips of the screen are reported with events
+    connect(quickWindow, &QWindow::screenChanged,
+            this, &WaylandQuickOutput::setScreen);
+    setScreen(quickWindow->screen());
+}
+
+void WaylandQuickOutput::setScreen(QScreen *screen)
+{
+    if (m_screen == screen)
+        return;
+
+    if (m_screen)
+        m_screen->removeEventFilter(this);
+    m_screen = screen;
+    if (m_screen)
+        m_screen->installEventFilter(this);
 }
 
 void WaylandQuickOutput::classBegin()
@@ -52,6 +86,34 @@ void WaylandQuickOutput::componentComplete()
     }
 }
 
+/*!
+ * \internal
+ */
+bool WaylandQuickOutput::eventFilter(QObject *watched, QEvent *event)
+{
+#if LIRI_FEATURE_aurora_qpa
+    if (watched == m_screen && event->type() == PlatformSupport::PresentationEvent::registeredType()) {
+        auto *e = static_cast<PlatformSupport::PresentationEvent *>(event);
+
+        // Buffers of the frames before are not on screen anymore, either
+        // replaced by this frame or dropped without ever being shown
+        for (auto it = m_scanoutBuffers.begin(); it != m_scanoutBuffers.end();) {
+            if (it->frame < e->frame) {
+                it = m_scanoutBuffers.erase(it);
+                continue;
+            }
+
+            Internal::ClientBuffer *buffer = Internal::ClientBuffer::fromBufferRef(it->buffer);
+            if (it->frame == e->frame && e->scanoutKey && buffer->scanoutKey() == e->scanoutKey)
+                buffer->setScanoutPresented();
+            ++it;
+        }
+    }
+#endif
+
+    return WaylandOutput::eventFilter(watched, event);
+}
+
 void WaylandQuickOutput::update()
 {
     if (!m_updateScheduled) {
@@ -83,6 +145,30 @@ void WaylandQuickOutput::setAutomaticFrameCallback(bool automatic)
     automaticFrameCallbackChanged();
 }
 
+/*!
+ * \qmlproperty bool AuroraCompositor::WaylandOutput::directScanout
+ *
+ * This property holds whether a Wayland surface that covers the whole window
+ * is shown by the display hardware directly, rather than being composited.
+ * Only surfaces that are opaque, not scaled nor transformed, and have nothing
+ * on top of them qualify, and only on platforms that support it.
+ *
+ * The default is true.
+ */
+bool WaylandQuickOutput::directScanout() const
+{
+    return m_directScanout;
+}
+
+void WaylandQuickOutput::setDirectScanout(bool enabled)
+{
+    if (m_directScanout == enabled)
+        return;
+
+    m_directScanout = enabled;
+    Q_EMIT directScanoutChanged();
+}
+
 static QQuickItem* clickableItemAtPosition(QQuickItem *rootItem, const QPointF &position)
 {
     if (!rootItem->isEnabled() || !rootItem->isVisible())
@@ -121,6 +207,159 @@ QQuickItem *WaylandQuickOutput::pickClickableItem(const QPointF &position)
     return clickableItemAtPosition(quickWindow->contentItem(), position);
 }
 
+// Largest integer rectangle inside \a rect, so that occluders never grow
+static QRect innerRect(const QRectF &rect)
+{
+    const int left = qCeil(rect.left());
+    const int top = qCeil(rect.top());
+    const int right = qFloor(rect.right());
+    const int bottom = qFloor(rect.bottom());
+    if (right <= left || bottom <= top)
+        return QRect();
+    return QRect(left, top, right - left, bottom - top);
+}
+
+static void updateViewHoldReason(WaylandOutput *output, WaylandQuickItem *item, qreal opacity,
+                                 const QRectF &clipRect, QRegion &occluders)
+{
+    WaylandView *view = item->view();
+    if (!view || view->output() != output || !item->surface())
+        return;
+
+    WaylandViewPrivate *viewPrivate = WaylandViewPrivate::get(view);
+    if (!item->isPaintEnabled() || qFuzzyIsNull(opacity)) {
+        viewPrivate->frameCallbackHoldReason = WaylandSurface::FrameCallbackHeldHidden;
+        return;
+    }
+
+    const QTransform transform = QQuickItemPrivate::get(item)->itemToWindowTransform();
+    const QRectF rect = transform.mapRect(item->boundingRect()) & clipRect;
+    if (rect.isEmpty())
+        viewPrivate->frameCallbackHoldReason = WaylandSurface::FrameCallbackHeldOffscreen;
+    else if ((QRegion(rect.toAlignedRect()) - occluders).isEmpty())
+        viewPrivate->frameCallbackHoldReason = WaylandSurface::FrameCallbackHeldOccluded;
+    else
+        viewPrivate->frameCallbackHoldReason = WaylandSurface::FrameCallbackNotHeld;
+
+    // Only what is surely covered can hide items behind
+    if (opacity < 1.0 || transform.type() > QTransform::TxScale)
+        return;
+
+    const QRegion opaqueRegion = WaylandSurfacePrivate::get(item->surface())->opaqueRegion;
+    for (const QRect &opaqueRect : opaqueRegion) {
+        const QRectF itemRect(item->mapFromSurface(opaqueRect.topLeft()),
+                              item->mapFromSurface(QPointF(opaqueRect.x() + opaqueRect.width(),
+                                                           opaqueRect.y() + opaqueRect.height())));
+        occluders += innerRect(transform.mapRect(itemRect) & clipRect);
+    }
+}
+
+/*
+    Walks \a item and its children front to back, like clickableItemAtPosition(),
+    to find out which views of \a output are going to be presented.
+
+    \a clipRect is the area of the window, in window coordinates, that is not
+    clipped by the ancestors of \a item, and \a occluders is what the opaque
+    surfaces already walked cover.
+*/
+static void updateItemHoldReasons(WaylandOutput *output, QQuickItem *item, qreal parentOpacity,
+                                  const QRectF &clipRect, QRegion &occluders)
+{
+    // Views of hidden subtrees keep the reason they were reset to
+    const qreal opacity = parentOpacity * item->opacity();
+    if (!item->isVisible() || qFuzzyIsNull(opacity))
+        return;
+
+    QQuickItemPrivate *itemPrivate = QQuickItemPrivate::get(item);
+    QRectF itemClipRect = clipRect;
+    if (item->clip())
+        itemClipRect &= itemPrivate->itemToWindowTransform().mapRect(item->clipRect());
+
+    QList<QQuickItem *> paintOrderItems = itemPrivate->paintOrderChildItems();
+    auto negativeZStart = paintOrderItems.crend();
+    for (auto it = paintOrderItems.crbegin(); it != paintOrderItems.crend(); ++it) {
+        if ((*it)->z() < 0) {
+            negativeZStart = it;
+            break;
+        }
+        updateItemHoldReasons(output, *it, opacity, itemClipRect, occluders);
+    }
+
+    if (auto *waylandItem = qobject_cast<WaylandQuickItem *>(item))
+        updateViewHoldReason(output, waylandItem, opacity, itemClipRect, occluders);
+
+    for (auto it = negativeZStart; it != paintOrderItems.crend(); ++it)
+        updateItemHoldReasons(output, *it, opacity, itemClipRect, occluders);
+}
+
+#if LIRI_FEATURE_aurora_qpa
+/*
+    Walks \a item and its children front to back and stops at the first
+    item that draws something inside \a clipRect, setting \a found.
+
+    Returns that item if it's a Wayland surface item that covers exactly
+    \a windowRect, without transparency nor any transformation other
+    than a translation, otherwise nullptr.
+*/
+static WaylandQuickItem *scanoutCandidate(QQuickItem *item, qreal parentOpacity, const QRectF &clipRect,
+                                          const QRectF &windowRect, bool *found)
+{
+    const qreal opacity = parentOpacity * item->opacity();
+    if (!item->isVisible() || qFuzzyIsNull(opacity))
+        return nullptr;
+
+    QQuickItemPrivate *itemPrivate = QQuickItemPrivate::get(item);
+
+    // What is rendered into a layer is drawn by someone else
+    if (itemPrivate->layer() && itemPrivate->layer()->enabled()) {
+        *found = true;
+        return nullptr;
+    }
+
+    const QTransform transform = itemPrivate->itemToWindowTransform();
+    QRectF itemClipRect = clipRect;
+    if (item->clip())
+        itemClipRect &= transform.mapRect(item->clipRect());
+    if (itemClipRect.isEmpty())
+        return nullptr;
+
+    QList<QQuickItem *> paintOrderItems = itemPrivate->paintOrderChildItems();
+    auto negativeZStart = paintOrderItems.crend();
+    for (auto it = paintOrderItems.crbegin(); it != paintOrderItems.crend(); ++it) {
+        if ((*it)->z() < 0) {
+            negativeZStart = it;
+            break;
+        }
+        WaylandQuickItem *candidate = scanoutCandidate(*it, opacity, itemClipRect, windowRect, found);
+        if (*found)
+            return candidate;
+    }
+
+    const QRectF rect = transform.mapRect(item->boundingRect());
+    if (item->flags().testFlag(QQuickItem::ItemHasContents) && rect.intersects(itemClipRect)) {
+        *found = true;
+
+        auto *waylandItem = qobject_cast<WaylandQuickItem *>(item);
+        if (!waylandItem || opacity < 1.0 || transform.type() > QTransform::TxTranslate)
+            return nullptr;
+        if (rect != windowRect || itemClipRect != windowRect)
+            return nullptr;
+        // Also used as the source of an effect
+        if (itemPrivate->extra.isAllocated() && itemPrivate->extra->effectRefCount > 0)
+            return nullptr;
+        return waylandItem;
+    }
+
+    for (auto it = negativeZStart; it != paintOrderItems.crend(); ++it) {
+        WaylandQuickItem *candidate = scanoutCandidate(*it, opacity, itemClipRect, windowRect, found);
+        if (*found)
+            return candidate;
+    }
+
+    return nullptr;
+}
+#endif
+
 /*!
  * \internal
  */
@@ -131,13 +370,259 @@ void WaylandQuickOutput::updateStarted()
     if (!compositor())
         return;
 
+    if (frameCallbackThrottling())
+        updateFrameCallbackHoldReasons();
+
+    updateDirectScanout();
+
+    QRegion scanoutDamage;
+    const QRegion damage = frameDamage(&scanoutDamage);
+
+    // Screen capture clients only copy what changed, on screen
+    const QRegion screenDamage = damage | scanoutDamage;
+    for (WaylandCapturedRegion &captured : WaylandOutputPrivate::get(this)->capturedDamage)
+        captured.damage |= screenDamage.intersected(captured.rect);
+
+#if LIRI_FEATURE_aurora_qpa
+    PlatformSupport::EglFSFunctions::setFrameDamage(window(), damage);
+#endif
+
     frameStarted();
 }
 
+/*!
+ * \internal
+ *
+ * Runs while the scene graph is synchronized, the GUI thread is blocked.
+ */
+void WaylandQuickOutput::updateFrameCallbackHoldReasons()
+{
+    QQuickWindow *quickWindow = static_cast<QQuickWindow *>(window());
+
+    // Items that are not walked are not part of the scene
+    const auto &surfaceViews = WaylandOutputPrivate::get(this)->surfaceViews;
+    for (const WaylandSurfaceViewMapper &surfacemapper : surfaceViews) {
+        for (WaylandView *view : surfacemapper.views) {
+            if (qobject_cast<QQuickItem *>(view->renderObject()))
+                WaylandViewPrivate::get(view)->frameCallbackHoldReason = WaylandSurface::FrameCallbackHeldHidden;
+        }
+    }
+
+    QRegion occluders;
+    const QRectF windowRect(QPointF(0, 0), quickWindow->size());
+    updateItemHoldReasons(this, quickWindow->contentItem(), 1.0, windowRect, occluders);
+}
+
+/*!
+ * \internal
+ *
+ * Runs while the scene graph is synchronized, on the render thread like
+ * the page flip that follows, the GUI thread is blocked.
+ */
+void WaylandQuickOutput::updateDirectScanout()
+{
+#if LIRI_FEATURE_aurora_qpa
+    QQuickWindow *quickWindow = static_cast<QQuickWindow *>(window());
+
+    WaylandQuickItem *item = nullptr;
+    if (m_directScanout) {
+        bool found = false;
+        const QRectF windowRect(QPointF(0, 0), quickWindow->size());
+        item = scanoutCandidate(quickWindow->contentItem(), 1.0, windowRect, windowRect, &found);
+    }
+
+    WaylandBufferRef buffer;
+    PlatformSupport::ScanoutBuffer scanout;
+    if (item && item->isPaintEnabled() && item->surface()
+            && item->view()->output() == this && !item->view()->isBufferLocked()) {
+        WaylandSurface *surface = item->surface();
+        buffer = item->view()->currentBuffer();
+
+        // The buffer has to match the screen pixel by pixel
+        const QSize pixelSize = (QSizeF(quickWindow->size()) * quickWindow->effectiveDevicePixelRatio()).toSize();
+        const QRectF fullSource(QPointF(0, 0), QSizeF(buffer.size()) / surface->bufferScale());
+        const bool suitable = buffer.origin() == WaylandSurface::OriginTopLeft
+                && buffer.size() == pixelSize
+                && surface->sourceGeometry() == fullSource
+                && surface->contentOrientation() == Qt::PrimaryOrientation
+                && surface->isOpaque();
+
+        if (!suitable || !Internal::scanoutBufferFor(buffer, &scanout))
+            buffer = WaylandBufferRef();
+
+        // Flipped without waiting for the vblank when both agree
+        scanout.allowTearing = allowTearing() && surface->allowsTearing();
+    }
+
+    if (scanout.key) {
+        if (PlatformSupport::EglFSFunctions::setScanoutBuffer(quickWindow->screen(), scanout))
+            Internal::ClientBuffer::fromBufferRef(buffer)->setScannedOut();
+        else
+            buffer = WaylandBufferRef();
+    } else if (m_scanoutItem) {
+        PlatformSupport::EglFSFunctions::setScanoutBuffer(quickWindow->screen(), scanout);
+    }
+
+    // The commit can still fail after the test, the frame rendered by the
+    // compositor is shown instead: the item is only left out of it once
+    // the buffer was shown by a flip
+    const bool presented = !buffer.isNull()
+            && Internal::ClientBuffer::fromBufferRef(buffer)->isScanoutPresented();
+    setScanoutItem(buffer.isNull() ? nullptr : item, presented);
+
+    // A buffer must not be released to the client before the flip of
+    // a later frame took it off screen, PresentationEvent tells
+    if (!buffer.isNull()) {
+        ScanoutFrame scanoutFrame;
+        scanoutFrame.buffer = buffer;
+        scanoutFrame.frame = PlatformSupport::EglFSFunctions::getFrameTiming(quickWindow->screen()).renderedFrames + 1;
+        m_scanoutBuffers.append(scanoutFrame);
+    }
+#endif
+}
+
+void WaylandQuickOutput::setScanoutItem(WaylandQuickItem *item, bool replacesNode)
+{
+    // Dirty items are synchronized right after beforeSynchronizing(),
+    // the node of the item comes back or goes away with this frame
+    if (m_scanoutItem != item) {
+        // Composited frames didn't show what the plane did
+        m_fullDamage = true;
+
+        if (m_scanoutItem) {
+            auto *itemPrivate = WaylandQuickItemPrivate::get(m_scanoutItem);
+            if (itemPrivate->directScanout) {
+                itemPrivate->directScanout = false;
+                itemPrivate->textureFullUpdate = true;
+                m_scanoutItem->update();
+            }
+        }
+
+        m_scanoutItem = item;
+    }
+
+    if (m_scanoutItem) {
+        auto *itemPrivate = WaylandQuickItemPrivate::get(m_scanoutItem);
+        if (itemPrivate->directScanout != replacesNode) {
+            itemPrivate->directScanout = replacesNode;
+            if (!replacesNode)
+                itemPrivate->textureFullUpdate = true;
+            m_scanoutItem->update();
+        }
+    }
+}
+
+/*!
+ * \internal
+ *
+ * Returns what the frame about to be synchronized changes, in window pixels.
+ *
+ * Runs before dirty items are synchronized, the GUI thread is blocked. Only
+ * new buffers of surfaces are known precisely, any other change to the
+ * scene damages the whole window.
+ *
+ * Animators such as OpacityAnimator change nodes on the render thread
+ * without dirtying items: while they run, and for the frame after they
+ * stopped, the whole window is damaged.
+ *
+ * New buffers of the item scanned out in place of its node change nothing
+ * that is rendered, they go to \a scanoutDamage instead: frames with
+ * nothing else to render are then left as they are.
+ */
+QRegion WaylandQuickOutput::frameDamage(QRegion *scanoutDamage)
+{
+    QQuickWindow *quickWindow = static_cast<QQuickWindow *>(window());
+    const qreal dpr = quickWindow->effectiveDevicePixelRatio();
+    const QRect windowRect(QPoint(0, 0), (QSizeF(quickWindow->size()) * dpr).toSize());
+
+    QQuickWindowPrivate *windowPrivate = QQuickWindowPrivate::get(quickWindow);
+    const bool animatorsRunning = windowPrivate->animationController
+            && (!windowPrivate->animationController->m_animationRoots.isEmpty()
+                || !windowPrivate->animationController->m_rootsPendingStart.isEmpty());
+    const bool animatorsStopped = m_animatorsRunning && !animatorsRunning;
+    m_animatorsRunning = animatorsRunning;
+
+    if (m_fullDamage || animatorsRunning || animatorsStopped) {
+        m_fullDamage = false;
+        return windowRect;
+    }
+
+    QRegion damage;
+    QQuickItem *item = windowPrivate->dirtyItemList;
+    for (; item; item = QQuickItemPrivate::get(item)->nextDirtyItem) {
+        QQuickItemPrivate *itemPrivate = QQuickItemPrivate::get(item);
+        auto *waylandItem = qobject_cast<WaylandQuickItem *>(item);
+        if (!waylandItem || !waylandItem->surface()
+                || (itemPrivate->dirtyAttributes & ~QQuickItemPrivate::Content))
+            return windowRect;
+
+        if (!itemPrivate->effectiveVisible)
+            continue;
+
+        // Layers and shader effects show the item somewhere else
+        for (QQuickItem *p = item; p; p = p->parentItem()) {
+            QQuickItemPrivate *pPrivate = QQuickItemPrivate::get(p);
+            if (pPrivate->extra.isAllocated() && pPrivate->extra->effectRefCount > 0)
+                return windowRect;
+        }
+
+        // The item has no node, the buffer goes straight to the screen
+        const bool scannedOut = waylandItem == m_scanoutItem
+                && WaylandQuickItemPrivate::get(waylandItem)->directScanout;
+        QRegion &targetDamage = scannedOut ? *scanoutDamage : damage;
+
+        // Without a new buffer the whole item is repainted
+        QRegion itemDamage;
+        auto *viewPrivate = WaylandViewPrivate::get(waylandItem->view());
+        if (viewPrivate->nextBufferCommitted) {
+            for (const QRect &rect : viewPrivate->nextDamage) {
+                const QPointF topLeft = waylandItem->mapFromSurface(rect.topLeft());
+                const QPointF bottomRight = waylandItem->mapFromSurface(QPointF(rect.x() + rect.width(),
+                                                                                rect.y() + rect.height()));
+                itemDamage |= QRectF(topLeft, bottomRight).normalized().toAlignedRect();
+            }
+        } else {
+            itemDamage = waylandItem->boundingRect().toAlignedRect();
+        }
+
+        const QTransform transform = itemPrivate->itemToWindowTransform();
+        for (const QRect &rect : itemDamage) {
+            const QRectF windowRect = transform.mapRect(QRectF(rect));
+            // Filtering samples the pixels around when scaled
+            targetDamage |= QRectF(windowRect.topLeft() * dpr, windowRect.size() * dpr)
+                    .toAlignedRect().adjusted(-1, -1, 1, 1);
+        }
+    }
+
+    *scanoutDamage &= windowRect;
+    return damage.intersected(windowRect);
+}
+
 void WaylandQuickOutput::doFrameCallbacks()
 {
-    if (m_automaticFrameCallback)
-        sendFrameCallbacks();
+    if (!m_automaticFrameCallback)
+        return;
+
+#if LIRI_FEATURE_aurora_qpa
+    // Clients are told when the frame is expected on screen, rather than
+    // when it was rendered: frames start as late as the scheduler of the
+    // screen allows, animations of clients are in step with what is shown
+    const PlatformSupport::FrameTiming timing =
+            PlatformSupport::EglFSFunctions::getFrameTiming(window()->screen());
+    if (timing.predictedPresentationTime > 0) {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        const qint64 now = qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+        const qint64 ahead = timing.predictedPresentationTime - now;
+        if (ahead >= 0 && ahead < 1000000) {
+            const uint time = compositor()->currentTimeMsecs() + uint(ahead / 1000);
+            WaylandOutputPrivate::get(this)->sendFrameCallbacks(time);
+            return;
+        }
+    }
+#endif
+
+    sendFrameCallbacks();
 }
 } // namespace Compositor
 
@@ -4,7 +4,10 @@
 
 #pragma once
 
+#include <QtCore/QPointer>
+#include <QtGui/QRegion>
 #include <QtQuick/QQuickWindow>
+#include <LiriAuroraCompositor/aurorawaylandbufferref.h>
 #include <LiriAuroraCompositor/aurorawaylandoutput.h>
 #include <LiriAuroraCompositor/aurorawaylandquickchildren.h>
 
@@ -15,6 +18,7 @@ namespace Aurora {
 namespace Compositor {
 
 class WaylandQuickCompositor;
+class WaylandQuickItem;
 
 class LIRIAURORACOMPOSITOR_EXPORT WaylandQuickOutput : public WaylandOutput, public QQmlParserStatus
 {
@@ -22,6 +26,7 @@ class LIRIAURORACOMPOSITOR_EXPORT WaylandQuickOutput : public WaylandOutput, pub
     Q_OBJECT
     AURORA_COMPOSITOR_DECLARE_QUICK_CHILDREN(WaylandQuickOutput)
     Q_PROPERTY(bool automaticFrameCallback READ automaticFrameCallback WRITE setAutomaticFrameCallback NOTIFY automaticFrameCallbackChanged)
+    Q_PROPERTY(bool directScanout READ directScanout WRITE setDirectScanout NOTIFY directScanoutChanged)
     QML_NAMED_ELEMENT(WaylandOutput)
     QML_ADDED_IN_VERSION(1, 0)
 public:
@@ -33,6 +38,9 @@ public:
     bool automaticFrameCallback() const;
     void setAutomaticFrameCallback(bool automatic);
 
+    bool directScanout() const;
+    void setDirectScanout(bool enabled);
+
     QQuickItem *pickClickableItem(const QPointF &position);
 
 public Q_SLOTS:
@@ -40,17 +48,39 @@ public Q_SLOTS:
 
 Q_SIGNALS:
     void automaticFrameCallbackChanged();
+    void directScanoutChanged();
 
 protected:
     void initialize() override;
     void classBegin() override;
     void componentComplete() override;
+    bool eventFilter(QObject *watched, QEvent *event) override;
 
 private:
+    struct ScanoutFrame {
+        WaylandBufferRef buffer;
+        // Number of the frame, as in PresentationEvent
+        quint64 frame = 0;
+    };
+
+    void setScreen(QScreen *screen);
     void doFrameCallbacks();
+    void updateFrameCallbackHoldReasons();
+    void updateDirectScanout();
+    void setScanoutItem(WaylandQuickItem *item, bool replacesNode);
+    QRegion frameDamage(QRegion *scanoutDamage);
 
     bool m_updateScheduled = false;
     bool m_automaticFrameCallback = true;
+    bool m_directScanout = true;
+    QPointer<WaylandQuickItem> m_scanoutItem;
+    // The next frame changes more than the dirty items tell
+    bool m_fullDamage = true;
+    // Animators ran on the render thread for the previous frame
+    bool m_animatorsRunning = false;
+    QPointer<QScreen> m_screen;
+    // Buffers scanned out by the frames not replaced on screen yet
+    QList<ScanoutFrame> m_scanoutBuffers;
 };
 
 } // namespace Compositor
@@ -7,6 +7,9 @@
 
 #include "wayland_wrapper/aurorawlbuffermanager_p.h"
 #include "wayland_wrapper/aurorawlregion_p.h"
+#if QT_CONFIG(opengl)
+#include "wayland_wrapper/aurorawlshmuploader_p.h"
+#endif
 #if LIRI_FEATURE_aurora_datadevice
 #include "wayland_wrapper/aurorawldatadevice_p.h"
 #include "wayland_wrapper/aurorawldatadevicemanager_p.h"
@@ -39,21 +42,31 @@ namespace Compositor {
 namespace Internal {
 class FrameCallback {
 public:
-    FrameCallback(WaylandSurface *surf, wl_resource *res)
-        : surface(surf)
-        , resource(res)
-    {
-        wl_resource_set_implementation(res, nullptr, this, destroyCallback);
-    }
-    ~FrameCallback()
+    static FrameCallback *create(WaylandSurface *surf, wl_resource *res)
     {
+        FrameCallback *callback = freeList;
+        if (callback) {
+            freeList = callback->next;
+            --freeCount;
+        } else {
+            callback = new FrameCallback;
+        }
+        callback->surface = surf;
+        callback->resource = res;
+        callback->canSend = false;
+        callback->next = nullptr;
+        wl_resource_set_implementation(res, nullptr, callback, destroyCallback);
+        return callback;
     }
     void destroy()
     {
-        if (resource)
+        if (resource) {
             wl_resource_destroy(resource);
-        else
-            delete this;
+        } else {
+            if (list)
+                list->remove(this);
+            recycle();
+        }
     }
     void send(uint time)
     {
@@ -65,13 +78,101 @@ public:
         FrameCallback *_this = static_cast<FrameCallback *>(wl_resource_get_user_data(res));
         if (_this->surface)
             WaylandSurfacePrivate::get(_this->surface)->removeFrameCallback(_this);
-        delete _this;
+        _this->recycle();
     }
     WaylandSurface *surface = nullptr;
     wl_resource *resource = nullptr;
     bool canSend = false;
+
+    // Links of the FrameCallbackList it belongs to, or of the free list
+    FrameCallbackList *list = nullptr;
+    FrameCallback *prev = nullptr;
+    FrameCallback *next = nullptr;
+
+private:
+    FrameCallback() = default;
+
+    void recycle()
+    {
+        Q_ASSERT(!list);
+        if (freeCount >= MaxFreeCount) {
+            delete this;
+            return;
+        }
+        surface = nullptr;
+        resource = nullptr;
+        prev = nullptr;
+        next = freeList;
+        freeList = this;
+        ++freeCount;
+    }
+
+    // Callbacks are recycled rather than deleted, as clients request one every frame
+    static const int MaxFreeCount = 256;
+    static FrameCallback *freeList;
+    static int freeCount;
 };
+
+FrameCallback *FrameCallback::freeList = nullptr;
+int FrameCallback::freeCount = 0;
+
+void FrameCallbackList::append(FrameCallback *callback)
+{
+    Q_ASSERT(!callback->list);
+    callback->list = this;
+    callback->prev = last;
+    callback->next = nullptr;
+    if (last)
+        last->next = callback;
+    else
+        first = callback;
+    last = callback;
+}
+
+void FrameCallbackList::remove(FrameCallback *callback)
+{
+    Q_ASSERT(callback->list == this);
+    if (callback->prev)
+        callback->prev->next = callback->next;
+    else
+        first = callback->next;
+    if (callback->next)
+        callback->next->prev = callback->prev;
+    else
+        last = callback->prev;
+    callback->list = nullptr;
+    callback->prev = nullptr;
+    callback->next = nullptr;
+}
+
+/*
+    Moves all callbacks of \a other to the end of this list. Only the
+    list of each callback has to be updated, links are left untouched.
+*/
+void FrameCallbackList::takeAll(FrameCallbackList &other)
+{
+    if (other.isEmpty())
+        return;
+
+    for (FrameCallback *callback = other.first; callback; callback = callback->next)
+        callback->list = this;
+
+    if (last) {
+        last->next = other.first;
+        other.first->prev = last;
+    } else {
+        first = other.first;
+    }
+    last = other.last;
+    other.first = other.last = nullptr;
 }
+}
+// How many commits a buffer can stay out of the surface before its texture
+// has to be uploaded again completely
+static const int MaxCommitDamageHistory = 4;
+
+static quint64 s_commitSerial = 0;
+
 static QRegion infiniteRegion() {
     return QRegion(QRect(QPoint(std::numeric_limits<int>::min(), std::numeric_limits<int>::min()),
                          QPoint(std::numeric_limits<int>::max(), std::numeric_limits<int>::max())));
@@ -100,18 +201,75 @@ WaylandSurfacePrivate::~WaylandSurfacePrivate()
     }
     views.clear();
 
+    // The wl_subsurface can outlive the surface
+    if (subsurface)
+        subsurface->surface = nullptr;
+
     bufferRef = WaylandBufferRef();
 
-    for (Internal::FrameCallback *c : std::as_const(pendingFrameCallbacks))
-        c->destroy();
-    for (Internal::FrameCallback *c : std::as_const(frameCallbacks))
-        c->destroy();
+    // Destroying a callback removes it from its list
+    while (!pending.frameCallbacks.isEmpty())
+        pending.frameCallbacks.first->destroy();
+    while (!cached.frameCallbacks.isEmpty())
+        cached.frameCallbacks.first->destroy();
+    while (!frameCallbacks.isEmpty())
+        frameCallbacks.first->destroy();
 }
 
 void WaylandSurfacePrivate::removeFrameCallback(Internal::FrameCallback *callback)
 {
-    pendingFrameCallbacks.removeOne(callback);
-    frameCallbacks.removeOne(callback);
+    if (callback->list)
+        callback->list->remove(callback);
+}
+
+/*
+    Maps \a surfaceDamage to buffer coordinates. Without viewport or buffer
+    transform the damage only needs to be scaled, in any other case the
+    whole buffer is considered damaged.
+*/
+QRegion WaylandSurfacePrivate::toBufferDamage(const QRegion &surfaceDamage) const
+{
+    const QRect bufferRect(QPoint(), bufferSize);
+    const QSize surfaceSize = bufferSize / bufferScale;
+
+    if (sourceGeometry != QRectF(QPoint(), surfaceSize) || destinationSize != surfaceSize
+            || contentOrientation != Qt::PrimaryOrientation)
+        return bufferRect;
+
+    QRegion bufferDamage;
+    for (const QRect &rect : surfaceDamage)
+        bufferDamage |= QRect(rect.topLeft() * bufferScale, rect.size() * bufferScale);
+    return bufferDamage.intersected(bufferRect);
+}
+
+/*
+    Works out which part of the texture of \a buffer is out of date. This is the
+    union of the damage of every commit since the buffer was last attached to
+    this surface, or the whole buffer if it wasn't attached recently.
+*/
+void WaylandSurfacePrivate::trackTextureDamage(Internal::ClientBuffer *buffer)
+{
+    const QRect bufferRect(QPoint(), bufferSize);
+    const QRegion bufferDamage = toBufferDamage(damage);
+
+    QRegion staleRegion = bufferDamage;
+    bool found = false;
+    for (auto it = commitDamageHistory.crbegin(); it != commitDamageHistory.crend(); ++it) {
+        if (it->serial == buffer->commitSerial()) {
+            found = true;
+            break;
+        }
+        staleRegion |= it->damage;
+    }
+    if (!found)
+        staleRegion = bufferRect;
+
+    const quint64 serial = ++s_commitSerial;
+    commitDamageHistory.append({ serial, bufferDamage });
+    if (commitDamageHistory.size() > MaxCommitDamageHistory)
+        commitDamageHistory.removeFirst();
+
+    buffer->addTextureDamage(staleRegion, serial);
 }
 
 void WaylandSurfacePrivate::notifyViewsAboutDestruction()
@@ -127,6 +285,35 @@ void WaylandSurfacePrivate::notifyViewsAboutDestruction()
     }
 }
 
+/*
+    Sends pending frame callbacks with \a time, which is the time the frame
+    that was rendered is expected to be presented when that's known.
+*/
+void WaylandSurfacePrivate::sendFrameCallbacks(uint time)
+{
+    const uint now = compositor->currentTimeMsecs();
+    Internal::FrameCallback *c = frameCallbacks.first;
+    while (c) {
+        Internal::FrameCallback *next = c->next;
+        if (c->canSend) {
+            frameCallbacks.remove(c);
+            c->surface = nullptr;
+            c->send(time);
+            lastFrameCallbackTime = now;
+        }
+        c = next;
+    }
+}
+
+void WaylandSurfacePrivate::setFrameCallbackHoldReason(WaylandSurface::FrameCallbackHoldReason reason)
+{
+    Q_Q(WaylandSurface);
+    if (frameCallbackHoldReason == reason)
+        return;
+    frameCallbackHoldReason = reason;
+    emit q->frameCallbackHoldReasonChanged();
+}
+
 #ifndef QT_NO_DEBUG
 void WaylandSurfacePrivate::addUninitializedSurface(WaylandSurfacePrivate *surface)
 {
@@ -190,7 +377,7 @@ void WaylandSurfacePrivate::surface_frame(Resource *resource, uint32_t callback)
 {
     Q_Q(WaylandSurface);
     struct wl_resource *frame_callback = wl_resource_create(resource->client(), &wl_callback_interface, wl_callback_interface.version, callback);
-    pendingFrameCallbacks << new Internal::FrameCallback(q, frame_callback);
+    pending.frameCallbacks.append(Internal::FrameCallback::create(q, frame_callback));
 }
 
 void WaylandSurfacePrivate::surface_set_opaque_region(Resource *, struct wl_resource *region)
@@ -208,6 +395,54 @@ void WaylandSurfacePrivate::surface_set_input_region(Resource *, struct wl_resou
 }
 
 void WaylandSurfacePrivate::surface_commit(Resource *)
+{
+    if (subsurface && (subsurface->isSynchronized() || hasCachedState)) {
+        // Checked now against the buffer it will be applied with, the pending
+        // state is gone once merged into the cache
+        if (viewport) {
+            const WaylandBufferRef &buffer = pending.newlyAttached ? pending.buffer
+                    : cached.newlyAttached ? cached.buffer : bufferRef;
+            viewport->checkCommittedState(buffer.size(), pending.bufferScale);
+        }
+
+        // A synchronized subsurface keeps its state until the parent commits,
+        // a desynchronized one applies what was cached along with the new state
+        cacheState();
+        if (!subsurface->isSynchronized()) {
+            hasCachedState = false;
+            applyState(cached);
+        }
+        return;
+    }
+
+    applyState(pending);
+}
+
+/*
+    Merges the pending state into the cached state of a subsurface.
+*/
+void WaylandSurfacePrivate::cacheState()
+{
+    if (pending.newlyAttached) {
+        cached.buffer = std::move(pending.buffer);
+        cached.newlyAttached = true;
+    }
+    cached.offset += pending.offset;
+    cached.surfaceDamage |= pending.surfaceDamage;
+    cached.bufferDamage |= pending.bufferDamage;
+    cached.inputRegion = pending.inputRegion;
+    cached.opaqueRegion = pending.opaqueRegion;
+    cached.bufferScale = pending.bufferScale;
+    cached.sourceGeometry = pending.sourceGeometry;
+    cached.destinationSize = pending.destinationSize;
+    cached.allowsTearing = pending.allowsTearing;
+    cached.frameCallbacks.takeAll(pending.frameCallbacks);
+    hasCachedState = true;
+
+    pending.clearPerCommitState();
+}
+
+void WaylandSurfacePrivate::applyState(State &state)
 {
     Q_Q(WaylandSurface);
 
@@ -217,23 +452,24 @@ void WaylandSurfacePrivate::surface_commit(Resource *)
     QSize oldDestinationSize = destinationSize;
     bool oldHasContent = hasContent;
     int oldBufferScale = bufferScale;
+    bool oldAllowsTearing = allowsTearing;
 
     // Update all internal state
-    if (pending.buffer.hasBuffer() || pending.newlyAttached)
-        bufferRef = pending.buffer;
-    bufferScale = pending.bufferScale;
+    if (state.buffer.hasBuffer() || state.newlyAttached)
+        bufferRef = std::move(state.buffer);
+    bufferScale = state.bufferScale;
     bufferSize = bufferRef.size();
     QSize surfaceSize = bufferSize / bufferScale;
-    sourceGeometry = !pending.sourceGeometry.isValid() ? QRect(QPoint(), surfaceSize) : pending.sourceGeometry;
-    destinationSize = pending.destinationSize.isEmpty() ? sourceGeometry.size().toSize() : pending.destinationSize;
+    sourceGeometry = !state.sourceGeometry.isValid() ? QRect(QPoint(), surfaceSize) : state.sourceGeometry;
+    destinationSize = state.destinationSize.isEmpty() ? sourceGeometry.size().toSize() : state.destinationSize;
     QRect destinationRect(QPoint(), destinationSize);
-    // pending.damage is already in surface coordinates
-    damage = pending.surfaceDamage.intersected(destinationRect);
-    if (!pending.bufferDamage.isNull()) {
+    // state.surfaceDamage is already in surface coordinates
+    damage = state.surfaceDamage.intersected(destinationRect);
+    if (!state.bufferDamage.isNull()) {
         if (bufferScale == 1) {
-            damage |= pending.bufferDamage.intersected(destinationRect); // Already in surface coordinates
+            damage |= state.bufferDamage.intersected(destinationRect); // Already in surface coordinates
         } else {
-            // We must transform pending.damage from buffer coordinate system to surface coordinates
+            // We must transform state.bufferDamage from buffer coordinate system to surface coordinates
             // TODO(QTBUG-85461): Also support wp_viewport setting more complex transformations
             auto xform = [](const QRect &r, int scale) -> QRect {
                 QRect res{
@@ -242,38 +478,55 @@ void WaylandSurfacePrivate::surface_commit(Resource *)
                 };
                 return res;
             };
-            for (const QRect &r : pending.bufferDamage)
+            for (const QRect &r : state.bufferDamage)
                 damage |= xform(r, bufferScale).intersected(destinationRect);
         }
     }
     hasContent = bufferRef.hasContent();
-    frameCallbacks << pendingFrameCallbacks;
-    inputRegion = pending.inputRegion.intersected(destinationRect);
-    opaqueRegion = pending.opaqueRegion.intersected(destinationRect);
+    frameCallbacks.takeAll(state.frameCallbacks);
+    inputRegion = state.inputRegion.intersected(destinationRect);
+    opaqueRegion = state.opaqueRegion.intersected(destinationRect);
     bool becameOpaque = opaqueRegion.boundingRect().contains(destinationRect);
     if (becameOpaque != isOpaque) {
         isOpaque = becameOpaque;
         emit q->isOpaqueChanged();
     }
+    allowsTearing = state.allowsTearing;
 
-    QPoint offsetForNextFrame = pending.offset;
+    QPoint offsetForNextFrame = state.offset;
 
-    if (viewport)
-        viewport->checkCommittedState();
+    // Cached state was checked when it was committed
+    if (viewport && &state == &pending)
+        viewport->checkCommittedState(bufferSize, bufferScale);
 
     // Clear per-commit state
-    pending.buffer = WaylandBufferRef();
-    pending.offset = QPoint();
-    pending.newlyAttached = false;
-    pending.bufferDamage = QRegion();
-    pending.surfaceDamage = QRegion();
-    pendingFrameCallbacks.clear();
+    state.clearPerCommitState();
 
     // Notify buffers and views
-    if (auto *buffer = bufferRef.buffer())
+    if (auto *buffer = bufferRef.buffer()) {
+        trackTextureDamage(buffer);
         buffer->setCommitted(damage);
-    for (auto *view : std::as_const(views))
-        view->bufferCommitted(bufferRef, damage);
+    }
+
+    // With asynchronous uploads views only get shm buffers once the texture is ready,
+    // later commits have to wait for them to keep the order
+    bool deferred = false;
+#if QT_CONFIG(opengl)
+    auto *uploader = bufferRef.isSharedMemory() ? Internal::ShmUploader::instance() : nullptr;
+    if (uploader || !pendingUploads.isEmpty()) {
+        deferred = true;
+        pendingUploads.append({ 0, bufferRef, damage, !uploader });
+        if (uploader) {
+            pendingUploads.last().id = uploader->upload(bufferRef, q, [this](quint64 id) {
+                uploadCompleted(id);
+            });
+        }
+    }
+#endif
+    if (!deferred) {
+        for (auto *view : std::as_const(views))
+            view->bufferCommitted(bufferRef, damage);
+    }
 
     // Now all double-buffered state has been applied so it's safe to emit general signals
     // i.e. we won't have inconsistensies such as mismatched surface size and buffer scale in
@@ -296,10 +549,66 @@ void WaylandSurfacePrivate::surface_commit(Resource *)
     if (oldHasContent != hasContent)
         emit q->hasContentChanged();
 
+    if (oldAllowsTearing != allowsTearing)
+        emit q->allowsTearingChanged();
+
     if (!offsetForNextFrame.isNull())
         emit q->offsetForNextFrame(offsetForNextFrame);
 
-    emit q->redraw();
+    if (!deferred)
+        emit q->redraw();
+
+    applyChildrenState();
+}
+
+/*
+    Applies what subsurfaces of this surface were waiting for its commit:
+    their position and, for synchronized ones, the cached state.
+*/
+void WaylandSurfacePrivate::applyChildrenState()
+{
+    const auto children = subsurfaceChildren;
+    for (const auto &child : children) {
+        if (!child)
+            continue;
+
+        auto *childPrivate = get(child);
+        if (childPrivate->destroyed || !childPrivate->subsurface)
+            continue;
+
+        childPrivate->subsurface->applyPosition();
+        if (childPrivate->hasCachedState && childPrivate->subsurface->isSynchronized()) {
+            childPrivate->hasCachedState = false;
+            childPrivate->applyState(childPrivate->cached);
+        }
+    }
+}
+
+/*
+    Hands the buffers whose upload \a id completed to the views, along with
+    the commits queued behind them.
+*/
+void WaylandSurfacePrivate::uploadCompleted(quint64 id)
+{
+    Q_Q(WaylandSurface);
+
+    for (auto &upload : pendingUploads) {
+        if (upload.id == id) {
+            upload.done = true;
+            break;
+        }
+    }
+
+    bool redraw = false;
+    while (!pendingUploads.isEmpty() && pendingUploads.constFirst().done) {
+        const PendingUpload upload = pendingUploads.takeFirst();
+        for (auto *view : std::as_const(views))
+            view->bufferCommitted(upload.buffer, upload.damage);
+        redraw = true;
+    }
+
+    if (redraw)
+        emit q->redraw();
 }
 
 void WaylandSurfacePrivate::surface_set_buffer_transform(Resource *resource, int32_t orientation)
@@ -701,7 +1010,7 @@ WaylandCompositor *WaylandSurface::compositor() const
 void WaylandSurface::frameStarted()
 {
     Q_D(WaylandSurface);
-    for (Internal::FrameCallback *c : std::as_const(d->frameCallbacks))
+    for (Internal::FrameCallback *c = d->frameCallbacks.first; c; c = c->next)
         c->canSend = true;
 }
 
@@ -711,17 +1020,7 @@ void WaylandSurface::frameStarted()
 void WaylandSurface::sendFrameCallbacks()
 {
     Q_D(WaylandSurface);
-    uint time = d->compositor->currentTimeMsecs();
-    int i = 0;
-    while (i < d->frameCallbacks.size()) {
-        if (d->frameCallbacks.at(i)->canSend) {
-            d->frameCallbacks.at(i)->surface = nullptr;
-            d->frameCallbacks.at(i)->send(time);
-            d->frameCallbacks.removeAt(i);
-        } else {
-            i++;
-        }
-    }
+    d->sendFrameCallbacks(d->compositor->currentTimeMsecs());
 }
 
 /*!
@@ -834,6 +1133,29 @@ bool WaylandSurface::inhibitsIdle() const
     return !d->idleInhibitors.isEmpty();
 }
 
+/*!
+ * \qmlproperty bool AuroraCompositor::WaylandSurface::allowsTearing
+ *
+ * This property holds whether the client prefers this surface to be shown
+ * as soon as possible, even if it tears.
+ *
+ * \sa TearingControlManagerV1, WaylandOutput::allowTearing
+ */
+
+/*!
+ * \property WaylandSurface::allowsTearing
+ *
+ * This property holds whether the client prefers this surface to be shown
+ * as soon as possible, even if it tears.
+ *
+ * \sa WaylandTearingControlManagerV1, WaylandOutput::allowTearing
+ */
+bool WaylandSurface::allowsTearing() const
+{
+    Q_D(const WaylandSurface);
+    return d->allowsTearing;
+}
+
 /*!
  *  \qmlproperty bool AuroraCompositor::WaylandSurface::isOpaque
  *  \since 6.4
@@ -855,6 +1177,32 @@ bool WaylandSurface::isOpaque() const
     return d->isOpaque;
 }
 
+/*!
+ *  \qmlproperty enumeration AuroraCompositor::WaylandSurface::frameCallbackHoldReason
+ *
+ *  This property holds why frame callbacks of this surface were held back
+ *  the last time an output with WaylandOutput::frameCallbackThrottling enabled
+ *  was rendered.
+ *
+ *  \value WaylandSurface.FrameCallbackNotHeld The surface was presented and its frame callbacks were sent.
+ *  \value WaylandSurface.FrameCallbackHeldHidden The surface was not visible or fully transparent.
+ *  \value WaylandSurface.FrameCallbackHeldOffscreen The surface was outside of the output.
+ *  \value WaylandSurface.FrameCallbackHeldOccluded The surface was covered by opaque surfaces.
+ */
+
+/*!
+ *  \property WaylandSurface::frameCallbackHoldReason
+ *
+ *  This property holds why frame callbacks of this surface were held back
+ *  the last time an output with WaylandOutput::frameCallbackThrottling enabled
+ *  was rendered.
+ */
+WaylandSurface::FrameCallbackHoldReason WaylandSurface::frameCallbackHoldReason() const
+{
+    Q_D(const WaylandSurface);
+    return d->frameCallbackHoldReason;
+}
+
 #if QT_CONFIG(im)
 WaylandInputMethodControl *WaylandSurface::inputMethodControl() const
 {
@@ -1041,12 +1389,33 @@ void WaylandSurfacePrivate::initSubsurface(WaylandSurface *parent, wl_client *cl
     emit parent->childAdded(q);
 }
 
-void WaylandSurfacePrivate::Subsurface::subsurface_set_position(wl_subsurface::Resource *resource, int32_t x, int32_t y)
+/*
+    Returns whether the subsurface is in synchronized mode, either by itself
+    or because one of its ancestors is.
+*/
+bool WaylandSurfacePrivate::Subsurface::isSynchronized() const
 {
-    Q_UNUSED(resource);
-    position = QPoint(x,y);
+    if (synchronized)
+        return true;
+    return parentSurface && parentSurface->subsurface && parentSurface->subsurface->isSynchronized();
+}
+
+void WaylandSurfacePrivate::Subsurface::applyPosition()
+{
+    if (!hasPendingPosition)
+        return;
+
+    hasPendingPosition = false;
+    position = pendingPosition;
     emit surface->q_func()->subsurfacePositionChanged(position);
+}
 
+void WaylandSurfacePrivate::Subsurface::subsurface_set_position(wl_subsurface::Resource *resource, int32_t x, int32_t y)
+{
+    Q_UNUSED(resource);
+    // Takes effect when the parent commits
+    pendingPosition = QPoint(x, y);
+    hasPendingPosition = true;
 }
 
 void WaylandSurfacePrivate::Subsurface::subsurface_place_above(wl_subsurface::Resource *resource, struct wl_resource *sibling)
@@ -1064,15 +1433,40 @@ void WaylandSurfacePrivate::Subsurface::subsurface_place_below(wl_subsurface::Re
 void WaylandSurfacePrivate::Subsurface::subsurface_set_sync(wl_subsurface::Resource *resource)
 {
     Q_UNUSED(resource);
-    // TODO: sync/desync implementation
-    qDebug() << Q_FUNC_INFO;
+    synchronized = true;
 }
 
 void WaylandSurfacePrivate::Subsurface::subsurface_set_desync(wl_subsurface::Resource *resource)
 {
     Q_UNUSED(resource);
-    // TODO: sync/desync implementation
-    qDebug() << Q_FUNC_INFO;
+    synchronized = false;
+
+    // Nothing holds the cached state back anymore
+    if (surface->hasCachedState && !isSynchronized()) {
+        surface->hasCachedState = false;
+        surface->applyState(surface->cached);
+    }
+}
+
+void WaylandSurfacePrivate::Subsurface::subsurface_destroy(wl_subsurface::Resource *resource)
+{
+    wl_resource_destroy(resource->handle);
+}
+
+void WaylandSurfacePrivate::Subsurface::subsurface_destroy_resource(wl_subsurface::Resource *resource)
+{
+    Q_UNUSED(resource);
+
+    // The surface loses its role, what it cached is applied right away
+    if (surface) {
+        surface->subsurface = nullptr;
+        if (surface->hasCachedState && !surface->destroyed) {
+            surface->hasCachedState = false;
+            surface->applyState(surface->cached);
+        }
+    }
+
+    delete this;
 }
 
 /*!
@@ -54,7 +54,9 @@ class LIRIAURORACOMPOSITOR_EXPORT WaylandSurface : public WaylandObject
     Q_PROPERTY(bool hasContent READ hasContent NOTIFY hasContentChanged)
     Q_PROPERTY(bool cursorSurface READ isCursorSurface WRITE markAsCursorSurface NOTIFY cursorSurfaceChanged)
     Q_PROPERTY(bool inhibitsIdle READ inhibitsIdle NOTIFY inhibitsIdleChanged)
+    Q_PROPERTY(bool allowsTearing READ allowsTearing NOTIFY allowsTearingChanged)
     Q_PROPERTY(bool isOpaque READ isOpaque NOTIFY isOpaqueChanged)
+    Q_PROPERTY(Aurora::Compositor::WaylandSurface::FrameCallbackHoldReason frameCallbackHoldReason READ frameCallbackHoldReason NOTIFY frameCallbackHoldReasonChanged)
     Q_MOC_INCLUDE("aurorawaylanddrag.h")
     Q_MOC_INCLUDE("aurorawaylandcompositor.h")
 
@@ -68,6 +70,14 @@ public:
     };
     Q_ENUM(Origin)
 
+    enum FrameCallbackHoldReason {
+        FrameCallbackNotHeld,
+        FrameCallbackHeldHidden,
+        FrameCallbackHeldOffscreen,
+        FrameCallbackHeldOccluded
+    };
+    Q_ENUM(FrameCallbackHoldReason)
+
     WaylandSurface();
     WaylandSurface(WaylandCompositor *compositor, WaylandClient *client, uint id, int version);
     ~WaylandSurface() override;
@@ -115,8 +125,11 @@ public:
     bool isCursorSurface() const;
 
     bool inhibitsIdle() const;
+    bool allowsTearing() const;
     bool isOpaque() const;
 
+    FrameCallbackHoldReason frameCallbackHoldReason() const;
+
 #if QT_CONFIG(im)
     WaylandInputMethodControl *inputMethodControl() const;
 #endif
@@ -148,7 +161,9 @@ Q_SIGNALS:
     void dragStarted(Aurora::Compositor::WaylandDrag *drag);
     void cursorSurfaceChanged();
     void inhibitsIdleChanged();
+    void allowsTearingChanged();
     void isOpaqueChanged();
+    void frameCallbackHoldReasonChanged();
 
     void configure(bool hasBuffer);
     void redraw();
@@ -38,6 +38,7 @@
 #include <LiriAuroraCompositor/private/aurora-server-wayland.h>
 #include <LiriAuroraCompositor/private/aurorawaylandviewporter_p.h>
 #include <LiriAuroraCompositor/private/aurorawaylandidleinhibitv1_p.h>
+#include <LiriAuroraCompositor/private/aurorawaylandtearingcontrolv1_p.h>
 
 #include <QtCore/qpointer.h>
 
@@ -52,6 +53,18 @@ class WaylandInputMethodControl;
 
 namespace Internal {
 class FrameCallback;
+
+// Intrusive list of frame callbacks, insertion and removal don't allocate
+struct FrameCallbackList
+{
+    FrameCallback *first = nullptr;
+    FrameCallback *last = nullptr;
+
+    bool isEmpty() const { return !first; }
+    void append(FrameCallback *callback);
+    void remove(FrameCallback *callback);
+    void takeAll(FrameCallbackList &other);
+};
 }
 
 class LIRIAURORACOMPOSITOR_EXPORT WaylandSurfacePrivate : public QObjectPrivate, public PrivateServer::wl_surface
@@ -72,8 +85,19 @@ public:
 
     void removeFrameCallback(Internal::FrameCallback *callback);
 
+    QRegion toBufferDamage(const QRegion &surfaceDamage) const;
+    void trackTextureDamage(Internal::ClientBuffer *buffer);
+    void uploadCompleted(quint64 id);
+
+    void cacheState();
+    void applyState(State &state);
+    void applyChildrenState();
+
     void notifyViewsAboutDestruction();
 
+    void setFrameCallbackHoldReason(WaylandSurface::FrameCallbackHoldReason reason);
+    void sendFrameCallbacks(uint time);
+
 #ifndef QT_NO_DEBUG
     static void addUninitializedSurface(WaylandSurfacePrivate *surface);
     static void removeUninitializedSurface(WaylandSurfacePrivate *surface);
@@ -115,7 +139,7 @@ public: //member variables
     WaylandSurfaceRole *role = nullptr;
     WaylandViewporterPrivate::Viewport *viewport = nullptr;
 
-    struct {
+    struct State {
         WaylandBufferRef buffer;
         QRegion surfaceDamage;
         QRegion bufferDamage;
@@ -126,17 +150,50 @@ public: //member variables
         QRectF sourceGeometry;
         QSize destinationSize;
         QRegion opaqueRegion;
-    } pending;
+        bool allowsTearing = false;
+        Internal::FrameCallbackList frameCallbacks;
+
+        void clearPerCommitState()
+        {
+            buffer = WaylandBufferRef();
+            offset = QPoint();
+            newlyAttached = false;
+            bufferDamage = QRegion();
+            surfaceDamage = QRegion();
+        }
+    };
+    State pending;
+
+    // State committed by a synchronized subsurface, applied when the parent commits
+    State cached;
+    bool hasCachedState = false;
 
     QPoint lastLocalMousePos;
     QPoint lastGlobalMousePos;
 
-    QList<Internal::FrameCallback *> pendingFrameCallbacks;
-    QList<Internal::FrameCallback *> frameCallbacks;
+    // Buffer damage of the most recent commits, used to know what is stale
+    // in the texture of a buffer that comes back from the client's swapchain
+    struct CommitDamage {
+        quint64 serial = 0;
+        QRegion damage;
+    };
+    QList<CommitDamage> commitDamageHistory;
+
+    // Commits waiting for asynchronous shm uploads before views are notified
+    struct PendingUpload {
+        quint64 id = 0;
+        WaylandBufferRef buffer;
+        QRegion damage;
+        bool done = false;
+    };
+    QList<PendingUpload> pendingUploads;
+
+    Internal::FrameCallbackList frameCallbacks;
 
     QList<QPointer<WaylandSurface>> subsurfaceChildren;
 
     QList<WaylandIdleInhibitManagerV1Private::Inhibitor *> idleInhibitors;
+    WaylandTearingControlManagerV1Private::TearingControl *tearingControl = nullptr;
 
     QRegion inputRegion;
     QRegion opaqueRegion;
@@ -150,6 +207,10 @@ public: //member variables
     bool hasContent = false;
     bool isInitialized = false;
     bool isOpaque = false;
+    bool allowsTearing = false;
+    WaylandSurface::FrameCallbackHoldReason frameCallbackHoldReason = WaylandSurface::FrameCallbackNotHeld;
+    // Compositor time of the last frame callbacks sent, used to throttle held surfaces
+    uint lastFrameCallbackTime = 0;
     Qt::ScreenOrientation contentOrientation = Qt::PrimaryOrientation;
     QWindow::Visibility visibility;
 #if QT_CONFIG(im)
@@ -168,12 +229,22 @@ public: //member variables
         void subsurface_place_below(wl_subsurface::Resource *resource, struct wl_resource *sibling) override;
         void subsurface_set_sync(wl_subsurface::Resource *resource) override;
         void subsurface_set_desync(wl_subsurface::Resource *resource) override;
+        void subsurface_destroy(wl_subsurface::Resource *resource) override;
+        void subsurface_destroy_resource(wl_subsurface::Resource *resource) override;
 
     private:
         friend class WaylandSurfacePrivate;
+
+        bool isSynchronized() const;
+        void applyPosition();
+
         WaylandSurfacePrivate *surface = nullptr;
         WaylandSurfacePrivate *parentSurface = nullptr;
         QPoint position;
+        QPoint pendingPosition;
+        bool hasPendingPosition = false;
+        // Subsurfaces are created in synchronized mode
+        bool synchronized = true;
     };
 
     Subsurface *subsurface = nullptr;
@@ -192,7 +192,8 @@ void WaylandView::bufferCommitted(const WaylandBufferRef &buffer, const QRegion
     Q_D(WaylandView);
     QMutexLocker locker(&d->bufferMutex);
     d->nextBuffer = buffer;
-    d->nextDamage = damage;
+    // Commits that were not consumed by advance() yet still count as damage
+    d->nextDamage = d->nextBufferCommitted ? d->nextDamage.united(damage) : damage;
     d->nextBufferCommitted = true;
 }
 
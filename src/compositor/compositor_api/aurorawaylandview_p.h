@@ -10,6 +10,7 @@
 #include <QtCore/private/qobject_p.h>
 
 #include <LiriAuroraCompositor/WaylandBufferRef>
+#include <LiriAuroraCompositor/WaylandSurface>
 
 //
 //  W A R N I N G
@@ -57,6 +58,8 @@ public:
     bool forceAdvanceSucceed = false;
     bool allowDiscardFrontBuffer = false;
     bool independentFrameCallback = false; //If frame callbacks are independent of the main quick scene graph
+    // Whether the last frame of the output presented this view, see WaylandOutput::frameCallbackThrottling
+    WaylandSurface::FrameCallbackHoldReason frameCallbackHoldReason = WaylandSurface::FrameCallbackNotHeld;
 };
 
 } // namespace Compositor
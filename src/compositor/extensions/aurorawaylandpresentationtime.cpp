@@ -5,10 +5,16 @@
 #include "aurorawaylandpresentationtime_p_p.h"
 
 #include <time.h>
+#include <QGuiApplication>
 #include <QQuickWindow>
+#include <QScreen>
 #include <LiriAuroraCompositor/WaylandView>
 #include <LiriAuroraCompositor/WaylandQuickItem>
 
+#if LIRI_FEATURE_aurora_qpa
+#include <LiriAuroraPlatformHeaders/lirieglfsfunctions.h>
+#endif
+
 namespace Aurora {
 
 namespace Compositor {
@@ -31,8 +37,9 @@ namespace Compositor {
  * an instance of the PresentationTime component and add it to the list of extensions
  * supported by the compositor:
  *
- * Then, call sendFeedback() when a surface is presented on screen.
- * Usually, the timing can be obtained from drm page flip event.
+ * On the eglfs_kms platform feedback is sent automatically with the time of
+ * the page flip that shows the surface. On other platforms, call sendFeedback()
+ * when a surface is presented on screen.
  *
  * \qml
  * import Aurora.Compositor.PresentationTime
@@ -98,6 +105,58 @@ void WaylandPresentationTime::initialize()
     WaylandCompositorExtensionTemplate::initialize();
 
     d->init(compositor->display(), /* version */ 1);
+
+    const auto screens = QGuiApplication::screens();
+    for (QScreen *screen : screens)
+        watchScreen(screen);
+    connect(qGuiApp, &QGuiApplication::screenAdded, this, &WaylandPresentationTime::watchScreen);
+}
+
+void WaylandPresentationTime::watchScreen(QScreen *screen)
+{
+    Q_D(WaylandPresentationTime);
+
+    // Page flips of the screen are reported with events
+    screen->installEventFilter(this);
+
+    // Frames that were not shown yet will never be
+    connect(screen, &QObject::destroyed, this, [d, screen] {
+        const auto feedback = d->pendingFeedback.value(screen);
+        for (PresentationFeedback *f : feedback)
+            f->discard();
+        d->pendingFeedback.remove(screen);
+    });
+}
+
+/*!
+ * \internal
+ */
+bool WaylandPresentationTime::eventFilter(QObject *watched, QEvent *event)
+{
+#if LIRI_FEATURE_aurora_qpa
+    if (event->type() == PlatformSupport::PresentationEvent::registeredType()) {
+        Q_D(WaylandPresentationTime);
+
+        auto *e = static_cast<PlatformSupport::PresentationEvent *>(event);
+
+        uint32_t flags = PrivateServer::wp_presentation_feedback::kind_hw_clock
+                | PrivateServer::wp_presentation_feedback::kind_hw_completion;
+        if (!e->tearing)
+            flags |= PrivateServer::wp_presentation_feedback::kind_vsync;
+
+        const auto feedback = d->pendingFeedback.value(static_cast<QScreen *>(watched));
+        for (PresentationFeedback *f : feedback) {
+            // Commits synchronized into later frames wait for their flip
+            if (f->m_frame <= e->frame)
+                f->sendPresented(e->sequence, e->tv_sec, e->tv_nsec, e->refreshNsec, flags);
+        }
+
+        // Outputs release the buffers the flip took off screen
+        return false;
+    }
+#endif
+
+    return WaylandCompositorExtensionTemplate::eventFilter(watched, event);
 }
 
 WaylandCompositor *WaylandPresentationTime::compositor() const
@@ -112,6 +171,8 @@ WaylandCompositor *WaylandPresentationTime::compositor() const
  * If your platform supports DRM events, \c page_flip_handler is the proper timing to send it.
  * The \a sequence is the refresh counter. \a sec and \a nsec hold the
  * seconds and nanoseconds parts of the presentation timestamp, respectively.
+ *
+ * This is not needed on the eglfs_kms platform, which sends feedback on its own.
  */
 
 /*!
@@ -119,15 +180,29 @@ WaylandCompositor *WaylandPresentationTime::compositor() const
  * If your platform supports DRM events, \c page_flip_handler is the proper timing to send it.
  * The \a sequence is the refresh counter. \a tv_sec and \a tv_nsec hold the
  * seconds and nanoseconds parts of the presentation timestamp, respectively.
+ *
+ * Only surfaces shown on the screen of \a window receive the feedback.
+ * This is not needed on the eglfs_kms platform, which sends feedback on its own.
  */
 void WaylandPresentationTime::sendFeedback(QQuickWindow *window, quint64 sequence, quint64 tv_sec, quint32 tv_nsec)
 {
-    if (!window)
-        return;
+    Q_D(WaylandPresentationTime);
 
-    quint32 refresh_nsec = window->screen()->refreshRate() != 0 ? 1000000000 / window->screen()->refreshRate() : 0;
+    if (!window || !window->screen())
+        return;
 
-    emit presented(sequence, tv_sec, tv_nsec, refresh_nsec);
+    QScreen *screen = window->screen();
+    quint32 refresh_nsec = screen->refreshRate() != 0 ? 1000000000 / screen->refreshRate() : 0;
+
+    const auto feedback = d->pendingFeedback.value(screen);
+    for (PresentationFeedback *f : feedback) {
+        if (f->m_swapped) {
+            f->sendPresented(sequence, tv_sec, tv_nsec, refresh_nsec,
+                             PrivateServer::wp_presentation_feedback::kind_vsync
+                             | PrivateServer::wp_presentation_feedback::kind_hw_clock
+                             | PrivateServer::wp_presentation_feedback::kind_hw_completion);
+        }
+    }
 }
 
 /*!
@@ -153,6 +228,12 @@ PresentationFeedback::PresentationFeedback(WaylandPresentationTime *pTime, Wayla
     setSurface(surface);
 }
 
+PresentationFeedback::~PresentationFeedback()
+{
+    if (m_sync && m_presentationTime)
+        WaylandPresentationTimePrivate::get(m_presentationTime)->removePending(this);
+}
+
 void PresentationFeedback::setSurface(WaylandSurface *qwls)
 {
     if (!qwls) {
@@ -245,18 +326,32 @@ void PresentationFeedback::connectToWindow(QQuickWindow *window)
 
     m_connectedWindow = window;
 
-    connect(window, &QQuickWindow::beforeSynchronizing, this, &PresentationFeedback::onSync);
+    // The GUI thread is blocked while the render thread synchronizes
+    connect(window, &QQuickWindow::beforeSynchronizing, this, &PresentationFeedback::onSync, Qt::DirectConnection);
     connect(window, &QQuickWindow::afterFrameEnd, this, &PresentationFeedback::onSwapped);
 }
 
 void PresentationFeedback::onSync()
 {
-    QQuickWindow *window = qobject_cast<QQuickWindow *>(sender());
+    QQuickWindow *window = m_connectedWindow;
 
-    if (m_committed) {
+    if (m_committed && window) {
         disconnect(m_surface, &WaylandSurface::damaged, this, &PresentationFeedback::onSurfaceCommit);
         disconnect(window, &QQuickWindow::beforeSynchronizing, this, &PresentationFeedback::onSync);
         m_sync = true;
+
+        // The frame being synchronized is the next one rendered on this screen
+        m_screen = window->screen();
+#if LIRI_FEATURE_aurora_qpa
+        m_frame = PlatformSupport::EglFSFunctions::getFrameTiming(m_screen).renderedFrames + 1;
+#endif
+
+        // Pending feedback belongs to the GUI thread, the call runs
+        // before the presentation event of the frame is delivered
+        QMetaObject::invokeMethod(this, [this] {
+            if (m_presentationTime)
+                WaylandPresentationTimePrivate::get(m_presentationTime)->addPending(this);
+        }, Qt::QueuedConnection);
     }
 }
 
@@ -266,7 +361,7 @@ void PresentationFeedback::onSwapped()
 
     if (m_sync) {
         disconnect(window, &QQuickWindow::afterFrameEnd, this, &PresentationFeedback::onSwapped);
-        connect(m_presentationTime, &WaylandPresentationTime::presented, this, &PresentationFeedback::sendPresented);
+        m_swapped = true;
     }
 }
 
@@ -292,14 +387,11 @@ void PresentationFeedback::sendSyncOutput()
         send_sync_output(r);
 }
 
-void PresentationFeedback::sendPresented(quint64 sequence, quint64 tv_sec, quint32 tv_nsec, quint32 refresh_nsec)
+void PresentationFeedback::sendPresented(quint64 sequence, quint64 tv_sec, quint32 tv_nsec, quint32 refresh_nsec, uint32_t flags)
 {
     sendSyncOutput();
 
-    send_presented(tv_sec >> 32, tv_sec, tv_nsec, refresh_nsec, sequence >> 32, sequence,
-            PrivateServer::wp_presentation_feedback::kind_vsync
-            | PrivateServer::wp_presentation_feedback::kind_hw_clock
-            | PrivateServer::wp_presentation_feedback::kind_hw_completion);
+    send_presented(tv_sec >> 32, tv_sec, tv_nsec, refresh_nsec, sequence >> 32, sequence, flags);
 
     destroy();
 }
@@ -319,6 +411,22 @@ WaylandPresentationTimePrivate::WaylandPresentationTimePrivate()
 {
 }
 
+void WaylandPresentationTimePrivate::addPending(PresentationFeedback *feedback)
+{
+    pendingFeedback[feedback->m_screen].append(feedback);
+}
+
+void WaylandPresentationTimePrivate::removePending(PresentationFeedback *feedback)
+{
+    auto it = pendingFeedback.find(feedback->m_screen);
+    if (it == pendingFeedback.end())
+        return;
+
+    it->removeOne(feedback);
+    if (it->isEmpty())
+        pendingFeedback.erase(it);
+}
+
 void WaylandPresentationTimePrivate::wp_presentation_bind_resource(Resource *resource)
 {
     send_clock_id(resource->handle, CLOCK_MONOTONIC);
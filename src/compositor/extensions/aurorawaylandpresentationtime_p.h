@@ -19,6 +19,7 @@
 #include <QtCore/private/qglobal_p.h>
 
 class QQuickWindow;
+class QScreen;
 
 namespace Aurora {
 
@@ -42,8 +43,11 @@ public:
     static const struct wl_interface *interface();
     static QByteArray interfaceName();
 
-Q_SIGNALS:
-    void presented(quint64 sequence, quint64 tv_sec, quint32 tv_nsec, quint32 refresh_nsec);
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+    void watchScreen(QScreen *screen);
 };
 
 } // namespace Compositor
@@ -19,9 +19,10 @@
 
 #include <QObject>
 #include <QPointer>
-#include <QMultiMap>
+#include <QHash>
 
 class QQuickWindow;
+class QScreen;
 
 namespace Aurora {
 
@@ -36,36 +37,42 @@ class PresentationFeedback : public QObject, public PrivateServer::wp_presentati
     Q_OBJECT
 public:
     PresentationFeedback(WaylandPresentationTime *, WaylandSurface *, struct ::wl_client *, uint32_t, int);
+    ~PresentationFeedback();
 
     void setSurface(WaylandSurface *);
     WaylandSurface *surface() { return m_surface; }
 
     void destroy();
+    void discard();
     void sendSyncOutput();
+    void sendPresented(quint64 sequence, quint64 tv_sec, quint32 tv_nsec, quint32 refresh_nsec, uint32_t flags);
 
 private Q_SLOTS:
-    void discard();
     void onSurfaceCommit();
     void onSurfaceMapped();
     void onWindowChanged();
     void onSync();
     void onSwapped();
-    void sendPresented(quint64 sequence, quint64 tv_sec, quint32 tv_nsec, quint32 refresh_nsec);
 
 private:
-    WaylandPresentationTime *presentationTime() { return m_presentationTime; }
+    WaylandPresentationTime *presentationTime() { return m_presentationTime.data(); }
     void maybeConnectToWindow(WaylandView *);
     void connectToWindow(QQuickWindow *);
 
     void wp_presentation_feedback_destroy_resource(Resource *resource) override;
 
 public:
-    WaylandPresentationTime *m_presentationTime = nullptr;
+    QPointer<WaylandPresentationTime> m_presentationTime;
     WaylandSurface *m_surface = nullptr;
     QQuickWindow *m_connectedWindow = nullptr;
 
     bool m_committed = false;
     bool m_sync = false;
+    bool m_swapped = false;
+
+    // Screen and number of the frame that shows the commit
+    QScreen *m_screen = nullptr;
+    quint64 m_frame = 0;
 };
 
 class WaylandPresentationTimePrivate : public WaylandCompositorExtensionPrivate, public PrivateServer::wp_presentation
@@ -74,6 +81,14 @@ class WaylandPresentationTimePrivate : public WaylandCompositorExtensionPrivate,
 public:
     WaylandPresentationTimePrivate();
 
+    static WaylandPresentationTimePrivate *get(WaylandPresentationTime *presentationTime) { return presentationTime->d_func(); }
+
+    void addPending(PresentationFeedback *feedback);
+    void removePending(PresentationFeedback *feedback);
+
+    // Feedback synchronized into a frame of each screen, not presented yet
+    QHash<QScreen *, QList<PresentationFeedback *>> pendingFeedback;
+
 protected:
     void wp_presentation_feedback(Resource *resource, struct ::wl_resource *surface, uint32_t callback) override;
     void wp_presentation_bind_resource(Resource *resource) override;
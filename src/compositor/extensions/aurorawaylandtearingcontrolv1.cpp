@@ -0,0 +1,175 @@
+// SPDX-FileCopyrightText: 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <LiriAuroraCompositor/WaylandCompositor>
+#include <LiriAuroraCompositor/private/aurorawaylandsurface_p.h>
+
+#include "aurorawaylandtearingcontrolv1_p.h"
+
+namespace Aurora {
+
+namespace Compositor {
+
+/*!
+    \class WaylandTearingControlManagerV1
+    \inmodule AuroraCompositor
+    \brief Provides an extension that allows clients to accept tearing for lower latency.
+    \sa WaylandSurface::allowsTearing, WaylandOutput::allowTearing
+
+    The WaylandTearingControlV1 extension provides a way for a client to tell the compositor
+    that the content of a surface may be presented as soon as possible, even if it tears,
+    which is what games and drawing applications usually want.
+
+    WaylandTearingControlManagerV1 corresponds to the Wayland interface, \c wp_tearing_control_manager_v1.
+
+    Surfaces of such clients have the WaylandSurface::allowsTearing property set to \c true.
+*/
+
+/*!
+    \qmltype TearingControlManagerV1
+    \instantiates WaylandTearingControlManagerV1
+    \inqmlmodule Aurora.Compositor
+    \brief Provides an extension that allows clients to accept tearing for lower latency.
+    \sa WaylandSurface::allowsTearing, WaylandOutput::allowTearing
+
+    The TearingControlManagerV1 extension provides a way for a client to tell the compositor
+    that the content of a surface may be presented as soon as possible, even if it tears,
+    which is what games and drawing applications usually want.
+
+    TearingControlManagerV1 corresponds to the Wayland interface, \c wp_tearing_control_manager_v1.
+
+    To provide the functionality of the extension in a compositor, create an instance of the
+    TearingControlManagerV1 component and add it to the list of extensions supported by the compositor:
+
+    \qml
+    import Aurora.Compositor
+
+    WaylandCompositor {
+        TearingControlManagerV1 {
+            // ...
+        }
+    }
+    \endqml
+
+    Surfaces of such clients have the WaylandSurface::allowsTearing property set to \c true.
+    They are only presented with tearing when shown fullscreen on an output that
+    allows it.
+*/
+
+/*!
+    Constructs a WaylandTearingControlManagerV1 object.
+*/
+WaylandTearingControlManagerV1::WaylandTearingControlManagerV1()
+    : WaylandCompositorExtensionTemplate<WaylandTearingControlManagerV1>(*new WaylandTearingControlManagerV1Private())
+{
+}
+
+/*!
+    Constructs a WaylandTearingControlManagerV1 object for the provided \a compositor.
+*/
+WaylandTearingControlManagerV1::WaylandTearingControlManagerV1(WaylandCompositor *compositor)
+    : WaylandCompositorExtensionTemplate<WaylandTearingControlManagerV1>(compositor, *new WaylandTearingControlManagerV1Private())
+{
+}
+
+/*!
+    Destructs a WaylandTearingControlManagerV1 object.
+*/
+WaylandTearingControlManagerV1::~WaylandTearingControlManagerV1() = default;
+
+/*!
+    Initializes the extension.
+*/
+void WaylandTearingControlManagerV1::initialize()
+{
+    Q_D(WaylandTearingControlManagerV1);
+
+    WaylandCompositorExtensionTemplate::initialize();
+    WaylandCompositor *compositor = static_cast<WaylandCompositor *>(extensionContainer());
+    if (!compositor) {
+        qCWarning(gLcAuroraCompositor) << "Failed to find WaylandCompositor when initializing WaylandTearingControlManagerV1";
+        return;
+    }
+    d->init(compositor->display(), d->interfaceVersion());
+}
+
+/*!
+    Returns the Wayland interface for the WaylandTearingControlManagerV1.
+*/
+const wl_interface *WaylandTearingControlManagerV1::interface()
+{
+    return WaylandTearingControlManagerV1Private::interface();
+}
+
+
+void WaylandTearingControlManagerV1Private::wp_tearing_control_manager_v1_destroy(Resource *resource)
+{
+    wl_resource_destroy(resource->handle);
+}
+
+void WaylandTearingControlManagerV1Private::wp_tearing_control_manager_v1_get_tearing_control(Resource *resource, uint32_t id, wl_resource *surfaceResource)
+{
+    auto *surface = WaylandSurface::fromResource(surfaceResource);
+    if (!surface) {
+        qCWarning(gLcAuroraCompositor) << "Couldn't find surface requested for tearing control";
+        wl_resource_post_error(resource->handle, WL_DISPLAY_ERROR_INVALID_OBJECT,
+                               "invalid wl_surface@%d", wl_resource_get_id(surfaceResource));
+        return;
+    }
+
+    auto *surfacePrivate = WaylandSurfacePrivate::get(surface);
+    if (surfacePrivate->tearingControl) {
+        wl_resource_post_error(resource->handle, error_tearing_control_exists,
+                               "wl_surface@%d already has a tearing control object",
+                               wl_resource_get_id(surfaceResource));
+        return;
+    }
+
+    surfacePrivate->tearingControl = new TearingControl(surface, resource->client(), id, resource->version());
+}
+
+
+WaylandTearingControlManagerV1Private::TearingControl::TearingControl(WaylandSurface *surface,
+                                                                      wl_client *client,
+                                                                      quint32 id, quint32 version)
+    : PrivateServer::wp_tearing_control_v1(client, id, qMin<quint32>(version, interfaceVersion()))
+    , m_surface(surface)
+{
+    Q_ASSERT(surface);
+}
+
+WaylandTearingControlManagerV1Private::TearingControl::~TearingControl()
+{
+    // Back to vsync with the next commit
+    if (m_surface) {
+        auto *surfacePrivate = WaylandSurfacePrivate::get(m_surface.data());
+        surfacePrivate->pending.allowsTearing = false;
+        surfacePrivate->tearingControl = nullptr;
+    }
+}
+
+void WaylandTearingControlManagerV1Private::TearingControl::wp_tearing_control_v1_destroy_resource(Resource *resource)
+{
+    Q_UNUSED(resource);
+    delete this;
+}
+
+void WaylandTearingControlManagerV1Private::TearingControl::wp_tearing_control_v1_set_presentation_hint(Resource *resource, uint32_t hint)
+{
+    Q_UNUSED(resource);
+
+    // Inert once the surface is gone
+    if (m_surface)
+        WaylandSurfacePrivate::get(m_surface.data())->pending.allowsTearing = hint == presentation_hint_async;
+}
+
+void WaylandTearingControlManagerV1Private::TearingControl::wp_tearing_control_v1_destroy(Resource *resource)
+{
+    wl_resource_destroy(resource->handle);
+}
+
+} // namespace Compositor
+
+} // namespace Aurora
+
+#include "moc_aurorawaylandtearingcontrolv1.cpp"
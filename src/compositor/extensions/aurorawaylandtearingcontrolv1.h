@@ -0,0 +1,30 @@
+// SPDX-FileCopyrightText: 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <LiriAuroraCompositor/WaylandCompositorExtension>
+
+namespace Aurora {
+
+namespace Compositor {
+
+class WaylandTearingControlManagerV1Private;
+
+class LIRIAURORACOMPOSITOR_EXPORT WaylandTearingControlManagerV1 : public WaylandCompositorExtensionTemplate<WaylandTearingControlManagerV1>
+{
+    Q_OBJECT
+    Q_DECLARE_PRIVATE(WaylandTearingControlManagerV1)
+public:
+    WaylandTearingControlManagerV1();
+    explicit WaylandTearingControlManagerV1(WaylandCompositor *compositor);
+    ~WaylandTearingControlManagerV1();
+
+    void initialize() override;
+
+    static const struct wl_interface *interface();
+};
+
+} // namespace Compositor
+
+} // namespace Aurora
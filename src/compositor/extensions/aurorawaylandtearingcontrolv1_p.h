@@ -0,0 +1,61 @@
+// SPDX-FileCopyrightText: 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <LiriAuroraCompositor/WaylandSurface>
+#include <LiriAuroraCompositor/WaylandTearingControlManagerV1>
+#include <LiriAuroraCompositor/private/aurorawaylandcompositorextension_p.h>
+#include <LiriAuroraCompositor/private/aurora-server-tearing-control-v1.h>
+
+#include <QtCore/qpointer.h>
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Aurora API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+namespace Aurora {
+
+namespace Compositor {
+
+class LIRIAURORACOMPOSITOR_EXPORT WaylandTearingControlManagerV1Private
+        : public WaylandCompositorExtensionPrivate
+        , public PrivateServer::wp_tearing_control_manager_v1
+{
+    Q_DECLARE_PUBLIC(WaylandTearingControlManagerV1)
+public:
+    explicit WaylandTearingControlManagerV1Private() = default;
+
+    class LIRIAURORACOMPOSITOR_EXPORT TearingControl
+            : public PrivateServer::wp_tearing_control_v1
+    {
+    public:
+        explicit TearingControl(WaylandSurface *surface, wl_client *client, quint32 id, quint32 version);
+        ~TearingControl();
+
+    protected:
+        void wp_tearing_control_v1_destroy_resource(Resource *resource) override;
+        void wp_tearing_control_v1_set_presentation_hint(Resource *resource, uint32_t hint) override;
+        void wp_tearing_control_v1_destroy(Resource *resource) override;
+
+    private:
+        QPointer<WaylandSurface> m_surface;
+    };
+
+    static WaylandTearingControlManagerV1Private *get(WaylandTearingControlManagerV1 *manager) { return manager ? manager->d_func() : nullptr; }
+
+protected:
+    void wp_tearing_control_manager_v1_destroy(Resource *resource) override;
+    void wp_tearing_control_manager_v1_get_tearing_control(Resource *resource, uint32_t id, wl_resource *surfaceResource) override;
+};
+
+} // namespace Compositor
+
+} // namespace Aurora
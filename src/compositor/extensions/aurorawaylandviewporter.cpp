@@ -106,8 +106,10 @@ WaylandViewporterPrivate::Viewport::~Viewport()
 
 // This function has to be called immediately after a surface is committed, before no
 // other client events have been dispatched, or we may incorrectly error out on an
-// incomplete pending state. See comment below.
-void WaylandViewporterPrivate::Viewport::checkCommittedState()
+// incomplete pending state. See comment below. \a bufferSize and \a bufferScale are
+// those of the buffer the state is applied with, which for a subsurface caching its
+// state is not the current one yet.
+void WaylandViewporterPrivate::Viewport::checkCommittedState(const QSize &bufferSize, int bufferScale)
 {
     auto *surfacePrivate = WaylandSurfacePrivate::get(m_surface);
 
@@ -125,8 +127,8 @@ void WaylandViewporterPrivate::Viewport::checkCommittedState()
         return;
     }
 
-    if (m_surface->bufferSize().isValid()) {
-        QRectF max = QRectF(QPointF(), m_surface->bufferSize() / m_surface->bufferScale());
+    if (bufferSize.isValid()) {
+        QRectF max = QRectF(QPointF(), bufferSize / bufferScale);
         // We can't use QRectF.contains, because that would return false for values on the border
         if (max.united(source) != max) {
             wl_resource_post_error(resource()->handle, error_out_of_buffer,
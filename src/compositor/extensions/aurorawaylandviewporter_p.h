@@ -41,7 +41,7 @@ public:
     public:
         explicit Viewport(WaylandSurface *surface, wl_client *client, int id);
         ~Viewport() override;
-        void checkCommittedState();
+        void checkCommittedState(const QSize &bufferSize, int bufferScale);
 
     protected:
         void wp_viewport_destroy_resource(Resource *resource) override;
@@ -6,11 +6,19 @@
 #include "aurorawaylandoutput.h"
 #include "aurorawaylandwlrexportdmabufv1_p.h"
 
+#include <QGuiApplication>
+#include <QScreen>
+#include <QWindow>
+
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <wayland-server-protocol.h>
 
+#if LIRI_FEATURE_aurora_qpa
+#include <LiriAuroraPlatformHeaders/lirieglfsfunctions.h>
+#endif
+
 namespace Aurora {
 
 namespace Compositor {
@@ -40,6 +48,19 @@ void WaylandWlrExportDmabufManagerV1::initialize()
         return;
     }
     d->init(compositor->display(), WaylandWlrExportDmabufManagerV1Private::interfaceVersion());
+
+#if LIRI_FEATURE_aurora_qpa
+    // Export what the platform scans out when it can, otherwise
+    // frames are left to outputCaptureRequested() handlers
+    if (QGuiApplication::platformFunction(PlatformSupport::EglFSFunctions::isScreenCastSupportedIdentifier())) {
+        d->screenCastFilter = new WaylandWlrExportDmabufScreenCastFilter(d, this);
+        const auto screens = QGuiApplication::screens();
+        for (QScreen *screen : screens)
+            d->screenCastFilter->watchScreen(screen);
+        connect(qGuiApp, &QGuiApplication::screenAdded,
+                d->screenCastFilter, &WaylandWlrExportDmabufScreenCastFilter::watchScreen);
+    }
+#endif
 }
 
 const wl_interface *WaylandWlrExportDmabufManagerV1::interface()
@@ -77,7 +98,23 @@ void WaylandWlrExportDmabufManagerV1Private::zwlr_export_dmabuf_manager_v1_captu
     }
 
     auto *frame = new WaylandWlrExportDmabufFrameV1(q, overlay_cursor == 1, output, q);
-    WaylandWlrExportDmabufFrameV1Private::get(frame)->init(resource->client(), id, resource->version());
+    auto *framePrivate = WaylandWlrExportDmabufFrameV1Private::get(frame);
+    framePrivate->init(resource->client(), id, resource->version());
+
+    // The buffer of the next page flip is exported as is, the cursor
+    // plane is not part of it
+#if LIRI_FEATURE_aurora_qpa
+    QScreen *screen = output->window() ? output->window()->screen() : nullptr;
+    if (screenCastFilter && screen && PlatformSupport::EglFSFunctions::isScreenCastSupported(screen)) {
+        framePrivate->screen = screen;
+        screenCastFrames.append(frame);
+        PlatformSupport::EglFSFunctions::enableScreenCast(screen);
+        // An idle output doesn't flip, render a frame to export
+        output->update();
+        return;
+    }
+#endif
+
     Q_EMIT q->outputCaptureRequested(frame);
 }
 
@@ -88,7 +125,7 @@ void WaylandWlrExportDmabufManagerV1Private::zwlr_export_dmabuf_manager_v1_captu
 WaylandWlrExportDmabufFrameV1::WaylandWlrExportDmabufFrameV1(WaylandWlrExportDmabufManagerV1 *manager,
                                                              bool overlayCursor, WaylandOutput *output,
                                                              QObject *parent)
-    : QObject(*new WaylandWlrExportDmabufFrameV1Private)
+    : QObject(*new WaylandWlrExportDmabufFrameV1Private, parent)
 {
     Q_D(WaylandWlrExportDmabufFrameV1);
     d->manager = manager;
@@ -163,7 +200,8 @@ WaylandWlrExportDmabufFrameV1Private::WaylandWlrExportDmabufFrameV1Private()
 void WaylandWlrExportDmabufFrameV1Private::zwlr_export_dmabuf_frame_v1_destroy_resource(Resource *resource)
 {
     Q_UNUSED(resource)
-    delete this;
+    Q_Q(WaylandWlrExportDmabufFrameV1);
+    q->deleteLater();
 }
 
 void WaylandWlrExportDmabufFrameV1Private::zwlr_export_dmabuf_frame_v1_destroy(Resource *resource)
@@ -171,6 +209,109 @@ void WaylandWlrExportDmabufFrameV1Private::zwlr_export_dmabuf_frame_v1_destroy(R
     wl_resource_destroy(resource->handle);
 }
 
+/*
+ * WaylandWlrExportDmabufScreenCastFilter
+ */
+
+WaylandWlrExportDmabufScreenCastFilter::WaylandWlrExportDmabufScreenCastFilter(WaylandWlrExportDmabufManagerV1Private *manager,
+                                                                             QObject *parent)
+    : QObject(parent)
+    , m_manager(manager)
+{
+}
+
+void WaylandWlrExportDmabufScreenCastFilter::watchScreen(QScreen *screen)
+{
+    // Exported buffers of the screen are reported with events
+    screen->installEventFilter(this);
+
+    // Frames of a screen that went away will never come
+    connect(screen, &QObject::destroyed, this, [this, screen] {
+        for (auto it = m_manager->screenCastFrames.begin(); it != m_manager->screenCastFrames.end();) {
+            auto *framePrivate = *it ? WaylandWlrExportDmabufFrameV1Private::get(*it) : nullptr;
+            if (!framePrivate || framePrivate->screen == screen) {
+                if (framePrivate && framePrivate->resource())
+                    framePrivate->send_cancel(WaylandWlrExportDmabufFrameV1::Permanent);
+                it = m_manager->screenCastFrames.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    });
+}
+
+bool WaylandWlrExportDmabufScreenCastFilter::eventFilter(QObject *watched, QEvent *event)
+{
+#if LIRI_FEATURE_aurora_qpa
+    using namespace PlatformSupport;
+
+    const auto type = event->type();
+    if (type != ScreenCastFrameEvent::registeredType()
+            && type != ScreenCastObjectEvent::registeredType()
+            && type != ScreenCastReadyEvent::registeredType()
+            && type != ScreenCastCancelEvent::registeredType())
+        return QObject::eventFilter(watched, event);
+
+    QScreen *screen = static_cast<QScreen *>(watched);
+    auto &frames = m_manager->screenCastFrames;
+
+    if (type == ScreenCastFrameEvent::registeredType()) {
+        auto *e = static_cast<ScreenCastFrameEvent *>(event);
+        const WaylandWlrExportDmabufFrameV1::FrameFlags flags = WaylandWlrExportDmabufFrameV1::Transient;
+
+        // Frames waiting for a buffer get this one
+        for (auto &frame : frames) {
+            auto *framePrivate = frame ? WaylandWlrExportDmabufFrameV1Private::get(frame) : nullptr;
+            if (!framePrivate || framePrivate->screen != screen || framePrivate->serial != 0)
+                continue;
+
+            framePrivate->serial = e->serial;
+            if (framePrivate->resource())
+                frame->frame(e->size, e->offset, {}, flags, e->drmFormat, e->modifier, e->numObjects);
+        }
+    } else if (type == ScreenCastObjectEvent::registeredType()) {
+        auto *e = static_cast<ScreenCastObjectEvent *>(event);
+
+        for (auto &frame : frames) {
+            auto *framePrivate = frame ? WaylandWlrExportDmabufFrameV1Private::get(frame) : nullptr;
+            if (!framePrivate || framePrivate->serial != e->serial || !framePrivate->resource())
+                continue;
+
+            // The file descriptor is duplicated for the client and closed with the event
+            framePrivate->send_object(e->index, e->fd, e->size, e->offset, e->stride, e->planeIndex);
+        }
+    } else if (type == ScreenCastReadyEvent::registeredType()) {
+        auto *e = static_cast<ScreenCastReadyEvent *>(event);
+
+        for (auto &frame : frames) {
+            auto *framePrivate = frame ? WaylandWlrExportDmabufFrameV1Private::get(frame) : nullptr;
+            if (framePrivate && framePrivate->serial == e->serial && framePrivate->resource())
+                frame->ready(e->tv_sec, e->tv_nsec);
+        }
+    } else {
+        auto *e = static_cast<ScreenCastCancelEvent *>(event);
+
+        // Frames with a buffer that left the screen, or still waiting for
+        // one when the platform can't export anything
+        for (auto it = frames.begin(); it != frames.end();) {
+            auto *framePrivate = *it ? WaylandWlrExportDmabufFrameV1Private::get(*it) : nullptr;
+            if (framePrivate && (framePrivate->serial != e->serial || framePrivate->screen != screen)) {
+                ++it;
+                continue;
+            }
+
+            if (framePrivate && framePrivate->resource())
+                framePrivate->send_cancel(static_cast<uint32_t>(e->reason));
+            it = frames.erase(it);
+        }
+    }
+
+    return true;
+#else
+    return QObject::eventFilter(watched, event);
+#endif
+}
+
 } // namespace Compositor
 
 } // namespace Aurora
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <QLoggingCategory>
+#include <QPointer>
 
 #include <LiriAuroraCompositor/WaylandWlrExportDmabufManagerV1>
 #include <LiriAuroraCompositor/private/aurorawaylandcompositorextension_p.h>
@@ -21,10 +22,14 @@
 // We mean it.
 //
 
+class QScreen;
+
 namespace Aurora {
 
 namespace Compositor {
 
+class WaylandWlrExportDmabufScreenCastFilter;
+
 class LIRIAURORACOMPOSITOR_EXPORT WaylandWlrExportDmabufManagerV1Private
         : public WaylandCompositorExtensionPrivate
         , public PrivateServer::zwlr_export_dmabuf_manager_v1
@@ -33,6 +38,10 @@ class LIRIAURORACOMPOSITOR_EXPORT WaylandWlrExportDmabufManagerV1Private
 public:
     explicit WaylandWlrExportDmabufManagerV1Private();
 
+    // Frames exported by the platform from the buffers it scans out
+    WaylandWlrExportDmabufScreenCastFilter *screenCastFilter = nullptr;
+    QList<QPointer<WaylandWlrExportDmabufFrameV1>> screenCastFrames;
+
 protected:
     void zwlr_export_dmabuf_manager_v1_capture_output(Resource *resource,
                                                       uint32_t id,
@@ -54,11 +63,33 @@ public:
     bool overlayCursor = false;
     WaylandOutput *output = nullptr;
 
+    // Screen the frame is exported from and serial of the exported buffer,
+    // zero while waiting for the next page flip
+    QScreen *screen = nullptr;
+    quint64 serial = 0;
+
 protected:
     void zwlr_export_dmabuf_frame_v1_destroy_resource(Resource *resource) override;
     void zwlr_export_dmabuf_frame_v1_destroy(Resource *resource) override;
 };
 
+class LIRIAURORACOMPOSITOR_EXPORT WaylandWlrExportDmabufScreenCastFilter
+        : public QObject
+{
+    Q_OBJECT
+public:
+    explicit WaylandWlrExportDmabufScreenCastFilter(WaylandWlrExportDmabufManagerV1Private *manager,
+                                                   QObject *parent = nullptr);
+
+    void watchScreen(QScreen *screen);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+    WaylandWlrExportDmabufManagerV1Private *m_manager = nullptr;
+};
+
 } // namespace Compositor
 
 } // namespace Aurora
@@ -3,17 +3,56 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include <QDateTime>
+#include <QMutexLocker>
 #include <QPainter>
 #include <QQuickItem>
 #include <QQuickItemGrabResult>
 #include <QQuickWindow>
+#include <QRunnable>
+#include <QSGRendererInterface>
+
+#if QT_CONFIG(opengl)
+#include <QOpenGLContext>
+#include <QOpenGLTexture>
+#endif
 
 #include "aurorawaylandcompositor.h"
+#include "aurorawaylandcompositor_p.h"
 #include "aurorawaylandoutput.h"
+#include "aurorawaylandoutput_p.h"
 #include "aurorawaylandwlrscreencopyv1_p.h"
+#include "aurorawlbuffermanager_p.h"
+#include "aurorawlclientbuffer_p.h"
+#include "hardware_integration/aurorawlclientbufferintegration_p.h"
 
 #include <GL/gl.h>
 
+#include <algorithm>
+#include <cstring>
+
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#endif
+#ifndef GL_STREAM_READ
+#define GL_STREAM_READ 0x88E1
+#endif
+#ifndef GL_MAP_READ_BIT
+#define GL_MAP_READ_BIT 0x0001
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#define GL_TIMEOUT_EXPIRED 0x911B
+#endif
+#ifndef GL_PACK_ROW_LENGTH
+#define GL_PACK_ROW_LENGTH 0x0D02
+#endif
+
+// DRM_FORMAT_XRGB8888, what dmabufs for screencopy are expected to be
+static const uint32_t DmabufFormat = 0x34325258;
+// DRM_FORMAT_MOD_INVALID
+static const uint64_t DmabufModifierInvalid = 0x00ffffffffffffffULL;
+
 static inline QImage::Format fromWaylandShmFormat(wl_shm_format format)
 {
     switch (format) {
@@ -54,7 +93,7 @@ bool WaylandWlrScreencopyFrameEventFilter::eventFilter(QObject *watched, QEvent
         auto *exposeEvent = static_cast<QExposeEvent *>(event);
         if (!exposeEvent->region().isEmpty()) {
             frame->output->window()->removeEventFilter(this);
-            frame->damageRect = exposeEvent->region().boundingRect();
+            frame->damage = exposeEvent->region().boundingRect();
             frame->copy(resource, buffer_res);
             return true;
         }
@@ -63,6 +102,365 @@ bool WaylandWlrScreencopyFrameEventFilter::eventFilter(QObject *watched, QEvent
     return QObject::eventFilter(watched, event);
 }
 
+void WaylandWlrScreencopyFrameEventFilter::handleFrameSwapped()
+{
+    // Frames that didn't change the region are not delivered
+    if (!frame->hasDamage())
+        return;
+
+    disconnect(frame->output->window(), nullptr, this, nullptr);
+    frame->copy(resource, buffer_res);
+}
+
+/*
+ * WaylandWlrScreencopyReadback
+ */
+
+#if QT_CONFIG(opengl)
+
+// How long the render thread blocks on a fence when it has nothing else to do
+static const GLuint64 ReadbackFenceTimeout = 100 * 1000 * 1000;
+
+WaylandWlrScreencopyReadback::WaylandWlrScreencopyReadback(QQuickWindow *window)
+    : QObject(window)
+    , m_window(window)
+{
+    connect(window, &QQuickWindow::afterRendering, this, [this] {
+        m_window->beginExternalCommands();
+        retireFences(false);
+        readback();
+        m_window->endExternalCommands();
+    }, Qt::DirectConnection);
+    connect(window, &QQuickWindow::sceneGraphInvalidated,
+            this, &WaylandWlrScreencopyReadback::releaseResources, Qt::DirectConnection);
+}
+
+/*
+ * Returns whether frames of \a window can be read back asynchronously,
+ * which takes pixel buffer objects and fences, that is OpenGL ES 3.0 or
+ * OpenGL 3.2.
+ */
+bool WaylandWlrScreencopyReadback::isSupported(QQuickWindow *window)
+{
+    QSGRendererInterface *rif = window->rendererInterface();
+    if (!rif || rif->graphicsApi() != QSGRendererInterface::OpenGL)
+        return false;
+
+    auto *context = static_cast<QOpenGLContext *>(
+                rif->getResource(window, QSGRendererInterface::OpenGLContextResource));
+    if (!context)
+        return false;
+
+    const QSurfaceFormat format = context->format();
+    return context->isOpenGLES()
+            ? format.majorVersion() >= 3
+            : format.version() >= qMakePair(3, 2);
+}
+
+WaylandWlrScreencopyReadback *WaylandWlrScreencopyReadback::get(QQuickWindow *window)
+{
+    auto *readback = window->findChild<WaylandWlrScreencopyReadback *>(QString(), Qt::FindDirectChildrenOnly);
+    if (!readback)
+        readback = new WaylandWlrScreencopyReadback(window);
+    return readback;
+}
+
+/*
+ * Queues a copy of \a rect, in window pixels, from the next frame of the
+ * window into \a image, which is scaled to the size of the image when
+ * they differ.
+ *
+ * \a done is called on this thread with the outcome once the image holds
+ * the pixels, unless \a receiver has been destroyed in the meantime.
+ * Client memory is never written by the render thread: clients may
+ * destroy their buffers at any time, callers copy the image to them.
+ */
+void WaylandWlrScreencopyReadback::queue(const QImage &image, const QRect &rect,
+                                         QObject *receiver, const std::function<void(bool)> &done)
+{
+    Job job;
+    // The render thread writes the image directly, without detaching
+    job.data = const_cast<uchar *>(image.constBits());
+    job.bytesPerLine = image.bytesPerLine();
+    job.rect = rect;
+    job.size = image.size();
+
+    // Keeps the image alive until the render thread is done
+    enqueue(job, { image, WaylandBufferRef(), receiver, done });
+}
+
+/*
+ * Queues a blit of \a rect, in window pixels, from the next frame of the
+ * window to the dmabuf \a buffer, without going through system memory.
+ */
+void WaylandWlrScreencopyReadback::queue(const WaylandBufferRef &buffer, const QRect &rect,
+                                         QObject *receiver, const std::function<void(bool)> &done)
+{
+    Job job;
+    job.target = Internal::ClientBuffer::fromBufferRef(buffer);
+    job.rect = rect;
+    job.size = buffer.size();
+
+    // Keeps the buffer alive until the render thread is done
+    enqueue(job, { QImage(), buffer, receiver, done });
+}
+
+void WaylandWlrScreencopyReadback::enqueue(const Job &job, const PendingJob &pendingJob)
+{
+    const quint64 id = ++m_lastId;
+    m_pending.insert(id, pendingJob);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_jobs.append(job);
+        m_jobs.last().id = id;
+    }
+
+    // The frame that was just rendered is gone, read back the next one
+    m_window->update();
+}
+
+/*
+ * Reads the regions of the queued jobs from the frame that was just
+ * rendered into pixel buffer objects. Runs on the render thread.
+ */
+void WaylandWlrScreencopyReadback::readback()
+{
+    QList<Job> jobs;
+    {
+        QMutexLocker locker(&m_mutex);
+        jobs.swap(m_jobs);
+    }
+    if (jobs.isEmpty())
+        return;
+
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    QOpenGLExtraFunctions *gl = context->extraFunctions();
+    const int windowHeight = qRound(m_window->height() * m_window->effectiveDevicePixelRatio());
+
+    gl->glBindFramebuffer(GL_FRAMEBUFFER, context->defaultFramebufferObject());
+    gl->glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    gl->glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+
+    for (Job &job : jobs) {
+        // The region is outside of the window
+        if (job.rect.isEmpty()) {
+            const quint64 id = job.id;
+            QMetaObject::invokeMethod(this, [this, id] { handleCompleted(id, false); }, Qt::QueuedConnection);
+            continue;
+        }
+
+        const int slotIndex = m_nextSlot;
+        Slot &slot = m_slots[slotIndex];
+        while (slot.fence)
+            retireFences(true);
+
+        if (job.target) {
+            if (!blit(gl, job, windowHeight)) {
+                const quint64 id = job.id;
+                QMetaObject::invokeMethod(this, [this, id] { handleCompleted(id, false); }, Qt::QueuedConnection);
+                continue;
+            }
+            gl->glBindFramebuffer(GL_FRAMEBUFFER, context->defaultFramebufferObject());
+
+            slot.fence = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            slot.job = job;
+
+            m_inFlight.append(slotIndex);
+            m_nextSlot = (m_nextSlot + 1) % SlotCount;
+            continue;
+        }
+
+        if (!slot.pbo)
+            gl->glGenBuffers(1, &slot.pbo);
+
+        const qint64 size = qint64(job.rect.width()) * job.rect.height() * 4;
+        gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        if (slot.size < size) {
+            gl->glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+            slot.size = size;
+        }
+
+        // The framebuffer is bottom-up, GL_RGBA bytes are what ABGR8888
+        // and XBGR8888 buffers hold: no conversion needed afterwards
+        gl->glReadPixels(job.rect.x(), windowHeight - 1 - job.rect.bottom(), job.rect.width(), job.rect.height(),
+                         GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+        slot.fence = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.job = job;
+
+        m_inFlight.append(slotIndex);
+        m_nextSlot = (m_nextSlot + 1) % SlotCount;
+    }
+
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    gl->glFlush();
+
+    // Nothing might be rendered for a while, retire them once the render
+    // thread is idle
+    QPointer<WaylandWlrScreencopyReadback> self(this);
+    m_window->scheduleRenderJob(QRunnable::create([self] {
+        if (self)
+            self->retireFences(true);
+    }), QQuickWindow::NoStage);
+}
+
+/*
+ * Blits the region of the job from the window framebuffer to the dmabuf
+ * of the client, which is imported as a texture by the client
+ * buffer integration. Runs on the render thread.
+ */
+bool WaylandWlrScreencopyReadback::blit(QOpenGLExtraFunctions *gl, const Job &job, int windowHeight)
+{
+    job.target->setTextureDirty();
+    QOpenGLTexture *texture = job.target->toOpenGlTexture(0);
+    if (!texture) {
+        qCWarning(gLcAuroraCompositorWlrScreencopyV1, "Failed to import dmabuf for screencopy");
+        return false;
+    }
+
+    if (!m_fbo)
+        gl->glGenFramebuffers(1, &m_fbo);
+
+    gl->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_fbo);
+    gl->glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                               texture->textureId(), 0);
+
+    const bool complete = gl->glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (complete) {
+        gl->glBindFramebuffer(GL_READ_FRAMEBUFFER, QOpenGLContext::currentContext()->defaultFramebufferObject());
+
+        // The framebuffer is bottom-up, the client buffer top-down
+        const QRect &r = job.rect;
+        const int top = windowHeight - r.y();
+        gl->glBlitFramebuffer(r.x(), top - r.height(), r.x() + r.width(), top,
+                              0, job.size.height(), job.size.width(), 0,
+                              GL_COLOR_BUFFER_BIT, r.size() == job.size ? GL_NEAREST : GL_LINEAR);
+    } else {
+        qCWarning(gLcAuroraCompositorWlrScreencopyV1, "Cannot render to the dmabuf for screencopy");
+    }
+
+    gl->glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    return complete;
+}
+
+/*
+ * Copies the pixels of completed readbacks into the client buffers, in
+ * the order they were queued. With \a wait the render thread blocks for
+ * a while on each of them.
+ */
+void WaylandWlrScreencopyReadback::retireFences(bool wait)
+{
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (!context) {
+        // Retired with the next frame instead
+        if (!m_inFlight.isEmpty())
+            QMetaObject::invokeMethod(m_window, "update", Qt::QueuedConnection);
+        return;
+    }
+
+    QOpenGLExtraFunctions *gl = context->extraFunctions();
+
+    while (!m_inFlight.isEmpty()) {
+        Slot &slot = m_slots[m_inFlight.first()];
+        const GLenum result = gl->glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                                   wait ? ReadbackFenceTimeout : 0);
+        if (result == GL_TIMEOUT_EXPIRED)
+            break;
+
+        gl->glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+        m_inFlight.removeFirst();
+
+        // Blits are in the client buffer already
+        if (slot.job.target) {
+            const quint64 id = slot.job.id;
+            slot.job = Job();
+            QMetaObject::invokeMethod(this, [this, id] { handleCompleted(id, true); },
+                                      Qt::QueuedConnection);
+            continue;
+        }
+
+        const Job &job = slot.job;
+        const int width = job.rect.width();
+        const int height = job.rect.height();
+        const qint64 size = qint64(width) * height * 4;
+
+        gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        auto *pixels = static_cast<const uchar *>(gl->glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size,
+                                                                       GL_MAP_READ_BIT));
+        if (pixels) {
+            // Rows go back to the top-down order of the client buffer
+            QImage scaled;
+            if (job.rect.size() != job.size) {
+                const QImage frame(pixels, width, height, width * 4, QImage::Format_RGBA8888_Premultiplied);
+                scaled = frame.scaled(job.size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+                        .mirrored().convertToFormat(QImage::Format_RGBA8888_Premultiplied);
+            }
+
+            if (scaled.isNull()) {
+                for (int y = 0; y < height; ++y) {
+                    std::memcpy(job.data + y * job.bytesPerLine,
+                                pixels + qint64(height - 1 - y) * width * 4,
+                                size_t(width) * 4);
+                }
+            } else {
+                for (int y = 0; y < scaled.height(); ++y)
+                    std::memcpy(job.data + y * job.bytesPerLine, scaled.constScanLine(y), size_t(scaled.width()) * 4);
+            }
+            gl->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        } else {
+            qCWarning(gLcAuroraCompositorWlrScreencopyV1, "Failed to map pixel buffer object for screencopy");
+        }
+        gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        const quint64 id = job.id;
+        const bool success = pixels != nullptr;
+        slot.job = Job();
+        QMetaObject::invokeMethod(this, [this, id, success] { handleCompleted(id, success); },
+                                  Qt::QueuedConnection);
+    }
+}
+
+/*
+ * Deletes the pixel buffer objects when the scene graph goes away, copies
+ * still in flight fail.
+ */
+void WaylandWlrScreencopyReadback::releaseResources()
+{
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    QOpenGLExtraFunctions *gl = context ? context->extraFunctions() : nullptr;
+
+    for (Slot &slot : m_slots) {
+        if (slot.fence) {
+            const quint64 id = slot.job.id;
+            QMetaObject::invokeMethod(this, [this, id] { handleCompleted(id, false); },
+                                      Qt::QueuedConnection);
+            if (gl)
+                gl->glDeleteSync(slot.fence);
+        }
+        if (gl && slot.pbo)
+            gl->glDeleteBuffers(1, &slot.pbo);
+        slot = Slot();
+    }
+
+    if (gl && m_fbo)
+        gl->glDeleteFramebuffers(1, &m_fbo);
+    m_fbo = 0;
+
+    m_inFlight.clear();
+    m_nextSlot = 0;
+}
+
+void WaylandWlrScreencopyReadback::handleCompleted(quint64 id, bool success)
+{
+    const PendingJob pendingJob = m_pending.take(id);
+    if (pendingJob.receiver && pendingJob.done)
+        pendingJob.done(success);
+}
+
+#endif // QT_CONFIG(opengl)
+
 /*
  * WaylandWlrScreencopyManagerV1Private
  */
@@ -88,6 +486,7 @@ void WaylandWlrScreencopyManagerV1Private::zwlr_screencopy_manager_v1_capture_ou
 
     auto *screencopyFrame = new WaylandWlrScreencopyFrameV1(q);
     auto *screencopyFramePriv = WaylandWlrScreencopyFrameV1Private::get(screencopyFrame);
+    screencopyFramePriv->client = WaylandClient::fromWlClient(output->compositor(), resource->client());
     screencopyFramePriv->overlayCursor = overlay_cursor == 1;
     screencopyFramePriv->output = output;
     screencopyFramePriv->rect = QRect(QPoint(0, 0), output->geometry().size());
@@ -121,6 +520,7 @@ void WaylandWlrScreencopyManagerV1Private::zwlr_screencopy_manager_v1_capture_ou
 
     auto *screencopyFrame = new WaylandWlrScreencopyFrameV1(q);
     auto *screencopyFramePriv = WaylandWlrScreencopyFrameV1Private::get(screencopyFrame);
+    screencopyFramePriv->client = WaylandClient::fromWlClient(output->compositor(), resource->client());
     screencopyFramePriv->overlayCursor = overlay_cursor == 1;
     screencopyFramePriv->output = output;
     screencopyFramePriv->rect = QRect(x, y, width, height);
@@ -189,14 +589,29 @@ WaylandWlrScreencopyFrameV1Private::WaylandWlrScreencopyFrameV1Private()
 
 WaylandWlrScreencopyFrameV1Private::~WaylandWlrScreencopyFrameV1Private()
 {
-    if (filterObject)
-        filterObject->deleteLater();
+    bufferDestroyListener.reset();
+
+    // Deleted right away, so that frameSwapped() calls already queued
+    // are dropped instead of reaching a frame that is gone
+    if (filterObject) {
+        if (output && output->window()) {
+            output->window()->removeEventFilter(filterObject);
+            QObject::disconnect(output->window(), nullptr, filterObject, nullptr);
+        }
+        delete filterObject;
+    }
 }
 
 void WaylandWlrScreencopyFrameV1Private::setup()
 {
     send_buffer(requestedBufferFormat, rect.width(), rect.height(), stride);
 
+    if (resource()->version() >= 3) {
+        if (isDmabufSupported())
+            send_linux_dmabuf(DmabufFormat, rect.width(), rect.height());
+        send_buffer_done();
+    }
+
     QDateTime dateTime(QDateTime::currentDateTimeUtc());
     qint64 secs = dateTime.toSecsSinceEpoch();
     tv_sec_hi = secs >> 32;
@@ -219,33 +634,174 @@ void WaylandWlrScreencopyFrameV1Private::copy(Resource *resource, wl_resource *b
 
     auto *shmBuffer = wl_shm_buffer_get(buffer_res);
     if (!shmBuffer) {
-        qCWarning(gLcAuroraCompositorWlrScreencopyV1, "Unsupported buffer type, only shm buffers are supported");
-        wl_resource_post_error(resource->handle, error_invalid_buffer,
-                               "unsupported buffer type");
-        return;
-    }
+        auto *bufferManager = WaylandCompositorPrivate::get(output->compositor())->bufferManager();
+        Internal::ClientBuffer *clientBuffer = isDmabufSupported() ? bufferManager->getBuffer(buffer_res) : nullptr;
+        Internal::DmabufAttributes attributes;
+        if (!clientBuffer || !clientBuffer->dmabufAttributes(&attributes)) {
+            qCWarning(gLcAuroraCompositorWlrScreencopyV1, "Unsupported buffer type, only shm and dmabuf buffers are supported");
+            wl_resource_post_error(resource->handle, error_invalid_buffer,
+                                   "unsupported buffer type");
+            return;
+        }
 
-    uint32_t bufferFormat = wl_shm_buffer_get_format(shmBuffer);
-    int32_t bufferWidth = wl_shm_buffer_get_width(shmBuffer);
-    int32_t bufferHeight = wl_shm_buffer_get_height(shmBuffer);
-    int32_t bufferStride = wl_shm_buffer_get_stride(shmBuffer);
+        if (attributes.drmFormat != DmabufFormat || attributes.size != rect.size()) {
+            qCWarning(gLcAuroraCompositorWlrScreencopyV1, "Invalid dmabuf attributes");
+            wl_resource_post_error(resource->handle, error_invalid_buffer,
+                                   "invalid buffer attributes");
+            return;
+        }
 
-    if (bufferFormat != requestedBufferFormat || bufferWidth != rect.width() ||
-            bufferHeight != rect.height() || bufferStride != stride) {
-        qCWarning(gLcAuroraCompositorWlrScreencopyV1, "Invalid buffer attributes");
-        wl_resource_post_error(resource->handle, error_invalid_buffer,
-                               "invalid buffer attributes");
-        return;
+        if (!canRenderToDmabuf(attributes.drmFormat, attributes.modifier)) {
+            qCWarning(gLcAuroraCompositorWlrScreencopyV1, "Cannot render to a dmabuf with modifier 0x%llx",
+                      static_cast<unsigned long long>(attributes.modifier));
+            send_failed();
+            return;
+        }
+
+        dmabuf = Internal::ClientBuffer::toBufferRef(clientBuffer);
+    } else {
+        uint32_t bufferFormat = wl_shm_buffer_get_format(shmBuffer);
+        int32_t bufferWidth = wl_shm_buffer_get_width(shmBuffer);
+        int32_t bufferHeight = wl_shm_buffer_get_height(shmBuffer);
+        int32_t bufferStride = wl_shm_buffer_get_stride(shmBuffer);
+
+        if (bufferFormat != requestedBufferFormat || bufferWidth != rect.width() ||
+                bufferHeight != rect.height() || bufferStride != stride) {
+            qCWarning(gLcAuroraCompositorWlrScreencopyV1, "Invalid buffer attributes");
+            wl_resource_post_error(resource->handle, error_invalid_buffer,
+                                   "invalid buffer attributes");
+            return;
+        }
+    }
+
+    // QtQuick outputs track what their frames change, a full copy
+    // delivers all of it too
+    if (qobject_cast<QQuickWindow *>(output->window())) {
+        const QRegion changed = takeDamage();
+        if (withDamage)
+            damage = changed;
     }
 
-    if (withDamage)
-        send_damage(damageRect.x(), damageRect.y(), damageRect.width(), damageRect.height());
+    // The whole region is copied, damage only tells what changed
+    if (withDamage) {
+        for (const QRect &r : damage)
+            send_damage(r.x(), r.y(), r.width(), r.height());
+    }
 
     ready = true;
     buffer = shmBuffer;
+    if (buffer) {
+        bufferDestroyListener.listenForDestruction(buffer_res);
+        QObject::connect(&bufferDestroyListener, &WaylandDestroyListener::fired, q, [this] {
+            bufferDestroyListener.reset();
+            buffer = nullptr;
+        });
+    }
     emit q->ready();
 }
 
+/*
+ * Returns whether frames can be copied into dmabufs, which are blitted to
+ * by the GPU from the framebuffer of the output window.
+ */
+bool WaylandWlrScreencopyFrameV1Private::isDmabufSupported() const
+{
+#if QT_CONFIG(opengl)
+    auto *quickWindow = qobject_cast<QQuickWindow *>(output->window());
+    return quickWindow && WaylandWlrScreencopyReadback::isSupported(quickWindow)
+            && canRenderToDmabuf(DmabufFormat, DmabufModifierInvalid);
+#else
+    return false;
+#endif
+}
+
+/*
+ * Returns whether a client buffer integration imports dmabufs of the format
+ * and modifier as textures that can be rendered to, rather than external
+ * textures that can only be sampled.
+ */
+bool WaylandWlrScreencopyFrameV1Private::canRenderToDmabuf(quint32 drmFormat, quint64 modifier) const
+{
+    const auto integrations = WaylandCompositorPrivate::get(output->compositor())->clientBufferIntegrations();
+    for (Internal::ClientBufferIntegration *integration : integrations) {
+        if (integration->canRenderToDmabuf(drmFormat, modifier))
+            return true;
+    }
+    return false;
+}
+
+#if QT_CONFIG(opengl)
+/*
+ * Returns the region in pixels of the framebuffer of \a window, which
+ * is scaled by its device pixel ratio from output coordinates.
+ */
+QRect WaylandWlrScreencopyFrameV1Private::windowRect(QQuickWindow *window) const
+{
+    const qreal dpr = window->effectiveDevicePixelRatio();
+    const QRect pixels(QRectF(QPointF(rect.topLeft()) * dpr, QSizeF(rect.size()) * dpr).toAlignedRect());
+    const QRect windowPixels(QPoint(0, 0), (QSizeF(window->size()) * dpr).toSize());
+    return pixels.intersected(windowPixels);
+}
+#endif
+
+/*
+ * Returns whether the region changed since the client last copied it.
+ */
+bool WaylandWlrScreencopyFrameV1Private::hasDamage() const
+{
+    if (!client)
+        return true;
+
+    const auto &captured = WaylandOutputPrivate::get(output)->capturedDamage;
+    for (const WaylandCapturedRegion &region : captured) {
+        if (region.client == client && region.rect == rect)
+            return !region.damage.isEmpty();
+    }
+
+    return true;
+}
+
+/*
+ * Returns what changed in the region since the client last copied it,
+ * relative to the region, and starts tracking changes from now on.
+ * The first copy of the region changes everything.
+ */
+QRegion WaylandWlrScreencopyFrameV1Private::takeDamage()
+{
+    const QRegion fullDamage(QRect(QPoint(0, 0), rect.size()));
+
+    if (!client)
+        return fullDamage;
+
+    auto &captured = WaylandOutputPrivate::get(output)->capturedDamage;
+    for (WaylandCapturedRegion &region : captured) {
+        if (region.client == client && region.rect == rect) {
+            const QRegion changed = region.damage.translated(-rect.topLeft());
+            region.damage = QRegion();
+            return changed;
+        }
+    }
+
+    WaylandClient *c = client;
+    WaylandOutput *o = output;
+    const bool tracked = std::any_of(captured.cbegin(), captured.cend(),
+                                     [c](const WaylandCapturedRegion &region) {
+        return region.client == c;
+    });
+    if (!tracked) {
+        QObject::connect(c, &QObject::destroyed, o, [c, o] {
+            WaylandOutputPrivate::get(o)->capturedDamage.removeIf(
+                        [c](const WaylandCapturedRegion &region) { return region.client == c; });
+        });
+    }
+
+    WaylandCapturedRegion region;
+    region.client = c;
+    region.rect = rect;
+    captured.append(region);
+    return fullDamage;
+}
+
 void WaylandWlrScreencopyFrameV1Private::zwlr_screencopy_frame_v1_destroy_resource(Resource *resource)
 {
     Q_UNUSED(resource)
@@ -270,11 +826,24 @@ void WaylandWlrScreencopyFrameV1Private::zwlr_screencopy_frame_v1_copy_with_dama
 {
     withDamage = true;
 
+    // Copy right away if the region changed since the last copy, otherwise
+    // wait for a frame that changes it
+    auto *quickWindow = qobject_cast<QQuickWindow *>(output->window());
+    if (quickWindow && hasDamage()) {
+        copy(resource, buffer_res);
+        return;
+    }
+
     filterObject = new WaylandWlrScreencopyFrameEventFilter();
     filterObject->resource = resource;
     filterObject->buffer_res = buffer_res;
     filterObject->frame = this;
-    output->window()->installEventFilter(filterObject);
+    if (quickWindow) {
+        QObject::connect(quickWindow, &QQuickWindow::frameSwapped,
+                         filterObject, &WaylandWlrScreencopyFrameEventFilter::handleFrameSwapped);
+    } else {
+        output->window()->installEventFilter(filterObject);
+    }
 }
 
 /*
@@ -329,7 +898,61 @@ void WaylandWlrScreencopyFrameV1::copy(const QString &childToCapture)
 {
     Q_D(WaylandWlrScreencopyFrameV1);
 
-    if (d->ready) {
+    if (d->ready && !d->dmabuf.isNull()) {
+        // Only the frame the window renders can be blitted, the software
+        // cursor is always part of it and single items can't be captured
+        if (!d->overlayCursor && !childToCapture.isEmpty()) {
+            qCWarning(gLcAuroraCompositorWlrScreencopyV1, "Cannot capture an item into a dmabuf");
+            d->dmabuf = WaylandBufferRef();
+            d->send_failed();
+            return;
+        }
+
+#if QT_CONFIG(opengl)
+        auto *quickWindow = qobject_cast<QQuickWindow *>(d->output->window());
+        const QRect windowRect = d->windowRect(quickWindow);
+        WaylandWlrScreencopyReadback::get(quickWindow)->queue(d->dmabuf, windowRect, this, [d](bool success) {
+            d->dmabuf = WaylandBufferRef();
+            if (success) {
+                d->send_flags(static_cast<uint32_t>(d->flags));
+                d->send_ready(d->tv_sec_hi, d->tv_sec_lo, 0);
+            } else {
+                d->send_failed();
+            }
+        });
+#endif
+    } else if (d->ready) {
+#if QT_CONFIG(opengl)
+        // Whole windows are read back from the frame the window renders
+        // anyway, rather than rendering the items a second time
+        auto *readbackWindow = qobject_cast<QQuickWindow *>(d->output->window());
+        const uint32_t format = wl_shm_buffer_get_format(d->buffer);
+        if (readbackWindow && (d->overlayCursor || childToCapture.isEmpty())
+                && (format == WL_SHM_FORMAT_ABGR8888 || format == WL_SHM_FORMAT_XBGR8888)
+                && WaylandWlrScreencopyReadback::isSupported(readbackWindow)) {
+            const QImage image(d->rect.size(), QImage::Format_RGBA8888_Premultiplied);
+            const QRect windowRect = d->windowRect(readbackWindow);
+            WaylandWlrScreencopyReadback::get(readbackWindow)->queue(image, windowRect, this, [d, image](bool success) {
+                // The client may have destroyed the buffer in the meantime
+                if (!success || !d->buffer) {
+                    d->send_failed();
+                    return;
+                }
+
+                wl_shm_buffer_begin_access(d->buffer);
+                auto *data = static_cast<uchar *>(wl_shm_buffer_get_data(d->buffer));
+                const qsizetype bytesPerLine = qMin(image.bytesPerLine(), qsizetype(d->stride));
+                for (int y = 0; y < image.height(); ++y)
+                    std::memcpy(data + y * d->stride, image.constScanLine(y), bytesPerLine);
+                wl_shm_buffer_end_access(d->buffer);
+
+                d->send_flags(static_cast<uint32_t>(d->flags));
+                d->send_ready(d->tv_sec_hi, d->tv_sec_lo, 0);
+            });
+            return;
+        }
+#endif
+
         wl_shm_buffer_begin_access(d->buffer);
         void *data = wl_shm_buffer_get_data(d->buffer);
 
@@ -367,7 +990,13 @@ void WaylandWlrScreencopyFrameV1::copy(const QString &childToCapture)
 #warning "Image format conversion is not supported, please upgrade to Qt >= 5.13"
 #endif
 
-                memcpy(data, finalImage.bits(), finalImage.sizeInBytes());
+                // The whole region is written, even with damage
+                const int bytesPerLine = qMin(finalImage.bytesPerLine(), qsizetype(d->stride));
+                const int height = qMin(finalImage.height(), d->rect.height());
+                for (int y = 0; y < height; ++y) {
+                    memcpy(static_cast<uchar *>(data) + y * d->stride,
+                           finalImage.constScanLine(y), bytesPerLine);
+                }
             };
 
             if (result.isNull() || result->image().isNull()) {
@@ -4,14 +4,30 @@
 
 #pragma once
 
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QPointer>
 #include <QRect>
+#include <QRegion>
 
+#include <functional>
+
+#include <LiriAuroraCompositor/WaylandBufferRef>
+#include <LiriAuroraCompositor/WaylandClient>
+#include <LiriAuroraCompositor/WaylandDestroyListener>
 #include <LiriAuroraCompositor/WaylandWlrScreencopyManagerV1>
 #include <LiriAuroraCompositor/private/aurorawaylandcompositorextension_p.h>
 #include <LiriAuroraCompositor/private/aurora-server-wlr-screencopy-unstable-v1.h>
 
 #include <wayland-server-protocol.h>
 
+#if QT_CONFIG(opengl)
+#include <QOpenGLExtraFunctions>
+#endif
+
+class QQuickWindow;
+
 //
 //  W A R N I N G
 //  -------------
@@ -27,6 +43,10 @@ namespace Aurora {
 
 namespace Compositor {
 
+namespace Internal {
+class ClientBuffer;
+}
+
 class WaylandWlrScreencopyFrameEventFilter;
 
 class LIRIAURORACOMPOSITOR_EXPORT WaylandWlrScreencopyManagerV1Private
@@ -62,17 +82,31 @@ public:
 
     void setup();
     void copy(Resource *resource, struct ::wl_resource *buffer_res);
+    bool hasDamage() const;
+    QRegion takeDamage();
+    bool isDmabufSupported() const;
+    bool canRenderToDmabuf(quint32 drmFormat, quint64 modifier) const;
+#if QT_CONFIG(opengl)
+    QRect windowRect(QQuickWindow *window) const;
+#endif
 
     WaylandWlrScreencopyFrameEventFilter *filterObject = nullptr;
+    QPointer<WaylandClient> client;
     bool overlayCursor = false;
     WaylandOutput *output = nullptr;
     QRect rect;
     WaylandWlrScreencopyFrameV1::Flags flags;
     bool withDamage = false;
-    QRect damageRect;
+    // What changed since the last copy, relative to rect, reported with
+    // damage events: the buffer always receives the whole region
+    QRegion damage;
     uint32_t stride = 0;
     wl_shm_format requestedBufferFormat = WL_SHM_FORMAT_ABGR8888;
     struct ::wl_shm_buffer *buffer = nullptr;
+    // Clears buffer when the client destroys it
+    WaylandDestroyListener bufferDestroyListener;
+    // Client dmabuf, filled by the GPU instead of buffer
+    WaylandBufferRef dmabuf;
     quint32 tv_sec_hi = 0, tv_sec_lo = 0;
     bool ready = false;
 
@@ -98,10 +132,84 @@ public:
     struct ::wl_resource *buffer_res = nullptr;
     WaylandWlrScreencopyFrameV1Private *frame = nullptr;
 
+public Q_SLOTS:
+    void handleFrameSwapped();
+
 protected:
     bool eventFilter(QObject *watched, QEvent *event) override;
 };
 
+#if QT_CONFIG(opengl)
+
+class LIRIAURORACOMPOSITOR_EXPORT WaylandWlrScreencopyReadback : public QObject
+{
+    Q_OBJECT
+public:
+    static bool isSupported(QQuickWindow *window);
+    static WaylandWlrScreencopyReadback *get(QQuickWindow *window);
+
+    void queue(const QImage &image, const QRect &rect,
+               QObject *receiver, const std::function<void(bool)> &done);
+    void queue(const WaylandBufferRef &buffer, const QRect &rect,
+               QObject *receiver, const std::function<void(bool)> &done);
+
+private:
+    struct Job {
+        quint64 id = 0;
+        // Pixels of the image of the pending job, which keeps them alive
+        uchar *data = nullptr;
+        qsizetype bytesPerLine = 0;
+        // Or the client dmabuf to blit to, alive as long as the pending job
+        Internal::ClientBuffer *target = nullptr;
+        // Captured region in window pixels, scaled to the size of the
+        // client buffer when they differ
+        QRect rect;
+        QSize size;
+    };
+
+    struct Slot {
+        GLuint pbo = 0;
+        qint64 size = 0;
+        GLsync fence = nullptr;
+        Job job;
+    };
+
+    struct PendingJob {
+        QImage image;
+        WaylandBufferRef buffer;
+        QPointer<QObject> receiver;
+        std::function<void(bool)> done;
+    };
+
+    explicit WaylandWlrScreencopyReadback(QQuickWindow *window);
+
+    void enqueue(const Job &job, const PendingJob &pendingJob);
+    void readback();
+    bool blit(QOpenGLExtraFunctions *gl, const Job &job, int windowHeight);
+    void retireFences(bool wait);
+    void releaseResources();
+    void handleCompleted(quint64 id, bool success);
+
+    QQuickWindow *m_window = nullptr;
+
+    // Shared with the render thread
+    QMutex m_mutex;
+    QList<Job> m_jobs;
+
+    // Render thread only
+    static const int SlotCount = 3;
+    Slot m_slots[SlotCount];
+    int m_nextSlot = 0;
+    QList<int> m_inFlight;
+    GLuint m_fbo = 0;
+
+    // GUI thread only
+    quint64 m_lastId = 0;
+    QHash<quint64, PendingJob> m_pending;
+};
+
+#endif // QT_CONFIG(opengl)
+
 } // namespace Compositor
 
 } // namespace Aurora
@@ -46,6 +46,15 @@ public:
     virtual ClientBuffer *createBufferFor(struct ::wl_resource *buffer) = 0;
     virtual bool isProtected(struct ::wl_resource *buffer) { Q_UNUSED(buffer); return false; }
 
+    // Whether dmabufs of the format and modifier are imported as textures
+    // the compositor can render to, DRM_FORMAT_MOD_INVALID for any modifier
+    virtual bool canRenderToDmabuf(quint32 drmFormat, quint64 modifier) const
+    {
+        Q_UNUSED(drmFormat);
+        Q_UNUSED(modifier);
+        return false;
+    }
+
 protected:
     WaylandCompositor *m_compositor = nullptr;
 };
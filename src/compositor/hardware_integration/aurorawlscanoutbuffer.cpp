@@ -0,0 +1,54 @@
+// SPDX-FileCopyrightText: 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "aurorawlscanoutbuffer_p.h"
+#include "aurorawlclientbuffer_p.h"
+
+namespace Aurora {
+
+namespace Compositor {
+
+namespace Internal {
+
+/*
+    Describes \a buffer in \a scanout, for the platform to show it on a
+    plane without composition. Returns false if \a buffer is not something
+    the display hardware could use, like shared memory.
+
+    The caller marks the client buffer scanned out once the platform
+    accepted it, the platform is then told when it goes away.
+*/
+bool scanoutBufferFor(const WaylandBufferRef &buffer, PlatformSupport::ScanoutBuffer *scanout)
+{
+    ClientBuffer *clientBuffer = ClientBuffer::fromBufferRef(buffer);
+    if (!clientBuffer || !buffer.hasContent() || buffer.isSharedMemory())
+        return false;
+
+    DmabufAttributes attributes;
+    if (clientBuffer->dmabufAttributes(&attributes)) {
+        scanout->size = attributes.size;
+        scanout->drmFormat = attributes.drmFormat;
+        scanout->modifier = attributes.modifier;
+        scanout->numPlanes = attributes.planeCount;
+        for (int i = 0; i < attributes.planeCount; ++i) {
+            scanout->fds[i] = attributes.fds[i];
+            scanout->offsets[i] = attributes.offsets[i];
+            scanout->strides[i] = attributes.strides[i];
+        }
+    } else if (buffer.bufferFormatEgl() != WaylandBufferRef::BufferFormatEgl_Null) {
+        // Let the platform import it, it might be a wl_drm buffer
+        scanout->size = buffer.size();
+        scanout->waylandBuffer = buffer.wl_buffer();
+    } else {
+        return false;
+    }
+
+    scanout->key = clientBuffer->scanoutKey();
+    return true;
+}
+
+} // namespace Internal
+
+} // namespace Compositor
+
+} // namespace Aurora
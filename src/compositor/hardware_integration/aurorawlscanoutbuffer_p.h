@@ -0,0 +1,33 @@
+// SPDX-FileCopyrightText: 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Aurora API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <LiriAuroraCompositor/WaylandBufferRef>
+#include <LiriAuroraPlatformHeaders/lirieglfsfunctions.h>
+
+namespace Aurora {
+
+namespace Compositor {
+
+namespace Internal {
+
+LIRIAURORACOMPOSITOR_EXPORT bool scanoutBufferFor(const WaylandBufferRef &buffer,
+                                                  PlatformSupport::ScanoutBuffer *scanout);
+
+} // namespace Internal
+
+} // namespace Compositor
+
+} // namespace Aurora
@@ -9,8 +9,13 @@ WaylandQuickItem {
     property QtObject seat
     property int hotspotX: 0
     property int hotspotY: 0
+    // The surface is shown by the hardware cursor, which follows the pointer
+    // by itself: the item doesn't need to be moved
+    readonly property alias hardwareCursor: hardwareCursor.active
+    property alias hardwareCursorEnabled: hardwareCursor.enabled
 
     visible: cursorItem.surface != null
+    paintEnabled: !hardwareCursor.active
     inputEventsEnabled: false
     enabled: false
     transform: Translate {
@@ -20,6 +25,11 @@ WaylandQuickItem {
         y: -hotspotY * (output ? output.scaleFactor / Screen.devicePixelRatio : 1)
     }
 
+    WaylandHardwareCursor {
+        id: hardwareCursor
+        hotspot: Qt.point(cursorItem.hotspotX, cursorItem.hotspotY)
+    }
+
     Connections {
         target: seat
         function onCursorSurfaceRequest(surface, hotspotX, hotspotY) {
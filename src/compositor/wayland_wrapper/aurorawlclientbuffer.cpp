@@ -5,23 +5,53 @@
 
 #if QT_CONFIG(opengl)
 #include "hardware_integration/aurorawlclientbufferintegration_p.h"
+#include "aurorawlshmtexturepool_p.h"
+#include "aurorawlshmuploader_p.h"
 #include <qpa/qplatformopenglcontext.h>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
 #include <QOpenGLTexture>
 #endif
 
 #include <QtCore/QDebug>
+#include <QtCore/QMutexLocker>
 
 #include <LiriAuroraCompositor/private/wayland-wayland-server-protocol.h>
 #include "aurorawaylandsharedmemoryformathelper_p.h"
 
 #include <LiriAuroraCompositor/private/aurorawaylandcompositor_p.h>
 
+#if LIRI_FEATURE_aurora_qpa
+#include <LiriAuroraPlatformHeaders/lirieglfsfunctions.h>
+#endif
+
+#ifndef GL_RED
+#define GL_RED 0x1903
+#endif
+#ifndef GL_UNPACK_ROW_LENGTH
+#define GL_UNPACK_ROW_LENGTH 0x0CF2
+#endif
+#ifndef GL_BGRA_EXT
+#define GL_BGRA_EXT 0x80E1
+#endif
+#ifndef GL_TEXTURE_SWIZZLE_R
+#define GL_TEXTURE_SWIZZLE_R 0x8E42
+#define GL_TEXTURE_SWIZZLE_B 0x8E44
+#define GL_TEXTURE_SWIZZLE_A 0x8E45
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+
 namespace Aurora {
 
 namespace Compositor {
 
 namespace Internal {
 
+static QBasicMutex s_uploadStatisticsMutex;
+static ShmUploadStatistics s_uploadStatistics;
+
 ClientBuffer::ClientBuffer(struct ::wl_resource *buffer)
     : m_buffer(buffer)
 {
@@ -32,6 +62,20 @@ ClientBuffer::~ClientBuffer()
 {
     if (m_buffer && m_committed && !m_destroyed)
         sendRelease();
+
+#if LIRI_FEATURE_aurora_qpa
+    if (m_scannedOut)
+        PlatformSupport::EglFSFunctions::releaseScanoutBuffer(m_scanoutKey);
+#endif
+}
+
+quintptr ClientBuffer::scanoutKey()
+{
+    // A new buffer might be allocated where a buffer still on screen was
+    static QBasicAtomicInteger<quintptr> nextKey = Q_BASIC_ATOMIC_INITIALIZER(0);
+    if (!m_scanoutKey)
+        m_scanoutKey = nextKey.fetchAndAddRelaxed(1) + 1;
+    return m_scanoutKey;
 }
 
 void ClientBuffer::sendRelease()
@@ -73,6 +117,17 @@ void ClientBuffer::setCommitted(QRegion &damage)
      m_textureDirty = true;
 }
 
+/*
+    Adds \a region, in buffer coordinates, to the area of the buffer that
+    has to be uploaded again and remembers the surface commit \a serial
+    that last attached this buffer.
+*/
+void ClientBuffer::addTextureDamage(const QRegion &region, quint64 serial)
+{
+    m_textureDamage |= region;
+    m_commitSerial = serial;
+}
+
 WaylandBufferRef::BufferFormatEgl ClientBuffer::bufferFormatEgl() const
 {
     return WaylandBufferRef::BufferFormatEgl_Null;
@@ -84,6 +139,19 @@ SharedMemoryBuffer::SharedMemoryBuffer(wl_resource *bufferResource)
 
 }
 
+SharedMemoryBuffer::~SharedMemoryBuffer()
+{
+#if QT_CONFIG(opengl)
+    ShmTexturePool *pool = ShmTexturePool::instance();
+    pool->release(m_texture.context, m_texture.texture,
+                  m_texture.storageSize, m_texture.internalFormat);
+    pool->release(m_stagingTexture.context, m_stagingTexture.texture,
+                  m_stagingTexture.storageSize, m_stagingTexture.internalFormat);
+    if (m_stagingFence)
+        ShmUploader::instance()->releaseFence(m_stagingFence);
+#endif
+}
+
 QSize SharedMemoryBuffer::size() const
 {
     if (wl_shm_buffer *shmBuffer = wl_shm_buffer_get(m_buffer)) {
@@ -124,41 +192,281 @@ QImage SharedMemoryBuffer::image() const
     return QImage();
 }
 
+ShmUploadStatistics SharedMemoryBuffer::uploadStatistics()
+{
+    QMutexLocker locker(&s_uploadStatisticsMutex);
+    return s_uploadStatistics;
+}
+
+void SharedMemoryBuffer::resetUploadStatistics()
+{
+    QMutexLocker locker(&s_uploadStatisticsMutex);
+    s_uploadStatistics = ShmUploadStatistics();
+}
+
+void SharedMemoryBuffer::recordUpload(bool fullUpload, quint64 bytes, bool converted)
+{
+    QMutexLocker locker(&s_uploadStatisticsMutex);
+    if (converted)
+        s_uploadStatistics.convertedUploads++;
+    if (fullUpload)
+        s_uploadStatistics.fullUploads++;
+    else
+        s_uploadStatistics.partialUploads++;
+    s_uploadStatistics.bytesUploaded += bytes;
+    s_uploadStatistics.lastUploadBytes = bytes;
+}
+
 #if QT_CONFIG(opengl)
 QOpenGLTexture *SharedMemoryBuffer::toOpenGlTexture(int plane)
 {
     Q_UNUSED(plane);
     if (isSharedMemory()) {
-        if (!m_shmTexture) {
-            m_shmTexture = new QOpenGLTexture(QOpenGLTexture::Target2D);
-            m_shmTexture->create();
+        // Uploaded by ShmUploader, which takes care of the texture. From
+        // now on frames sample m_texture, the staging texture can be
+        // written once the GPU is done with the frames before
+        if (m_asyncUpload) {
+            if (m_stagingSampled) {
+                QOpenGLExtraFunctions *gl = QOpenGLContext::currentContext()->extraFunctions();
+                if (m_stagingFence)
+                    gl->glDeleteSync(m_stagingFence);
+                m_stagingFence = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                gl->glFlush();
+                m_stagingSampled = false;
+            }
+            return m_texture.texture;
         }
+
         if (m_textureDirty) {
             m_textureDirty = false;
-            m_shmTexture->bind();
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-            // TODO: partial texture upload
             QImage image = this->image();
-            m_shmTexture->setSize(image.width(), image.height());
-            if (image.hasAlphaChannel()) {
-                m_shmTexture->setFormat(QOpenGLTexture::RGBAFormat);
-                if (image.format() != QImage::Format_RGBA8888)
-                    image = image.convertToFormat(QImage::Format_RGBA8888);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width(), image.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, image.constBits());
+            QOpenGLContext *context = QOpenGLContext::currentContext();
+            const ShmUploadFormat format = uploadFormat(context, image, uploadMode());
+
+            // The texture storage is kept as long as size and format are the same,
+            // in which case only what was damaged since the last upload is sent
+            const bool fullUpload = m_textureSize != image.size() || m_textureFormat != image.format();
+            QRegion region = fullUpload ? QRegion(image.rect()) : m_textureDamage.intersected(image.rect());
+            m_textureDamage = QRegion();
+            if (region.rectCount() > MaxUploadRects)
+                region = region.boundingRect();
+
+            if (fullUpload) {
+                m_textureSize = image.size();
+                m_textureFormat = image.format();
+                prepareTexture(m_texture, context, image.size(), format);
+                m_texture.texture->setSize(image.width(), image.height());
+                m_texture.texture->setFormat(image.hasAlphaChannel() ? QOpenGLTexture::RGBAFormat : QOpenGLTexture::RGBFormat);
             } else {
-                m_shmTexture->setFormat(QOpenGLTexture::RGBFormat);
-                if (image.format() != QImage::Format_RGBX8888)
-                    image = image.convertToFormat(QImage::Format_RGBX8888);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.width(), image.height(), 0, GL_RGB, GL_UNSIGNED_BYTE, image.constBits());
+                m_texture.texture->bind();
             }
+            m_lastUploadBytes = uploadImage(image, region, false, uploadMode());
+            const bool converted = image.format() != format.imageFormat;
+
+            qCDebug(gLcAuroraCompositor, "Uploaded %llu bytes in %d rectangle(s) for shm buffer %p (%s upload)",
+                    m_lastUploadBytes, region.rectCount(), static_cast<void *>(m_buffer),
+                    fullUpload ? "full" : "partial");
+
+            recordUpload(fullUpload, m_lastUploadBytes, converted);
+
             //we can release the buffer after uploading, since we have a copy
             if (isCommitted())
                 sendRelease();
         }
-        return m_shmTexture;
+        return m_texture.texture;
     }
     return nullptr;
 }
+
+/*
+    Returns how shm buffers are uploaded. Native uploads are used unless
+    AURORA_SHM_CONVERT_UPLOAD is set, which is useful to compare the two
+    paths or to work around driver bugs.
+*/
+SharedMemoryBuffer::UploadMode SharedMemoryBuffer::uploadMode()
+{
+    static const UploadMode mode = qEnvironmentVariableIntValue("AURORA_SHM_CONVERT_UPLOAD") > 0
+            ? ConvertUpload : NativeUpload;
+    return mode;
+}
+
+ShmUploadFormat SharedMemoryBuffer::uploadFormat(QOpenGLContext *context, const QImage &image, UploadMode mode)
+{
+    ShmUploadFormat result;
+    const bool hasAlpha = image.hasAlphaChannel();
+    if (!hasAlpha)
+        result.imageFormat = QImage::Format_RGBX8888;
+
+    const bool isGles = context->isOpenGLES();
+    const QSurfaceFormat format = context->format();
+    result.hasSwizzle = isGles
+            ? format.majorVersion() >= 3
+            : format.version() >= qMakePair(3, 3) || context->hasExtension(QByteArrayLiteral("GL_ARB_texture_swizzle"));
+
+    // ARGB8888 and XRGB8888 are BGRA in memory on little endian
+    const bool isBgra = QSysInfo::ByteOrder == QSysInfo::LittleEndian
+            && (image.format() == QImage::Format_ARGB32_Premultiplied || image.format() == QImage::Format_RGB32);
+    if (mode != NativeUpload || !isBgra)
+        return result;
+
+    if (!isGles || context->hasExtension(QByteArrayLiteral("GL_EXT_texture_format_BGRA8888"))) {
+        result.format = GL_BGRA_EXT;
+        result.internalFormat = isGles ? GL_BGRA_EXT : GL_RGBA;
+        result.imageFormat = image.format();
+    } else if (result.hasSwizzle) {
+        result.swapRedBlue = true;
+        result.imageFormat = image.format();
+    } else {
+        return result;
+    }
+
+    result.opaque = !hasAlpha && result.hasSwizzle;
+    return result;
+}
+
+/*
+    Binds \a target, a texture for an image of \a size in \a uploadFormat,
+    taken from the pool when possible. The previous texture, if any, goes
+    to the pool.
+
+    \a context must be current.
+*/
+void SharedMemoryBuffer::prepareTexture(ShmTexture &target, QOpenGLContext *context, const QSize &size,
+                                        const ShmUploadFormat &uploadFormat)
+{
+    ShmTexturePool *pool = ShmTexturePool::instance();
+
+    if (target.texture) {
+        if (target.context && QOpenGLContext::areSharing(context, target.context)
+                && target.storageSize == size && target.internalFormat == uploadFormat.internalFormat) {
+            target.texture->bind();
+            setTextureParameters(uploadFormat);
+            return;
+        }
+        pool->release(target.context, target.texture, target.storageSize, target.internalFormat);
+    }
+
+    target.context = context;
+    target.storageSize = size;
+    target.internalFormat = uploadFormat.internalFormat;
+
+    target.texture = pool->acquire(context, size, uploadFormat.internalFormat);
+    if (target.texture) {
+        target.texture->bind();
+        setTextureParameters(uploadFormat);
+    } else {
+        target.texture = new QOpenGLTexture(QOpenGLTexture::Target2D);
+        target.texture->create();
+        target.texture->bind();
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        allocateTexture(size, uploadFormat);
+    }
+}
+
+/*
+    Makes what ShmUploader uploaded the texture that is sampled. The texture
+    sampled so far becomes the staging texture, missing what was uploaded
+    since the last swap.
+*/
+void SharedMemoryBuffer::swapStagingTexture()
+{
+    std::swap(m_texture, m_stagingTexture);
+    std::swap(m_textureSize, m_stagingSize);
+    std::swap(m_textureFormat, m_stagingFormat);
+    m_stagingDamage = m_uploadedDamage;
+    m_uploadedDamage = QRegion();
+    m_stagingSampled = true;
+}
+
+/*
+    Keeps the texture being sampled when an upload failed: what the
+    uploads in flight had to upload is uploaded again, by the next upload
+    or by toOpenGlTexture(), the staging texture is allocated again.
+*/
+void SharedMemoryBuffer::discardStagingTexture()
+{
+    m_stagingFailed = false;
+    m_stagingSize = QSize();
+    m_stagingFormat = QImage::Format_Invalid;
+    m_stagingDamage = QRegion();
+    m_textureDamage |= m_uploadedDamage;
+    m_uploadedDamage = QRegion();
+    m_textureDirty = true;
+    m_asyncUpload = false;
+}
+
+/*
+    Specifies the storage of the currently bound texture for an image of \a size.
+*/
+void SharedMemoryBuffer::allocateTexture(const QSize &size, const ShmUploadFormat &uploadFormat)
+{
+    glTexImage2D(GL_TEXTURE_2D, 0, uploadFormat.internalFormat, size.width(), size.height(), 0,
+                 uploadFormat.format, GL_UNSIGNED_BYTE, nullptr);
+    setTextureParameters(uploadFormat);
+}
+
+/*
+    Sets up swizzling of the currently bound texture for \a uploadFormat.
+*/
+void SharedMemoryBuffer::setTextureParameters(const ShmUploadFormat &uploadFormat)
+{
+    if (uploadFormat.hasSwizzle) {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, uploadFormat.swapRedBlue ? GL_BLUE : GL_RED);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, uploadFormat.swapRedBlue ? GL_RED : GL_BLUE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, uploadFormat.opaque ? GL_ONE : GL_ALPHA);
+    }
+}
+
+/*
+    Uploads \a region of \a image into the currently bound texture and returns
+    the number of bytes uploaded. When \a allocate is true the texture storage
+    is specified first, otherwise it must already match size and format.
+
+    With NativeUpload, ARGB8888 and XRGB8888 data is uploaded as is using
+    GL_EXT_texture_format_BGRA8888 or texture swizzling, when neither is
+    available or with ConvertUpload the damaged part is converted to RGBA.
+*/
+quint64 SharedMemoryBuffer::uploadImage(const QImage &image, const QRegion &region, bool allocate, UploadMode mode)
+{
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    const ShmUploadFormat uploadFormat = SharedMemoryBuffer::uploadFormat(context, image, mode);
+
+    if (allocate)
+        allocateTexture(image.size(), uploadFormat);
+
+    if (region.isEmpty())
+        return 0;
+
+    const bool hasUnpackRowLength = !context->isOpenGLES()
+            || context->format().majorVersion() >= 3
+            || context->hasExtension(QByteArrayLiteral("GL_EXT_unpack_subimage"));
+    const int bytesPerPixel = image.depth() / 8;
+    const bool converted = image.format() != uploadFormat.imageFormat;
+    quint64 bytes = 0;
+
+    for (const QRect &rect : region) {
+        const uchar *origin = image.constScanLine(rect.y()) + rect.x() * bytesPerPixel;
+
+        if (!converted && hasUnpackRowLength) {
+            // Straight from the shm pool, no intermediate copy
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, image.bytesPerLine() / bytesPerPixel);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x(), rect.y(), rect.width(), rect.height(),
+                            uploadFormat.format, GL_UNSIGNED_BYTE, origin);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        } else {
+            // Only the damaged part of the buffer is copied or converted
+            const QImage subImage(origin, rect.width(), rect.height(), image.bytesPerLine(), image.format());
+            const QImage data = converted
+                    ? subImage.convertToFormat(uploadFormat.imageFormat) : subImage.copy();
+            glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x(), rect.y(), rect.width(), rect.height(),
+                            uploadFormat.format, GL_UNSIGNED_BYTE, data.constBits());
+        }
+
+        bytes += quint64(rect.width()) * rect.height() * 4;
+    }
+
+    return bytes;
+}
 #endif
 
 }
@@ -14,6 +14,7 @@
 // We mean it.
 //
 
+#include <QtCore/QPointer>
 #include <QtCore/QRect>
 #include <QtGui/qopengl.h>
 #include <QImage>
@@ -25,6 +26,7 @@
 
 #include <wayland-server-core.h>
 
+class QOpenGLContext;
 class QOpenGLTexture;
 
 namespace Aurora {
@@ -37,6 +39,20 @@ class WaylandCompositor;
 
 namespace Internal {
 
+class ShmUploader;
+
+// Describes a buffer that the display hardware can use directly
+struct DmabufAttributes
+{
+    QSize size;
+    quint32 drmFormat = 0;
+    quint64 modifier = 0x00ffffffffffffffULL;
+    int planeCount = 0;
+    int fds[4] = { -1, -1, -1, -1 };
+    quint32 offsets[4] = { 0, 0, 0, 0 };
+    quint32 strides[4] = { 0, 0, 0, 0 };
+};
+
 struct surface_buffer_destroy_listener
 {
     struct wl_listener listener;
@@ -59,6 +75,17 @@ public:
 
     virtual QImage image() const { return QImage(); }
 
+    // The fds are owned by the buffer and valid as long as it is not destroyed
+    virtual bool dmabufAttributes(DmabufAttributes *attributes) const { Q_UNUSED(attributes); return false; }
+
+    // Identifies the buffer to the platform, unlike addresses keys are never reused
+    quintptr scanoutKey();
+    // Accepted by the platform for scanout, it caches a framebuffer until the buffer goes away
+    void setScannedOut() { m_scannedOut = true; }
+    // A flip showed it without composition at least once
+    void setScanoutPresented() { m_scanoutPresented = true; }
+    bool isScanoutPresented() const { return m_scanoutPresented; }
+
     inline bool isCommitted() const { return m_committed; }
     virtual void setCommitted(QRegion &damage);
     bool isDestroyed() { return m_destroyed; }
@@ -69,10 +96,20 @@ public:
 
     bool isSharedMemory() const { return wl_shm_buffer_get(m_buffer); }
 
+    // Damage tracking for texture uploads, in buffer coordinates
+    quint64 commitSerial() const { return m_commitSerial; }
+    void addTextureDamage(const QRegion &region, quint64 serial);
+
+    // Written by the compositor rather than the client, e.g. by screen capture:
+    // the texture has to be bound to the buffer content again
+    void setTextureDirty() { m_textureDirty = true; }
+
 #if QT_CONFIG(opengl)
     virtual QOpenGLTexture *toOpenGlTexture(int plane = 0) = 0;
 #endif
 
+    static ClientBuffer *fromBufferRef(const WaylandBufferRef &ref) { return ref.m_buffer; }
+    static WaylandBufferRef toBufferRef(ClientBuffer *buffer) { return WaylandBufferRef(buffer); }
     static bool hasContent(ClientBuffer *buffer) { return buffer && buffer->waylandBufferHandle(); }
     static bool hasProtectedContent(ClientBuffer *buffer) { return buffer && buffer->isProtected(); }
 
@@ -84,11 +121,16 @@ protected:
 
     struct ::wl_resource *m_buffer = nullptr;
     QRegion m_damage;
+    QRegion m_textureDamage;
     bool m_textureDirty = false;
 
 private:
     bool m_committed = false;
     bool m_destroyed = false;
+    bool m_scannedOut = false;
+    bool m_scanoutPresented = false;
+    quintptr m_scanoutKey = 0;
+    quint64 m_commitSerial = 0;
 
     QAtomicInt m_refCount;
 
@@ -96,10 +138,40 @@ private:
     friend class BufferManager;
 };
 
+#if QT_CONFIG(opengl)
+struct ShmUploadFormat
+{
+    GLint internalFormat = GL_RGBA;
+    GLenum format = GL_RGBA;
+    // Format the pixel data has to be in for glTexSubImage2D
+    QImage::Format imageFormat = QImage::Format_RGBA8888;
+    bool hasSwizzle = false;
+    // Red and blue are swapped when sampling
+    bool swapRedBlue = false;
+    // Alpha is one when sampling, whatever the X channel contains
+    bool opaque = false;
+};
+#endif
+
+struct ShmUploadStatistics
+{
+    quint64 fullUploads = 0;
+    quint64 partialUploads = 0;
+    quint64 convertedUploads = 0;
+    quint64 bytesUploaded = 0;
+    quint64 lastUploadBytes = 0;
+};
+
 class LIRIAURORACOMPOSITOR_EXPORT SharedMemoryBuffer : public ClientBuffer
 {
 public:
+    enum UploadMode {
+        ConvertUpload,
+        NativeUpload
+    };
+
     SharedMemoryBuffer(struct ::wl_resource *bufferResource);
+    ~SharedMemoryBuffer() override;
 
     QSize size() const override;
     WaylandSurface::Origin origin() const  override;
@@ -108,8 +180,69 @@ public:
 #if QT_CONFIG(opengl)
     QOpenGLTexture *toOpenGlTexture(int plane = 0) override;
 
+    quint64 lastUploadBytes() const { return m_lastUploadBytes; }
+
+    static UploadMode uploadMode();
+    static ShmUploadFormat uploadFormat(QOpenGLContext *context, const QImage &image, UploadMode mode);
+    static void allocateTexture(const QSize &size, const ShmUploadFormat &uploadFormat);
+    static void setTextureParameters(const ShmUploadFormat &uploadFormat);
+    static quint64 uploadImage(const QImage &image, const QRegion &region, bool allocate, UploadMode mode);
+
+    // Texture uploaded by ShmUploader rather than by toOpenGlTexture()
+    bool isUploadedAsync() const { return m_asyncUpload; }
+#endif
+
+    static ShmUploadStatistics uploadStatistics();
+    static void resetUploadStatistics();
+
+    // Above this many rectangles it's cheaper to upload the bounding rectangle
+    static const int MaxUploadRects = 8;
+
 private:
-    QOpenGLTexture *m_shmTexture = nullptr;
+    static void recordUpload(bool fullUpload, quint64 bytes, bool converted);
+
+#if QT_CONFIG(opengl)
+    friend class ShmUploader;
+
+    // Borrowed from ShmTexturePool, where it goes back when the buffer is destroyed
+    struct ShmTexture {
+        QOpenGLTexture *texture = nullptr;
+        QPointer<QOpenGLContext> context;
+        QSize storageSize;
+        GLint internalFormat = 0;
+    };
+
+    void prepareTexture(ShmTexture &target, QOpenGLContext *context, const QSize &size,
+                        const ShmUploadFormat &uploadFormat);
+    void swapStagingTexture();
+    void discardStagingTexture();
+
+    ShmTexture m_texture;
+    QSize m_textureSize;
+    QImage::Format m_textureFormat = QImage::Format_Invalid;
+    quint64 m_lastUploadBytes = 0;
+    bool m_asyncUpload = false;
+
+    // ShmUploader writes this one while m_texture is sampled, the two are
+    // swapped once the uploads in flight completed. The worker thread owns
+    // m_stagingTexture, context included, while m_uploadsInFlight is not
+    // zero, the GUI thread only touches it otherwise. Everything else
+    // belongs to the GUI thread.
+    ShmTexture m_stagingTexture;
+    QSize m_stagingSize;
+    QImage::Format m_stagingFormat = QImage::Format_Invalid;
+    // Changed since the staging texture was last uploaded to
+    QRegion m_stagingDamage;
+    // Uploaded by the uploads in flight, m_texture misses it once swapped
+    QRegion m_uploadedDamage;
+    int m_uploadsInFlight = 0;
+    // Frames synchronized before the last swap may still sample the staging
+    // texture, until the render thread fenced them with m_stagingFence:
+    // the worker waits for the fence before it writes the texture again
+    bool m_stagingSampled = false;
+    GLsync m_stagingFence = nullptr;
+    // Set by the worker when an upload failed, the staging texture is lost
+    bool m_stagingFailed = false;
 #endif
 };
 
@@ -0,0 +1,191 @@
+// SPDX-FileCopyrightText: 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "aurorawlshmtexturepool_p.h"
+
+#if QT_CONFIG(opengl)
+
+#include <QtCore/QMutexLocker>
+#include <QtGui/QOpenGLContext>
+#include <QOpenGLTexture>
+
+#include <LiriAuroraCompositor/WaylandCompositor>
+
+#include "hardware_integration/aurorawltextureorphanage_p.h"
+
+namespace Aurora {
+
+namespace Compositor {
+
+Q_GLOBAL_STATIC(Internal::ShmTexturePool, shmTexturePool)
+
+namespace Internal {
+
+// Used unless AURORA_SHM_TEXTURE_POOL_SIZE says otherwise, in MiB
+static const int DefaultMaximumMiB = 64;
+
+ShmTexturePool::ShmTexturePool()
+{
+    const int maximumMiB = qEnvironmentVariableIsSet("AURORA_SHM_TEXTURE_POOL_SIZE")
+            ? qEnvironmentVariableIntValue("AURORA_SHM_TEXTURE_POOL_SIZE")
+            : DefaultMaximumMiB;
+    m_maximumBytes = qMax(0, maximumMiB) * qint64(1024 * 1024);
+}
+
+ShmTexturePool::~ShmTexturePool()
+{
+    // Contexts are usually gone by now, there is nothing left to delete
+    m_entries.clear();
+}
+
+ShmTexturePool *ShmTexturePool::instance()
+{
+    return shmTexturePool;
+}
+
+/*
+    Returns a texture of \a size with \a internalFormat storage, that can be
+    used by \a context, or nullptr when the pool doesn't have any.
+
+    \a context must be current.
+*/
+QOpenGLTexture *ShmTexturePool::acquire(QOpenGLContext *context, const QSize &size, GLint internalFormat)
+{
+    Q_ASSERT(context == QOpenGLContext::currentContext());
+
+    // Good time to get rid of evicted textures
+    WaylandTextureOrphanage::instance()->deleteTextures();
+
+    QMutexLocker locker(&m_mutex);
+
+    QOpenGLContextGroup *shareGroup = context->shareGroup();
+    for (qsizetype i = m_entries.size() - 1; i >= 0; --i) {
+        const Entry &entry = m_entries.at(i);
+        if (entry.shareGroup == shareGroup && entry.size == size && entry.internalFormat == internalFormat) {
+            QOpenGLTexture *texture = entry.texture;
+            m_statistics.hits++;
+            m_statistics.textures--;
+            m_statistics.bytes -= entry.bytes;
+            m_entries.removeAt(i);
+            return texture;
+        }
+    }
+
+    m_statistics.misses++;
+    return nullptr;
+}
+
+/*
+    Gives \a texture, created by \a context, back to the pool. The least
+    recently released textures are deleted when the pool grows too large.
+
+    No context needs to be current.
+*/
+void ShmTexturePool::release(QOpenGLContext *context, QOpenGLTexture *texture,
+                             const QSize &size, GLint internalFormat)
+{
+    if (!texture)
+        return;
+
+    if (!context) {
+        // The texture storage went away with its context, only the object is left
+        qCDebug(gLcAuroraCompositor, "Dropping shm texture %p of a destroyed context",
+                static_cast<void *>(texture));
+        delete texture;
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_contexts.contains(context)) {
+        m_contexts.insert(context);
+        connect(context, &QOpenGLContext::aboutToBeDestroyed, this,
+                [this, context]() { handleContextAboutToBeDestroyed(context); },
+                Qt::DirectConnection);
+    }
+
+    Entry entry;
+    entry.context = context;
+    entry.shareGroup = context->shareGroup();
+    entry.texture = texture;
+    entry.size = size;
+    entry.internalFormat = internalFormat;
+    entry.bytes = qint64(size.width()) * size.height() * 4;
+    m_entries.append(entry);
+
+    m_statistics.textures++;
+    m_statistics.bytes += entry.bytes;
+
+    trim();
+}
+
+qint64 ShmTexturePool::maximumBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_maximumBytes;
+}
+
+void ShmTexturePool::setMaximumBytes(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maximumBytes = qMax<qint64>(0, bytes);
+    trim();
+}
+
+ShmTexturePoolStatistics ShmTexturePool::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_statistics;
+}
+
+void ShmTexturePool::resetStatistics()
+{
+    QMutexLocker locker(&m_mutex);
+    const int textures = m_statistics.textures;
+    const qint64 bytes = m_statistics.bytes;
+    m_statistics = ShmTexturePoolStatistics();
+    m_statistics.textures = textures;
+    m_statistics.bytes = bytes;
+}
+
+void ShmTexturePool::trim()
+{
+    Q_ASSERT(!m_mutex.tryLock());
+
+    while (m_statistics.bytes > m_maximumBytes && !m_entries.isEmpty()) {
+        const Entry entry = m_entries.takeFirst();
+        m_statistics.evictions++;
+        m_statistics.textures--;
+        m_statistics.bytes -= entry.bytes;
+
+        // Deleted the next time a context of the share group is current
+        WaylandTextureOrphanage::instance()->admitTexture(entry.texture, entry.context);
+    }
+}
+
+void ShmTexturePool::handleContextAboutToBeDestroyed(QOpenGLContext *context)
+{
+    // The context is current, if it can be, while the signal is emitted
+    QMutexLocker locker(&m_mutex);
+
+    m_contexts.remove(context);
+
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (it->context == context) {
+            m_statistics.textures--;
+            m_statistics.bytes -= it->bytes;
+            delete it->texture;
+            it = m_entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+} // namespace Internal
+
+} // namespace Compositor
+
+} // namespace Aurora
+
+#endif // QT_CONFIG(opengl)
@@ -0,0 +1,95 @@
+// SPDX-FileCopyrightText: 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Aurora API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QSet>
+#include <QtCore/QSize>
+#include <QtGui/qopengl.h>
+
+#include <LiriAuroraCompositor/liriauroracompositorglobal.h>
+
+#if QT_CONFIG(opengl)
+
+class QOpenGLContext;
+class QOpenGLContextGroup;
+class QOpenGLTexture;
+
+namespace Aurora {
+
+namespace Compositor {
+
+namespace Internal {
+
+struct ShmTexturePoolStatistics
+{
+    quint64 hits = 0;
+    quint64 misses = 0;
+    quint64 evictions = 0;
+    int textures = 0;
+    qint64 bytes = 0;
+};
+
+/*
+    Textures of destroyed shm buffers, kept around for the next buffer
+    of the same size and internal format within the same share group.
+*/
+class LIRIAURORACOMPOSITOR_EXPORT ShmTexturePool : public QObject
+{
+public:
+    ShmTexturePool();
+    ~ShmTexturePool() override;
+
+    static ShmTexturePool *instance();
+
+    QOpenGLTexture *acquire(QOpenGLContext *context, const QSize &size, GLint internalFormat);
+    void release(QOpenGLContext *context, QOpenGLTexture *texture, const QSize &size, GLint internalFormat);
+
+    qint64 maximumBytes() const;
+    void setMaximumBytes(qint64 bytes);
+
+    ShmTexturePoolStatistics statistics() const;
+    void resetStatistics();
+
+private:
+    struct Entry {
+        QOpenGLContext *context = nullptr;
+        QOpenGLContextGroup *shareGroup = nullptr;
+        QOpenGLTexture *texture = nullptr;
+        QSize size;
+        GLint internalFormat = 0;
+        qint64 bytes = 0;
+    };
+
+    void trim();
+    void handleContextAboutToBeDestroyed(QOpenGLContext *context);
+
+    mutable QMutex m_mutex;
+    // Least recently released first
+    QList<Entry> m_entries;
+    QSet<QOpenGLContext *> m_contexts;
+    qint64 m_maximumBytes = 0;
+    ShmTexturePoolStatistics m_statistics;
+};
+
+} // namespace Internal
+
+} // namespace Compositor
+
+} // namespace Aurora
+
+#endif // QT_CONFIG(opengl)
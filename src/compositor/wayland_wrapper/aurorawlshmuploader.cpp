@@ -0,0 +1,436 @@
+// SPDX-FileCopyrightText: 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "aurorawlshmuploader_p.h"
+
+#if QT_CONFIG(opengl)
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QVarLengthArray>
+#include <QtGui/QOffscreenSurface>
+#include <QtGui/QOpenGLContext>
+#include <QOpenGLTexture>
+
+#include <LiriAuroraCompositor/WaylandCompositor>
+
+#include "aurorawlclientbuffer_p.h"
+
+#include <cstring>
+
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+#ifndef GL_STREAM_DRAW
+#define GL_STREAM_DRAW 0x88E0
+#endif
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#define GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#define GL_TIMEOUT_EXPIRED 0x911B
+#define GL_TIMEOUT_IGNORED 0xFFFFFFFFFFFFFFFFull
+#endif
+#ifndef GL_UNPACK_ROW_LENGTH
+#define GL_UNPACK_ROW_LENGTH 0x0CF2
+#endif
+
+namespace Aurora {
+
+namespace Compositor {
+
+namespace Internal {
+
+// How long the worker blocks on a fence before checking for new jobs
+static const GLuint64 FenceTimeout = 100 * 1000 * 1000;
+
+static ShmUploader *s_instance = nullptr;
+
+ShmUploader::ShmUploader(QOpenGLContext *context, QOffscreenSurface *surface)
+    : QThread(QCoreApplication::instance())
+    , m_context(context)
+    , m_surface(surface)
+{
+    setObjectName(QStringLiteral("AuroraShmUploader"));
+    m_context->moveToThread(this);
+}
+
+ShmUploader::~ShmUploader()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_quit = true;
+        m_condition.wakeAll();
+    }
+    wait();
+
+    delete m_context;
+    delete m_surface;
+
+    s_instance = nullptr;
+}
+
+/*
+    Returns the uploader, or nullptr when asynchronous uploads are not enabled
+    or not supported.
+
+    Uploads are opt-in with AURORA_SHM_ASYNC_UPLOAD and need a global share
+    context (Qt::AA_ShareOpenGLContexts) supporting pixel buffer objects and
+    fences, that is OpenGL ES 3.0 or OpenGL 3.2. Textures are only usable
+    by renderers using OpenGL.
+*/
+ShmUploader *ShmUploader::instance()
+{
+    static bool initialized = false;
+
+    if (initialized || !QCoreApplication::instance()
+            || QThread::currentThread() != QCoreApplication::instance()->thread())
+        return s_instance;
+    initialized = true;
+
+    if (qEnvironmentVariableIntValue("AURORA_SHM_ASYNC_UPLOAD") <= 0)
+        return nullptr;
+
+    QOpenGLContext *shareContext = QOpenGLContext::globalShareContext();
+    if (!shareContext) {
+        qCWarning(gLcAuroraCompositor, "Asynchronous shm uploads need Qt::AA_ShareOpenGLContexts, disabling");
+        return nullptr;
+    }
+
+    auto *context = new QOpenGLContext;
+    context->setShareContext(shareContext);
+    context->setFormat(shareContext->format());
+    auto *surface = new QOffscreenSurface;
+    surface->setFormat(shareContext->format());
+    surface->create();
+
+    const QSurfaceFormat format = context->create() ? context->format() : QSurfaceFormat();
+    const bool supported = context->isValid() && surface->isValid()
+            && (context->isOpenGLES()
+                ? format.majorVersion() >= 3
+                : format.version() >= qMakePair(3, 2));
+    if (!supported) {
+        qCWarning(gLcAuroraCompositor, "Asynchronous shm uploads need OpenGL ES 3.0 or OpenGL 3.2, disabling");
+        delete context;
+        delete surface;
+        return nullptr;
+    }
+
+    s_instance = new ShmUploader(context, surface);
+    s_instance->start();
+    qCDebug(gLcAuroraCompositor, "Uploading shm buffers on a separate thread");
+    return s_instance;
+}
+
+/*
+    Queues an upload of the damaged part of \a buffer to its staging texture,
+    which replaces the texture being sampled once the upload completed.
+
+    The buffer is released to the client as soon as its content has been
+    copied into a pixel buffer object, \a done is called with the upload
+    identifier once the texture can be sampled, unless \a receiver has been
+    destroyed in the meantime.
+*/
+quint64 ShmUploader::upload(const WaylandBufferRef &buffer, QObject *receiver,
+                            const std::function<void(quint64)> &done)
+{
+    Q_ASSERT(QThread::currentThread() == thread());
+    Q_ASSERT(buffer.isSharedMemory());
+
+    auto *shmBuffer = static_cast<SharedMemoryBuffer *>(buffer.buffer());
+
+    Job job;
+    job.id = ++m_lastId;
+    job.image = shmBuffer->image();
+
+    // Frames synchronized before the last swap may still sample the staging
+    // texture. The render thread fenced them once it synchronized this buffer
+    // again, otherwise the texture is left to them and replaced
+    if (shmBuffer->m_stagingFence) {
+        job.waitFence = shmBuffer->m_stagingFence;
+        shmBuffer->m_stagingFence = nullptr;
+    } else if (shmBuffer->m_stagingSampled) {
+        job.retiredTexture = shmBuffer->m_stagingTexture.texture;
+        shmBuffer->m_stagingTexture = SharedMemoryBuffer::ShmTexture();
+        shmBuffer->m_stagingSize = QSize();
+    }
+    shmBuffer->m_stagingSampled = false;
+
+    // Decided here rather than on the worker, because only this thread changes the buffer.
+    // The staging texture gets what changed since it was last uploaded to, the
+    // texture being sampled is left alone until the upload completed.
+    const QRect rect = job.image.rect();
+    const QRegion damage = shmBuffer->m_textureSize != job.image.size()
+            || shmBuffer->m_textureFormat != job.image.format()
+            ? QRegion(rect) : shmBuffer->m_textureDamage.intersected(rect);
+    job.allocate = shmBuffer->m_stagingSize != job.image.size()
+            || shmBuffer->m_stagingFormat != job.image.format();
+    job.region = job.allocate
+            ? QRegion(rect)
+            : (shmBuffer->m_stagingDamage | damage).intersected(rect);
+    if (job.region.rectCount() > SharedMemoryBuffer::MaxUploadRects)
+        job.region = job.region.boundingRect();
+
+    shmBuffer->m_textureDamage = QRegion();
+    shmBuffer->m_textureDirty = false;
+    shmBuffer->m_stagingSize = job.image.size();
+    shmBuffer->m_stagingFormat = job.image.format();
+    shmBuffer->m_stagingDamage = QRegion();
+    shmBuffer->m_uploadedDamage |= damage;
+    shmBuffer->m_uploadsInFlight++;
+    shmBuffer->m_asyncUpload = true;
+    // The staging texture itself is only touched by the worker until the upload completes
+    job.buffer = shmBuffer;
+
+    // Keeps the buffer alive and the pool mapped until the worker is done
+    m_pending.insert(job.id, { buffer, job.image, receiver, done });
+
+    QMutexLocker locker(&m_mutex);
+    m_jobs.append(job);
+    m_condition.wakeOne();
+
+    return job.id;
+}
+
+/*
+    Deletes \a fence on the worker thread, whose context shares it.
+*/
+void ShmUploader::releaseFence(GLsync fence)
+{
+    QMutexLocker locker(&m_mutex);
+    m_releasedFences.append(fence);
+    m_condition.wakeOne();
+}
+
+void ShmUploader::run()
+{
+    if (!m_context->makeCurrent(m_surface)) {
+        qCWarning(gLcAuroraCompositor, "Failed to make the shm upload context current");
+        m_context->moveToThread(thread());
+        return;
+    }
+
+    QOpenGLExtraFunctions *gl = m_context->extraFunctions();
+    for (Slot &slot : m_slots)
+        gl->glGenBuffers(1, &slot.pbo);
+
+    forever {
+        Job job;
+        bool hasJob = false;
+        QList<GLsync> releasedFences;
+
+        {
+            QMutexLocker locker(&m_mutex);
+            while (!m_quit && m_jobs.isEmpty() && m_inFlight.isEmpty() && m_releasedFences.isEmpty())
+                m_condition.wait(&m_mutex);
+            if (m_quit)
+                break;
+            if (!m_jobs.isEmpty()) {
+                job = m_jobs.takeFirst();
+                hasJob = true;
+            }
+            releasedFences.swap(m_releasedFences);
+        }
+
+        for (GLsync fence : std::as_const(releasedFences))
+            gl->glDeleteSync(fence);
+
+        if (hasJob)
+            uploadJob(job);
+
+        // Only block on the GPU when there is nothing else to do
+        retireFences(!hasJob);
+    }
+
+    for (Slot &slot : m_slots) {
+        if (slot.fence)
+            gl->glDeleteSync(slot.fence);
+        gl->glDeleteBuffers(1, &slot.pbo);
+    }
+    m_inFlight.clear();
+    for (GLsync fence : std::as_const(m_releasedFences))
+        gl->glDeleteSync(fence);
+    m_releasedFences.clear();
+
+    m_context->doneCurrent();
+    m_context->moveToThread(thread());
+}
+
+/*
+    Copies the damaged rectangles of the job, tightly packed, into the next
+    pixel buffer object of the ring and uploads them to the texture from there.
+
+    When the copy fails the job still completes in order, without touching
+    the texture and without releasing the buffer: the staging texture is
+    discarded once the uploads in flight completed.
+*/
+void ShmUploader::uploadJob(Job &job)
+{
+    QOpenGLExtraFunctions *gl = m_context->extraFunctions();
+
+    // Deleted once the frames that sample it are done
+    delete job.retiredTexture;
+    job.retiredTexture = nullptr;
+
+    const int slotIndex = m_nextSlot;
+    Slot &slot = m_slots[slotIndex];
+    while (slot.fence)
+        retireFences(true);
+
+    const ShmUploadFormat uploadFormat =
+            SharedMemoryBuffer::uploadFormat(m_context, job.image, SharedMemoryBuffer::uploadMode());
+    const bool converted = job.image.format() != uploadFormat.imageFormat;
+    const int bytesPerPixel = job.image.depth() / 8;
+
+    qint64 size = 0;
+    QVarLengthArray<qint64, SharedMemoryBuffer::MaxUploadRects> offsets;
+    for (const QRect &rect : std::as_const(job.region)) {
+        offsets.append(size);
+        size += qint64(rect.width()) * rect.height() * 4;
+    }
+
+    if (size > 0) {
+        gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+        if (slot.size < size) {
+            gl->glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+            slot.size = size;
+        }
+
+        auto *data = static_cast<uchar *>(gl->glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+        if (!data) {
+            qCWarning(gLcAuroraCompositor, "Failed to map pixel buffer object for shm upload");
+            gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            job.buffer->m_stagingFailed = true;
+        } else {
+            int i = 0;
+            for (const QRect &rect : std::as_const(job.region)) {
+                const uchar *origin = job.image.constScanLine(rect.y()) + rect.x() * bytesPerPixel;
+                QImage subImage(origin, rect.width(), rect.height(), job.image.bytesPerLine(), job.image.format());
+                if (converted)
+                    subImage = subImage.convertToFormat(uploadFormat.imageFormat);
+
+                uchar *dst = data + offsets.at(i++);
+                const qsizetype lineBytes = qsizetype(rect.width()) * 4;
+                for (int y = 0; y < rect.height(); ++y)
+                    std::memcpy(dst + y * lineBytes, subImage.constScanLine(y), lineBytes);
+            }
+            gl->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+    }
+
+    const QSize imageSize = job.image.size();
+    job.image = QImage();
+    const quint64 id = job.id;
+
+    if (job.waitFence) {
+        gl->glWaitSync(job.waitFence, 0, GL_TIMEOUT_IGNORED);
+        gl->glDeleteSync(job.waitFence);
+        job.waitFence = nullptr;
+    }
+
+    // Later uploads to a lost staging texture fail as well
+    const bool failed = job.buffer->m_stagingFailed;
+    if (failed) {
+        slot.fence = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.jobId = id;
+        m_inFlight.append(slotIndex);
+        m_nextSlot = (m_nextSlot + 1) % SlotCount;
+        return;
+    }
+
+    // The client can have its buffer back now
+    QMetaObject::invokeMethod(this, [this, id] { handleCopied(id); }, Qt::QueuedConnection);
+
+    if (job.allocate)
+        job.buffer->prepareTexture(job.buffer->m_stagingTexture, m_context, imageSize, uploadFormat);
+    else
+        job.buffer->m_stagingTexture.texture->bind();
+
+    if (size > 0) {
+        gl->glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        int i = 0;
+        for (const QRect &rect : std::as_const(job.region)) {
+            gl->glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x(), rect.y(), rect.width(), rect.height(),
+                                uploadFormat.format, GL_UNSIGNED_BYTE,
+                                reinterpret_cast<const void *>(quintptr(offsets.at(i++))));
+        }
+        gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    slot.fence = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.jobId = id;
+    gl->glFlush();
+
+    m_inFlight.append(slotIndex);
+    m_nextSlot = (m_nextSlot + 1) % SlotCount;
+
+    SharedMemoryBuffer::recordUpload(job.allocate, quint64(size), converted);
+}
+
+/*
+    Reports completed uploads in the order they were queued. With \a wait
+    the worker blocks for a while on the oldest one.
+*/
+void ShmUploader::retireFences(bool wait)
+{
+    QOpenGLExtraFunctions *gl = m_context->extraFunctions();
+
+    while (!m_inFlight.isEmpty()) {
+        Slot &slot = m_slots[m_inFlight.first()];
+        const GLenum result = gl->glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                                   wait ? FenceTimeout : 0);
+        if (result == GL_TIMEOUT_EXPIRED)
+            break;
+        wait = false;
+
+        gl->glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+        m_inFlight.removeFirst();
+
+        const quint64 id = slot.jobId;
+        QMetaObject::invokeMethod(this, [this, id] { handleCompleted(id); }, Qt::QueuedConnection);
+    }
+}
+
+void ShmUploader::handleCopied(quint64 id)
+{
+    auto it = m_pending.find(id);
+    if (it == m_pending.end())
+        return;
+
+    // Drops the reference to the shm pool on this thread
+    it->image = QImage();
+
+    auto *buffer = static_cast<SharedMemoryBuffer *>(it->buffer.buffer());
+    if (buffer->isCommitted() && buffer->waylandBufferHandle() && !buffer->isDestroyed())
+        buffer->sendRelease();
+}
+
+void ShmUploader::handleCompleted(quint64 id)
+{
+    const PendingJob pendingJob = m_pending.take(id);
+
+    // Later uploads write the same staging texture, it is swapped in after the last one
+    auto *buffer = static_cast<SharedMemoryBuffer *>(pendingJob.buffer.buffer());
+    if (buffer && --buffer->m_uploadsInFlight == 0) {
+        if (buffer->m_stagingFailed)
+            buffer->discardStagingTexture();
+        else
+            buffer->swapStagingTexture();
+    }
+
+    if (pendingJob.receiver && pendingJob.done)
+        pendingJob.done(id);
+}
+
+} // namespace Internal
+
+} // namespace Compositor
+
+} // namespace Aurora
+
+#endif // QT_CONFIG(opengl)
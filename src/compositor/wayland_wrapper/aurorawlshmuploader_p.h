@@ -0,0 +1,120 @@
+// SPDX-FileCopyrightText: 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Aurora API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QPointer>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+#include <QtGui/QImage>
+#include <QtGui/QRegion>
+
+#include <LiriAuroraCompositor/WaylandBufferRef>
+
+#include <functional>
+
+#if QT_CONFIG(opengl)
+
+#include <QtGui/QOpenGLExtraFunctions>
+
+class QOffscreenSurface;
+class QOpenGLContext;
+class QOpenGLTexture;
+
+namespace Aurora {
+
+namespace Compositor {
+
+namespace Internal {
+
+class SharedMemoryBuffer;
+
+class LIRIAURORACOMPOSITOR_EXPORT ShmUploader : public QThread
+{
+public:
+    ~ShmUploader() override;
+
+    static ShmUploader *instance();
+
+    quint64 upload(const WaylandBufferRef &buffer, QObject *receiver,
+                   const std::function<void(quint64)> &done);
+    void releaseFence(GLsync fence);
+
+protected:
+    void run() override;
+
+private:
+    struct Job {
+        quint64 id = 0;
+        SharedMemoryBuffer *buffer = nullptr;
+        QImage image;
+        QRegion region;
+        bool allocate = false;
+        // Frames that may still sample the staging texture, waited for by the GPU
+        GLsync waitFence = nullptr;
+        // Staging texture that may still be sampled, a new one replaces it
+        QOpenGLTexture *retiredTexture = nullptr;
+    };
+
+    struct Slot {
+        GLuint pbo = 0;
+        qint64 size = 0;
+        GLsync fence = nullptr;
+        quint64 jobId = 0;
+    };
+
+    struct PendingJob {
+        WaylandBufferRef buffer;
+        QImage image;
+        QPointer<QObject> receiver;
+        std::function<void(quint64)> done;
+    };
+
+    explicit ShmUploader(QOpenGLContext *context, QOffscreenSurface *surface);
+
+    void uploadJob(Job &job);
+    void retireFences(bool wait);
+    void handleCopied(quint64 id);
+    void handleCompleted(quint64 id);
+
+    QOpenGLContext *m_context = nullptr;
+    QOffscreenSurface *m_surface = nullptr;
+
+    // Shared with the worker thread
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    QList<Job> m_jobs;
+    QList<GLsync> m_releasedFences;
+    bool m_quit = false;
+
+    // Worker thread only
+    static const int SlotCount = 3;
+    Slot m_slots[SlotCount];
+    int m_nextSlot = 0;
+    QList<int> m_inFlight;
+
+    // GUI thread only
+    quint64 m_lastId = 0;
+    QHash<quint64, PendingJob> m_pending;
+};
+
+} // namespace Internal
+
+} // namespace Compositor
+
+} // namespace Aurora
+
+#endif // QT_CONFIG(opengl)
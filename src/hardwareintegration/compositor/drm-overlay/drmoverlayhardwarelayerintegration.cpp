@@ -0,0 +1,314 @@
+// SPDX-FileCopyrightText: 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <QtQuick/private/qquickitem_p.h>
+
+#include <LiriAuroraCompositor/WaylandSurface>
+#include <LiriAuroraCompositor/WaylandView>
+#include <LiriAuroraCompositor/private/aurorawaylandquickhardwarelayer_p.h>
+#include <LiriAuroraCompositor/private/aurorawlclientbuffer_p.h>
+#include <LiriAuroraCompositor/private/aurorawlscanoutbuffer_p.h>
+#include <LiriAuroraPlatformHeaders/lirieglfsfunctions.h>
+
+#include "drmoverlayhardwarelayerintegration.h"
+
+namespace Aurora {
+
+namespace Compositor {
+
+DrmOverlayLayer::DrmOverlayLayer(WaylandQuickHardwareLayer *hwLayer)
+    : m_hwLayer(hwLayer)
+    , m_item(hwLayer->waylandItem())
+{
+    if (!m_item)
+        return;
+
+    m_windowConnection = QObject::connect(m_item, &QQuickItem::windowChanged,
+                                          m_item, [this](QQuickWindow *window) {
+        setWindow(window);
+    });
+    setWindow(m_item->window());
+}
+
+DrmOverlayLayer::~DrmOverlayLayer()
+{
+    QObject::disconnect(m_windowConnection);
+    setWindow(nullptr);
+}
+
+void DrmOverlayLayer::setWindow(QQuickWindow *window)
+{
+    if (m_window == window)
+        return;
+
+    // The render thread only calls us while the GUI thread is blocked
+    if (m_window)
+        QObject::disconnect(m_syncConnection);
+
+    destroyPlane();
+
+    m_window = window;
+
+    // Runs on the render thread after the scene graph was synchronized:
+    // buffers were advanced and the GUI thread is blocked, the plane is
+    // committed with the page flip that follows
+    if (m_window) {
+        m_syncConnection = QObject::connect(m_window, &QQuickWindow::afterSynchronizing,
+                                            m_window, [this]() { updatePlane(); },
+                                            Qt::DirectConnection);
+    }
+}
+
+void DrmOverlayLayer::destroyPlane()
+{
+    if (m_screen) {
+        m_screen->removeEventFilter(this);
+        if (m_id >= 0)
+            PlatformSupport::EglFSFunctions::destroyOverlayLayer(m_screen, m_id);
+    }
+    m_id = -1;
+    m_screen = nullptr;
+    m_buffers.clear();
+
+    m_state = Composited;
+    m_presented = false;
+    setSceneGraphPainting(true);
+}
+
+void DrmOverlayLayer::updatePlane()
+{
+    if (!m_item || !m_window)
+        return;
+
+    if (m_screen != m_window->screen())
+        destroyPlane();
+
+    if (m_state == Leaving) {
+        // Keep the last buffer on the plane until the scene graph
+        // paints the item again, or it would disappear for a frame
+        if (!m_item->isPaintEnabled()) {
+            if (!m_buffers.isEmpty())
+                holdBuffer(m_buffers.last().buffer);
+            return;
+        }
+
+        PlatformSupport::EglFSFunctions::hideOverlayLayer(m_screen, m_id);
+        m_state = Composited;
+    }
+
+    if (showOnPlane()) {
+        if (m_state == Composited) {
+            m_state = Overlay;
+            m_presented = false;
+            m_overlayFrame = nextFrame();
+        }
+        holdBuffer(m_item->view()->currentBuffer());
+
+        // The commit can still fail after the test, the frame is then shown
+        // without any overlay: the scene graph keeps painting the item until
+        // a flip showed it on the plane
+        setSceneGraphPainting(!m_presented);
+    } else if (m_state == Overlay) {
+        m_state = Composited;
+        if (!m_sceneGraphPainting) {
+            // The plane was rejected, or the item can't be shown on it anymore:
+            // the plane keeps the last buffer until painting is back
+            if (!m_buffers.isEmpty()
+                    && PlatformSupport::EglFSFunctions::updateOverlayLayer(m_screen, m_id, m_layer)) {
+                holdBuffer(m_buffers.last().buffer);
+                m_state = Leaving;
+            }
+            setSceneGraphPainting(true);
+        }
+    }
+}
+
+/*
+    Puts the current buffer of the item on an overlay plane, returns
+    \c true when the plane took it.
+
+    Anything the plane can't do as the scene graph would is refused.
+*/
+bool DrmOverlayLayer::showOnPlane()
+{
+    WaylandSurface *surface = m_item->surface();
+    WaylandView *view = m_item->view();
+    if (!surface || !view || view->isBufferLocked() || m_hwLayer->stackingLevel() < 0)
+        return false;
+
+    if (!m_screen) {
+        m_screen = m_window->screen();
+        m_id = PlatformSupport::EglFSFunctions::createOverlayLayer(m_screen);
+
+        // Page flips of the screen are reported with events, the GUI
+        // thread is blocked while the render thread installs the filter
+        m_screen->installEventFilter(this);
+    }
+    if (m_id < 0)
+        return false;
+
+    bool suitable = m_item->isVisible()
+            && surface->contentOrientation() == Qt::PrimaryOrientation;
+
+    // Planes blend with the scene graph as they are
+    for (QQuickItem *item = m_item; item && suitable; item = item->parentItem())
+        suitable = qFuzzyCompare(item->opacity(), qreal(1));
+
+    // Only scaling and translation, planes can't rotate or skew
+    const QTransform transform = QQuickItemPrivate::get(m_item)->itemToWindowTransform();
+    suitable = suitable && transform.type() <= QTransform::TxScale
+            && transform.m11() > 0 && transform.m22() > 0;
+
+    const WaylandBufferRef buffer = view->currentBuffer();
+    suitable = suitable && buffer.origin() == WaylandSurface::OriginTopLeft;
+
+    PlatformSupport::OverlayLayer layer;
+    if (suitable && Internal::scanoutBufferFor(buffer, &layer.buffer)) {
+        const QRectF sourceGeometry = surface->sourceGeometry();
+        const int scale = surface->bufferScale();
+        const QRectF bufferSource(sourceGeometry.topLeft() * scale, sourceGeometry.size() * scale);
+        layer.zOrder = m_hwLayer->stackingLevel();
+
+        if (clippedGeometry(m_item, bufferSource, m_window->effectiveDevicePixelRatio(),
+                            &layer.geometry, &layer.source)
+                && PlatformSupport::EglFSFunctions::updateOverlayLayer(m_screen, m_id, layer)) {
+            Internal::ClientBuffer::fromBufferRef(buffer)->setScannedOut();
+            m_layer = layer;
+            return true;
+        }
+    }
+
+    PlatformSupport::EglFSFunctions::hideOverlayLayer(m_screen, m_id);
+    return false;
+}
+
+/*
+    Computes the part of \a item that is visible in its window, once
+    clipped by the ancestors of the item and by the window: \a geometry
+    is that part in pixels of the window, with the device pixel ratio
+    \a dpr, and \a source the area of the buffer shown there, in buffer
+    pixels, given that the item shows \a bufferSource.
+
+    The item must only be scaled and translated. Returns false when
+    nothing is visible, or the clip is not a rectangle.
+*/
+bool DrmOverlayLayer::clippedGeometry(QQuickItem *item, const QRectF &bufferSource, qreal dpr,
+                                      QRect *geometry, QRectF *source)
+{
+    const QRectF itemRect = QQuickItemPrivate::get(item)->itemToWindowTransform().mapRect(item->boundingRect());
+    if (itemRect.isEmpty())
+        return false;
+
+    QRectF visibleRect = itemRect;
+    if (item->window())
+        visibleRect &= QRectF(QPointF(0, 0), item->window()->size());
+    for (QQuickItem *parent = item->parentItem(); parent; parent = parent->parentItem()) {
+        if (!parent->clip())
+            continue;
+        const QTransform transform = QQuickItemPrivate::get(parent)->itemToWindowTransform();
+        if (transform.type() > QTransform::TxScale)
+            return false;
+        visibleRect &= transform.mapRect(parent->clipRect());
+    }
+
+    // Planes are placed on whole pixels
+    const QRectF pixelItemRect(itemRect.topLeft() * dpr, itemRect.size() * dpr);
+    const QRect pixelRect = QRectF(visibleRect.topLeft() * dpr, visibleRect.size() * dpr).toAlignedRect()
+            & pixelItemRect.toAlignedRect();
+    if (pixelRect.isEmpty())
+        return false;
+
+    const qreal sx = bufferSource.width() / pixelItemRect.width();
+    const qreal sy = bufferSource.height() / pixelItemRect.height();
+    *geometry = pixelRect;
+    *source = QRectF(bufferSource.x() + (pixelRect.x() - pixelItemRect.x()) * sx,
+                     bufferSource.y() + (pixelRect.y() - pixelItemRect.y()) * sy,
+                     pixelRect.width() * sx, pixelRect.height() * sy) & bufferSource;
+    return true;
+}
+
+void DrmOverlayLayer::setSceneGraphPainting(bool enable)
+{
+    // The render thread can't touch the item, painting is switched on the
+    // GUI thread and takes effect with the next frame
+    if (!m_item || m_sceneGraphPainting == enable)
+        return;
+
+    m_sceneGraphPainting = enable;
+
+    QPointer<WaylandQuickItem> item = m_item;
+    QMetaObject::invokeMethod(m_item, [item, enable]() {
+        if (item)
+            item->setPaintEnabled(enable);
+    }, Qt::QueuedConnection);
+}
+
+/*
+    Number of the frame being synchronized, as in PresentationEvent.
+*/
+quint64 DrmOverlayLayer::nextFrame() const
+{
+    return PlatformSupport::EglFSFunctions::getFrameTiming(m_screen).renderedFrames + 1;
+}
+
+/*
+    Keeps \a buffer from being released to the client until the flip of
+    a frame after the one being synchronized took it off the plane.
+*/
+void DrmOverlayLayer::holdBuffer(const WaylandBufferRef &buffer)
+{
+    HeldBuffer held;
+    held.buffer = buffer;
+    held.frame = nextFrame();
+    m_buffers.append(held);
+}
+
+bool DrmOverlayLayer::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == m_screen && event->type() == PlatformSupport::PresentationEvent::registeredType()) {
+        auto *e = static_cast<PlatformSupport::PresentationEvent *>(event);
+
+        // Buffers of the frames before are not on screen anymore, either
+        // replaced by this frame or dropped without ever being shown
+        for (auto it = m_buffers.begin(); it != m_buffers.end();) {
+            if (it->frame < e->frame) {
+                it = m_buffers.erase(it);
+                continue;
+            }
+
+            if (m_state == Overlay && it->frame == e->frame && it->frame >= m_overlayFrame) {
+                const quintptr key = Internal::ClientBuffer::fromBufferRef(it->buffer)->scanoutKey();
+                if (e->overlayKeys.contains(key))
+                    m_presented = true;
+            }
+            ++it;
+        }
+    }
+
+    return QObject::eventFilter(watched, event);
+}
+
+DrmOverlayHardwareLayerIntegration::DrmOverlayHardwareLayerIntegration(QObject *parent)
+    : Internal::HardwareLayerIntegration(parent)
+{
+}
+
+DrmOverlayHardwareLayerIntegration::~DrmOverlayHardwareLayerIntegration()
+{
+    qDeleteAll(m_layers);
+}
+
+void DrmOverlayHardwareLayerIntegration::add(WaylandQuickHardwareLayer *layer)
+{
+    if (!m_layers.contains(layer))
+        m_layers.insert(layer, new DrmOverlayLayer(layer));
+}
+
+void DrmOverlayHardwareLayerIntegration::remove(WaylandQuickHardwareLayer *layer)
+{
+    delete m_layers.take(layer);
+}
+
+} // namespace Compositor
+
+} // namespace Aurora
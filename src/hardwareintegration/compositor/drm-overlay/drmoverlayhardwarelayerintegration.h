@@ -0,0 +1,93 @@
+// SPDX-FileCopyrightText: 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <QtCore/QHash>
+#include <QtCore/QPointer>
+#include <QtGui/QScreen>
+#include <QtQuick/QQuickWindow>
+
+#include <LiriAuroraCompositor/WaylandBufferRef>
+#include <LiriAuroraCompositor/WaylandQuickItem>
+#include <LiriAuroraCompositor/private/aurorawlhardwarelayerintegration_p.h>
+#include <LiriAuroraPlatformHeaders/lirieglfsfunctions.h>
+
+namespace Aurora {
+
+namespace Compositor {
+
+class WaylandQuickHardwareLayer;
+
+class DrmOverlayLayer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DrmOverlayLayer(WaylandQuickHardwareLayer *hwLayer);
+    ~DrmOverlayLayer() override;
+
+    static bool clippedGeometry(QQuickItem *item, const QRectF &bufferSource, qreal dpr,
+                                QRect *geometry, QRectF *source);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+    enum State {
+        // The item is painted by the scene graph
+        Composited,
+        // The item is shown by an overlay plane
+        Overlay,
+        // Painting was given back to the scene graph, the plane stays
+        // until the item is painted again
+        Leaving
+    };
+
+    void setWindow(QQuickWindow *window);
+    void destroyPlane();
+    void updatePlane();
+    bool showOnPlane();
+    void setSceneGraphPainting(bool enable);
+    quint64 nextFrame() const;
+    void holdBuffer(const WaylandBufferRef &buffer);
+
+    struct HeldBuffer {
+        WaylandBufferRef buffer;
+        // Number of the frame, as in PresentationEvent
+        quint64 frame = 0;
+    };
+
+    WaylandQuickHardwareLayer *m_hwLayer = nullptr;
+    QPointer<WaylandQuickItem> m_item;
+    QPointer<QQuickWindow> m_window;
+    QPointer<QScreen> m_screen;
+    QMetaObject::Connection m_windowConnection;
+    QMetaObject::Connection m_syncConnection;
+    int m_id = -1;
+    State m_state = Composited;
+    // A flip showed the item on the plane since it entered the Overlay state
+    bool m_presented = false;
+    quint64 m_overlayFrame = 0;
+    bool m_sceneGraphPainting = true;
+    PlatformSupport::OverlayLayer m_layer;
+    // Buffers of the frames not replaced on screen yet
+    QList<HeldBuffer> m_buffers;
+};
+
+class DrmOverlayHardwareLayerIntegration : public Internal::HardwareLayerIntegration
+{
+    Q_OBJECT
+public:
+    explicit DrmOverlayHardwareLayerIntegration(QObject *parent = nullptr);
+    ~DrmOverlayHardwareLayerIntegration() override;
+
+    void add(WaylandQuickHardwareLayer *layer) override;
+    void remove(WaylandQuickHardwareLayer *layer) override;
+
+private:
+    QHash<WaylandQuickHardwareLayer *, DrmOverlayLayer *> m_layers;
+};
+
+} // namespace Compositor
+
+} // namespace Aurora
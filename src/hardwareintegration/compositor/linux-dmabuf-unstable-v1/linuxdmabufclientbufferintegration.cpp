@@ -311,7 +311,7 @@ void LinuxDmabufClientBufferIntegration::initializeHardware(struct ::wl_display
     // request and sent formats/modifiers only after egl_display is bound
     QHash<uint32_t, QList<uint64_t>> modifiers;
     for (const auto &format : supportedDrmFormats()) {
-        modifiers[format] = supportedDrmModifiers(format);
+        modifiers[format] = supportedDrmModifiers(format, &m_renderableModifiers[format]);
     }
     m_linuxDmabuf->setSupportedModifiers(modifiers);
 }
@@ -334,8 +334,14 @@ QList<uint32_t> LinuxDmabufClientBufferIntegration::supportedDrmFormats()
     return QList<uint32_t>();
 }
 
-QList<uint64_t> LinuxDmabufClientBufferIntegration::supportedDrmModifiers(uint32_t format)
+// Modifiers that buffers of the format can be imported with, those in
+// \a renderable can also be rendered to: the others only make external
+// textures. Implicit modifiers are expected to be renderable.
+QList<uint64_t> LinuxDmabufClientBufferIntegration::supportedDrmModifiers(uint32_t format, QList<uint64_t> *renderable)
 {
+    if (renderable)
+        *renderable = { DRM_FORMAT_MOD_INVALID };
+
     if (!egl_query_dmabuf_modifiers_ext)
         return QList<uint64_t>();
 
@@ -345,7 +351,14 @@ QList<uint64_t> LinuxDmabufClientBufferIntegration::supportedDrmModifiers(uint32
 
     if (success && count > 0) {
         QList<uint64_t> modifiers(count);
-        if (egl_query_dmabuf_modifiers_ext(m_eglDisplay, format, count, modifiers.data(), nullptr, &count)) {
+        QList<EGLBoolean> externalOnly(count);
+        if (egl_query_dmabuf_modifiers_ext(m_eglDisplay, format, count, modifiers.data(), externalOnly.data(), &count)) {
+            if (renderable) {
+                for (EGLint i = 0; i < count; ++i) {
+                    if (!externalOnly.at(i))
+                        renderable->append(modifiers.at(i));
+                }
+            }
             return modifiers;
         }
     }
@@ -353,6 +366,19 @@ QList<uint64_t> LinuxDmabufClientBufferIntegration::supportedDrmModifiers(uint32
     return QList<uint64_t>();
 }
 
+bool LinuxDmabufClientBufferIntegration::canRenderToDmabuf(quint32 drmFormat, quint64 modifier) const
+{
+    // YUV buffers are imported as several textures
+    if (m_yuvFormats.contains(EGLint(drmFormat)) || !egl_create_image)
+        return false;
+
+    auto it = m_renderableModifiers.constFind(drmFormat);
+    if (it == m_renderableModifiers.cend())
+        return false;
+
+    return modifier == DRM_FORMAT_MOD_INVALID || it->contains(modifier);
+}
+
 void LinuxDmabufClientBufferIntegration::deleteImage(EGLImageKHR image)
 {
     egl_destroy_image(m_eglDisplay, image);
@@ -453,6 +479,25 @@ WaylandSurface::Origin LinuxDmabufClientBuffer::origin() const
     return (d->flags() & PrivateServer::zwp_linux_buffer_params_v1::flags_y_invert) ? WaylandSurface::OriginBottomLeft : WaylandSurface::OriginTopLeft;
 }
 
+bool LinuxDmabufClientBuffer::dmabufAttributes(Internal::DmabufAttributes *attributes) const
+{
+    if (!m_buffer || !d)
+        return false;
+
+    attributes->size = d->size();
+    attributes->drmFormat = d->drmFormat();
+    attributes->planeCount = int(d->planesNumber());
+    for (uint32_t i = 0; i < d->planesNumber(); ++i) {
+        const Plane &plane = d->plane(i);
+        attributes->fds[i] = plane.fd;
+        attributes->offsets[i] = plane.offset;
+        attributes->strides[i] = plane.stride;
+        attributes->modifier = plane.modifiers;
+    }
+
+    return true;
+}
+
 } // namespace Compositor
 
 } // namespace Aurora
@@ -45,6 +45,7 @@ public:
 
     void initializeHardware(struct ::wl_display *display) override;
     Internal::ClientBuffer *createBufferFor(wl_resource *resource) override;
+    bool canRenderToDmabuf(quint32 drmFormat, quint64 modifier) const override;
     bool importBuffer(wl_resource *resource, LinuxDmabufWlBuffer *linuxDmabufBuffer);
     void removeBuffer(wl_resource *resource);
     void deleteImage(EGLImageKHR image);
@@ -63,13 +64,15 @@ private:
     bool initSimpleTexture(LinuxDmabufWlBuffer *dmabufBuffer);
     bool initYuvTexture(LinuxDmabufWlBuffer *dmabufBuffer);
     QList<uint32_t> supportedDrmFormats();
-    QList<uint64_t> supportedDrmModifiers(uint32_t format);
+    QList<uint64_t> supportedDrmModifiers(uint32_t format, QList<uint64_t> *renderable = nullptr);
 
     EGLDisplay m_eglDisplay = EGL_NO_DISPLAY;
     ::wl_display *m_wlDisplay = nullptr;
     bool m_displayBound = false;
 
     QHash<EGLint, YuvFormatConversion> m_yuvFormats;
+    // Modifiers of each format that are not limited to external textures
+    QHash<uint32_t, QList<uint64_t>> m_renderableModifiers;
     bool m_supportsDmabufModifiers = false;
     QHash<struct ::wl_resource *, LinuxDmabufWlBuffer *> m_importedBuffers;
     QScopedPointer<LinuxDmabuf> m_linuxDmabuf;
@@ -84,6 +87,7 @@ public:
     QSize size() const override;
     WaylandSurface::Origin origin() const override;
     QOpenGLTexture *toOpenGlTexture(int plane) override;
+    bool dmabufAttributes(Internal::DmabufAttributes *attributes) const override;
 
 protected:
     void setDestroyed() override;
@@ -23,6 +23,8 @@
 
 #include <QByteArray>
 
+#include <unistd.h>
+
 #include "lirieglfsfunctions.h"
 
 namespace Aurora {
@@ -116,6 +118,198 @@ void EglFSFunctions::disableScreenCast(QScreen *screen)
         func(screen);
 }
 
+QByteArray EglFSFunctions::isScreenCastSupportedIdentifier()
+{
+    return QByteArrayLiteral("LiriEglFSIsScreenCastSupported");
+}
+
+bool EglFSFunctions::isScreenCastSupported(QScreen *screen)
+{
+    IsScreenCastSupportedType func = reinterpret_cast<IsScreenCastSupportedType>(QGuiApplication::platformFunction(isScreenCastSupportedIdentifier()));
+    if (func)
+        return func(screen);
+    return false;
+}
+
+QByteArray EglFSFunctions::setScanoutBufferIdentifier()
+{
+    return QByteArrayLiteral("LiriEglFSSetScanoutBuffer");
+}
+
+/*
+    Asks to show \a buffer on the primary plane of \a screen with the next
+    page flip, instead of what was rendered. Returns true if the hardware
+    accepted it, otherwise the frame has to be composited as usual.
+
+    A buffer with a null key stops scanning out client buffers.
+*/
+bool EglFSFunctions::setScanoutBuffer(QScreen *screen, const ScanoutBuffer &buffer)
+{
+    SetScanoutBufferType func = reinterpret_cast<SetScanoutBufferType>(QGuiApplication::platformFunction(setScanoutBufferIdentifier()));
+    if (func)
+        return func(screen, buffer);
+    return false;
+}
+
+QByteArray EglFSFunctions::releaseScanoutBufferIdentifier()
+{
+    return QByteArrayLiteral("LiriEglFSReleaseScanoutBuffer");
+}
+
+/*
+    Forgets the framebuffer cached for the buffer identified by \a key,
+    to be called when the buffer is destroyed.
+*/
+void EglFSFunctions::releaseScanoutBuffer(quintptr key)
+{
+    ReleaseScanoutBufferType func = reinterpret_cast<ReleaseScanoutBufferType>(QGuiApplication::platformFunction(releaseScanoutBufferIdentifier()));
+    if (func)
+        func(key);
+}
+
+QByteArray EglFSFunctions::createOverlayLayerIdentifier()
+{
+    return QByteArrayLiteral("LiriEglFSCreateOverlayLayer");
+}
+
+/*
+    Reserves an overlay plane of \a screen and returns its layer id,
+    or -1 when no plane is free.
+*/
+int EglFSFunctions::createOverlayLayer(QScreen *screen)
+{
+    CreateOverlayLayerType func = reinterpret_cast<CreateOverlayLayerType>(QGuiApplication::platformFunction(createOverlayLayerIdentifier()));
+    if (func)
+        return func(screen);
+    return -1;
+}
+
+QByteArray EglFSFunctions::destroyOverlayLayerIdentifier()
+{
+    return QByteArrayLiteral("LiriEglFSDestroyOverlayLayer");
+}
+
+void EglFSFunctions::destroyOverlayLayer(QScreen *screen, int id)
+{
+    DestroyOverlayLayerType func = reinterpret_cast<DestroyOverlayLayerType>(QGuiApplication::platformFunction(destroyOverlayLayerIdentifier()));
+    if (func)
+        func(screen, id);
+}
+
+QByteArray EglFSFunctions::updateOverlayLayerIdentifier()
+{
+    return QByteArrayLiteral("LiriEglFSUpdateOverlayLayer");
+}
+
+/*
+    Shows \a layer on the overlay plane of layer \a id with the next page
+    flip. Returns true if the hardware accepted it, otherwise the layer is
+    hidden and its content has to be composited.
+*/
+bool EglFSFunctions::updateOverlayLayer(QScreen *screen, int id, const OverlayLayer &layer)
+{
+    UpdateOverlayLayerType func = reinterpret_cast<UpdateOverlayLayerType>(QGuiApplication::platformFunction(updateOverlayLayerIdentifier()));
+    if (func)
+        return func(screen, id, layer);
+    return false;
+}
+
+QByteArray EglFSFunctions::hideOverlayLayerIdentifier()
+{
+    return QByteArrayLiteral("LiriEglFSHideOverlayLayer");
+}
+
+void EglFSFunctions::hideOverlayLayer(QScreen *screen, int id)
+{
+    HideOverlayLayerType func = reinterpret_cast<HideOverlayLayerType>(QGuiApplication::platformFunction(hideOverlayLayerIdentifier()));
+    if (func)
+        func(screen, id);
+}
+
+QByteArray EglFSFunctions::setCursorImageIdentifier()
+{
+    return QByteArrayLiteral("LiriEglFSSetCursorImage");
+}
+
+bool EglFSFunctions::setCursorImage(QScreen *screen, const QImage &image, const QPoint &hotSpot)
+{
+    SetCursorImageType func = reinterpret_cast<SetCursorImageType>(QGuiApplication::platformFunction(setCursorImageIdentifier()));
+    if (func)
+        return func(screen, image, hotSpot);
+    return false;
+}
+
+QByteArray EglFSFunctions::getFrameTimingIdentifier()
+{
+    return QByteArrayLiteral("LiriEglFSGetFrameTiming");
+}
+
+FrameTiming EglFSFunctions::getFrameTiming(QScreen *screen)
+{
+    GetFrameTimingType func = reinterpret_cast<GetFrameTimingType>(QGuiApplication::platformFunction(getFrameTimingIdentifier()));
+    if (func)
+        return func(screen);
+    return FrameTiming();
+}
+
+QByteArray EglFSFunctions::setFrameSafetyMarginIdentifier()
+{
+    return QByteArrayLiteral("LiriEglFSSetFrameSafetyMargin");
+}
+
+void EglFSFunctions::setFrameSafetyMargin(QScreen *screen, qint64 usecs)
+{
+    SetFrameSafetyMarginType func = reinterpret_cast<SetFrameSafetyMarginType>(QGuiApplication::platformFunction(setFrameSafetyMarginIdentifier()));
+    if (func)
+        func(screen, usecs);
+}
+
+QByteArray EglFSFunctions::setVariableRefreshRateIdentifier()
+{
+    return QByteArrayLiteral("LiriEglFSSetVariableRefreshRate");
+}
+
+bool EglFSFunctions::setVariableRefreshRate(QScreen *screen, bool enabled)
+{
+    SetVariableRefreshRateType func = reinterpret_cast<SetVariableRefreshRateType>(QGuiApplication::platformFunction(setVariableRefreshRateIdentifier()));
+    if (func)
+        return func(screen, enabled);
+    return false;
+}
+
+QByteArray EglFSFunctions::setFrameDamageIdentifier()
+{
+    return QByteArrayLiteral("LiriEglFSSetFrameDamage");
+}
+
+void EglFSFunctions::setFrameDamage(QWindow *window, const QRegion &region)
+{
+    SetFrameDamageType func = reinterpret_cast<SetFrameDamageType>(QGuiApplication::platformFunction(setFrameDamageIdentifier()));
+    if (func)
+        func(window, region);
+}
+
+/*
+ * Presentation
+ */
+
+QEvent::Type PresentationEvent::eventType = QEvent::None;
+
+PresentationEvent::PresentationEvent()
+    : QEvent(registeredType())
+{
+}
+
+QEvent::Type PresentationEvent::registeredType()
+{
+    if (eventType == QEvent::None) {
+        int generatedType = QEvent::registerEventType();
+        eventType = static_cast<QEvent::Type>(generatedType);
+    }
+
+    return eventType;
+}
+
 /*
  * Screencast
  */
@@ -145,6 +339,13 @@ ScreenCastObjectEvent::ScreenCastObjectEvent()
 {
 }
 
+ScreenCastObjectEvent::~ScreenCastObjectEvent()
+{
+    // The event owns the file descriptor, receivers dup it when they need it
+    if (fd >= 0)
+        ::close(fd);
+}
+
 QEvent::Type ScreenCastObjectEvent::registeredType()
 {
     if (eventType == QEvent::None) {
@@ -173,6 +374,24 @@ QEvent::Type ScreenCastReadyEvent::registeredType()
     return eventType;
 }
 
+
+QEvent::Type ScreenCastCancelEvent::eventType = QEvent::None;
+
+ScreenCastCancelEvent::ScreenCastCancelEvent()
+    : QEvent(registeredType())
+{
+}
+
+QEvent::Type ScreenCastCancelEvent::registeredType()
+{
+    if (eventType == QEvent::None) {
+        int generatedType = QEvent::registerEventType();
+        eventType = static_cast<QEvent::Type>(generatedType);
+    }
+
+    return eventType;
+}
+
 } // namespace PlatformSupport
 
 } // namespace Aurora
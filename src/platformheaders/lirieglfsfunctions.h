@@ -25,9 +25,14 @@
 
 #include <QEvent>
 #include <QGuiApplication>
+#include <QImage>
+#include <QRegion>
+#include <QWindow>
 
 #include <LiriAuroraPlatformHeaders/liriauroraplatformheadersglobal.h>
 
+struct wl_resource;
+
 namespace Aurora {
 
 namespace PlatformSupport {
@@ -45,6 +50,66 @@ public:
     qreal scale = 1.0f;
 };
 
+class LIRIAURORAPLATFORMHEADERS_EXPORT ScanoutBuffer
+{
+public:
+    explicit ScanoutBuffer() = default;
+
+    // Identifies the client buffer, framebuffers are cached by key:
+    // keys are never reused, a released key is never shown again
+    quintptr key = 0;
+    QSize size;
+    quint32 drmFormat = 0;
+    quint64 modifier = 0x00ffffffffffffffULL;
+    int numPlanes = 0;
+    int fds[4] = { -1, -1, -1, -1 };
+    quint32 offsets[4] = { 0, 0, 0, 0 };
+    quint32 strides[4] = { 0, 0, 0, 0 };
+    // wl_buffer to import when there are no dmabuf planes
+    struct ::wl_resource *waylandBuffer = nullptr;
+    // Shown as soon as possible, even if it tears
+    bool allowTearing = false;
+};
+
+class LIRIAURORAPLATFORMHEADERS_EXPORT OverlayLayer
+{
+public:
+    explicit OverlayLayer() = default;
+
+    ScanoutBuffer buffer;
+    // Area of the buffer to show, in buffer pixels
+    QRectF source;
+    // Where on the screen, in screen pixels
+    QRect geometry;
+    // Layers with a higher order are stacked on top
+    int zOrder = 0;
+};
+
+class LIRIAURORAPLATFORMHEADERS_EXPORT FrameTiming
+{
+public:
+    explicit FrameTiming() = default;
+
+    // Times are in microseconds, on the CLOCK_MONOTONIC clock
+    qint64 refreshInterval = 0;
+    qint64 lastPresentationTime = 0;
+    // When the frame being rendered, or else the last one, is expected on screen
+    qint64 predictedPresentationTime = 0;
+    // Time it takes to render a frame, as estimated from the last frames
+    qint64 renderTime = 0;
+    qint64 safetyMargin = 0;
+    quint64 presentedFrames = 0;
+    // Frames presented after the vblank they were rendered for
+    quint64 missedDeadlines = 0;
+    // Frames handed over to the display so far, the frame being rendered
+    // is the next one and PresentationEvent reports it with this number
+    quint64 renderedFrames = 0;
+    // Commits that flip and reads of DRM events so far, counted for the
+    // whole device: synchronized screens share them
+    quint64 commitIoctls = 0;
+    quint64 eventReads = 0;
+};
+
 class LIRIAURORAPLATFORMHEADERS_EXPORT EglFSFunctions
 {
 public:
@@ -82,6 +147,87 @@ public:
     typedef void (*DisableScreenCastType)(QScreen *screen);
     static QByteArray disableScreenCastIdentifier();
     static void disableScreenCast(QScreen *screen);
+
+    // Whether enableScreenCast() makes the screen export its next page flip
+    typedef bool (*IsScreenCastSupportedType)(QScreen *screen);
+    static QByteArray isScreenCastSupportedIdentifier();
+    static bool isScreenCastSupported(QScreen *screen);
+
+    typedef bool (*SetScanoutBufferType)(QScreen *screen, const ScanoutBuffer &buffer);
+    static QByteArray setScanoutBufferIdentifier();
+    static bool setScanoutBuffer(QScreen *screen, const ScanoutBuffer &buffer);
+
+    typedef void (*ReleaseScanoutBufferType)(quintptr key);
+    static QByteArray releaseScanoutBufferIdentifier();
+    static void releaseScanoutBuffer(quintptr key);
+
+    typedef int (*CreateOverlayLayerType)(QScreen *screen);
+    static QByteArray createOverlayLayerIdentifier();
+    static int createOverlayLayer(QScreen *screen);
+
+    typedef void (*DestroyOverlayLayerType)(QScreen *screen, int id);
+    static QByteArray destroyOverlayLayerIdentifier();
+    static void destroyOverlayLayer(QScreen *screen, int id);
+
+    typedef bool (*UpdateOverlayLayerType)(QScreen *screen, int id, const OverlayLayer &layer);
+    static QByteArray updateOverlayLayerIdentifier();
+    static bool updateOverlayLayer(QScreen *screen, int id, const OverlayLayer &layer);
+
+    typedef void (*HideOverlayLayerType)(QScreen *screen, int id);
+    static QByteArray hideOverlayLayerIdentifier();
+    static void hideOverlayLayer(QScreen *screen, int id);
+
+    // A null image gives the cursor back to the window
+    typedef bool (*SetCursorImageType)(QScreen *screen, const QImage &image, const QPoint &hotSpot);
+    static QByteArray setCursorImageIdentifier();
+    static bool setCursorImage(QScreen *screen, const QImage &image, const QPoint &hotSpot);
+
+    typedef FrameTiming (*GetFrameTimingType)(QScreen *screen);
+    static QByteArray getFrameTimingIdentifier();
+    static FrameTiming getFrameTiming(QScreen *screen);
+
+    // How long before the deadline rendering starts, in microseconds
+    typedef void (*SetFrameSafetyMarginType)(QScreen *screen, qint64 usecs);
+    static QByteArray setFrameSafetyMarginIdentifier();
+    static void setFrameSafetyMargin(QScreen *screen, qint64 usecs);
+
+    // Returns false when the screen doesn't support variable refresh rate
+    typedef bool (*SetVariableRefreshRateType)(QScreen *screen, bool enabled);
+    static QByteArray setVariableRefreshRateIdentifier();
+    static bool setVariableRefreshRate(QScreen *screen, bool enabled);
+
+    // What changed in the frame about to be rendered since the previous one,
+    // in pixels; set while the scene is synchronized
+    typedef void (*SetFrameDamageType)(QWindow *window, const QRegion &region);
+    static QByteArray setFrameDamageIdentifier();
+    static void setFrameDamage(QWindow *window, const QRegion &region);
+};
+
+// Posted to the QScreen when a frame is on screen
+class LIRIAURORAPLATFORMHEADERS_EXPORT PresentationEvent : public QEvent
+{
+public:
+    explicit PresentationEvent();
+
+    // Number of the frame, as in FrameTiming::renderedFrames, frames
+    // before it were either presented already or dropped
+    quint64 frame = 0;
+    // Vblank counter and time of the flip, on the CLOCK_MONOTONIC clock
+    quint64 sequence = 0;
+    quint64 tv_sec = 0;
+    quint32 tv_nsec = 0;
+    // Time until the next refresh, 0 when the refresh rate is variable
+    quint32 refreshNsec = 0;
+    // Flipped without waiting for the vblank
+    bool tearing = false;
+    // Client buffer shown instead of the frame, 0 when it was composited
+    quintptr scanoutKey = 0;
+    // Client buffers shown by overlay planes
+    QList<quintptr> overlayKeys;
+
+    static QEvent::Type eventType;
+
+    static QEvent::Type registeredType();
 };
 
 class LIRIAURORAPLATFORMHEADERS_EXPORT ScreenCastFrameEvent : public QEvent
@@ -90,6 +236,8 @@ public:
     explicit ScreenCastFrameEvent();
 
     QScreen *screen = nullptr;
+    quint64 serial = 0;
+    // Crop offset inside the buffer, not the screen position
     QPoint offset;
     QSize size;
     quint32 drmFormat = 0;
@@ -105,8 +253,10 @@ class LIRIAURORAPLATFORMHEADERS_EXPORT ScreenCastObjectEvent : public QEvent
 {
 public:
     explicit ScreenCastObjectEvent();
+    ~ScreenCastObjectEvent();
 
     QScreen *screen = nullptr;
+    quint64 serial = 0;
     quint32 index = 0;
     int fd = -1;
     quint32 size = 0;
@@ -125,6 +275,7 @@ public:
     explicit ScreenCastReadyEvent();
 
     QScreen *screen = nullptr;
+    quint64 serial = 0;
     quint64 tv_sec = 0;
     quint32 tv_nsec = 0;
 
@@ -133,6 +284,26 @@ public:
     static QEvent::Type registeredType();
 };
 
+class LIRIAURORAPLATFORMHEADERS_EXPORT ScreenCastCancelEvent : public QEvent
+{
+public:
+    enum Reason {
+        Temporary = 0,
+        Permanent,
+        Resizing
+    };
+
+    explicit ScreenCastCancelEvent();
+
+    QScreen *screen = nullptr;
+    quint64 serial = 0;
+    Reason reason = Temporary;
+
+    static QEvent::Type eventType;
+
+    static QEvent::Type registeredType();
+};
+
 } // namespace PlatformSupport
 
 } // namespace Aurora
@@ -13,6 +13,7 @@
 #define EDID_DESCRIPTOR_ALPHANUMERIC_STRING 0xfe
 #define EDID_DESCRIPTOR_PRODUCT_NAME 0xfc
 #define EDID_DESCRIPTOR_SERIAL_NUMBER 0xff
+#define EDID_DESCRIPTOR_RANGE_LIMITS 0xfd
 
 #define EDID_DATA_BLOCK_COUNT 4
 #define EDID_OFFSET_DATA_BLOCKS 0x36
@@ -154,18 +155,24 @@ bool EdidParser::parse(const QByteArray &blob)
         serialNumber = QString();
 
     // Parse EDID data
+    minRefreshRate = maxRefreshRate = 0;
     for (int i = 0; i < EDID_DATA_BLOCK_COUNT; ++i) {
         const uint offset = EDID_OFFSET_DATA_BLOCKS + i * 18;
 
         if (data[offset] != 0 || data[offset + 1] != 0 || data[offset + 2] != 0)
             continue;
 
-        if (data[offset + 3] == EDID_DESCRIPTOR_PRODUCT_NAME)
+        if (data[offset + 3] == EDID_DESCRIPTOR_PRODUCT_NAME) {
             model = parseEdidString(&data[offset + 5]);
-        else if (data[offset + 3] == EDID_DESCRIPTOR_ALPHANUMERIC_STRING)
+        } else if (data[offset + 3] == EDID_DESCRIPTOR_ALPHANUMERIC_STRING) {
             identifier = parseEdidString(&data[offset + 5]);
-        else if (data[offset + 3] == EDID_DESCRIPTOR_SERIAL_NUMBER)
+        } else if (data[offset + 3] == EDID_DESCRIPTOR_SERIAL_NUMBER) {
             serialNumber = parseEdidString(&data[offset + 5]);
+        } else if (data[offset + 3] == EDID_DESCRIPTOR_RANGE_LIMITS) {
+            // Rates above 255 Hz have an offset flag since EDID 1.4
+            minRefreshRate = data[offset + 5] + ((data[offset + 4] & 0x01) ? 255 : 0);
+            maxRefreshRate = data[offset + 6] + ((data[offset + 4] & 0x02) ? 255 : 0);
+        }
     }
 
     // Try to use cache first because it is potentially more updated
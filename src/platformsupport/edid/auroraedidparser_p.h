@@ -48,6 +48,9 @@ public:
     QList<QList<uint16_t>> tables;
     bool sRgb;
     bool useTables;
+    // Vertical refresh rates the monitor accepts, 0 when unknown
+    int minRefreshRate = 0;
+    int maxRefreshRate = 0;
 
 private:
     QString parseEdidString(const quint8 *data);
@@ -51,6 +51,10 @@
 
 #define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
 
+#ifndef DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP
+#define DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP 0x15
+#endif
+
 Q_LOGGING_CATEGORY(qLcKmsDebug, "aurora.eglfs.kms")
 
 namespace Aurora {
@@ -615,6 +619,7 @@ KmsDevice::KmsDevice(KmsScreenConfig *screenConfig, const QString &path)
     , m_path(path)
     , m_dri_fd(-1)
     , m_has_atomic_support(false)
+    , m_has_atomic_async_page_flip(false)
     , m_crtc_allocator(0)
 {
     if (m_path.isEmpty()) {
@@ -688,6 +693,14 @@ void KmsDevice::createScreens()
             m_has_atomic_support = false;
         }
     }
+
+    // Tearing flips of atomic requests, older kernels only have them
+    // with the legacy API
+    if (m_has_atomic_support) {
+        uint64_t value = 0;
+        m_has_atomic_async_page_flip = !drmGetCap(m_dri_fd, DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP, &value) && value;
+        qCDebug(qLcKmsDebug, "Atomic async page flip %s", m_has_atomic_async_page_flip ? "supported" : "not supported");
+    }
 #endif
 
     drmModeResPtr resources = drmModeGetResources(m_dri_fd);
@@ -902,7 +915,7 @@ void KmsDevice::discoverPlanes()
             continue;
         }
 
-        enumerateProperties(objProps, [&plane](drmModePropertyPtr prop, quint64 value) {
+        enumerateProperties(objProps, [this, &plane](drmModePropertyPtr prop, quint64 value) {
             if (!strcmp(prop->name, "type")) {
                 plane.type = KmsPlane::Type(value);
             } else if (!strcmp(prop->name, "rotation")) {
@@ -937,6 +950,10 @@ void KmsDevice::discoverPlanes()
                 plane.zposPropertyId = prop->prop_id;
             } else if (!strcasecmp(prop->name, "blend_op")) {
                 plane.blendOpPropertyId = prop->prop_id;
+            } else if (!strcasecmp(prop->name, "fb_damage_clips")) {
+                plane.damageClipsPropertyId = prop->prop_id;
+            } else if (!strcmp(prop->name, "IN_FORMATS")) {
+                parseFormatModifiers(uint32_t(value), &plane);
             }
         });
 
@@ -948,6 +965,46 @@ void KmsDevice::discoverPlanes()
     drmModeFreePlaneResources(planeResources);
 }
 
+/*
+    Fills the modifiers supported by \a plane for each format from the
+    IN_FORMATS blob \a blobId.
+*/
+void KmsDevice::parseFormatModifiers(uint32_t blobId, KmsPlane *plane)
+{
+    drmModePropertyBlobPtr blob = drmModeGetPropertyBlob(m_dri_fd, blobId);
+    if (!blob)
+        return;
+
+    const auto *data = static_cast<const uint8_t *>(blob->data);
+    const auto *header = static_cast<const drm_format_modifier_blob *>(blob->data);
+    const bool valid = blob->length >= sizeof(*header)
+            && header->version == FORMAT_BLOB_CURRENT
+            && header->formats_offset + quint64(header->count_formats) * sizeof(uint32_t) <= blob->length
+            && header->modifiers_offset + quint64(header->count_modifiers) * sizeof(drm_format_modifier) <= blob->length;
+    if (!valid) {
+        qCDebug(qLcKmsDebug, "Invalid IN_FORMATS blob for plane %u", plane->id);
+        drmModeFreePropertyBlob(blob);
+        return;
+    }
+
+    const auto *formats = reinterpret_cast<const uint32_t *>(data + header->formats_offset);
+    const auto *modifiers = reinterpret_cast<const drm_format_modifier *>(data + header->modifiers_offset);
+    for (uint32_t i = 0; i < header->count_modifiers; ++i) {
+        // Each modifier has a mask of 64 formats, starting from its offset
+        const drm_format_modifier &modifier = modifiers[i];
+        for (uint32_t bit = 0; bit < 64; ++bit) {
+            const uint32_t index = modifier.offset + bit;
+            if ((modifier.formats & (1ULL << bit)) && index < header->count_formats)
+                plane->supportedModifiers[formats[index]].append(modifier.modifier);
+        }
+    }
+
+    qCDebug(qLcKmsDebug, "plane %u: %u modifiers for %u formats",
+            plane->id, header->count_modifiers, header->count_formats);
+
+    drmModeFreePropertyBlob(blob);
+}
+
 int KmsDevice::fd() const
 {
     return m_dri_fd;
@@ -969,6 +1026,11 @@ bool KmsDevice::hasAtomicSupport()
     return m_has_atomic_support;
 }
 
+bool KmsDevice::hasAtomicAsyncPageFlip()
+{
+    return m_has_atomic_async_page_flip;
+}
+
 #ifdef EGLFS_ENABLE_DRM_ATOMIC
 drmModeAtomicReq *KmsDevice::threadLocalAtomicRequest()
 {
@@ -982,21 +1044,33 @@ drmModeAtomicReq *KmsDevice::threadLocalAtomicRequest()
     return a.request;
 }
 
-bool KmsDevice::threadLocalAtomicCommit(void *user_data)
+/*
+    Commits the request of the thread. An \a async commit flips right away
+    instead of waiting for the vblank: the kernel refuses it for anything
+    else than a new framebuffer on planes that are already shown, and
+    refuses mode sets.
+*/
+bool KmsDevice::threadLocalAtomicCommit(void *user_data, bool async)
 {
-    if (!m_has_atomic_support)
+    if (!m_has_atomic_support || (async && !m_has_atomic_async_page_flip))
         return false;
 
     AtomicReqs &a(m_atomicReqs.localData());
     if (!a.request)
         return false;
 
-    int ret = drmModeAtomicCommit(m_dri_fd, a.request,
-                                  DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_ATOMIC_ALLOW_MODESET,
-                                  user_data);
+    const uint32_t flags = async
+            ? DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_PAGE_FLIP_ASYNC
+            : DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_ATOMIC_ALLOW_MODESET;
+    int ret = drmModeAtomicCommit(m_dri_fd, a.request, flags, user_data);
+    countCommitIoctl();
 
     if (ret) {
-        qWarning("Failed to commit atomic request (code=%d)", ret);
+        // Drivers refuse tearing for some changes, the caller flips with vsync
+        if (async)
+            qCDebug(qLcKmsDebug, "Async atomic commit refused (code=%d)", ret);
+        else
+            qWarning("Failed to commit atomic request (code=%d)", ret);
         return false;
     }
 
@@ -1028,9 +1102,10 @@ void KmsDevice::parseConnectorProperties(uint32_t connectorId, KmsOutput *output
     }
 
     enumerateProperties(objProps, [output](drmModePropertyPtr prop, quint64 value) {
-        Q_UNUSED(value);
         if (!strcasecmp(prop->name, "crtc_id"))
             output->crtcIdPropertyId = prop->prop_id;
+        else if (!strcasecmp(prop->name, "vrr_capable"))
+            output->vrr_capable = value != 0;
     });
 
     drmModeFreeObjectProperties(objProps);
@@ -1050,6 +1125,8 @@ void KmsDevice::parseCrtcProperties(uint32_t crtcId, KmsOutput *output)
             output->modeIdPropertyId = prop->prop_id;
         else if (!strcasecmp(prop->name, "active"))
             output->activePropertyId = prop->prop_id;
+        else if (!strcasecmp(prop->name, "vrr_enabled"))
+            output->vrrEnabledPropertyId = prop->prop_id;
     });
 
     drmModeFreeObjectProperties(objProps);
@@ -1064,6 +1141,7 @@ KmsScreenConfig::KmsScreenConfig()
     : m_headless(false)
     , m_hwCursor(true)
     , m_separateScreens(false)
+    , m_synchronizedOutputs(false)
     , m_pbuffers(false)
     , m_virtualDesktopLayout(VirtualDesktopLayoutHorizontal)
 {
@@ -1111,6 +1189,7 @@ void KmsScreenConfig::loadConfig()
     m_pbuffers = object.value(QLatin1String("pbuffers")).toBool(m_pbuffers);
     m_devicePath = object.value(QLatin1String("device")).toString();
     m_separateScreens = object.value(QLatin1String("separateScreens")).toBool(m_separateScreens);
+    m_synchronizedOutputs = object.value(QLatin1String("synchronizedOutputs")).toBool(m_synchronizedOutputs);
 
     const QString vdOriString = object.value(QLatin1String("virtualDesktopLayout")).toString();
     if (!vdOriString.isEmpty()) {
@@ -1142,6 +1221,7 @@ void KmsScreenConfig::loadConfig()
                          << "\thwcursor:" << m_hwCursor << "\n"
                          << "\tpbuffers:" << m_pbuffers << "\n"
                          << "\tseparateScreens:" << m_separateScreens << "\n"
+                         << "\tsynchronizedOutputs:" << m_synchronizedOutputs << "\n"
                          << "\tvirtualDesktopLayout:" << m_virtualDesktopLayout << "\n"
                          << "\toutputs:" << m_outputSettings;
 }
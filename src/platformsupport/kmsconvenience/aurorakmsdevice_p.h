@@ -54,6 +54,8 @@
 
 #include <QtGui/private/qtguiglobal_p.h>
 #include <qpa/qplatformscreen.h>
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QHash>
 #include <QtCore/QMap>
 #include <QtCore/QVariant>
 #include <QtCore/QThreadStorage>
@@ -119,6 +121,7 @@ public:
     QSize headlessSize() const { return m_headlessSize; }
     bool hwCursor() const { return m_hwCursor; }
     bool separateScreens() const { return m_separateScreens; }
+    bool synchronizedOutputs() const { return m_synchronizedOutputs; }
     bool supportsPBuffers() const { return m_pbuffers; }
     VirtualDesktopLayout virtualDesktopLayout() const { return m_virtualDesktopLayout; }
 
@@ -132,6 +135,7 @@ private:
     QSize m_headlessSize;
     bool m_hwCursor;
     bool m_separateScreens;
+    bool m_synchronizedOutputs;
     bool m_pbuffers;
     VirtualDesktopLayout m_virtualDesktopLayout;
     QMap<QString, QVariantMap> m_outputSettings;
@@ -165,6 +169,8 @@ struct KmsPlane
     int possibleCrtcs = 0;
 
     QVector<uint32_t> supportedFormats;
+    // Modifiers of each format, from IN_FORMATS
+    QHash<uint32_t, QVector<uint64_t>> supportedModifiers;
 
     Rotations initialRotation = Rotation0;
     Rotations availableRotations = Rotation0;
@@ -181,6 +187,7 @@ struct KmsPlane
     uint32_t crtcheightPropertyId = 0;
     uint32_t zposPropertyId = 0;
     uint32_t blendOpPropertyId = 0;
+    uint32_t damageClipsPropertyId = 0;
 
     uint32_t activeCrtcId = 0;
 };
@@ -214,6 +221,8 @@ struct KmsOutput
     uint32_t crtcIdPropertyId = 0;
     uint32_t modeIdPropertyId = 0;
     uint32_t activePropertyId = 0;
+    uint32_t vrrEnabledPropertyId = 0;
+    bool vrr_capable = false;
 
     uint32_t mode_blob_id = 0;
 
@@ -241,14 +250,21 @@ public:
     virtual void *nativeDisplay() const = 0;
 
     bool hasAtomicSupport();
+    bool hasAtomicAsyncPageFlip();
 
 #ifdef EGLFS_ENABLE_DRM_ATOMIC
     drmModeAtomicReq *threadLocalAtomicRequest();
-    bool threadLocalAtomicCommit(void *user_data);
+    bool threadLocalAtomicCommit(void *user_data, bool async = false);
     void threadLocalAtomicReset();
 #endif
     void createScreens();
 
+    // Commits that flip and reads of DRM events, counted from any thread
+    void countCommitIoctl() { m_commitIoctls.ref(); }
+    void countEventRead() { m_eventReads.ref(); }
+    quint64 commitIoctls() const { return m_commitIoctls.loadRelaxed(); }
+    quint64 eventReads() const { return m_eventReads.loadRelaxed(); }
+
     int fd() const;
     QString devicePath() const;
 
@@ -277,12 +293,17 @@ protected:
     void discoverPlanes();
     void parseConnectorProperties(uint32_t connectorId, KmsOutput *output);
     void parseCrtcProperties(uint32_t crtcId, KmsOutput *output);
+    void parseFormatModifiers(uint32_t blobId, KmsPlane *plane);
 
     KmsScreenConfig *m_screenConfig;
     QString m_path;
     int m_dri_fd;
 
     bool m_has_atomic_support;
+    bool m_has_atomic_async_page_flip;
+
+    QAtomicInteger<quint64> m_commitIoctls = 0;
+    QAtomicInteger<quint64> m_eventReads = 0;
 
 #ifdef EGLFS_ENABLE_DRM_ATOMIC
     struct AtomicReqs {
@@ -0,0 +1,30 @@
+// SPDX-FileCopyrightText: 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <LiriAuroraCompositor/private/aurorawlhardwarelayerintegrationplugin_p.h>
+#include "drmoverlayhardwarelayerintegration.h"
+
+namespace Aurora {
+
+namespace Compositor {
+
+class DrmOverlayHardwareLayerIntegrationPlugin : public Internal::HardwareLayerIntegrationPlugin
+{
+    Q_OBJECT
+    Q_PLUGIN_METADATA(IID AuroraHardwareLayerIntegrationFactoryInterface_iid FILE "drm-overlay.json")
+public:
+    Internal::HardwareLayerIntegration *create(const QString&, const QStringList&) override;
+};
+
+Internal::HardwareLayerIntegration *DrmOverlayHardwareLayerIntegrationPlugin::create(const QString& system, const QStringList& paramList)
+{
+    Q_UNUSED(paramList);
+    Q_UNUSED(system);
+    return new DrmOverlayHardwareLayerIntegration();
+}
+
+} // namespace Compositor
+
+} // namespace Aurora
+
+#include "main.moc"
@@ -107,13 +107,18 @@ void QEglFSContext::swapBuffers(QPlatformSurface *surface)
     // draw the cursor
     if (surface->surface()->surfaceClass() == QSurface::Window) {
         QPlatformWindow *window = static_cast<QPlatformWindow *>(surface);
-        if (QEglFSCursor *cursor = qobject_cast<QEglFSCursor *>(window->screen()->cursor()))
+        if (QEglFSCursor *cursor = qobject_cast<QEglFSCursor *>(window->screen()->cursor())) {
             cursor->paintOnScreen();
+            static_cast<QEglFSWindow *>(surface)->setFrameDamage(QRegion(QRect(QPoint(0, 0), window->geometry().size())));
+        }
     }
 
     qt_egl_device_integration()->waitForVSync(surface);
     QEGLPlatformContext::swapBuffers(surface);
     qt_egl_device_integration()->presentBuffer(surface);
+
+    if (surface->surface()->surfaceClass() == QSurface::Window)
+        static_cast<QEglFSWindow *>(surface)->endFrame();
 }
 
 QT_END_NAMESPACE
@@ -442,6 +442,8 @@ QFunctionPointer QEglFSIntegration::platformFunction(const QByteArray &function)
         return QFunctionPointer(enableScreenCastStatic);
     else if (function == Aurora::PlatformSupport::EglFSFunctions::disableScreenCastIdentifier())
         return QFunctionPointer(disableScreenCastStatic);
+    else if (function == Aurora::PlatformSupport::EglFSFunctions::setFrameDamageIdentifier())
+        return QFunctionPointer(setFrameDamageStatic);
 
     return qt_egl_device_integration()->platformFunction(function);
 }
@@ -507,6 +509,12 @@ void QEglFSIntegration::disableScreenCastStatic(QScreen *screen)
     platformScreen->setRecordingEnabled(false);
 }
 
+void QEglFSIntegration::setFrameDamageStatic(QWindow *window, const QRegion &region)
+{
+    if (window && window->handle())
+        static_cast<QEglFSWindow *>(window->handle())->setFrameDamage(region);
+}
+
 EGLNativeDisplayType QEglFSIntegration::nativeDisplay() const
 {
     return qt_egl_device_integration()->platformDisplay();
@@ -131,6 +131,8 @@ private:
     static void enableScreenCastStatic(QScreen *screen);
     static void disableScreenCastStatic(QScreen *screen);
 
+    static void setFrameDamageStatic(QWindow *window, const QRegion &region);
+
     EGLDisplay m_display;
     QPlatformInputContext *m_inputContext;
     QScopedPointer<QPlatformFontDatabase> m_fontDb;
@@ -51,6 +51,7 @@
 //
 
 #include "qeglfsglobal_p.h"
+#include <QtCore/QAtomicInteger>
 #include <QtCore/QPointer>
 
 #include <qpa/qplatformscreen.h>
@@ -97,8 +98,9 @@ public:
     virtual bool modeChangeRequested() const { return m_modeChangeRequested; }
     virtual void setModeChangeRequested(bool enabled) { m_modeChangeRequested = enabled; }
 
-    bool isRecordingEnabled() const { return m_recordingEnabled; }
-    void setRecordingEnabled(bool enabled) { m_recordingEnabled = enabled; }
+    // Requested by the compositor, served by the thread flipping buffers
+    bool isRecordingEnabled() const { return m_recordingEnabled.loadAcquire(); }
+    void setRecordingEnabled(bool enabled) { m_recordingEnabled.storeRelease(enabled); }
 
 protected:
     bool m_modeChangeRequested = false;
@@ -110,7 +112,7 @@ private:
     EGLSurface m_surface;
     QPlatformCursor *m_cursor;
     qreal m_scaleFactor = 1;
-    bool m_recordingEnabled = false;
+    QAtomicInteger<bool> m_recordingEnabled = false;
 
     friend class QEglFSWindow;
 };
@@ -38,6 +38,7 @@
 ****************************************************************************/
 
 #include <QtCore/qtextstream.h>
+#include <QtCore/qvarlengtharray.h>
 #include <qpa/qwindowsysteminterface.h>
 #include <qpa/qplatformintegration.h>
 #include <private/qguiapplication_p.h>
@@ -58,6 +59,14 @@
 
 QT_BEGIN_NAMESPACE
 
+#ifndef EGL_KHR_partial_update
+typedef EGLBoolean (EGLAPIENTRYP PFNEGLSETDAMAGEREGIONKHRPROC) (EGLDisplay dpy, EGLSurface surface, EGLint *rects, EGLint n_rects);
+#endif
+
+#ifndef EGL_EXT_buffer_age
+#define EGL_BUFFER_AGE_EXT 0x313D
+#endif
+
 QEglFSWindow::QEglFSWindow(QWindow *w)
     : QPlatformWindow(w),
 #ifndef QT_NO_OPENGL
@@ -192,6 +201,7 @@ void QEglFSWindow::invalidateSurface()
     }
     qt_egl_device_integration()->destroyNativeWindow(m_window);
     m_window = 0;
+    m_damageHistory.clear();
 }
 
 void QEglFSWindow::resetSurface()
@@ -224,6 +234,7 @@ bool QEglFSWindow::resizeSurface(const QSize &size)
     screen()->setPrimarySurface(surface);
     m_window = window;
     m_surface = surface;
+    m_damageHistory.clear();
 
     // New surface created: destroy the old one
     if (oldSurface != EGL_NO_SURFACE)
@@ -376,6 +387,107 @@ WId QEglFSWindow::winId() const
     return m_winId;
 }
 
+/*
+    Sets what changed in the frame about to be rendered, in pixels, since
+    the previous one. Frames without damage are entirely damaged.
+*/
+void QEglFSWindow::setFrameDamage(const QRegion &region)
+{
+    m_frameDamage = region;
+    m_hasFrameDamage = true;
+
+    // Set while the scene is synchronized, the context was made current
+    // for the frame already and nothing was drawn yet
+    if (m_surface != EGL_NO_SURFACE && eglGetCurrentSurface(EGL_DRAW) == m_surface)
+        applyDamageRegion();
+}
+
+QRegion QEglFSWindow::frameDamage() const
+{
+    if (m_hasFrameDamage)
+        return m_frameDamage;
+    return QRegion(QRect(QPoint(0, 0), geometry().size()));
+}
+
+/*
+    Limits rendering to what changed since the back buffer was shown
+    with EGL_KHR_partial_update, tiled GPUs then only load and store the
+    tiles that were damaged.
+
+    The surface must be current, the damage region can only be set before
+    the first draw call of the frame.
+*/
+void QEglFSWindow::applyDamageRegion()
+{
+    if (m_damageRegionApplied || !m_hasFrameDamage || m_surface == EGL_NO_SURFACE)
+        return;
+
+    // Once per frame, whatever happens
+    m_damageRegionApplied = true;
+
+#ifndef QT_NO_OPENGL
+    // The cursor drawn by OpenGL is not part of the damage
+    if (qobject_cast<QEglFSCursor *>(screen()->cursor()))
+        return;
+#endif
+
+    EGLDisplay display = screen()->display();
+    static PFNEGLSETDAMAGEREGIONKHRPROC setDamageRegion = nullptr;
+    static bool resolved = false;
+    if (!resolved) {
+        resolved = true;
+        const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+        if (extensions && strstr(extensions, "EGL_KHR_partial_update") && strstr(extensions, "EGL_EXT_buffer_age"))
+            setDamageRegion = reinterpret_cast<PFNEGLSETDAMAGEREGIONKHRPROC>(eglGetProcAddress("eglSetDamageRegionKHR"));
+    }
+    if (!setDamageRegion)
+        return;
+
+    // Nothing is known about new buffers or buffers older than the history
+    EGLint age = 0;
+    if (!eglQuerySurface(display, m_surface, EGL_BUFFER_AGE_EXT, &age) || age <= 0 || age > m_damageHistory.size() + 1)
+        return;
+
+    QRegion region = m_frameDamage;
+    for (int i = 0; i < age - 1; ++i)
+        region |= m_damageHistory.at(i);
+
+    // The buffer is up to date, as when a client buffer is scanned out in
+    // place of the frame: an empty region would damage the whole surface,
+    // a single pixel lets the GPU skip the rest
+    if (region.isEmpty())
+        region = QRect(0, 0, 1, 1);
+
+    // EGL rectangles start from the bottom left corner
+    EGLint height = 0;
+    eglQuerySurface(display, m_surface, EGL_HEIGHT, &height);
+
+    QVarLengthArray<EGLint, 16> rects;
+    for (const QRect &rect : region) {
+        rects.append(rect.x());
+        rects.append(height - rect.y() - rect.height());
+        rects.append(rect.width());
+        rects.append(rect.height());
+    }
+
+    setDamageRegion(display, m_surface, rects.data(), region.rectCount());
+}
+
+/*
+    Called after the frame was swapped and presented.
+*/
+void QEglFSWindow::endFrame()
+{
+    // Up to four buffers in flight
+    m_damageHistory.prepend(frameDamage());
+    while (m_damageHistory.size() > 4)
+        m_damageHistory.removeLast();
+
+    m_frameDamage = QRegion();
+    m_hasFrameDamage = false;
+    m_damageRegionApplied = false;
+}
+
 void QEglFSWindow::setOpacity(qreal)
 {
     if (!isRaster())
@@ -54,6 +54,8 @@
 #include "qeglfsintegration_p.h"
 #include "qeglfsscreen_p.h"
 
+#include <QtCore/QList>
+#include <QtGui/QRegion>
 #include <qpa/qplatformwindow.h>
 #ifndef QT_NO_OPENGL
 # include <QtPlatformCompositorSupport/private/qopenglcompositor_p.h>
@@ -106,6 +108,11 @@ public:
     virtual void resetSurface();
     virtual bool resizeSurface(const QSize &size);
 
+    void setFrameDamage(const QRegion &region);
+    QRegion frameDamage() const;
+    void applyDamageRegion();
+    void endFrame();
+
 #ifndef QT_NO_OPENGL
     QOpenGLCompositorBackingStore *backingStore() { return m_backingStore; }
     void setBackingStore(QOpenGLCompositorBackingStore *backingStore) { m_backingStore = backingStore; }
@@ -130,6 +137,13 @@ protected:
     EGLConfig m_config;
     QSurfaceFormat m_format;
 
+    // Damage of the frame being rendered, in pixels, relative to the
+    // previous frame and of the last frames, most recent first
+    QRegion m_frameDamage;
+    bool m_hasFrameDamage = false;
+    bool m_damageRegionApplied = false;
+    QList<QRegion> m_damageHistory;
+
     enum Flag {
         Created = 0x01,
         HasNativeWindow = 0x02
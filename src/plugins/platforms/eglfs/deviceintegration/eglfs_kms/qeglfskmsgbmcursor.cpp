@@ -70,6 +70,7 @@ QEglFSKmsGbmCursor::QEglFSKmsGbmCursor(QEglFSKmsGbmScreen *screen)
     , m_cursorSize(64, 64) // 64x64 is the old standard size, we now try to query the real size below
     , m_bo(nullptr)
     , m_cursorImage(nullptr, nullptr, 0, 0, 0, 0)
+    , m_clientCursor(false)
     , m_state(CursorPendingVisible)
     , m_deviceListener(nullptr)
 {
@@ -178,9 +179,18 @@ void QEglFSKmsGbmCursor::changeCursor(QCursor *windowCursor, QWindow *window)
         }
     }
 
+    if (windowCursor)
+        m_windowCursor = *windowCursor;
+
     if (m_state == CursorHidden || m_state == CursorDisabled)
         return;
 
+    // The compositor shows the cursor of a client until it gives it back
+    if (m_clientCursor) {
+        uploadCursorImage();
+        return;
+    }
+
     const Qt::CursorShape newShape = windowCursor ? windowCursor->shape() : Qt::ArrowCursor;
     if (newShape == Qt::BitmapCursor) {
         m_cursorImage.set(windowCursor->pixmap().toImage(),
@@ -209,6 +219,61 @@ void QEglFSKmsGbmCursor::changeCursor(QCursor *windowCursor, QWindow *window)
         }
     }
 
+    uploadCursorImage();
+}
+#endif // QT_NO_CURSOR
+
+/*
+    Shows \a image, with the hot spot at \a hotSpot, instead of the window
+    cursor. The compositor uses it for the cursor surface of a client, the
+    plane moves with the pointer without the scene being redrawn.
+
+    Returns \c false when the hardware cursor can't show \a image.
+*/
+bool QEglFSKmsGbmCursor::setClientCursor(const QImage &image, const QPoint &hotSpot)
+{
+    if (!m_bo || m_state == CursorDisabled)
+        return false;
+
+    // Clipping or scaling the image is not an option
+    if (image.isNull() || image.width() > m_cursorSize.width() || image.height() > m_cursorSize.height())
+        return false;
+
+    const bool hotSpotChanged = !m_clientCursor || m_cursorImage.hotspot() != hotSpot;
+
+    // The image may wrap memory of the client, it's uploaded again later
+    m_clientCursor = true;
+    m_cursorImage.set(image.copy(), hotSpot.x(), hotSpot.y());
+
+    if (m_state == CursorHidden || m_state == CursorPendingHidden)
+        return true;
+
+    uploadCursorImage();
+    if (hotSpotChanged)
+        setPos(m_pos);
+
+    return true;
+}
+
+/*
+    Gives the cursor back to the window.
+*/
+void QEglFSKmsGbmCursor::unsetClientCursor()
+{
+    if (!m_clientCursor)
+        return;
+
+    m_clientCursor = false;
+
+#ifndef QT_NO_CURSOR
+    QCursor cursor = m_windowCursor;
+    changeCursor(&cursor, nullptr);
+#endif
+    setPos(m_pos);
+}
+
+void QEglFSKmsGbmCursor::uploadCursorImage()
+{
     if (m_cursorImage.image()->width() > m_cursorSize.width() || m_cursorImage.image()->height() > m_cursorSize.height())
         qWarning("Cursor larger than %dx%d, cursor will be clipped.", m_cursorSize.width(), m_cursorSize.height());
 
@@ -237,7 +302,6 @@ void QEglFSKmsGbmCursor::changeCursor(QCursor *windowCursor, QWindow *window)
             qWarning("Could not set cursor on screen %s: %d", kmsScreen->name().toLatin1().constData(), status);
     }
 }
-#endif // QT_NO_CURSOR
 
 QPoint QEglFSKmsGbmCursor::pos() const
 {
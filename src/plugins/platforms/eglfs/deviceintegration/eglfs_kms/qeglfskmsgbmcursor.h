@@ -41,6 +41,7 @@
 
 #include <qpa/qplatformcursor.h>
 #include <QtCore/QVector>
+#include <QtGui/QCursor>
 #include <QtGui/QImage>
 #include <QtGui/private/qinputdevicemanager_p.h>
 
@@ -89,8 +90,12 @@ public:
     void setCursorTheme(const QString &name, int size);
     void reevaluateVisibilityForScreens() { setPos(pos()); }
 
+    bool setClientCursor(const QImage &image, const QPoint &hotSpot);
+    void unsetClientCursor();
+
 private:
     void initCursorAtlas();
+    void uploadCursorImage();
 
     enum CursorState {
         CursorDisabled,
@@ -105,6 +110,11 @@ private:
     gbm_bo *m_bo;
     QPoint m_pos;
     QPlatformCursorImage m_cursorImage;
+    // Set by the compositor, replaces the cursor of the window
+    bool m_clientCursor;
+#ifndef QT_NO_CURSOR
+    QCursor m_windowCursor;
+#endif
     CursorState m_state;
     QEglFSKmsGbmCursorDeviceListener *m_deviceListener;
     Liri::Platform::XcursorTheme m_cursorTheme;
@@ -45,6 +45,7 @@
 #include "qeglfsintegration_p.h"
 
 #include <QtCore/QLoggingCategory>
+#include <QtCore/QMutexLocker>
 #include <QtCore/private/qcore_unix_p.h>
 
 #include <LiriAuroraLogind/Logind>
@@ -148,6 +149,137 @@ void QEglFSKmsGbmDevice::destroyGlobalCursor()
     }
 }
 
+/*
+    Reserves the plane \a planeId for one screen, returns false when
+    another screen already uses it.
+*/
+bool QEglFSKmsGbmDevice::acquirePlane(uint32_t planeId)
+{
+    QMutexLocker locker(&m_planesMutex);
+
+    if (m_acquiredPlanes.contains(planeId))
+        return false;
+
+    m_acquiredPlanes.insert(planeId);
+    return true;
+}
+
+void QEglFSKmsGbmDevice::releasePlane(uint32_t planeId)
+{
+    QMutexLocker locker(&m_planesMutex);
+    m_acquiredPlanes.remove(planeId);
+}
+
+/*
+    Adds the frame queued by \a screen to the next synchronized commit,
+    which is done right away unless a synchronized flip is in flight.
+
+    Synchronized outputs are enabled with "synchronizedOutputs" in the
+    KMS configuration file: all screens of the device are committed in
+    one atomic request, and flip on the same vblank when their modes
+    share the timing.
+*/
+void QEglFSKmsGbmDevice::scheduleSynchronizedFlip(QEglFSKmsGbmScreen *screen)
+{
+    QMutexLocker locker(&m_syncMutex);
+
+    if (!m_syncReady.contains(screen))
+        m_syncReady.append(screen);
+
+    if (m_syncPending.isEmpty())
+        commitSynchronizedFlip();
+}
+
+/*
+    Called when the flip of \a screen completed, \a frameQueued tells
+    whether another frame waits behind it. The next synchronized commit
+    is done once the flips of all screens completed.
+*/
+void QEglFSKmsGbmDevice::synchronizedFlipFinished(QEglFSKmsGbmScreen *screen, bool frameQueued)
+{
+    QMutexLocker locker(&m_syncMutex);
+
+    m_syncPending.removeOne(screen);
+    if (frameQueued && !m_syncReady.contains(screen))
+        m_syncReady.append(screen);
+
+    if (m_syncPending.isEmpty())
+        commitSynchronizedFlip();
+}
+
+/*
+    Page flip events of a synchronized commit all carry the screen that
+    committed it, hand each one to the screen of \a crtcId.
+*/
+void QEglFSKmsGbmDevice::synchronizedPageFlipped(unsigned int crtcId, unsigned int sequence,
+                                                 unsigned int tv_sec, unsigned int tv_usec)
+{
+    QEglFSKmsGbmScreen *target = nullptr;
+    {
+        QMutexLocker locker(&m_syncMutex);
+        for (QEglFSKmsGbmScreen *screen : qAsConst(m_syncPending)) {
+            if (screen->output().crtc_id == crtcId) {
+                target = screen;
+                break;
+            }
+        }
+    }
+
+    // Clones complete along with their source
+    if (target)
+        target->pageFlipped(crtcId, sequence, tv_sec, tv_usec);
+}
+
+void QEglFSKmsGbmDevice::removeSynchronizedScreen(QEglFSKmsGbmScreen *screen)
+{
+    QMutexLocker locker(&m_syncMutex);
+
+    m_syncReady.removeOne(screen);
+    if (m_syncPending.removeOne(screen) && m_syncPending.isEmpty())
+        commitSynchronizedFlip();
+}
+
+/*
+    Commits the frames queued by the screens in m_syncReady with a single
+    atomic request. When the request is refused, each screen commits its
+    frame on its own instead.
+
+    m_syncMutex must be locked, no synchronized flip may be in flight.
+*/
+void QEglFSKmsGbmDevice::commitSynchronizedFlip()
+{
+#ifdef EGLFS_ENABLE_DRM_ATOMIC
+    if (m_syncReady.isEmpty())
+        return;
+
+    drmModeAtomicReq *request = threadLocalAtomicRequest();
+    if (!request)
+        return;
+
+    QVector<QEglFSKmsGbmScreen *> screens;
+    for (QEglFSKmsGbmScreen *screen : qAsConst(m_syncReady)) {
+        if (screen->prepareSynchronizedFlip())
+            screens.append(screen);
+    }
+    m_syncReady.clear();
+
+    if (screens.isEmpty())
+        return;
+
+    const bool committed = threadLocalAtomicCommit(screens.first());
+    if (!committed) {
+        qCDebug(qLcEglfsKmsDebug, "Synchronized commit of %d screens failed, committing them separately",
+                int(screens.size()));
+        drmModeAtomicSetCursor(request, 0);
+    }
+
+    for (QEglFSKmsGbmScreen *screen : qAsConst(screens)) {
+        if (screen->finishSynchronizedFlip(committed))
+            m_syncPending.append(screen);
+    }
+#endif
+}
+
 QPlatformScreen *QEglFSKmsGbmDevice::createScreen(const KmsOutput &output)
 {
     QEglFSKmsGbmScreen *screen = new QEglFSKmsGbmScreen(this, output, false);
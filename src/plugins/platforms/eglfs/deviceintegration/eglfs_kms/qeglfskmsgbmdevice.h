@@ -41,6 +41,10 @@
 
 #pragma once
 
+#include <QtCore/QMutex>
+#include <QtCore/QSet>
+#include <QtCore/QVector>
+
 #include <LiriEglFSKmsSupport/qeglfskmsdevice.h>
 
 #include "qeglfskmsgbmcursor.h"
@@ -50,6 +54,7 @@
 QT_BEGIN_NAMESPACE
 
 class QEglFSKmsScreen;
+class QEglFSKmsGbmScreen;
 
 class QEglFSKmsGbmDevice: public QEglFSKmsDevice
 {
@@ -65,6 +70,15 @@ public:
     QPlatformCursor *globalCursor() const;
     void destroyGlobalCursor();
 
+    bool acquirePlane(uint32_t planeId);
+    void releasePlane(uint32_t planeId);
+
+    void scheduleSynchronizedFlip(QEglFSKmsGbmScreen *screen);
+    void synchronizedFlipFinished(QEglFSKmsGbmScreen *screen, bool frameQueued);
+    void synchronizedPageFlipped(unsigned int crtcId, unsigned int sequence,
+                                 unsigned int tv_sec, unsigned int tv_usec);
+    void removeSynchronizedScreen(QEglFSKmsGbmScreen *screen);
+
     QPlatformScreen *createScreen(const KmsOutput &output) override;
     QPlatformScreen *createHeadlessScreen() override;
     void registerScreenCloning(QPlatformScreen *screen,
@@ -81,6 +95,17 @@ private:
     gbm_device *m_gbm_device;
 
     QEglFSKmsGbmCursor *m_globalCursor;
+
+    // Overlay planes can often be used by more than one CRTC
+    QMutex m_planesMutex;
+    QSet<uint32_t> m_acquiredPlanes;
+
+    // Screens with a frame for the next synchronized commit, and screens
+    // whose flip of the commit in flight didn't complete yet
+    void commitSynchronizedFlip();
+    QMutex m_syncMutex;
+    QVector<QEglFSKmsGbmScreen *> m_syncReady;
+    QVector<QEglFSKmsGbmScreen *> m_syncPending;
 };
 
 QT_END_NAMESPACE
@@ -0,0 +1,211 @@
+// SPDX-FileCopyrightText: 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "qeglfskmsgbmframescheduler.h"
+
+#include <QtCore/QLoggingCategory>
+#include <QtCore/QMutexLocker>
+
+#include <algorithm>
+#include <time.h>
+
+QT_BEGIN_NAMESPACE
+
+Q_DECLARE_LOGGING_CATEGORY(qLcEglfsKmsDebug)
+
+// Beyond that the last vblank says little about the next one
+static const qint64 maxPredictionAge = 1000000;
+
+QEglFSKmsGbmFrameScheduler::QEglFSKmsGbmFrameScheduler()
+{
+    bool ok = false;
+    const int margin = qEnvironmentVariableIntValue("QT_QPA_EGLFS_KMS_FRAME_MARGIN", &ok);
+    m_safetyMargin = ok && margin >= 0 ? margin : 1500;
+}
+
+qint64 QEglFSKmsGbmFrameScheduler::currentTime()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void QEglFSKmsGbmFrameScheduler::setRefreshInterval(qint64 usecs)
+{
+    QMutexLocker locker(&m_mutex);
+    m_refreshInterval = usecs;
+}
+
+void QEglFSKmsGbmFrameScheduler::setSafetyMargin(qint64 usecs)
+{
+    QMutexLocker locker(&m_mutex);
+    m_safetyMargin = qMax<qint64>(0, usecs);
+}
+
+/*
+    With variable refresh rate the screen waits for the frame instead:
+    frames are rendered right away and flipped as soon as they are ready,
+    the panel keeps up within its range.
+*/
+void QEglFSKmsGbmFrameScheduler::setVariableRefreshRate(bool active)
+{
+    QMutexLocker locker(&m_mutex);
+    m_variableRefreshRate = active;
+    if (active)
+        m_lastTarget = 0;
+}
+
+/*
+    Async flips don't wait for the vblank either, and complete whenever
+    the frame is ready: there's nothing to aim at, and their timestamps
+    are not vblanks to predict from.
+*/
+void QEglFSKmsGbmFrameScheduler::setAsyncFlip(bool active)
+{
+    QMutexLocker locker(&m_mutex);
+    m_asyncFlip = active;
+    if (active)
+        m_lastTarget = 0;
+}
+
+/*
+    Returns how long to wait before rendering the next frame, and picks the
+    vblank it's meant for.
+
+    Called by the GUI thread when an update is requested.
+*/
+qint64 QEglFSKmsGbmFrameScheduler::renderDelay()
+{
+    QMutexLocker locker(&m_mutex);
+
+    const qint64 now = currentTime();
+    m_target = 0;
+
+    // Nothing to predict from, render right away
+    if (m_variableRefreshRate || m_asyncFlip || m_refreshInterval <= 0 || m_lastVblank <= 0 || now - m_lastVblank > maxPredictionAge)
+        return 0;
+
+    const qint64 budget = renderTime() + m_safetyMargin;
+
+    // The frame can't be shown before the frames in flight
+    qint64 vblank = nextVblank(now + budget);
+    if (m_framesInFlight > 0)
+        vblank = std::max(vblank, nextVblank(now) + m_framesInFlight * m_refreshInterval);
+
+    m_target = vblank;
+    return std::max<qint64>(0, vblank - budget - now);
+}
+
+/*
+    Called by the GUI thread when the update request is delivered,
+    rendering starts with polishing the scene.
+*/
+void QEglFSKmsGbmFrameScheduler::renderStarted()
+{
+    QMutexLocker locker(&m_mutex);
+    m_renderStart = currentTime();
+}
+
+/*
+    Called by the render thread when the frame is about to be flipped,
+    returns the vblank it was meant for or 0 when there's none.
+*/
+qint64 QEglFSKmsGbmFrameScheduler::frameRendered()
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Frames started by the render thread alone are not measured
+    if (m_renderStart > 0) {
+        m_renderTimes[m_renderTimeIndex] = currentTime() - m_renderStart;
+        m_renderTimeIndex = (m_renderTimeIndex + 1) % RenderTimeHistory;
+        m_renderStart = 0;
+    }
+
+    ++m_framesInFlight;
+    ++m_renderedFrames;
+
+    const qint64 target = m_target;
+    m_target = 0;
+    if (target > 0)
+        m_lastTarget = target;
+    return target;
+}
+
+/*
+    Returns the number of the frame that was rendered last.
+*/
+quint64 QEglFSKmsGbmFrameScheduler::renderedFrames() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_renderedFrames;
+}
+
+/*
+    Called by the event reader thread when the flip of the frame rendered
+    for \a target completed at \a timestamp.
+*/
+void QEglFSKmsGbmFrameScheduler::framePresented(qint64 target, qint64 timestamp)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_asyncFlip)
+        m_lastVblank = timestamp;
+    m_framesInFlight = qMax(0, m_framesInFlight - 1);
+    ++m_presentedFrames;
+
+    if (target > 0 && timestamp > target + m_refreshInterval / 2) {
+        ++m_missedDeadlines;
+        qCDebug(qLcEglfsKmsDebug, "Frame presented %lld us after its deadline, %llu missed out of %llu",
+                timestamp - target, m_missedDeadlines, m_presentedFrames);
+    }
+}
+
+/*
+    Called when a rendered frame was replaced or couldn't be flipped.
+*/
+void QEglFSKmsGbmFrameScheduler::frameDropped()
+{
+    QMutexLocker locker(&m_mutex);
+    m_framesInFlight = qMax(0, m_framesInFlight - 1);
+}
+
+Aurora::PlatformSupport::FrameTiming QEglFSKmsGbmFrameScheduler::timing() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    Aurora::PlatformSupport::FrameTiming timing;
+    timing.refreshInterval = m_refreshInterval;
+    timing.lastPresentationTime = m_lastVblank;
+    timing.predictedPresentationTime = m_target > 0 ? m_target : m_lastTarget;
+    timing.renderTime = renderTime();
+    timing.safetyMargin = m_safetyMargin;
+    timing.presentedFrames = m_presentedFrames;
+    timing.missedDeadlines = m_missedDeadlines;
+    timing.renderedFrames = m_renderedFrames;
+    return timing;
+}
+
+/*
+    Returns the first vblank after \a time.
+
+    m_mutex must be locked.
+*/
+qint64 QEglFSKmsGbmFrameScheduler::nextVblank(qint64 time) const
+{
+    if (time < m_lastVblank)
+        return m_lastVblank;
+    return m_lastVblank + ((time - m_lastVblank) / m_refreshInterval + 1) * m_refreshInterval;
+}
+
+/*
+    Returns the longest time it took to render the last frames, frames
+    take longer from time to time and a miss costs a whole refresh.
+
+    m_mutex must be locked.
+*/
+qint64 QEglFSKmsGbmFrameScheduler::renderTime() const
+{
+    return *std::max_element(m_renderTimes, m_renderTimes + RenderTimeHistory);
+}
+
+QT_END_NAMESPACE
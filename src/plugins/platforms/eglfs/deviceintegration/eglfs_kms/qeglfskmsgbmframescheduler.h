@@ -0,0 +1,73 @@
+// SPDX-FileCopyrightText: 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <QtCore/QMutex>
+
+#include <LiriAuroraPlatformHeaders/lirieglfsfunctions.h>
+
+QT_BEGIN_NAMESPACE
+
+/*
+    Decides when a screen starts rendering a frame.
+
+    The next vblank is predicted from the timestamp of the last page flip
+    and the refresh interval, rendering starts as late as the time it took
+    to render the last frames, plus a safety margin, allows to make it.
+    Input and client buffers that come in the meantime make it to the
+    screen with that same vblank.
+
+    Times are in microseconds, on the CLOCK_MONOTONIC clock used by DRM
+    for page flip timestamps.
+*/
+class QEglFSKmsGbmFrameScheduler
+{
+public:
+    QEglFSKmsGbmFrameScheduler();
+
+    static qint64 currentTime();
+
+    void setRefreshInterval(qint64 usecs);
+    void setSafetyMargin(qint64 usecs);
+    void setVariableRefreshRate(bool active);
+    void setAsyncFlip(bool active);
+
+    qint64 renderDelay();
+    void renderStarted();
+    qint64 frameRendered();
+    quint64 renderedFrames() const;
+    void framePresented(qint64 target, qint64 timestamp);
+    void frameDropped();
+
+    Aurora::PlatformSupport::FrameTiming timing() const;
+
+private:
+    qint64 nextVblank(qint64 time) const;
+    qint64 renderTime() const;
+
+    mutable QMutex m_mutex;
+
+    qint64 m_refreshInterval = 0;
+    qint64 m_safetyMargin = 0;
+    qint64 m_lastVblank = 0;
+    bool m_variableRefreshRate = false;
+    bool m_asyncFlip = false;
+
+    // Vblank the frame about to be rendered is meant for
+    qint64 m_target = 0;
+    qint64 m_lastTarget = 0;
+    qint64 m_renderStart = 0;
+    // Rendered and not presented yet
+    int m_framesInFlight = 0;
+
+    static const int RenderTimeHistory = 16;
+    qint64 m_renderTimes[RenderTimeHistory] = {};
+    int m_renderTimeIndex = 0;
+
+    quint64 m_presentedFrames = 0;
+    quint64 m_renderedFrames = 0;
+    quint64 m_missedDeadlines = 0;
+};
+
+QT_END_NAMESPACE
@@ -160,7 +160,12 @@ void QEglFSKmsGbmIntegration::presentBuffer(QPlatformSurface *surface)
 
     QWindow *window = static_cast<QWindow *>(surface->surface());
     QEglFSKmsGbmScreen *screen = static_cast<QEglFSKmsGbmScreen *>(window->screen()->handle());
-    screen->flip();
+    screen->flip(static_cast<QEglFSWindow *>(surface)->frameDamage());
+
+    // Scanout refused the modifiers of the surface, the next frame
+    // is rendered to a surface without explicit modifiers
+    if (screen->isSurfaceRejected())
+        static_cast<QEglFSKmsGbmWindow *>(surface)->resizeSurface(screen->rawGeometry().size());
 }
 
 QEglFSWindow *QEglFSKmsGbmIntegration::createWindow(QWindow *window) const
@@ -178,6 +183,28 @@ QFunctionPointer QEglFSKmsGbmIntegration::platformFunction(const QByteArray &fun
         return QFunctionPointer(testScreenChangesStatic);
     else if (function == Aurora::PlatformSupport::EglFSFunctions::applyScreenChangesIdentifier())
         return QFunctionPointer(applyScreenChangesStatic);
+    else if (function == Aurora::PlatformSupport::EglFSFunctions::setScanoutBufferIdentifier())
+        return QFunctionPointer(setScanoutBufferStatic);
+    else if (function == Aurora::PlatformSupport::EglFSFunctions::releaseScanoutBufferIdentifier())
+        return QFunctionPointer(releaseScanoutBufferStatic);
+    else if (function == Aurora::PlatformSupport::EglFSFunctions::createOverlayLayerIdentifier())
+        return QFunctionPointer(createOverlayLayerStatic);
+    else if (function == Aurora::PlatformSupport::EglFSFunctions::destroyOverlayLayerIdentifier())
+        return QFunctionPointer(destroyOverlayLayerStatic);
+    else if (function == Aurora::PlatformSupport::EglFSFunctions::updateOverlayLayerIdentifier())
+        return QFunctionPointer(updateOverlayLayerStatic);
+    else if (function == Aurora::PlatformSupport::EglFSFunctions::hideOverlayLayerIdentifier())
+        return QFunctionPointer(hideOverlayLayerStatic);
+    else if (function == Aurora::PlatformSupport::EglFSFunctions::setCursorImageIdentifier())
+        return QFunctionPointer(setCursorImageStatic);
+    else if (function == Aurora::PlatformSupport::EglFSFunctions::getFrameTimingIdentifier())
+        return QFunctionPointer(getFrameTimingStatic);
+    else if (function == Aurora::PlatformSupport::EglFSFunctions::setFrameSafetyMarginIdentifier())
+        return QFunctionPointer(setFrameSafetyMarginStatic);
+    else if (function == Aurora::PlatformSupport::EglFSFunctions::setVariableRefreshRateIdentifier())
+        return QFunctionPointer(setVariableRefreshRateStatic);
+    else if (function == Aurora::PlatformSupport::EglFSFunctions::isScreenCastSupportedIdentifier())
+        return QFunctionPointer(isScreenCastSupportedStatic);
 
     return nullptr;
 }
@@ -250,4 +277,93 @@ bool QEglFSKmsGbmIntegration::applyScreenChangesStatic(const QVector<Aurora::Pla
     return true;
 }
 
+bool QEglFSKmsGbmIntegration::setScanoutBufferStatic(QScreen *screen, const Aurora::PlatformSupport::ScanoutBuffer &buffer)
+{
+    if (!screen || !screen->handle())
+        return false;
+
+    auto *gbmScreen = static_cast<QEglFSKmsGbmScreen *>(screen->handle());
+    return gbmScreen->setScanoutBuffer(buffer);
+}
+
+void QEglFSKmsGbmIntegration::releaseScanoutBufferStatic(quintptr key)
+{
+    // The buffer might have been shown on any screen
+    const auto screens = QGuiApplication::screens();
+    for (auto *screen : screens) {
+        if (auto *gbmScreen = static_cast<QEglFSKmsGbmScreen *>(screen->handle()))
+            gbmScreen->releaseScanoutBuffer(key);
+    }
+}
+
+int QEglFSKmsGbmIntegration::createOverlayLayerStatic(QScreen *screen)
+{
+    if (!screen || !screen->handle())
+        return -1;
+
+    return static_cast<QEglFSKmsGbmScreen *>(screen->handle())->createOverlayLayer();
+}
+
+void QEglFSKmsGbmIntegration::destroyOverlayLayerStatic(QScreen *screen, int id)
+{
+    if (screen && screen->handle())
+        static_cast<QEglFSKmsGbmScreen *>(screen->handle())->destroyOverlayLayer(id);
+}
+
+bool QEglFSKmsGbmIntegration::updateOverlayLayerStatic(QScreen *screen, int id, const Aurora::PlatformSupport::OverlayLayer &layer)
+{
+    if (!screen || !screen->handle())
+        return false;
+
+    return static_cast<QEglFSKmsGbmScreen *>(screen->handle())->updateOverlayLayer(id, layer);
+}
+
+void QEglFSKmsGbmIntegration::hideOverlayLayerStatic(QScreen *screen, int id)
+{
+    if (screen && screen->handle())
+        static_cast<QEglFSKmsGbmScreen *>(screen->handle())->hideOverlayLayer(id);
+}
+
+bool QEglFSKmsGbmIntegration::setCursorImageStatic(QScreen *screen, const QImage &image, const QPoint &hotSpot)
+{
+    if (!screen || !screen->handle())
+        return false;
+
+    return static_cast<QEglFSKmsGbmScreen *>(screen->handle())->setClientCursor(image, hotSpot);
+}
+
+Aurora::PlatformSupport::FrameTiming QEglFSKmsGbmIntegration::getFrameTimingStatic(QScreen *screen)
+{
+    if (!screen || !screen->handle())
+        return Aurora::PlatformSupport::FrameTiming();
+
+    auto *gbmScreen = static_cast<QEglFSKmsGbmScreen *>(screen->handle());
+    Aurora::PlatformSupport::FrameTiming timing = gbmScreen->frameScheduler()->timing();
+    timing.commitIoctls = gbmScreen->device()->commitIoctls();
+    timing.eventReads = gbmScreen->device()->eventReads();
+    return timing;
+}
+
+void QEglFSKmsGbmIntegration::setFrameSafetyMarginStatic(QScreen *screen, qint64 usecs)
+{
+    if (screen && screen->handle())
+        static_cast<QEglFSKmsGbmScreen *>(screen->handle())->frameScheduler()->setSafetyMargin(usecs);
+}
+
+bool QEglFSKmsGbmIntegration::setVariableRefreshRateStatic(QScreen *screen, bool enabled)
+{
+    if (!screen || !screen->handle())
+        return false;
+
+    return static_cast<QEglFSKmsGbmScreen *>(screen->handle())->setVariableRefreshRate(enabled);
+}
+
+bool QEglFSKmsGbmIntegration::isScreenCastSupportedStatic(QScreen *screen)
+{
+    if (!screen || !screen->handle())
+        return false;
+
+    return static_cast<QEglFSKmsGbmScreen *>(screen->handle())->isScreenCastSupported();
+}
+
 QT_END_NAMESPACE
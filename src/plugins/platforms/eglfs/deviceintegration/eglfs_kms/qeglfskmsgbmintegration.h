@@ -50,6 +50,8 @@ namespace Aurora {
 namespace PlatformSupport {
 class Udev;
 class ScreenChange;
+class ScanoutBuffer;
+class OverlayLayer;
 }
 }
 
@@ -84,6 +86,17 @@ private:
 
     static bool testScreenChangesStatic(const QVector<Aurora::PlatformSupport::ScreenChange> &changes);
     static bool applyScreenChangesStatic(const QVector<Aurora::PlatformSupport::ScreenChange> &changes);
+    static bool setScanoutBufferStatic(QScreen *screen, const Aurora::PlatformSupport::ScanoutBuffer &buffer);
+    static void releaseScanoutBufferStatic(quintptr key);
+    static int createOverlayLayerStatic(QScreen *screen);
+    static void destroyOverlayLayerStatic(QScreen *screen, int id);
+    static bool updateOverlayLayerStatic(QScreen *screen, int id, const Aurora::PlatformSupport::OverlayLayer &layer);
+    static void hideOverlayLayerStatic(QScreen *screen, int id);
+    static bool setCursorImageStatic(QScreen *screen, const QImage &image, const QPoint &hotSpot);
+    static Aurora::PlatformSupport::FrameTiming getFrameTimingStatic(QScreen *screen);
+    static void setFrameSafetyMarginStatic(QScreen *screen, qint64 usecs);
+    static bool setVariableRefreshRateStatic(QScreen *screen, bool enabled);
+    static bool isScreenCastSupportedStatic(QScreen *screen);
 };
 
 QT_END_NAMESPACE
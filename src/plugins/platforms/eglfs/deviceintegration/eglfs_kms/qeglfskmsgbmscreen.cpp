@@ -45,6 +45,8 @@
 #include "qeglfsintegration_p.h"
 
 #include <QtCore/QLoggingCategory>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QVarLengthArray>
 
 #include <QtGui/private/qguiapplication_p.h>
 #include <QtGui/private/qtguiglobal_p.h>
@@ -52,12 +54,19 @@
 
 #include <LiriAuroraLogind/Logind>
 
+#include <algorithm>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 QT_BEGIN_NAMESPACE
 
 Q_DECLARE_LOGGING_CATEGORY(qLcEglfsKmsDebug)
 
+#ifndef EGL_EXT_image_dma_buf_import_modifiers
+typedef EGLBoolean (EGLAPIENTRYP PFNEGLQUERYDMABUFMODIFIERSEXTPROC) (EGLDisplay dpy, EGLint format, EGLint max_modifiers, EGLuint64KHR *modifiers, EGLBoolean *external_only, EGLint *num_modifiers);
+#endif
+
 static inline uint32_t drmFormatToGbmFormat(uint32_t drmFormat)
 {
     Q_ASSERT(DRM_FORMAT_XRGB8888 == GBM_FORMAT_XRGB8888);
@@ -92,19 +101,35 @@ QEglFSKmsGbmScreen::FrameBuffer *QEglFSKmsGbmScreen::framebufferForBufferObject(
 
     uint32_t width = gbm_bo_get_width(bo);
     uint32_t height = gbm_bo_get_height(bo);
-    uint32_t handles[4] = { gbm_bo_get_handle(bo).u32 };
-    uint32_t strides[4] = { gbm_bo_get_stride(bo) };
+    uint32_t handles[4] = { 0 };
+    uint32_t strides[4] = { 0 };
     uint32_t offsets[4] = { 0 };
+    uint64_t modifiers[4] = { 0 };
     uint32_t pixelFormat = gbmFormatToDrmFormat(gbm_bo_get_format(bo));
 
+    // Tiled and compressed buffers have more than one plane
+    const uint64_t modifier = m_surfaceModifiers ? gbm_bo_get_modifier(bo) : DRM_FORMAT_MOD_INVALID;
+    const int planeCount = qMin(gbm_bo_get_plane_count(bo), 4);
+    for (int i = 0; i < planeCount; ++i) {
+        handles[i] = gbm_bo_get_handle_for_plane(bo, i).u32;
+        strides[i] = gbm_bo_get_stride_for_plane(bo, i);
+        offsets[i] = gbm_bo_get_offset(bo, i);
+        modifiers[i] = modifier;
+    }
+
     QScopedPointer<FrameBuffer> fb(new FrameBuffer);
-    qCDebug(qLcEglfsKmsDebug, "Adding FB, size %ux%u, DRM format 0x%x", width, height, pixelFormat);
+    qCDebug(qLcEglfsKmsDebug, "Adding FB, size %ux%u, DRM format 0x%x, modifier 0x%llx",
+            width, height, pixelFormat, static_cast<unsigned long long>(modifier));
 
-    int ret = drmModeAddFB2(device()->fd(), width, height, pixelFormat,
-                            handles, strides, offsets, &fb->fb, 0);
+    const bool hasModifier = modifier != DRM_FORMAT_MOD_INVALID;
+    int ret = drmModeAddFB2WithModifiers(device()->fd(), width, height, pixelFormat,
+                                         handles, strides, offsets,
+                                         hasModifier ? modifiers : nullptr, &fb->fb,
+                                         hasModifier ? DRM_MODE_FB_MODIFIERS : 0);
 
     if (ret) {
         qWarning("Failed to create KMS FB!");
+        rejectSurfaceModifiers();
         return nullptr;
     }
 
@@ -117,18 +142,34 @@ QEglFSKmsGbmScreen::QEglFSKmsGbmScreen(QEglFSKmsDevice *device, const KmsOutput
     , m_gbm_surface(nullptr)
     , m_gbm_bo_current(nullptr)
     , m_gbm_bo_next(nullptr)
+    , m_gbm_bo_queued(nullptr)
     , m_flipPending(false)
     , m_cursor(nullptr)
     , m_cloneSource(nullptr)
 {
+    // Keep hardware layers of other screens off the primary plane
+    if (m_output.eglfs_plane)
+        static_cast<QEglFSKmsGbmDevice *>(device)->acquirePlane(m_output.eglfs_plane->id);
 }
 
 QEglFSKmsGbmScreen::~QEglFSKmsGbmScreen()
 {
+    // Leave the synchronized commit first, the event thread must not
+    // flip this screen while it is torn down
+    static_cast<QEglFSKmsGbmDevice *>(device())->removeSynchronizedScreen(this);
+
     const int remainingScreenCount = qGuiApp->screens().count();
     qCDebug(qLcEglfsKmsDebug, "Screen dtor. Remaining screens: %d", remainingScreenCount);
     if (!remainingScreenCount && !device()->screenConfig()->separateScreens())
         static_cast<QEglFSKmsGbmDevice *>(device())->destroyGlobalCursor();
+
+    for (const Overlay &overlay : qAsConst(m_overlays))
+        static_cast<QEglFSKmsGbmDevice *>(device())->releasePlane(overlay.plane.id);
+    if (m_output.eglfs_plane)
+        static_cast<QEglFSKmsGbmDevice *>(device())->releasePlane(m_output.eglfs_plane->id);
+
+    for (const ScanoutFrameBuffer &scanout : qAsConst(m_scanoutBuffers))
+        destroyScanoutFramebuffer(scanout);
 }
 
 QPlatformCursor *QEglFSKmsGbmScreen::cursor() const
@@ -161,7 +202,25 @@ gbm_surface *QEglFSKmsGbmScreen::createGbmSurface(EGLConfig eglConfig, const QSi
     qCDebug(qLcEglfsKmsDebug) << "Got native format" << Qt::hex << native_format << Qt::dec << "from eglGetConfigAttrib() with return code" << bool(success);
     gbm_surface *gbmSurface = nullptr;
 
-    if (success)
+    // Tiled or compressed buffers, when the primary plane and EGL agree on them
+    const QVector<uint64_t> modifiers = success ? scanoutModifiers(uint32_t(native_format)) : QVector<uint64_t>();
+    if (!modifiers.isEmpty()) {
+        gbmSurface = gbm_surface_create_with_modifiers(gbmDevice,
+                                                       size.width(),
+                                                       size.height(),
+                                                       native_format,
+                                                       modifiers.constData(),
+                                                       uint(modifiers.size()));
+        qCDebug(qLcEglfsKmsDebug, "Created gbm_surface with %d modifiers: %s",
+                int(modifiers.size()), gbmSurface ? "success" : "failure");
+    }
+    {
+        QMutexLocker locker(&m_flipMutex);
+        m_surfaceModifiers = gbmSurface != nullptr;
+        m_surfaceRejected = false;
+    }
+
+    if (success && !gbmSurface)
         gbmSurface = gbm_surface_create(gbmDevice,
                                         size.width(),
                                         size.height(),
@@ -181,6 +240,82 @@ gbm_surface *QEglFSKmsGbmScreen::createGbmSurface(EGLConfig eglConfig, const QSi
     return gbmSurface; // not owned, gets destroyed by the caller
 }
 
+/*
+    Returns the modifiers the primary plane, and the planes of clones, can
+    scan out and EGL can render to for \a format. An empty list leaves the
+    choice to the driver.
+*/
+QVector<uint64_t> QEglFSKmsGbmScreen::scanoutModifiers(uint32_t format) const
+{
+    static const bool disabled = qEnvironmentVariableIntValue("QT_QPA_EGLFS_KMS_NO_MODIFIERS");
+    if (disabled || m_modifiersRejected || !m_output.eglfs_plane)
+        return QVector<uint64_t>();
+
+    QVector<uint64_t> modifiers = m_output.eglfs_plane->supportedModifiers.value(format);
+    for (const CloneDestination &d : m_cloneDests) {
+        const KmsPlane *plane = d.screen->output().eglfs_plane;
+        const QVector<uint64_t> cloneModifiers = plane ? plane->supportedModifiers.value(format) : QVector<uint64_t>();
+        modifiers.erase(std::remove_if(modifiers.begin(), modifiers.end(), [&cloneModifiers](uint64_t modifier) {
+            return !cloneModifiers.contains(modifier);
+        }), modifiers.end());
+    }
+    if (modifiers.isEmpty())
+        return modifiers;
+
+    static PFNEGLQUERYDMABUFMODIFIERSEXTPROC queryDmaBufModifiers = nullptr;
+    static bool resolved = false;
+    if (!resolved) {
+        resolved = true;
+        const char *extensions = eglQueryString(display(), EGL_EXTENSIONS);
+        if (extensions && strstr(extensions, "EGL_EXT_image_dma_buf_import_modifiers"))
+            queryDmaBufModifiers = reinterpret_cast<PFNEGLQUERYDMABUFMODIFIERSEXTPROC>(eglGetProcAddress("eglQueryDmaBufModifiersEXT"));
+    }
+
+    // Without EGL telling what it renders to, let the driver pick
+    EGLint count = 0;
+    if (!queryDmaBufModifiers || !queryDmaBufModifiers(display(), EGLint(format), 0, nullptr, nullptr, &count) || count <= 0)
+        return QVector<uint64_t>();
+
+    QVector<EGLuint64KHR> eglModifiers(count);
+    QVector<EGLBoolean> externalOnly(count);
+    if (!queryDmaBufModifiers(display(), EGLint(format), count, eglModifiers.data(), externalOnly.data(), &count))
+        return QVector<uint64_t>();
+
+    QVector<uint64_t> result;
+    for (EGLint i = 0; i < count; ++i) {
+        if (!externalOnly.at(i) && modifiers.contains(eglModifiers.at(i)))
+            result.append(eglModifiers.at(i));
+    }
+    return result;
+}
+
+/*
+    Remembers that scanout failed with the modifiers of the surface: the
+    window renders to a surface without explicit modifiers from then on.
+
+    m_flipMutex must be locked.
+*/
+void QEglFSKmsGbmScreen::rejectSurfaceModifiers()
+{
+    if (!m_surfaceModifiers || m_modifiersRejected)
+        return;
+
+    qCDebug(qLcEglfsKmsDebug, "Scanout with modifiers failed on screen %s, falling back to implicit modifiers",
+            qPrintable(name()));
+    m_modifiersRejected = true;
+    m_surfaceRejected = true;
+    m_output.mode_set = false;
+}
+
+/*
+    Returns whether the surface has to be created again, without modifiers.
+*/
+bool QEglFSKmsGbmScreen::isSurfaceRejected()
+{
+    QMutexLocker locker(&m_flipMutex);
+    return m_surfaceRejected;
+}
+
 gbm_surface *QEglFSKmsGbmScreen::createSurface(EGLConfig eglConfig)
 {
     if (!m_gbm_surface)
@@ -195,6 +330,12 @@ void QEglFSKmsGbmScreen::resetSurface()
 
 void QEglFSKmsGbmScreen::setSurface(gbm_surface *surface)
 {
+    // Buffers of the new surface may have another size or format
+    {
+        QMutexLocker locker(&m_flipMutex);
+        cancelScreenCast(Aurora::PlatformSupport::ScreenCastCancelEvent::Resizing);
+    }
+
     if (m_gbm_bo_current) {
         gbm_surface_release_buffer(m_gbm_surface,
                                    m_gbm_bo_current);
@@ -204,7 +345,17 @@ void QEglFSKmsGbmScreen::setSurface(gbm_surface *surface)
         gbm_surface_release_buffer(m_gbm_surface,
                                    m_gbm_bo_next);
         m_gbm_bo_next = nullptr;
+        m_frameScheduler.frameDropped();
     }
+    if (m_gbm_bo_queued) {
+        gbm_surface_release_buffer(m_gbm_surface,
+                                   m_gbm_bo_queued);
+        m_gbm_bo_queued = nullptr;
+        m_frameScheduler.frameDropped();
+    }
+
+    // The next buffer comes from another surface
+    m_damageTracked = false;
 
     m_gbm_surface = surface;
 }
@@ -265,10 +416,12 @@ void QEglFSKmsGbmScreen::ensureModeSet(uint32_t fb)
                                          &op.connector_id, 1,
                                          &op.modes[op.mode]);
 
-                if (ret == 0)
+                if (ret == 0) {
                     setPowerState(PowerStateOn);
-                else
+                } else {
                     qErrnoWarning(errno, "Could not set DRM mode for screen %s", qPrintable(name()));
+                    rejectSurfaceModifiers();
+                }
             }
         }
     }
@@ -283,23 +436,19 @@ void QEglFSKmsGbmScreen::waitForFlip()
     if (!Aurora::PlatformSupport::Logind::instance()->isSessionActive())
         return;
 
-    // Don't lock the mutex unless we actually need to
-    if (!m_gbm_bo_next)
-        return;
-
-    m_flipMutex.lock();
-    device()->eventReader()->startWaitFlip(this, &m_flipMutex, &m_flipCond);
-    m_flipCond.wait(&m_flipMutex);
-    m_flipMutex.unlock();
-
-    flipFinished();
-
-#if EGLFS_ENABLE_DRM_ATOMIC
-    device()->threadLocalAtomicReset();
-#endif
+    // Only one frame can wait behind the flip in flight
+    QMutexLocker locker(&m_flipMutex);
+    while (m_gbm_bo_queued)
+        m_flipCond.wait(&m_flipMutex);
 }
 
-void QEglFSKmsGbmScreen::flip()
+/*
+    Commits the frame that was just rendered, without waiting for the flip
+    in flight: the frame is queued behind it and committed by the event
+    reader thread when that flip completes. The render thread only blocks
+    when the surface has no free buffer left to render the next frame.
+*/
+void QEglFSKmsGbmScreen::flip(const QRegion &damage)
 {
     // For headless screen just return silently. It is not necessarily an error
     // to end up here, so show no warnings.
@@ -319,15 +468,213 @@ void QEglFSKmsGbmScreen::flip()
         return;
     }
 
-    m_gbm_bo_next = gbm_surface_lock_front_buffer(m_gbm_surface);
-    if (!m_gbm_bo_next) {
+    QMutexLocker flipLocker(&m_flipMutex);
+
+    gbm_bo *bo = gbm_surface_lock_front_buffer(m_gbm_surface);
+    if (!bo) {
         qWarning("Could not lock GBM surface front buffer!");
         return;
     }
 
-    FrameBuffer *fb = framebufferForBufferObject(m_gbm_bo_next);
+    // A client buffer that passed the test replaces what was rendered
+    quintptr scanoutKey = 0;
+    {
+        QMutexLocker locker(&m_scanoutMutex);
+        scanoutKey = m_scanoutNext;
+        m_scanoutNext = 0;
+    }
+
+    // Mode sets are committed from the render thread, and without
+    // a flip in flight, other frames of synchronized screens are
+    // committed by the device along with the other screens
+    const bool synchronized = isSynchronized();
+    const bool queue = output().mode_set && (m_gbm_bo_next || synchronized);
+    if (!queue) {
+        while (m_gbm_bo_next)
+            m_flipCond.wait(&m_flipMutex);
+    }
+
+    const qint64 target = m_frameScheduler.frameRendered();
+    const quint64 frameNumber = m_frameScheduler.renderedFrames();
+
+    QRegion frameDamage = damage;
+    if (m_gbm_bo_queued) {
+        // Replaced by a newer frame before it could be shown
+        gbm_surface_release_buffer(m_gbm_surface, m_gbm_bo_queued);
+        m_gbm_bo_queued = nullptr;
+        m_frameScheduler.frameDropped();
+        frameDamage |= m_damageQueued;
+    }
+
+    if (queue) {
+        m_gbm_bo_queued = bo;
+        m_frameTargetQueued = target;
+        m_frameNumberQueued = frameNumber;
+        m_damageQueued = frameDamage;
+        QMutexLocker locker(&m_scanoutMutex);
+        m_scanoutQueued = scanoutKey;
+    } else if (submitFlip(bo, scanoutKey, frameDamage)) {
+        m_frameTargetNext = target;
+        m_frameNumberNext = frameNumber;
+    } else {
+        m_frameScheduler.frameDropped();
+    }
+
+    if (queue && synchronized) {
+        flipLocker.unlock();
+        static_cast<QEglFSKmsGbmDevice *>(device())->scheduleSynchronizedFlip(this);
+        flipLocker.relock();
+    }
+
+    // The next frame needs a buffer to be rendered into
+    while (m_gbm_bo_next && !gbm_surface_has_free_buffers(m_gbm_surface))
+        m_flipCond.wait(&m_flipMutex);
+}
+
+/*
+    Commits \a bo, with the client buffer \a scanoutKey on the primary plane
+    if any, and the hardware layers. \a damage is what changed since the
+    frame rendered before.
+
+    m_flipMutex must be locked, no flip may be in flight.
+*/
+bool QEglFSKmsGbmScreen::submitFlip(gbm_bo *bo, quintptr scanoutKey, const QRegion &damage)
+{
+#ifdef EGLFS_ENABLE_DRM_ATOMIC
+    if (submitAsyncFlip(bo, scanoutKey))
+        return true;
+#endif
+
+    PendingFlip flip;
+    if (!prepareFlip(bo, scanoutKey, damage, &flip))
+        return false;
+
+    bool committed = true;
+#ifdef EGLFS_ENABLE_DRM_ATOMIC
+    if (device()->hasAtomicSupport())
+        committed = device()->threadLocalAtomicCommit(this);
+#endif
+
+    return finishFlip(&flip, committed);
+}
+
+#ifdef EGLFS_ENABLE_DRM_ATOMIC
+/*
+    Flips to the client buffer \a scanoutKey right away instead of waiting
+    for the vblank, the frame tears but is shown sooner. Returns false when
+    the frame must be flipped with vsync instead.
+
+    Tearing flips may only change the framebuffer of the primary plane: it
+    must show a client buffer already, with nothing else on the screen.
+
+    m_flipMutex must be locked, no flip may be in flight.
+*/
+bool QEglFSKmsGbmScreen::submitAsyncFlip(gbm_bo *bo, quintptr scanoutKey)
+{
+    Q_ASSERT(!m_gbm_bo_next);
+
+    if (!scanoutKey || !device()->hasAtomicAsyncPageFlip() || !output().mode_set)
+        return false;
+    if (!m_cloneDests.isEmpty() || isSynchronized() || m_vrrEnabled != m_vrrActive)
+        return false;
+
+    FrameBuffer *fb = framebufferForBufferObject(bo);
+    if (!fb)
+        return false;
+
+    KmsOutput &op(output());
+    drmModeAtomicReq *request = device()->threadLocalAtomicRequest();
+    if (!request)
+        return false;
+
+    {
+        QMutexLocker locker(&m_scanoutMutex);
+
+        auto it = m_scanoutBuffers.constFind(scanoutKey);
+        if (it == m_scanoutBuffers.cend() || !it->fb || it->rejected || !it->allowTearing || it->asyncRejected)
+            return false;
+        if (!m_scanoutCurrent)
+            return false;
+        for (const Overlay &overlay : qAsConst(m_overlays)) {
+            if (overlay.key || overlay.currentKey || overlay.destroyed)
+                return false;
+        }
+
+        drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->framebufferPropertyId, it->fb);
+    }
+
+    m_gbm_bo_next = bo;
+    m_flipPending = true;
+
+    if (!device()->threadLocalAtomicCommit(this, true)) {
+        // Some drivers only tear between buffers of the same format and
+        // layout, this buffer is flipped with vsync from now on
+        drmModeAtomicSetCursor(request, 0);
+        m_gbm_bo_next = nullptr;
+        m_flipPending = false;
+
+        QMutexLocker locker(&m_scanoutMutex);
+        auto it = m_scanoutBuffers.find(scanoutKey);
+        if (it != m_scanoutBuffers.end())
+            it->asyncRejected = true;
+        return false;
+    }
+
+    // The kernel has its own copy of the request
+    device()->threadLocalAtomicReset();
+
+    if (!m_asyncFlip) {
+        qCDebug(qLcEglfsKmsDebug, "Async page flips enabled on screen %s", qPrintable(name()));
+        m_asyncFlip = true;
+        m_frameScheduler.setAsyncFlip(true);
+    }
+
+    QMutexLocker locker(&m_scanoutMutex);
+    m_currentFb = m_scanoutBuffers.value(scanoutKey).fb;
+    m_damageTracked = false;
+    m_scanoutPending = scanoutKey;
+    return true;
+}
+#endif
+
+/*
+    Adds the state of the frame \a bo to the atomic request of the thread,
+    or queues the legacy page flip, and keeps what is needed to finish the
+    flip in \a flip.
+
+    m_flipMutex must be locked, no flip may be in flight.
+*/
+bool QEglFSKmsGbmScreen::prepareFlip(gbm_bo *bo, quintptr scanoutKey, const QRegion &damage, PendingFlip *flip)
+{
+    Q_ASSERT(!m_gbm_bo_next);
+
+    FrameBuffer *fb = framebufferForBufferObject(bo);
+    if (!fb) {
+        gbm_surface_release_buffer(m_gbm_surface, bo);
+        return false;
+    }
+
+    m_gbm_bo_next = bo;
+    flip->modeSet = !output().mode_set;
     ensureModeSet(fb->fb);
 
+    uint32_t scanoutFb = 0;
+    {
+        QMutexLocker locker(&m_scanoutMutex);
+        auto it = m_scanoutBuffers.constFind(scanoutKey);
+        if (it != m_scanoutBuffers.cend() && it->fb && !it->rejected)
+            scanoutFb = it->fb;
+        else
+            scanoutKey = 0;
+    }
+
+    flip->bo = bo;
+    flip->fb = fb->fb;
+    flip->scanoutKey = scanoutKey;
+    flip->damage = damage;
+    flip->vrr = m_vrrActive;
+    flip->damageBlob = 0;
+
     KmsOutput &op(output());
     const int fd = device()->fd();
     m_flipPending = true;
@@ -336,27 +683,29 @@ void QEglFSKmsGbmScreen::flip()
 #ifdef EGLFS_ENABLE_DRM_ATOMIC
         drmModeAtomicReq *request = device()->threadLocalAtomicRequest();
         if (request) {
-            drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->framebufferPropertyId, fb->fb);
-            drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcPropertyId, op.crtc_id);
-            drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcwidthPropertyId,
-                                     op.size.width() << 16);
-            drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcXPropertyId, 0);
-            drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcYPropertyId, 0);
-            drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcheightPropertyId,
-                                     op.size.height() << 16);
-            drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcXPropertyId, 0);
-            drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcYPropertyId, 0);
-            drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcwidthPropertyId,
-                                     m_output.modes[m_output.mode].hdisplay);
-            drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcheightPropertyId,
-                                     m_output.modes[m_output.mode].vdisplay);
-
-            static int zpos = qEnvironmentVariableIntValue("QT_QPA_EGLFS_KMS_ZPOS");
-            if (zpos)
-                drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->zposPropertyId, zpos);
-            static uint blendOp = uint(qEnvironmentVariableIntValue("QT_QPA_EGLFS_KMS_BLEND_OP"));
-            if (blendOp)
-                drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->blendOpPropertyId, blendOp);
+            QMutexLocker locker(&m_scanoutMutex);
+            m_currentFb = scanoutKey ? scanoutFb : fb->fb;
+            addPlaneProperties(request, m_currentFb);
+            addOverlayProperties(request);
+
+            // Only a fullscreen client drives the refresh rate, the
+            // compositor doesn't render at a steady pace
+            flip->vrr = m_vrrEnabled && scanoutKey && m_cloneDests.isEmpty();
+            if (flip->vrr != m_vrrActive)
+                drmModeAtomicAddProperty(request, op.crtc_id, op.vrrEnabledPropertyId, flip->vrr);
+
+            // Drivers that copy or compress the framebuffer only handle
+            // what changed, that's only known between composited frames
+            if (!scanoutKey && m_damageTracked && op.eglfs_plane->damageClipsPropertyId)
+                flip->damageBlob = createDamageBlob(damage);
+            if (flip->damageBlob)
+                drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->damageClipsPropertyId, flip->damageBlob);
+
+            for (Overlay &overlay : m_overlays) {
+                overlay.pendingKey = overlay.key;
+                if (overlay.destroyed)
+                    overlay.disabled = true;
+            }
         }
 #endif
     } else {
@@ -365,21 +714,22 @@ void QEglFSKmsGbmScreen::flip()
                               fb->fb,
                               DRM_MODE_PAGE_FLIP_EVENT,
                               this);
+        device()->countCommitIoctl();
         if (ret) {
             qErrnoWarning("Could not queue DRM page flip on screen %s", qPrintable(name()));
             m_flipPending = false;
             gbm_surface_release_buffer(m_gbm_surface, m_gbm_bo_next);
             m_gbm_bo_next = nullptr;
-            return;
+            return false;
         }
     }
 
     for (CloneDestination &d : m_cloneDests) {
         if (d.screen != this) {
             d.screen->ensureModeSet(fb->fb);
-            d.cloneFlipPending = true;
 
             if (device()->hasAtomicSupport()) {
+                // Completes along with the flip of this screen
 #ifdef EGLFS_ENABLE_DRM_ATOMIC
                 drmModeAtomicReq *request = device()->threadLocalAtomicRequest();
                 if (request) {
@@ -390,11 +740,13 @@ void QEglFSKmsGbmScreen::flip()
                 }
 #endif
             } else {
+                d.cloneFlipPending = true;
                 int ret = drmModePageFlip(fd,
                                           d.screen->output().crtc_id,
                                           fb->fb,
                                           DRM_MODE_PAGE_FLIP_EVENT,
                                           d.screen);
+                device()->countCommitIoctl();
                 if (ret) {
                     qErrnoWarning("Could not queue DRM page flip for clone screen %s", qPrintable(name()));
                     d.cloneFlipPending = false;
@@ -403,35 +755,663 @@ void QEglFSKmsGbmScreen::flip()
         }
     }
 
+    return true;
+}
+
+/*
+    Completes \a flip once the atomic request was \a committed, falling
+    back to composition when client buffers were refused.
+
+    m_flipMutex must be locked.
+*/
+bool QEglFSKmsGbmScreen::finishFlip(PendingFlip *flip, bool committed)
+{
+#ifdef EGLFS_ENABLE_DRM_ATOMIC
+    if (device()->hasAtomicSupport()) {
+        KmsOutput &op(output());
+        quintptr scanoutKey = flip->scanoutKey;
+        bool vrr = flip->vrr;
+
+        // Passed the test but not the real thing, show the composited frame
+        // without any overlay, hardware layers are tested again next frame
+        QMutexLocker locker(&m_scanoutMutex);
+        if (!committed && (scanoutKey || !m_overlays.isEmpty())) {
+            qCDebug(qLcEglfsKmsDebug, "Scanout of client buffers failed on screen %s, falling back to composition",
+                    qPrintable(name()));
+
+            auto it = m_scanoutBuffers.find(scanoutKey);
+            if (it != m_scanoutBuffers.end())
+                it->rejected = true;
+            scanoutKey = 0;
+
+            for (Overlay &overlay : m_overlays)
+                overlay.key = overlay.pendingKey = 0;
+
+            drmModeAtomicReq *request = device()->threadLocalAtomicRequest();
+            if (request) {
+                m_currentFb = flip->fb;
+                drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->framebufferPropertyId, flip->fb);
+                addOverlayProperties(request);
+                if (vrr || m_vrrActive) {
+                    vrr = false;
+                    drmModeAtomicAddProperty(request, op.crtc_id, op.vrrEnabledPropertyId, 0);
+                }
+                locker.unlock();
+                committed = device()->threadLocalAtomicCommit(this);
+                locker.relock();
+            }
+        }
+
+        // The kernel holds its own reference to the blob
+        if (flip->damageBlob) {
+            drmModeDestroyPropertyBlob(device()->fd(), flip->damageBlob);
+            flip->damageBlob = 0;
+        }
+        m_damageTracked = committed && !scanoutKey;
+
+        if (!committed) {
+            // The request still refers to the buffer released below, the
+            // next commit of this thread must not carry it
+            drmModeAtomicReq *request = device()->threadLocalAtomicRequest();
+            if (request)
+                drmModeAtomicSetCursor(request, 0);
+
+            qWarning("Could not commit the frame of screen %s", qPrintable(name()));
+            if (flip->modeSet)
+                rejectSurfaceModifiers();
+            m_flipPending = false;
+            gbm_surface_release_buffer(m_gbm_surface, m_gbm_bo_next);
+            m_gbm_bo_next = nullptr;
+            return false;
+        }
+
+        // The kernel has its own copy of the request
+        device()->threadLocalAtomicReset();
+
+        if (vrr != m_vrrActive) {
+            qCDebug(qLcEglfsKmsDebug, "Variable refresh rate %s on screen %s",
+                    vrr ? "enabled" : "disabled", qPrintable(name()));
+            m_vrrActive = vrr;
+            m_frameScheduler.setVariableRefreshRate(vrr);
+        }
+
+        if (m_asyncFlip) {
+            qCDebug(qLcEglfsKmsDebug, "Async page flips disabled on screen %s", qPrintable(name()));
+            m_asyncFlip = false;
+            m_frameScheduler.setAsyncFlip(false);
+        }
+
+        m_scanoutPending = scanoutKey;
+        return true;
+    }
+#else
+    Q_UNUSED(committed);
+#endif
+
+    QMutexLocker locker(&m_scanoutMutex);
+    m_scanoutPending = flip->scanoutKey;
+    return true;
+}
+
+/*
+    Returns whether the frames of this screen are committed together with
+    the other screens of the device, in one atomic request per vblank.
+*/
+bool QEglFSKmsGbmScreen::isSynchronized() const
+{
+#ifdef EGLFS_ENABLE_DRM_ATOMIC
+    return !m_headless && !m_cloneSource && device()->hasAtomicSupport()
+            && device()->screenConfig()->synchronizedOutputs();
+#else
+    return false;
+#endif
+}
+
+/*
+    Returns whether recordFrame() can export the buffers flipped on this
+    screen: clones show the buffers of their source, and headless screens
+    never flip.
+*/
+bool QEglFSKmsGbmScreen::isScreenCastSupported() const
+{
+    return !m_headless && !m_cloneSource;
+}
+
+/*
+    Takes the frame queued behind the flip in flight and adds it to the
+    atomic request the device is about to commit, returns false when
+    there is no such frame or the screen still waits for its own flip.
+
+    Called by the device, on the thread that commits.
+*/
+bool QEglFSKmsGbmScreen::prepareSynchronizedFlip()
+{
+    QMutexLocker locker(&m_flipMutex);
+
+    if (!m_gbm_bo_queued || m_gbm_bo_next)
+        return false;
+
+    gbm_bo *bo = m_gbm_bo_queued;
+    m_gbm_bo_queued = nullptr;
+    const QRegion damage = m_damageQueued;
+    m_damageQueued = QRegion();
+    m_frameTargetNext = m_frameTargetQueued;
+    m_frameTargetQueued = 0;
+    m_frameNumberNext = m_frameNumberQueued;
+
+    quintptr scanoutKey = 0;
+    {
+        QMutexLocker scanoutLocker(&m_scanoutMutex);
+        scanoutKey = m_scanoutQueued;
+        m_scanoutQueued = 0;
+    }
+
+    if (!prepareFlip(bo, scanoutKey, damage, &m_synchronizedFlip)) {
+        m_frameScheduler.frameDropped();
+        m_frameTargetNext = 0;
+        m_flipCond.wakeAll();
+        return false;
+    }
+
+    return true;
+}
+
+/*
+    Completes the flip added to the request of the device, which was
+    \a committed or not. A refused request is committed again by each
+    screen on its own, so that it can fall back to composition.
+
+    Returns whether a flip is in flight.
+*/
+bool QEglFSKmsGbmScreen::finishSynchronizedFlip(bool committed)
+{
+    QMutexLocker locker(&m_flipMutex);
+
+    PendingFlip flip = m_synchronizedFlip;
+    m_synchronizedFlip = PendingFlip();
+
+    bool submitted = false;
+    if (committed) {
+        submitted = finishFlip(&flip, true);
+    } else {
+        if (flip.damageBlob)
+            drmModeDestroyPropertyBlob(device()->fd(), flip.damageBlob);
+        m_flipPending = false;
+        m_gbm_bo_next = nullptr;
+        submitted = submitFlip(flip.bo, flip.scanoutKey, flip.damage);
+    }
+
+    if (!submitted) {
+        m_frameScheduler.frameDropped();
+        m_frameTargetNext = 0;
+    }
+
+    m_flipCond.wakeAll();
+    return submitted;
+}
+
+static int primaryZpos()
+{
+    static int zpos = qEnvironmentVariableIntValue("QT_QPA_EGLFS_KMS_ZPOS");
+    return zpos;
+}
+
+#ifdef EGLFS_ENABLE_DRM_ATOMIC
+void QEglFSKmsGbmScreen::addPlaneProperties(drmModeAtomicReq *request, uint32_t fb)
+{
+    KmsOutput &op(output());
+
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->framebufferPropertyId, fb);
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcPropertyId, op.crtc_id);
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcwidthPropertyId,
+                             op.size.width() << 16);
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcXPropertyId, 0);
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcYPropertyId, 0);
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->srcheightPropertyId,
+                             op.size.height() << 16);
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcXPropertyId, 0);
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcYPropertyId, 0);
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcwidthPropertyId,
+                             m_output.modes[m_output.mode].hdisplay);
+    drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->crtcheightPropertyId,
+                             m_output.modes[m_output.mode].vdisplay);
+
+    if (const int zpos = primaryZpos())
+        drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->zposPropertyId, zpos);
+    static uint blendOp = uint(qEnvironmentVariableIntValue("QT_QPA_EGLFS_KMS_BLEND_OP"));
+    if (blendOp)
+        drmModeAtomicAddProperty(request, op.eglfs_plane->id, op.eglfs_plane->blendOpPropertyId, blendOp);
+}
+
+/*
+    Returns a blob with the rectangles of \a damage for FB_DAMAGE_CLIPS,
+    or 0 when the whole framebuffer is damaged.
+*/
+uint32_t QEglFSKmsGbmScreen::createDamageBlob(const QRegion &damage)
+{
+    const QRect bounds(QPoint(0, 0), output().size);
+    const QRegion region = damage.intersected(bounds);
+    if (region.isEmpty() || region.boundingRect() == bounds)
+        return 0;
+
+    QVarLengthArray<drm_mode_rect, 16> clips;
+    for (const QRect &rect : region)
+        clips.append({ rect.left(), rect.top(), rect.right() + 1, rect.bottom() + 1 });
+
+    uint32_t blobId = 0;
+    if (drmModeCreatePropertyBlob(device()->fd(), clips.data(), clips.size() * sizeof(drm_mode_rect), &blobId))
+        return 0;
+    return blobId;
+}
+
+/*
+    Adds the state of all overlay planes to \a request, stacked above the
+    primary plane by their order. The overlay \a skipId is replaced by
+    \a extra, if any.
+
+    m_scanoutMutex must be locked.
+*/
+void QEglFSKmsGbmScreen::addOverlayProperties(drmModeAtomicReq *request, int skipId, const Overlay *extra)
+{
+    QVector<const Overlay *> visible;
+    for (auto it = m_overlays.cbegin(); it != m_overlays.cend(); ++it) {
+        const Overlay &overlay = it.value();
+        if (it.key() == skipId)
+            continue;
+
+        if (overlay.key && !overlay.destroyed) {
+            visible.append(&overlay);
+        } else {
+            drmModeAtomicAddProperty(request, overlay.plane.id, overlay.plane.framebufferPropertyId, 0);
+            drmModeAtomicAddProperty(request, overlay.plane.id, overlay.plane.crtcPropertyId, 0);
+        }
+    }
+    if (extra)
+        visible.append(extra);
+
+    std::stable_sort(visible.begin(), visible.end(), [](const Overlay *a, const Overlay *b) {
+        return a->zOrder < b->zOrder;
+    });
+
+    const uint32_t crtcId = output().crtc_id;
+    int zpos = primaryZpos();
+    for (const Overlay *overlay : qAsConst(visible)) {
+        const KmsPlane &plane = overlay->plane;
+        const uint32_t fb = m_scanoutBuffers.value(overlay->key).fb;
+
+        drmModeAtomicAddProperty(request, plane.id, plane.framebufferPropertyId, fb);
+        drmModeAtomicAddProperty(request, plane.id, plane.crtcPropertyId, fb ? crtcId : 0);
+        if (!fb)
+            continue;
+
+        // Source coordinates are in 16.16 fixed point
+        drmModeAtomicAddProperty(request, plane.id, plane.srcXPropertyId, uint64_t(overlay->source.x() * 65536));
+        drmModeAtomicAddProperty(request, plane.id, plane.srcYPropertyId, uint64_t(overlay->source.y() * 65536));
+        drmModeAtomicAddProperty(request, plane.id, plane.srcwidthPropertyId, uint64_t(overlay->source.width() * 65536));
+        drmModeAtomicAddProperty(request, plane.id, plane.srcheightPropertyId, uint64_t(overlay->source.height() * 65536));
+        drmModeAtomicAddProperty(request, plane.id, plane.crtcXPropertyId, uint64_t(int64_t(overlay->geometry.x())));
+        drmModeAtomicAddProperty(request, plane.id, plane.crtcYPropertyId, uint64_t(int64_t(overlay->geometry.y())));
+        drmModeAtomicAddProperty(request, plane.id, plane.crtcwidthPropertyId, overlay->geometry.width());
+        drmModeAtomicAddProperty(request, plane.id, plane.crtcheightPropertyId, overlay->geometry.height());
+        if (plane.zposPropertyId)
+            drmModeAtomicAddProperty(request, plane.id, plane.zposPropertyId, ++zpos);
+    }
+}
+#endif
+
+/*
+    Asks to show \a buffer on the primary plane with the next flip, instead
+    of the frame rendered by the compositor. Returns true if an atomic
+    test-only commit accepted the buffer, the compositor is expected to
+    composite the frame otherwise.
+
+    Called on the render thread, before the frame is rendered.
+*/
+bool QEglFSKmsGbmScreen::setScanoutBuffer(const Aurora::PlatformSupport::ScanoutBuffer &buffer)
+{
+    QMutexLocker locker(&m_scanoutMutex);
+
+    m_scanoutNext = 0;
+
+    if (!buffer.key)
+        return false;
+
+    // The test needs the mode to be set already, and clones can't share it
+    if (m_headless || m_cloneSource || !m_cloneDests.isEmpty() || modeChangeRequested())
+        return false;
+    if (!device()->hasAtomicSupport() || !output().mode_set || !output().eglfs_plane)
+        return false;
+
+    // Only a buffer as large as the screen can replace the whole frame
+    if (buffer.size != output().size)
+        return false;
+
+    auto it = m_scanoutBuffers.find(buffer.key);
+    if (it == m_scanoutBuffers.end())
+        it = m_scanoutBuffers.insert(buffer.key, importScanoutBuffer(buffer));
+    if (it->released)
+        return false;
+    it->allowTearing = buffer.allowTearing;
+
+    // Other planes might change what the hardware can do, test every frame
+    if (!it->fb || it->rejected || !testScanout(it->fb)) {
+        dropRefusedScanoutBuffer(buffer.key);
+        return false;
+    }
+
+    it->accepted = true;
+    m_scanoutNext = buffer.key;
+    return true;
+}
+
+/*
+    Forgets the framebuffer of the client buffer identified by \a key,
+    once no flip uses it anymore.
+*/
+void QEglFSKmsGbmScreen::releaseScanoutBuffer(quintptr key)
+{
+    QMutexLocker locker(&m_scanoutMutex);
+
+    auto it = m_scanoutBuffers.find(key);
+    if (it == m_scanoutBuffers.end())
+        return;
+
+    if (isScanoutBufferInUse(key)) {
+        it->released = true;
+        return;
+    }
+
+    destroyScanoutFramebuffer(it.value());
+    m_scanoutBuffers.erase(it);
+}
+
+/*
+    Reserves a free overlay plane for a hardware layer and returns the id
+    of the layer, or -1 when there is none.
+*/
+int QEglFSKmsGbmScreen::createOverlayLayer()
+{
+    if (m_headless || m_cloneSource || !device()->hasAtomicSupport())
+        return -1;
+
+    auto *gbmDevice = static_cast<QEglFSKmsGbmDevice *>(device());
+    for (const KmsPlane &plane : qAsConst(output().available_planes)) {
+        if (plane.type != KmsPlane::OverlayPlane)
+            continue;
+        if (output().eglfs_plane && plane.id == output().eglfs_plane->id)
+            continue;
+        if (!gbmDevice->acquirePlane(plane.id))
+            continue;
+
+        qCDebug(qLcEglfsKmsDebug, "Using plane %u for a hardware layer on screen %s",
+                plane.id, qPrintable(name()));
+
+        QMutexLocker locker(&m_scanoutMutex);
+        Overlay overlay;
+        overlay.plane = plane;
+        const int id = m_nextOverlayId++;
+        m_overlays.insert(id, overlay);
+        return id;
+    }
+
+    return -1;
+}
+
+/*
+    Turns the overlay plane of layer \a id off with the next flip, the
+    plane is given back once the flip is done.
+*/
+void QEglFSKmsGbmScreen::destroyOverlayLayer(int id)
+{
+    QMutexLocker locker(&m_scanoutMutex);
+
+    auto it = m_overlays.find(id);
+    if (it == m_overlays.end())
+        return;
+
+    it->destroyed = true;
+    it->key = 0;
+}
+
+/*
+    Shows \a layer on the overlay plane of layer \a id with the next flip,
+    if an atomic test-only commit accepts it together with the primary plane
+    and the other overlays. Otherwise the layer is hidden and false is
+    returned.
+*/
+bool QEglFSKmsGbmScreen::updateOverlayLayer(int id, const Aurora::PlatformSupport::OverlayLayer &layer)
+{
+    QMutexLocker locker(&m_scanoutMutex);
+
+    auto it = m_overlays.find(id);
+    if (it == m_overlays.end() || it->destroyed)
+        return false;
+
+    Overlay &overlay = it.value();
+    overlay.key = 0;
+
+    if (!layer.buffer.key || modeChangeRequested() || !output().mode_set || !m_currentFb)
+        return false;
+    if (layer.buffer.numPlanes > 0 && !overlay.plane.supportedFormats.contains(layer.buffer.drmFormat))
+        return false;
+    if (layer.geometry.isEmpty() || !QRect(QPoint(0, 0), output().size).contains(layer.geometry))
+        return false;
+
+    auto bufferIt = m_scanoutBuffers.find(layer.buffer.key);
+    if (bufferIt == m_scanoutBuffers.end())
+        bufferIt = m_scanoutBuffers.insert(layer.buffer.key, importScanoutBuffer(layer.buffer));
+    if (bufferIt->released)
+        return false;
+
+    Overlay candidate = overlay;
+    candidate.key = layer.buffer.key;
+    candidate.source = layer.source;
+    candidate.geometry = layer.geometry;
+    candidate.zOrder = layer.zOrder;
+    if (!bufferIt->fb || bufferIt->rejected || !testScanout(m_currentFb, id, &candidate)) {
+        dropRefusedScanoutBuffer(layer.buffer.key);
+        return false;
+    }
+
+    bufferIt->accepted = true;
+    overlay = candidate;
+    return true;
+}
+
+void QEglFSKmsGbmScreen::hideOverlayLayer(int id)
+{
+    QMutexLocker locker(&m_scanoutMutex);
+
+    auto it = m_overlays.find(id);
+    if (it != m_overlays.end())
+        it->key = 0;
+}
+
+QEglFSKmsGbmScreen::ScanoutFrameBuffer QEglFSKmsGbmScreen::importScanoutBuffer(const Aurora::PlatformSupport::ScanoutBuffer &buffer)
+{
+    ScanoutFrameBuffer scanout;
+
+    const auto gbmDevice = static_cast<QEglFSKmsGbmDevice *>(device())->gbmDevice();
+    if (buffer.numPlanes > 0) {
+        gbm_import_fd_modifier_data data = {};
+        data.width = uint32_t(buffer.size.width());
+        data.height = uint32_t(buffer.size.height());
+        data.format = buffer.drmFormat;
+        data.num_fds = uint32_t(qMin(buffer.numPlanes, 4));
+        data.modifier = buffer.modifier;
+        for (uint32_t i = 0; i < data.num_fds; ++i) {
+            data.fds[i] = buffer.fds[i];
+            data.strides[i] = int(buffer.strides[i]);
+            data.offsets[i] = int(buffer.offsets[i]);
+        }
+        scanout.bo = gbm_bo_import(gbmDevice, GBM_BO_IMPORT_FD_MODIFIER, &data, GBM_BO_USE_SCANOUT);
+    } else if (buffer.waylandBuffer) {
+        scanout.bo = gbm_bo_import(gbmDevice, GBM_BO_IMPORT_WL_BUFFER, buffer.waylandBuffer, GBM_BO_USE_SCANOUT);
+    }
+
+    if (!scanout.bo) {
+        qCDebug(qLcEglfsKmsDebug, "Cannot import client buffer for scanout on screen %s", qPrintable(name()));
+        return scanout;
+    }
+
+    uint32_t handles[4] = { 0 };
+    uint32_t strides[4] = { 0 };
+    uint32_t offsets[4] = { 0 };
+    uint64_t modifiers[4] = { 0 };
+    const uint64_t modifier = gbm_bo_get_modifier(scanout.bo);
+    const int planeCount = qMin(gbm_bo_get_plane_count(scanout.bo), 4);
+    for (int i = 0; i < planeCount; ++i) {
+        handles[i] = gbm_bo_get_handle_for_plane(scanout.bo, i).u32;
+        strides[i] = gbm_bo_get_stride_for_plane(scanout.bo, i);
+        offsets[i] = gbm_bo_get_offset(scanout.bo, i);
+        modifiers[i] = modifier;
+    }
+
+    const bool hasModifier = modifier != DRM_FORMAT_MOD_INVALID;
+    int ret = drmModeAddFB2WithModifiers(device()->fd(),
+                                         gbm_bo_get_width(scanout.bo), gbm_bo_get_height(scanout.bo),
+                                         gbmFormatToDrmFormat(gbm_bo_get_format(scanout.bo)),
+                                         handles, strides, offsets,
+                                         hasModifier ? modifiers : nullptr, &scanout.fb,
+                                         hasModifier ? DRM_MODE_FB_MODIFIERS : 0);
+    if (ret) {
+        qCDebug(qLcEglfsKmsDebug, "Cannot create KMS FB for client buffer on screen %s", qPrintable(name()));
+        gbm_bo_destroy(scanout.bo);
+        scanout.bo = nullptr;
+        scanout.fb = 0;
+    }
+
+    return scanout;
+}
+
+/*
+    Tests \a fb on the primary plane together with the overlays, where
+    the overlay \a overlayId is replaced by \a overlay if not null.
+*/
+bool QEglFSKmsGbmScreen::testScanout(uint32_t fb, int overlayId, const Overlay *overlay)
+{
 #ifdef EGLFS_ENABLE_DRM_ATOMIC
-    device()->threadLocalAtomicCommit(this);
+    drmModeAtomicReq *request = drmModeAtomicAlloc();
+    if (!request)
+        return false;
+
+    addPlaneProperties(request, fb);
+    addOverlayProperties(request, overlayId, overlay);
+    int ret = drmModeAtomicCommit(device()->fd(), request, DRM_MODE_ATOMIC_TEST_ONLY, nullptr);
+    drmModeAtomicFree(request);
+
+    return ret == 0;
+#else
+    Q_UNUSED(fb);
+    Q_UNUSED(overlayId);
+    Q_UNUSED(overlay);
+    return false;
 #endif
 }
 
+void QEglFSKmsGbmScreen::destroyScanoutFramebuffer(const ScanoutFrameBuffer &scanout)
+{
+    if (scanout.fb)
+        drmModeRmFB(device()->fd(), scanout.fb);
+    if (scanout.bo)
+        gbm_bo_destroy(scanout.bo);
+}
+
 void QEglFSKmsGbmScreen::setCursorTheme(const QString &name, int size)
 {
     if (!m_cursor.isNull())
         m_cursor->setCursorTheme(name, size);
 }
 
+/*
+    Lets fullscreen clients shown on the primary plane set the pace of
+    the screen, returns \c false when it doesn't support variable refresh
+    rate.
+*/
+bool QEglFSKmsGbmScreen::setVariableRefreshRate(bool enabled)
+{
+#ifdef EGLFS_ENABLE_DRM_ATOMIC
+    const KmsOutput &op = output();
+    if (enabled) {
+        if (m_headless || !device()->hasAtomicSupport() || !op.vrr_capable || !op.vrrEnabledPropertyId)
+            return false;
+
+        // The panel only goes slower than the mode
+        const int refreshRate = op.modes[op.mode].vrefresh;
+        if (m_edid.minRefreshRate > 0 && refreshRate <= m_edid.minRefreshRate) {
+            qCDebug(qLcEglfsKmsDebug, "Mode of screen %s is out of the variable refresh rate range %d-%d Hz",
+                    qPrintable(name()), m_edid.minRefreshRate, m_edid.maxRefreshRate);
+            return false;
+        }
+    }
+
+    // Takes effect with the next flip
+    QMutexLocker locker(&m_flipMutex);
+    m_vrrEnabled = enabled;
+    return true;
+#else
+    return !enabled;
+#endif
+}
+
+bool QEglFSKmsGbmScreen::setClientCursor(const QImage &image, const QPoint &hotSpot)
+{
+    if (!device()->screenConfig()->hwCursor())
+        return false;
+
+    auto *hwCursor = static_cast<QEglFSKmsGbmCursor *>(cursor());
+    if (!hwCursor)
+        return false;
+
+    if (image.isNull()) {
+        hwCursor->unsetClientCursor();
+        return true;
+    }
+
+    return hwCursor->setClientCursor(image, hotSpot);
+}
+
 void QEglFSKmsGbmScreen::setModeChangeRequested(bool enabled)
 {
     m_modeChangeRequested = enabled;
 }
 
-void QEglFSKmsGbmScreen::flipFinished()
+void QEglFSKmsGbmScreen::pageFlipped(unsigned int crtcId, unsigned int sequence,
+                                     unsigned int tv_sec, unsigned int tv_usec)
 {
     if (m_cloneSource) {
         m_cloneSource->cloneDestFlipFinished(this);
         return;
     }
 
-    m_flipPending = false;
-    updateFlipStatus();
+    // An atomic commit completes once for each CRTC, clones included,
+    // and synchronized commits for all the screens in it
+    if (crtcId && crtcId != m_output.crtc_id) {
+        if (isSynchronized())
+            static_cast<QEglFSKmsGbmDevice *>(device())->synchronizedPageFlipped(crtcId, sequence, tv_sec, tv_usec);
+        return;
+    }
+
+    bool frameQueued = false;
+    {
+        QMutexLocker locker(&m_flipMutex);
+        if (!m_flipPending)
+            return;
+
+        m_flipPending = false;
+        m_flipTimestamp = qint64(tv_sec) * 1000000 + tv_usec;
+        m_flipSequence = sequence;
+        updateFlipStatus();
+        frameQueued = m_gbm_bo_queued != nullptr;
+    }
+
+    if (isSynchronized())
+        static_cast<QEglFSKmsGbmDevice *>(device())->synchronizedFlipFinished(this, frameQueued);
 }
 
 void QEglFSKmsGbmScreen::cloneDestFlipFinished(QEglFSKmsGbmScreen *cloneDestScreen)
 {
+    QMutexLocker locker(&m_flipMutex);
     for (CloneDestination &d : m_cloneDests) {
         if (d.screen == cloneDestScreen) {
             d.cloneFlipPending = false;
@@ -441,11 +1421,17 @@ void QEglFSKmsGbmScreen::cloneDestFlipFinished(QEglFSKmsGbmScreen *cloneDestScre
     updateFlipStatus();
 }
 
+/*
+    Moves on to the next frame once the flip completed on all CRTCs,
+    and commits the frame queued behind it.
+
+    m_flipMutex must be locked.
+*/
 void QEglFSKmsGbmScreen::updateFlipStatus()
 {
     Q_ASSERT(!m_cloneSource);
 
-    if (m_flipPending)
+    if (m_flipPending || !m_gbm_bo_next)
         return;
 
     for (const CloneDestination &d : qAsConst(m_cloneDests)) {
@@ -453,47 +1439,307 @@ void QEglFSKmsGbmScreen::updateFlipStatus()
             return;
     }
 
+    // The mode may have changed since the last frame
+    m_frameScheduler.setRefreshInterval(refreshInterval());
+    m_frameScheduler.framePresented(m_frameTargetNext, m_flipTimestamp);
+    m_frameTargetNext = 0;
+
     if (m_gbm_bo_current)
         gbm_surface_release_buffer(m_gbm_surface,
                                    m_gbm_bo_current);
 
     m_gbm_bo_current = m_gbm_bo_next;
     m_gbm_bo_next = nullptr;
+
+    quintptr queuedKey = 0;
+    {
+        QMutexLocker locker(&m_scanoutMutex);
+        m_scanoutCurrent = m_scanoutPending;
+        m_scanoutPending = 0;
+        queuedKey = m_scanoutQueued;
+        m_scanoutQueued = 0;
+
+        for (auto it = m_overlays.begin(); it != m_overlays.end();) {
+            if (it->disabled) {
+                static_cast<QEglFSKmsGbmDevice *>(device())->releasePlane(it->plane.id);
+                it = m_overlays.erase(it);
+            } else {
+                it->currentKey = it->pendingKey;
+                ++it;
+            }
+        }
+
+        releaseUnusedScanoutBuffers();
+    }
+
+    // The buffer exported last went back to the surface or the client
+    cancelScreenCast(Aurora::PlatformSupport::ScreenCastCancelEvent::Temporary);
+    recordFrame();
+    sendPresentation();
+
+    // Synchronized screens wait for the device to commit them all
+    if (m_gbm_bo_queued && !isSynchronized()) {
+        gbm_bo *bo = m_gbm_bo_queued;
+        m_gbm_bo_queued = nullptr;
+        const QRegion damage = m_damageQueued;
+        m_damageQueued = QRegion();
+        if (submitFlip(bo, queuedKey, damage)) {
+            m_frameTargetNext = m_frameTargetQueued;
+            m_frameNumberNext = m_frameNumberQueued;
+        } else
+            m_frameScheduler.frameDropped();
+        m_frameTargetQueued = 0;
+    }
+
+    m_flipCond.wakeAll();
+}
+
+/*
+    Tells the compositor that the frame of the flip that just completed is
+    on screen, surfaces waiting for presentation feedback on this screen
+    get the time of the flip.
+
+    m_flipMutex must be locked.
+*/
+void QEglFSKmsGbmScreen::sendPresentation()
+{
+    QScreen *qscreen = screen();
+    if (!qscreen)
+        return;
+
+    auto *event = new Aurora::PlatformSupport::PresentationEvent();
+    event->frame = m_frameNumberNext;
+    event->sequence = m_flipSequence;
+    event->tv_sec = m_flipTimestamp / 1000000;
+    event->tv_nsec = (m_flipTimestamp % 1000000) * 1000;
+    event->tearing = m_asyncFlip;
+    {
+        QMutexLocker locker(&m_scanoutMutex);
+        event->scanoutKey = m_scanoutCurrent;
+        for (const Overlay &overlay : qAsConst(m_overlays)) {
+            if (overlay.currentKey)
+                event->overlayKeys.append(overlay.currentKey);
+        }
+    }
+    // Neither variable refresh rate nor tearing flips keep a steady pace
+    if (!m_vrrActive && !m_asyncFlip)
+        event->refreshNsec = refreshInterval() * 1000;
+    QCoreApplication::postEvent(qscreen, event);
+}
+
+/*
+    Returns the time between two vblanks of the current mode, in microseconds.
+*/
+qint64 QEglFSKmsGbmScreen::refreshInterval() const
+{
+    const drmModeModeInfo &mode = m_output.modes[m_output.mode];
+    if (!mode.clock || !mode.htotal || !mode.vtotal)
+        return 0;
+
+    // The pixel clock is in kHz
+    qint64 interval = qint64(mode.htotal) * mode.vtotal * 1000 / mode.clock;
+    if (mode.flags & DRM_MODE_FLAG_INTERLACE)
+        interval /= 2;
+    if (mode.flags & DRM_MODE_FLAG_DBLSCAN)
+        interval *= 2;
+    if (mode.vscan > 1)
+        interval *= mode.vscan;
+    return interval;
+}
+
+bool QEglFSKmsGbmScreen::isScanoutBufferInUse(quintptr key) const
+{
+    if (key == m_scanoutCurrent || key == m_scanoutPending || key == m_scanoutQueued || key == m_scanoutNext)
+        return true;
+
+    for (const Overlay &overlay : m_overlays) {
+        if (key == overlay.key || key == overlay.pendingKey || key == overlay.currentKey)
+            return true;
+    }
+
+    return false;
 }
 
-void QEglFSKmsGbmScreen::recordFrame(unsigned int tv_sec, unsigned int tv_usec)
+/*
+    Destroys the framebuffers of client buffers that went away while in use.
+
+    m_scanoutMutex must be locked.
+*/
+void QEglFSKmsGbmScreen::releaseUnusedScanoutBuffers()
+{
+    for (auto it = m_scanoutBuffers.begin(); it != m_scanoutBuffers.end();) {
+        if (it->released && !isScanoutBufferInUse(it.key())) {
+            destroyScanoutFramebuffer(it.value());
+            it = m_scanoutBuffers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/*
+    Destroys the framebuffer of the client buffer \a key that was just
+    refused, unless it was accepted before or is still in use: the
+    compositor only tells about client buffers that were accepted
+    when they go away.
+
+    m_scanoutMutex must be locked.
+*/
+void QEglFSKmsGbmScreen::dropRefusedScanoutBuffer(quintptr key)
+{
+    auto it = m_scanoutBuffers.find(key);
+    if (it == m_scanoutBuffers.end() || it->accepted || isScanoutBufferInUse(key))
+        return;
+
+    destroyScanoutFramebuffer(it.value());
+    m_scanoutBuffers.erase(it);
+}
+
+/*
+    Exports the buffer the flip that just completed put on screen to the
+    screen capture clients waiting for a frame, without copying it.
+    Clients get the dmabuf of the primary plane as it is scanned out:
+    the compositor's own buffer, or the client buffer being scanned out
+    directly.
+
+    m_flipMutex must be locked.
+*/
+void QEglFSKmsGbmScreen::recordFrame()
 {
     if (!isRecordingEnabled())
         return;
 
+    QScreen *qscreen = screen();
+    if (!qscreen)
+        return;
+
     // We don't want to be called every flip
     setRecordingEnabled(false);
 
-    auto *bo = m_gbm_bo_current;
+    gbm_bo *bo = m_gbm_bo_current;
+    bool hasOverlays = false;
+    {
+        QMutexLocker locker(&m_scanoutMutex);
+        auto it = m_scanoutBuffers.constFind(m_scanoutCurrent);
+        if (it != m_scanoutBuffers.constEnd() && it->bo)
+            bo = it->bo;
+        hasOverlays = !m_overlays.isEmpty();
+    }
+
+    // Content on overlay planes is not part of the primary plane buffer
+    // and clients would miss it, they can try again once it went away
+    if (!bo || hasOverlays) {
+        auto *cancelEvent = new Aurora::PlatformSupport::ScreenCastCancelEvent();
+        cancelEvent->screen = qscreen;
+        cancelEvent->reason = Aurora::PlatformSupport::ScreenCastCancelEvent::Temporary;
+        QCoreApplication::postEvent(qscreen, cancelEvent);
+        return;
+    }
+
+    const int planeCount = qMin(gbm_bo_get_plane_count(bo), 4);
+    int fds[4] = { -1, -1, -1, -1 };
+    bool exported = true;
+#ifdef EGLFS_HAVE_GBM_BO_GET_FD_FOR_PLANE
+    for (int i = 0; i < planeCount && exported; ++i) {
+        fds[i] = gbm_bo_get_fd_for_plane(bo, i);
+        exported = fds[i] >= 0;
+    }
+    if (!exported)
+        qErrnoWarning("Could not export buffer of screen %s for screen capture", qPrintable(name()));
+#else
+    // Without per plane export we can only hand out the buffer object
+    // itself, which is right as long as all planes live in it
+    const quint32 handle = gbm_bo_get_handle_for_plane(bo, 0).u32;
+    for (int i = 1; i < planeCount && exported; ++i)
+        exported = gbm_bo_get_handle_for_plane(bo, i).u32 == handle;
+    if (!exported) {
+        qWarning("Cannot export buffer of screen %s for screen capture: planes are in different buffer objects",
+                 qPrintable(name()));
+    } else {
+        fds[0] = gbm_bo_get_fd(bo);
+        exported = fds[0] >= 0;
+        for (int i = 1; i < planeCount && exported; ++i) {
+            fds[i] = fcntl(fds[0], F_DUPFD_CLOEXEC, 0);
+            exported = fds[i] >= 0;
+        }
+        if (!exported)
+            qErrnoWarning("Could not export buffer of screen %s for screen capture", qPrintable(name()));
+    }
+#endif
+    if (!exported) {
+        for (int i = 0; i < planeCount; ++i) {
+            if (fds[i] >= 0)
+                ::close(fds[i]);
+        }
+
+        auto *cancelEvent = new Aurora::PlatformSupport::ScreenCastCancelEvent();
+        cancelEvent->screen = qscreen;
+        cancelEvent->reason = Aurora::PlatformSupport::ScreenCastCancelEvent::Temporary;
+        QCoreApplication::postEvent(qscreen, cancelEvent);
+        return;
+    }
+
+    const quint64 serial = ++m_screenCastSerial;
 
     auto *frameEvent = new Aurora::PlatformSupport::ScreenCastFrameEvent();
-    frameEvent->screen = screen();
-    frameEvent->offset = rawGeometry().topLeft();
+    frameEvent->screen = qscreen;
+    frameEvent->serial = serial;
+    // The whole buffer is on screen, there is nothing to crop
+    frameEvent->offset = QPoint(0, 0);
     frameEvent->size = QSize(gbm_bo_get_width(bo), gbm_bo_get_height(bo));
     frameEvent->drmFormat = gbmFormatToDrmFormat(gbm_bo_get_format(bo));
     frameEvent->modifier = gbm_bo_get_modifier(bo);
-    frameEvent->numObjects = 1;
-    QCoreApplication::postEvent(QCoreApplication::instance(), frameEvent);
-
-    auto *objectEvent = new Aurora::PlatformSupport::ScreenCastObjectEvent();
-    objectEvent->screen = screen();
-    objectEvent->index = 0;
-    objectEvent->fd = gbm_bo_get_fd(bo);
-    objectEvent->stride = gbm_bo_get_stride(bo);
-    objectEvent->size = gbm_bo_get_width(bo) * gbm_bo_get_height(bo) * objectEvent->stride;
-    objectEvent->planeIndex = 0;
-    QCoreApplication::postEvent(QCoreApplication::instance(), objectEvent);
+    frameEvent->numObjects = planeCount;
+    QCoreApplication::postEvent(qscreen, frameEvent);
+
+    for (int i = 0; i < planeCount; ++i) {
+        auto *objectEvent = new Aurora::PlatformSupport::ScreenCastObjectEvent();
+        objectEvent->screen = qscreen;
+        objectEvent->serial = serial;
+        objectEvent->index = i;
+        objectEvent->fd = fds[i];
+        objectEvent->offset = gbm_bo_get_offset(bo, i);
+        objectEvent->stride = gbm_bo_get_stride_for_plane(bo, i);
+        objectEvent->planeIndex = i;
+        const off_t size = lseek(fds[i], 0, SEEK_END);
+        lseek(fds[i], 0, SEEK_SET);
+        objectEvent->size = size > 0 ? quint32(size) : 0;
+        QCoreApplication::postEvent(qscreen, objectEvent);
+    }
 
     auto *readyEvent = new Aurora::PlatformSupport::ScreenCastReadyEvent();
-    readyEvent->screen = screen();
-    readyEvent->tv_sec = tv_sec;
-    readyEvent->tv_nsec = tv_usec * 1000;
-    QCoreApplication::postEvent(QCoreApplication::instance(), readyEvent);
+    readyEvent->screen = qscreen;
+    readyEvent->serial = serial;
+    readyEvent->tv_sec = m_flipTimestamp / 1000000;
+    readyEvent->tv_nsec = (m_flipTimestamp % 1000000) * 1000;
+    QCoreApplication::postEvent(qscreen, readyEvent);
+
+    m_screenCastExported = true;
+}
+
+/*
+    Tells screen capture clients that the buffer exported to them is
+    not on screen anymore, because another flip replaced it or the
+    surface went away.
+
+    m_flipMutex must be locked.
+*/
+void QEglFSKmsGbmScreen::cancelScreenCast(Aurora::PlatformSupport::ScreenCastCancelEvent::Reason reason)
+{
+    if (!m_screenCastExported)
+        return;
+
+    m_screenCastExported = false;
+
+    QScreen *qscreen = screen();
+    if (!qscreen)
+        return;
+
+    auto *event = new Aurora::PlatformSupport::ScreenCastCancelEvent();
+    event->screen = qscreen;
+    event->serial = m_screenCastSerial;
+    event->reason = reason;
+    QCoreApplication::postEvent(qscreen, event);
 }
 
 QT_END_NAMESPACE
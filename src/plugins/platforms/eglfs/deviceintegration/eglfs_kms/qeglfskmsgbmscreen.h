@@ -41,13 +41,24 @@
 
 #pragma once
 
+#include <QtCore/QHash>
 #include <QtCore/QMutex>
 #include <QtCore/QWaitCondition>
 
+#include <LiriAuroraPlatformHeaders/lirieglfsfunctions.h>
 #include <LiriEglFSKmsSupport/qeglfskmsscreen.h>
 
+#include "qeglfskmsgbmframescheduler.h"
+
 #include <gbm.h>
 
+namespace Aurora {
+namespace PlatformSupport {
+class OverlayLayer;
+class ScanoutBuffer;
+}
+}
+
 QT_BEGIN_NAMESPACE
 
 class QEglFSKmsGbmCursor;
@@ -62,6 +73,7 @@ public:
 
     gbm_surface *createGbmSurface(EGLConfig eglConfig, const QSize &size);
     gbm_surface *createSurface(EGLConfig eglConfig);
+    bool isSurfaceRejected();
     void resetSurface();
     void setSurface(gbm_surface *surface);
 
@@ -69,26 +81,105 @@ public:
                      const QVector<QPlatformScreen *> &screensCloningThisScreen);
 
     void waitForFlip() override;
+    void pageFlipped(unsigned int crtcId, unsigned int sequence,
+                     unsigned int tv_sec, unsigned int tv_usec) override;
+
+    void flip(const QRegion &damage);
 
-    void flip();
+    QEglFSKmsGbmFrameScheduler *frameScheduler() { return &m_frameScheduler; }
+
+    bool isSynchronized() const;
+    bool prepareSynchronizedFlip();
+    bool finishSynchronizedFlip(bool committed);
 
     void setCursorTheme(const QString &name, int size) override;
+    bool setClientCursor(const QImage &image, const QPoint &hotSpot);
+    bool setVariableRefreshRate(bool enabled);
+    bool isScreenCastSupported() const;
 
     void setModeChangeRequested(bool enabled) override;
 
+    bool setScanoutBuffer(const Aurora::PlatformSupport::ScanoutBuffer &buffer);
+    void releaseScanoutBuffer(quintptr key);
+
+    int createOverlayLayer();
+    void destroyOverlayLayer(int id);
+    bool updateOverlayLayer(int id, const Aurora::PlatformSupport::OverlayLayer &layer);
+    void hideOverlayLayer(int id);
+
 private:
-    void flipFinished();
+    // Frame added to an atomic request, or flipped with the legacy API
+    struct PendingFlip {
+        gbm_bo *bo = nullptr;
+        uint32_t fb = 0;
+        quintptr scanoutKey = 0;
+        QRegion damage;
+        bool vrr = false;
+        uint32_t damageBlob = 0;
+        // The flip sets the mode
+        bool modeSet = false;
+    };
+
+    bool submitFlip(gbm_bo *bo, quintptr scanoutKey, const QRegion &damage);
+#ifdef EGLFS_ENABLE_DRM_ATOMIC
+    bool submitAsyncFlip(gbm_bo *bo, quintptr scanoutKey);
+#endif
+    bool prepareFlip(gbm_bo *bo, quintptr scanoutKey, const QRegion &damage, PendingFlip *flip);
+    bool finishFlip(PendingFlip *flip, bool committed);
     void ensureModeSet(uint32_t fb);
     void cloneDestFlipFinished(QEglFSKmsGbmScreen *cloneDestScreen);
     void updateFlipStatus();
-    void recordFrame(unsigned int tv_sec, unsigned int tv_usec);
+    void recordFrame();
+    void cancelScreenCast(Aurora::PlatformSupport::ScreenCastCancelEvent::Reason reason);
+    void sendPresentation();
+    QVector<uint64_t> scanoutModifiers(uint32_t format) const;
+    void rejectSurfaceModifiers();
+    qint64 refreshInterval() const;
 
     gbm_surface *m_gbm_surface;
 
+    // The surface was created with explicit modifiers, scanout refused
+    // them once and the surface must be created again without
+    bool m_surfaceModifiers = false;
+    bool m_modifiersRejected = false;
+    bool m_surfaceRejected = false;
+
+    // Shown, flip in flight and rendered waiting for that flip
     gbm_bo *m_gbm_bo_current;
     gbm_bo *m_gbm_bo_next;
+    gbm_bo *m_gbm_bo_queued;
     bool m_flipPending;
 
+    // Vblanks the frames of m_gbm_bo_next and m_gbm_bo_queued were rendered for
+    QEglFSKmsGbmFrameScheduler m_frameScheduler;
+    qint64 m_frameTargetNext = 0;
+    qint64 m_frameTargetQueued = 0;
+    qint64 m_flipTimestamp = 0;
+    unsigned int m_flipSequence = 0;
+
+    // Last buffer exported to screen capture clients, until it leaves the screen
+    quint64 m_screenCastSerial = 0;
+    bool m_screenCastExported = false;
+
+    // Numbers of the frames of m_gbm_bo_next and m_gbm_bo_queued
+    quint64 m_frameNumberNext = 0;
+    quint64 m_frameNumberQueued = 0;
+
+    // Frame added to the request of the device by prepareSynchronizedFlip()
+    PendingFlip m_synchronizedFlip;
+
+    // Damage of the queued frame, and whether the primary plane shows the
+    // frame rendered before the next one, so that damage applies to it
+    QRegion m_damageQueued;
+    bool m_damageTracked = false;
+
+    // Variable refresh rate allowed, and set on the CRTC by the last flip
+    bool m_vrrEnabled = false;
+    bool m_vrrActive = false;
+
+    // The last flip didn't wait for the vblank
+    bool m_asyncFlip = false;
+
     QMutex m_flipMutex;
     QWaitCondition m_flipCond;
 
@@ -100,6 +191,59 @@ private:
     static void bufferDestroyedHandler(gbm_bo *bo, void *data);
     FrameBuffer *framebufferForBufferObject(gbm_bo *bo);
 
+    // Overlay planes assigned to hardware layers of the compositor
+    struct Overlay {
+        KmsPlane plane;
+        quintptr key = 0;
+        QRectF source;
+        QRect geometry;
+        int zOrder = 0;
+        // Key of the buffer shown by the last flip, or pending
+        quintptr pendingKey = 0;
+        quintptr currentKey = 0;
+        bool destroyed = false;
+        // Destroyed and turned off by the pending flip, given back after it
+        bool disabled = false;
+    };
+
+#ifdef EGLFS_ENABLE_DRM_ATOMIC
+    void addPlaneProperties(drmModeAtomicReq *request, uint32_t fb);
+    void addOverlayProperties(drmModeAtomicReq *request, int skipId = 0, const Overlay *extra = nullptr);
+    uint32_t createDamageBlob(const QRegion &damage);
+#endif
+    bool isScanoutBufferInUse(quintptr key) const;
+    void releaseUnusedScanoutBuffers();
+    void dropRefusedScanoutBuffer(quintptr key);
+
+    // Client buffers shown on the primary plane instead of the composited frame
+    struct ScanoutFrameBuffer {
+        gbm_bo *bo = nullptr;
+        uint32_t fb = 0;
+        // Failed a real commit after passing the test
+        bool rejected = false;
+        // The client prefers tearing, unless the driver refused it
+        bool allowTearing = false;
+        bool asyncRejected = false;
+        // Destroyed by the client while still in use by a flip
+        bool released = false;
+        // Accepted once, the compositor tells when the client buffer goes away
+        bool accepted = false;
+    };
+    ScanoutFrameBuffer importScanoutBuffer(const Aurora::PlatformSupport::ScanoutBuffer &buffer);
+    bool testScanout(uint32_t fb, int overlayId = 0, const Overlay *overlay = nullptr);
+    void destroyScanoutFramebuffer(const ScanoutFrameBuffer &scanout);
+
+    QMutex m_scanoutMutex;
+    QHash<quintptr, ScanoutFrameBuffer> m_scanoutBuffers;
+    quintptr m_scanoutNext = 0;
+    quintptr m_scanoutPending = 0;
+    quintptr m_scanoutQueued = 0;
+    quintptr m_scanoutCurrent = 0;
+    // Primary plane content of the last flip, to test overlays against
+    uint32_t m_currentFb = 0;
+    QHash<int, Overlay> m_overlays;
+    int m_nextOverlayId = 1;
+
     QEglFSKmsGbmScreen *m_cloneSource;
     struct CloneDestination {
         QEglFSKmsGbmScreen *screen = nullptr;
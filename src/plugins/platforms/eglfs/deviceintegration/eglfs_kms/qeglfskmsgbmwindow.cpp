@@ -41,6 +41,7 @@
 #include "qeglfskmsgbmintegration.h"
 #include "qeglfskmsgbmscreen.h"
 
+#include <QtCore/QTimer>
 #include <QtEglSupport/private/qeglconvenience_p.h>
 
 QT_BEGIN_NAMESPACE
@@ -123,6 +124,7 @@ bool QEglFSKmsGbmWindow::resizeSurface(const QSize &size)
     // Switch to the new one
     m_window = window;
     m_surface = surface;
+    m_damageHistory.clear();
 
     // New surface created: destroy the old one
     if (oldSurface != EGL_NO_SURFACE)
@@ -133,4 +135,26 @@ bool QEglFSKmsGbmWindow::resizeSurface(const QSize &size)
     return true;
 }
 
+/*
+    Updates are delivered as late as the frame scheduler of the screen
+    allows to make the next vblank, with the latest input and client
+    buffers.
+*/
+void QEglFSKmsGbmWindow::requestUpdate()
+{
+    QEglFSKmsGbmScreen *gbmScreen = static_cast<QEglFSKmsGbmScreen *>(screen());
+    const qint64 delay = gbmScreen->frameScheduler()->renderDelay();
+
+    // The platform window may be gone by the time the timer fires
+    QWindow *w = window();
+    QTimer::singleShot(int(delay / 1000), Qt::PreciseTimer, w, [w]() {
+        auto *platformWindow = static_cast<QEglFSKmsGbmWindow *>(w->handle());
+        if (!platformWindow || !platformWindow->hasPendingUpdateRequest())
+            return;
+
+        static_cast<QEglFSKmsGbmScreen *>(platformWindow->screen())->frameScheduler()->renderStarted();
+        platformWindow->deliverUpdateRequest();
+    });
+}
+
 QT_END_NAMESPACE
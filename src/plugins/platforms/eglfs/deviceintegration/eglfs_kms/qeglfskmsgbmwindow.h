@@ -61,6 +61,8 @@ public:
     void invalidateSurface() override;
     bool resizeSurface(const QSize &size) override;
 
+    void requestUpdate() override;
+
 private:
     const QEglFSKmsGbmIntegration *m_integration;
 };
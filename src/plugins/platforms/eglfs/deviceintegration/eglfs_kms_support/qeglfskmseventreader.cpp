@@ -39,6 +39,7 @@
 
 #include "qeglfskmseventreader.h"
 #include "qeglfskmsdevice.h"
+#include "qeglfskmsscreen.h"
 #include <QSocketNotifier>
 #include <QCoreApplication>
 #include <QLoggingCategory>
@@ -47,101 +48,18 @@ QT_BEGIN_NAMESPACE
 
 Q_DECLARE_LOGGING_CATEGORY(qLcEglfsKmsDebug)
 
-static void pageFlipHandler(int fd, unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec, void *user_data)
+/*
+    Page flips are completed right on the event reader thread: the screen
+    commits the frame queued behind, if any, without waiting for the thread
+    that rendered it.
+*/
+static void pageFlipHandler(int fd, unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec,
+                            unsigned int crtc_id, void *user_data)
 {
     Q_UNUSED(fd);
-    Q_UNUSED(sequence);
-    Q_UNUSED(tv_sec);
-    Q_UNUSED(tv_usec);
 
-    QEglFSKmsEventReaderThread *t = static_cast<QEglFSKmsEventReaderThread *>(QThread::currentThread());
-    t->eventHost()->handlePageFlipCompleted(user_data);
-}
-
-class RegisterWaitFlipEvent : public QEvent
-{
-public:
-    static const QEvent::Type TYPE = QEvent::Type(QEvent::User + 1);
-    RegisterWaitFlipEvent(void *key, QMutex *mutex, QWaitCondition *cond)
-        : QEvent(TYPE), key(key), mutex(mutex), cond(cond)
-    { }
-    void *key;
-    QMutex *mutex;
-    QWaitCondition *cond;
-};
-
-bool QEglFSKmsEventHost::event(QEvent *event)
-{
-    if (event->type() == RegisterWaitFlipEvent::TYPE) {
-        RegisterWaitFlipEvent *e = static_cast<RegisterWaitFlipEvent *>(event);
-        PendingFlipWait *p = &pendingFlipWaits[0];
-        PendingFlipWait *end = p + MAX_FLIPS;
-        while (p < end) {
-            if (!p->key) {
-                p->key = e->key;
-                p->mutex = e->mutex;
-                p->cond = e->cond;
-                updateStatus();
-                return true;
-            }
-            ++p;
-        }
-        qWarning("Cannot queue page flip wait (more than %d screens?)", MAX_FLIPS);
-        e->mutex->lock();
-        e->cond->wakeOne();
-        e->mutex->unlock();
-        return true;
-    }
-    return QObject::event(event);
-}
-
-void QEglFSKmsEventHost::updateStatus()
-{
-    void **begin = &completedFlips[0];
-    void **end = begin + MAX_FLIPS;
-
-    for (int i = 0; i < MAX_FLIPS; ++i) {
-        PendingFlipWait *w = pendingFlipWaits + i;
-        if (!w->key)
-            continue;
-
-        void **p = begin;
-        while (p < end) {
-            if (*p == w->key) {
-                *p = nullptr;
-                w->key = nullptr;
-                w->mutex->lock();
-                w->cond->wakeOne();
-                w->mutex->unlock();
-                return;
-            }
-            ++p;
-        }
-    }
-}
-
-void QEglFSKmsEventHost::handlePageFlipCompleted(void *key)
-{
-    void **begin = &completedFlips[0];
-    void **end = begin + MAX_FLIPS;
-    void **p = begin;
-    while (p < end) {
-        if (*p == key) {
-            updateStatus();
-            return;
-        }
-        ++p;
-    }
-    p = begin;
-    while (p < end) {
-        if (!*p) {
-            *p = key;
-            updateStatus();
-            return;
-        }
-        ++p;
-    }
-    qWarning("Cannot store page flip status (more than %d screens?)", MAX_FLIPS);
+    QEglFSKmsScreen *screen = static_cast<QEglFSKmsScreen *>(user_data);
+    screen->pageFlipped(crtc_id, sequence, tv_sec, tv_usec);
 }
 
 void QEglFSKmsEventReaderThread::run()
@@ -152,16 +70,15 @@ void QEglFSKmsEventReaderThread::run()
     QObject::connect(&notifier, &QSocketNotifier::activated, &notifier, [this] {
         drmEventContext drmEvent;
         memset(&drmEvent, 0, sizeof(drmEvent));
-        drmEvent.version = 2;
+        drmEvent.version = 3;
         drmEvent.vblank_handler = nullptr;
-        drmEvent.page_flip_handler = pageFlipHandler;
+        drmEvent.page_flip_handler2 = pageFlipHandler;
         drmHandleEvent(m_fd, &drmEvent);
+        m_device->countEventRead();
     });
 
     exec();
 
-    m_ev.moveToThread(thread()); // move back to the thread where m_ev was created
-
     qCDebug(qLcEglfsKmsDebug, "Event reader thread: event loop stopped");
 }
 
@@ -182,12 +99,8 @@ void QEglFSKmsEventReader::create(QEglFSKmsDevice *device)
     qCDebug(qLcEglfsKmsDebug, "Initalizing event reader for device %p fd %d",
             m_device, m_device->fd());
 
-    m_thread = new QEglFSKmsEventReaderThread(m_device->fd());
+    m_thread = new QEglFSKmsEventReaderThread(m_device, m_device->fd());
     m_thread->start();
-
-    // Change thread affinity for the event host, so that postEvent()
-    // goes through the event reader thread's event loop for that object.
-    m_thread->eventHost()->moveToThread(m_thread);
 }
 
 void QEglFSKmsEventReader::destroy()
@@ -207,12 +120,4 @@ void QEglFSKmsEventReader::destroy()
     m_device = nullptr;
 }
 
-void QEglFSKmsEventReader::startWaitFlip(void *key, QMutex *mutex, QWaitCondition *cond)
-{
-    if (m_thread) {
-        QCoreApplication::postEvent(m_thread->eventHost(),
-                                    new RegisterWaitFlipEvent(key, mutex, cond));
-    }
-}
-
 QT_END_NAMESPACE
@@ -40,42 +40,21 @@
 #pragma once
 
 #include "qeglfsglobal_p.h"
-#include <QObject>
 #include <QThread>
-#include <QMutex>
-#include <QWaitCondition>
 
 QT_BEGIN_NAMESPACE
 
 class QEglFSKmsDevice;
 
-struct QEglFSKmsEventHost : public QObject
-{
-    struct PendingFlipWait {
-        void *key;
-        QMutex *mutex;
-        QWaitCondition *cond;
-    };
-
-    static const int MAX_FLIPS = 32;
-    void *completedFlips[MAX_FLIPS] = {};
-    QEglFSKmsEventHost::PendingFlipWait pendingFlipWaits[MAX_FLIPS] = {};
-
-    bool event(QEvent *event) override;
-    void updateStatus();
-    void handlePageFlipCompleted(void *key);
-};
-
 class QEglFSKmsEventReaderThread : public QThread
 {
 public:
-    QEglFSKmsEventReaderThread(int fd) : m_fd(fd) { }
+    QEglFSKmsEventReaderThread(QEglFSKmsDevice *device, int fd) : m_device(device), m_fd(fd) { }
     void run() override;
-    QEglFSKmsEventHost *eventHost() { return &m_ev; }
 
 private:
+    QEglFSKmsDevice *m_device;
     int m_fd;
-    QEglFSKmsEventHost m_ev;
 };
 
 class Q_EGLFS_EXPORT QEglFSKmsEventReader
@@ -86,8 +65,6 @@ public:
     void create(QEglFSKmsDevice *device);
     void destroy();
 
-    void startWaitFlip(void *key, QMutex *mutex, QWaitCondition *cond);
-
 private:
     QEglFSKmsDevice *m_device = nullptr;
     QEglFSKmsEventReaderThread *m_thread = nullptr;
@@ -205,6 +205,19 @@ void QEglFSKmsScreen::waitForFlip()
 {
 }
 
+/*
+    Called on the event reader thread when the flip committed with this
+    screen as user data completed on \a crtcId.
+*/
+void QEglFSKmsScreen::pageFlipped(unsigned int crtcId, unsigned int sequence,
+                                  unsigned int tv_sec, unsigned int tv_usec)
+{
+    Q_UNUSED(crtcId);
+    Q_UNUSED(sequence);
+    Q_UNUSED(tv_sec);
+    Q_UNUSED(tv_usec);
+}
+
 void QEglFSKmsScreen::restoreMode()
 {
     m_output.restoreMode(m_device);
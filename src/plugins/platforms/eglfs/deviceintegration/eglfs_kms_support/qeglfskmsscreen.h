@@ -92,6 +92,8 @@ public:
     QEglFSKmsDevice *device() const { return m_device; }
 
     virtual void waitForFlip();
+    virtual void pageFlipped(unsigned int crtcId, unsigned int sequence,
+                             unsigned int tv_sec, unsigned int tv_usec);
 
     KmsOutput &output() { return m_output; }
     void restoreMode();
@@ -10,6 +10,7 @@
 #include "testseat.h"
 
 #include <QtGui/QScreen>
+#include <QtQuick/QQuickWindow>
 #include <LiriAuroraCompositor/WaylandBufferRef>
 #include <LiriAuroraCompositor/WaylandXdgShell>
 #include <LiriAuroraCompositor/private/aurorawaylandkeyboard_p.h>
@@ -20,6 +21,8 @@
 #include <LiriAuroraCompositor/WaylandResource>
 #include <LiriAuroraCompositor/WaylandKeymap>
 #include <LiriAuroraCompositor/WaylandView>
+#include <LiriAuroraCompositor/WaylandQuickItem>
+#include <LiriAuroraCompositor/WaylandQuickOutput>
 #include <LiriAuroraCompositor/WaylandViewporter>
 #include <LiriAuroraCompositor/WaylandIdleInhibitManagerV1>
 #include <LiriAuroraCompositor/WaylandXdgOutputManagerV1>
@@ -27,6 +30,7 @@
 #include <aurora-client-ivi-application.h>
 #include <LiriAuroraCompositor/private/aurorawaylandoutput_p.h>
 #include <LiriAuroraCompositor/private/aurorawaylandsurface_p.h>
+#include <LiriAuroraCompositor/private/aurorawaylandview_p.h>
 
 #include <QtTest/QtTest>
 
@@ -64,6 +68,10 @@ private slots:
     void mapSurface();
     void mapSurfaceHiDpi();
     void frameCallback();
+    void frameCallbackPending();
+    void frameCallbackThrottling();
+    void synchronizedSubsurface();
+    void viewDamageAccumulates();
     void pixelFormats();
     void outputs();
     void customSurface();
@@ -634,6 +642,256 @@ void tst_WaylandCompositor::frameCallback()
     wl_surface_destroy(surface);
 }
 
+void tst_WaylandCompositor::frameCallbackPending()
+{
+    TestCompositor compositor;
+    compositor.create();
+
+    MockClient client;
+
+    wl_surface *surface = client.createSurface();
+    QTRY_COMPARE(compositor.surfaces.size(), 1);
+    WaylandSurface *waylandSurface = compositor.surfaces.at(0);
+    WaylandView view;
+    view.setSurface(waylandSurface);
+    view.setOutput(compositor.defaultOutput());
+    QSignalSpy damagedSpy(waylandSurface, SIGNAL(damaged(const QRegion &)));
+
+    QSize size(16, 16);
+    ShmBuffer buffer(size, client.shm);
+
+    int committedCounter = 0;
+    int pendingCounter = 0;
+
+    // Two callbacks are committed, the third one is still pending
+    wl_surface_attach(surface, buffer.handle, 0, 0);
+    registerFrameCallback(surface, &committedCounter);
+    registerFrameCallback(surface, &committedCounter);
+    wl_surface_damage(surface, 0, 0, size.width(), size.height());
+    wl_surface_commit(surface);
+    registerFrameCallback(surface, &pendingCounter);
+    QTRY_COMPARE(damagedSpy.count(), 1);
+
+    compositor.defaultOutput()->frameStarted();
+    compositor.defaultOutput()->sendFrameCallbacks();
+    QTRY_COMPARE(committedCounter, 2);
+    QCOMPARE(pendingCounter, 0);
+
+    wl_surface_commit(surface);
+    QTRY_COMPARE(damagedSpy.count(), 2);
+    compositor.defaultOutput()->frameStarted();
+    compositor.defaultOutput()->sendFrameCallbacks();
+    QTRY_COMPARE(pendingCounter, 1);
+    QCOMPARE(committedCounter, 2);
+
+    // Callbacks left behind by a destroyed surface must not be sent
+    registerFrameCallback(surface, &pendingCounter);
+    wl_surface_commit(surface);
+    QTRY_COMPARE(damagedSpy.count(), 3);
+    wl_surface_destroy(surface);
+    QTRY_COMPARE(compositor.surfaces.size(), 0);
+    QCOMPARE(pendingCounter, 1);
+}
+
+void tst_WaylandCompositor::frameCallbackThrottling()
+{
+    // Any scene graph backend will do, views are walked while synchronizing
+    QQuickWindow::setGraphicsApi(QSGRendererInterface::Software);
+
+    TestCompositor compositor;
+    compositor.create();
+
+    QQuickWindow window;
+    window.resize(64, 64);
+    WaylandQuickOutput output(&compositor, &window);
+    output.setFrameCallbackThrottling(true);
+    output.setThrottledFrameCallbackInterval(0);
+
+    MockClient client;
+
+    wl_surface *back = client.createSurface();
+    QTRY_COMPARE(compositor.surfaces.size(), 1);
+    wl_surface *front = client.createSurface();
+    QTRY_COMPARE(compositor.surfaces.size(), 2);
+    WaylandSurface *waylandBack = compositor.surfaces.at(0);
+    WaylandSurface *waylandFront = compositor.surfaces.at(1);
+
+    QSize size(16, 16);
+    ShmBuffer backBuffer(size, client.shm);
+    ShmBuffer frontBuffer(size, client.shm);
+
+    // Only the surface in front is opaque
+    wl_region *opaqueRegion = wl_compositor_create_region(client.compositor);
+    wl_region_add(opaqueRegion, 0, 0, size.width(), size.height());
+    wl_surface_set_opaque_region(front, opaqueRegion);
+    wl_region_destroy(opaqueRegion);
+
+    int backCounter = 0;
+    wl_surface_attach(back, backBuffer.handle, 0, 0);
+    registerFrameCallback(back, &backCounter);
+    wl_surface_damage(back, 0, 0, size.width(), size.height());
+    wl_surface_commit(back);
+    wl_surface_attach(front, frontBuffer.handle, 0, 0);
+    wl_surface_damage(front, 0, 0, size.width(), size.height());
+    wl_surface_commit(front);
+    QTRY_VERIFY(waylandBack->hasContent() && waylandFront->hasContent());
+
+    WaylandQuickItem backItem;
+    backItem.setSurface(waylandBack);
+    backItem.setParentItem(window.contentItem());
+    WaylandQuickItem frontItem;
+    frontItem.setSurface(waylandFront);
+    frontItem.setParentItem(window.contentItem());
+
+    QSignalSpy reasonSpy(waylandBack, SIGNAL(frameCallbackHoldReasonChanged()));
+
+    window.show();
+    QVERIFY(QTest::qWaitForWindowExposed(&window));
+
+    // Covered by the opaque surface stacked above
+    QTRY_COMPARE(waylandBack->frameCallbackHoldReason(), WaylandSurface::FrameCallbackHeldOccluded);
+    QCOMPARE(waylandFront->frameCallbackHoldReason(), WaylandSurface::FrameCallbackNotHeld);
+    QCOMPARE(backCounter, 0);
+
+    // ...until the trickle lets them through
+    output.setThrottledFrameCallbackInterval(1);
+    QTRY_COMPARE(backCounter, 1);
+    output.setThrottledFrameCallbackInterval(0);
+
+    // Stacked above the opaque surface
+    registerFrameCallback(back, &backCounter);
+    wl_surface_commit(back);
+    backItem.setZ(1);
+    QTRY_COMPARE(waylandBack->frameCallbackHoldReason(), WaylandSurface::FrameCallbackNotHeld);
+    QTRY_COMPARE(backCounter, 2);
+
+    // Outside of the window
+    backItem.setZ(0);
+    backItem.setX(100);
+    QTRY_COMPARE(waylandBack->frameCallbackHoldReason(), WaylandSurface::FrameCallbackHeldOffscreen);
+
+    // Moved next to the opaque surface
+    backItem.setX(32);
+    QTRY_COMPARE(waylandBack->frameCallbackHoldReason(), WaylandSurface::FrameCallbackNotHeld);
+
+    // Hidden
+    backItem.setVisible(false);
+    QTRY_COMPARE(waylandBack->frameCallbackHoldReason(), WaylandSurface::FrameCallbackHeldHidden);
+    QVERIFY(reasonSpy.count() >= 5);
+
+    wl_surface_destroy(front);
+    wl_surface_destroy(back);
+}
+
+void tst_WaylandCompositor::synchronizedSubsurface()
+{
+    TestCompositor compositor;
+    compositor.create();
+
+    MockClient client;
+    QTRY_VERIFY(client.subcompositor);
+
+    wl_surface *parent = client.createSurface();
+    QTRY_COMPARE(compositor.surfaces.size(), 1);
+    wl_surface *child = client.createSurface();
+    QTRY_COMPARE(compositor.surfaces.size(), 2);
+    WaylandSurface *waylandParent = compositor.surfaces.at(0);
+    WaylandSurface *waylandChild = compositor.surfaces.at(1);
+
+    wl_subsurface *subsurface = wl_subcompositor_get_subsurface(client.subcompositor, child, parent);
+    QSignalSpy childDamagedSpy(waylandChild, SIGNAL(damaged(const QRegion &)));
+    QSignalSpy positionSpy(waylandChild, SIGNAL(subsurfacePositionChanged(const QPoint &)));
+    QSignalSpy parentDamagedSpy(waylandParent, SIGNAL(damaged(const QRegion &)));
+
+    QSize size(16, 16);
+    ShmBuffer buffer(size, client.shm);
+
+    // Subsurfaces start synchronized: nothing is applied before the parent commits
+    wl_subsurface_set_position(subsurface, 10, 20);
+    wl_surface_attach(child, buffer.handle, 0, 0);
+    wl_surface_damage(child, 0, 0, size.width(), size.height());
+    wl_surface_commit(child);
+    wl_surface_commit(parent);
+    QTRY_COMPARE(parentDamagedSpy.count(), 1);
+    QCOMPARE(childDamagedSpy.count(), 1);
+    QCOMPARE(waylandChild->bufferSize(), size);
+    QCOMPARE(positionSpy.count(), 1);
+    QCOMPARE(positionSpy.first().first().toPoint(), QPoint(10, 20));
+
+    // Several child commits are applied as one
+    wl_surface_damage(child, 0, 0, 4, 4);
+    wl_surface_commit(child);
+    wl_surface_damage(child, 8, 8, 4, 4);
+    wl_surface_commit(child);
+    wl_surface_commit(parent);
+    QTRY_COMPARE(parentDamagedSpy.count(), 2);
+    QCOMPARE(childDamagedSpy.count(), 2);
+    QCOMPARE(childDamagedSpy.last().first().value<QRegion>(),
+             QRegion(0, 0, 4, 4) | QRegion(8, 8, 4, 4));
+
+    // Desynchronized subsurfaces apply their state right away
+    wl_subsurface_set_desync(subsurface);
+    wl_surface_commit(child);
+    QTRY_COMPARE(childDamagedSpy.count(), 3);
+    QCOMPARE(parentDamagedSpy.count(), 2);
+
+    // Switching to desynchronized applies the cached state
+    wl_subsurface_set_sync(subsurface);
+    wl_surface_commit(child);
+    wl_subsurface_set_desync(subsurface);
+    QTRY_COMPARE(childDamagedSpy.count(), 4);
+    QCOMPARE(parentDamagedSpy.count(), 2);
+
+    // Destroying the subsurface applies the cached state
+    wl_subsurface_set_sync(subsurface);
+    wl_surface_damage(child, 2, 2, 4, 4);
+    wl_surface_commit(child);
+    wl_subsurface_destroy(subsurface);
+    QTRY_COMPARE(childDamagedSpy.count(), 5);
+    QCOMPARE(childDamagedSpy.last().first().value<QRegion>(), QRegion(2, 2, 4, 4));
+    QCOMPARE(parentDamagedSpy.count(), 2);
+
+    wl_surface_destroy(child);
+    wl_surface_destroy(parent);
+}
+
+void tst_WaylandCompositor::viewDamageAccumulates()
+{
+    TestCompositor compositor;
+    compositor.create();
+
+    MockClient client;
+
+    wl_surface *surface = client.createSurface();
+    QTRY_COMPARE(compositor.surfaces.size(), 1);
+    WaylandSurface *waylandSurface = compositor.surfaces.at(0);
+    WaylandView view;
+    view.setSurface(waylandSurface);
+    view.setOutput(compositor.defaultOutput());
+
+    QSignalSpy damagedSpy(waylandSurface, SIGNAL(damaged(const QRegion &)));
+
+    QSize size(64, 64);
+    ShmBuffer buffer(size, client.shm);
+    wl_surface_attach(surface, buffer.handle, 0, 0);
+    wl_surface_damage(surface, 0, 0, size.width(), size.height());
+    wl_surface_commit(surface);
+    QTRY_COMPARE(damagedSpy.count(), 1);
+    QVERIFY(view.advance());
+    QCOMPARE(view.currentDamage(), QRegion(0, 0, 64, 64));
+
+    // Two commits before the view advances: none of the damage is lost
+    wl_surface_damage(surface, 0, 0, 8, 8);
+    wl_surface_commit(surface);
+    wl_surface_damage(surface, 32, 32, 8, 8);
+    wl_surface_commit(surface);
+    QTRY_COMPARE(damagedSpy.count(), 3);
+    QVERIFY(view.advance());
+    QCOMPARE(view.currentDamage(), QRegion(0, 0, 8, 8).united(QRect(32, 32, 8, 8)));
+
+    wl_surface_destroy(surface);
+}
+
 void tst_WaylandCompositor::pixelFormats()
 {
     TestCompositor compositor;
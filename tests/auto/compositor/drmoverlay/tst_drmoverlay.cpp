@@ -0,0 +1,111 @@
+// SPDX-FileCopyrightText: 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <QtQuick/QQuickItem>
+#include <QtQuick/QQuickWindow>
+#include <QtTest/QtTest>
+
+#include "drmoverlayhardwarelayerintegration.h"
+
+namespace Aurora {
+
+namespace Compositor {
+
+class tst_DrmOverlay : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void clippedGeometry_data();
+    void clippedGeometry();
+    void clippedAway();
+};
+
+void tst_DrmOverlay::initTestCase()
+{
+    QQuickWindow::setGraphicsApi(QSGRendererInterface::Software);
+}
+
+void tst_DrmOverlay::clippedGeometry_data()
+{
+    QTest::addColumn<QPointF>("position");
+    QTest::addColumn<bool>("clip");
+    QTest::addColumn<qreal>("dpr");
+    QTest::addColumn<QRect>("geometry");
+    QTest::addColumn<QRectF>("source");
+
+    // The item is 100x100 and shows a 200x200 buffer, its parent is at 10,10
+    QTest::newRow("inside") << QPointF(0, 0) << true << qreal(1)
+                            << QRect(10, 10, 100, 100) << QRectF(0, 0, 200, 200);
+    QTest::newRow("unclipped") << QPointF(50, -20) << false << qreal(1)
+                               << QRect(60, 0, 100, 90) << QRectF(0, 20, 200, 180);
+    QTest::newRow("parent clip") << QPointF(50, -20) << true << qreal(1)
+                                 << QRect(60, 10, 50, 80) << QRectF(0, 40, 100, 160);
+    QTest::newRow("parent clip, scaled") << QPointF(50, -20) << true << qreal(2)
+                                         << QRect(120, 20, 100, 160) << QRectF(0, 40, 100, 160);
+    QTest::newRow("window") << QPointF(180, 20) << false << qreal(1)
+                            << QRect(190, 30, 10, 100) << QRectF(0, 0, 20, 200);
+}
+
+void tst_DrmOverlay::clippedGeometry()
+{
+    QFETCH(QPointF, position);
+    QFETCH(bool, clip);
+    QFETCH(qreal, dpr);
+    QFETCH(QRect, geometry);
+    QFETCH(QRectF, source);
+
+    QQuickWindow window;
+    window.resize(200, 200);
+
+    QQuickItem parent(window.contentItem());
+    parent.setPosition(QPointF(10, 10));
+    parent.setSize(QSizeF(100, 100));
+    parent.setClip(clip);
+
+    QQuickItem item(&parent);
+    item.setPosition(position);
+    item.setSize(QSizeF(100, 100));
+
+    QRect layerGeometry;
+    QRectF layerSource;
+    QVERIFY(DrmOverlayLayer::clippedGeometry(&item, QRectF(0, 0, 200, 200), dpr,
+                                             &layerGeometry, &layerSource));
+    QCOMPARE(layerGeometry, geometry);
+    QCOMPARE(layerSource, source);
+}
+
+void tst_DrmOverlay::clippedAway()
+{
+    QQuickWindow window;
+    window.resize(200, 200);
+
+    QQuickItem parent(window.contentItem());
+    parent.setSize(QSizeF(100, 100));
+    parent.setClip(true);
+
+    QQuickItem item(&parent);
+    item.setPosition(QPointF(120, 0));
+    item.setSize(QSizeF(50, 50));
+
+    QRect geometry;
+    QRectF source;
+    QVERIFY(!DrmOverlayLayer::clippedGeometry(&item, QRectF(0, 0, 50, 50), 1,
+                                              &geometry, &source));
+
+    // Planes can't clip to a rotated rectangle
+    item.setPosition(QPointF(20, 20));
+    parent.setRotation(45);
+    QVERIFY(!DrmOverlayLayer::clippedGeometry(&item, QRectF(0, 0, 50, 50), 1,
+                                              &geometry, &source));
+}
+
+} // namespace Compositor
+
+} // namespace Aurora
+
+QTEST_MAIN(Aurora::Compositor::tst_DrmOverlay)
+
+#include "tst_drmoverlay.moc"
@@ -0,0 +1,166 @@
+// Copyright (C) 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#include "mockclient.h"
+#include "testcompositor.h"
+
+#include <QtGui/QOffscreenSurface>
+#include <QtGui/QOpenGLContext>
+#include <QtGui/QOpenGLExtraFunctions>
+#include <QtGui/QOpenGLTexture>
+#include <QtTest/QtTest>
+
+#include <LiriAuroraCompositor/WaylandBufferRef>
+#include <LiriAuroraCompositor/WaylandView>
+#include <LiriAuroraCompositor/private/aurorawlclientbuffer_p.h>
+#include <LiriAuroraCompositor/private/aurorawlshmuploader_p.h>
+
+namespace Aurora {
+
+namespace Compositor {
+
+class tst_ShmUploader : public QObject
+{
+    Q_OBJECT
+
+public:
+    static void initMain();
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+
+    void stagingTexture();
+
+private:
+    // Green channel of the texel at \a pos, which is the same byte whatever
+    // order red and blue are stored in
+    int green(QOpenGLTexture *texture, const QPoint &pos);
+
+    QTemporaryDir m_tmpRuntimeDir;
+    QOffscreenSurface m_surface;
+    QOpenGLContext m_context;
+    GLuint m_fbo = 0;
+};
+
+void tst_ShmUploader::initMain()
+{
+    // Uploads need a share context and are opt-in
+    QCoreApplication::setAttribute(Qt::AA_ShareOpenGLContexts);
+    qputenv("AURORA_SHM_ASYNC_UPLOAD", "1");
+}
+
+void tst_ShmUploader::initTestCase()
+{
+    if (!Internal::ShmUploader::instance())
+        QSKIP("Asynchronous shm uploads are not supported");
+
+    m_surface.setFormat(QOpenGLContext::globalShareContext()->format());
+    m_surface.create();
+    m_context.setShareContext(QOpenGLContext::globalShareContext());
+    m_context.setFormat(QOpenGLContext::globalShareContext()->format());
+    if (!m_context.create() || !m_context.makeCurrent(&m_surface))
+        QSKIP("OpenGL is not available");
+
+    m_context.functions()->glGenFramebuffers(1, &m_fbo);
+}
+
+void tst_ShmUploader::cleanupTestCase()
+{
+    if (m_fbo)
+        m_context.functions()->glDeleteFramebuffers(1, &m_fbo);
+    m_context.doneCurrent();
+}
+
+void tst_ShmUploader::init()
+{
+    qputenv("XDG_RUNTIME_DIR", m_tmpRuntimeDir.path().toLocal8Bit());
+}
+
+int tst_ShmUploader::green(QOpenGLTexture *texture, const QPoint &pos)
+{
+    QOpenGLFunctions *gl = m_context.functions();
+
+    gl->glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    gl->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                               texture->textureId(), 0);
+    uchar pixel[4] = { 0, 0, 0, 0 };
+    gl->glReadPixels(pos.x(), pos.y(), 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+    gl->glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    return pixel[1];
+}
+
+void tst_ShmUploader::stagingTexture()
+{
+    TestCompositor compositor;
+    compositor.create();
+
+    MockClient client;
+
+    wl_surface *surface = client.createSurface();
+    QTRY_COMPARE(compositor.surfaces.size(), 1);
+
+    WaylandSurface *waylandSurface = compositor.surfaces.at(0);
+    WaylandView view;
+    view.setSurface(waylandSurface);
+    QSignalSpy redrawSpy(waylandSurface, &WaylandSurface::redraw);
+
+    const QSize size(64, 64);
+    ShmBuffer buffer(size, client.shm);
+    buffer.image.fill(qRgb(0, 0x20, 0));
+
+    auto commit = [&](const QRect &damage) {
+        wl_surface_attach(surface, buffer.handle, 0, 0);
+        wl_surface_damage(surface, damage.x(), damage.y(), damage.width(), damage.height());
+        wl_surface_commit(surface);
+    };
+
+    // The first upload allocates the texture that is sampled
+    commit(QRect(QPoint(0, 0), size));
+    QTRY_COMPARE(redrawSpy.size(), 1);
+    QVERIFY(view.advance());
+    auto *shmBuffer = static_cast<Internal::SharedMemoryBuffer *>(view.currentBuffer().buffer());
+    QVERIFY(shmBuffer->isUploadedAsync());
+    QOpenGLTexture *first = shmBuffer->toOpenGlTexture();
+    QVERIFY(first);
+    QCOMPARE(green(first, QPoint(40, 40)), 0x20);
+
+    // Then a staging texture is uploaded to and swapped in
+    const QRect damageA(0, 0, 16, 16);
+    for (int y = damageA.top(); y <= damageA.bottom(); ++y) {
+        for (int x = damageA.left(); x <= damageA.right(); ++x)
+            buffer.image.setPixel(x, y, qRgb(0, 0x80, 0));
+    }
+    commit(damageA);
+    QTRY_COMPARE(redrawSpy.size(), 2);
+    QOpenGLTexture *second = shmBuffer->toOpenGlTexture();
+    QVERIFY(second);
+    QVERIFY(second != first);
+    QCOMPARE(green(second, QPoint(8, 8)), 0x80);
+    QCOMPARE(green(second, QPoint(40, 40)), 0x20);
+
+    // The first texture comes back and catches up with what it missed
+    const QRect damageB(32, 32, 16, 16);
+    for (int y = damageB.top(); y <= damageB.bottom(); ++y) {
+        for (int x = damageB.left(); x <= damageB.right(); ++x)
+            buffer.image.setPixel(x, y, qRgb(0, 0xff, 0));
+    }
+    commit(damageB);
+    QTRY_COMPARE(redrawSpy.size(), 3);
+    QCOMPARE(shmBuffer->toOpenGlTexture(), first);
+    QCOMPARE(green(first, QPoint(8, 8)), 0x80);
+    QCOMPARE(green(first, QPoint(40, 40)), 0xff);
+    QCOMPARE(green(first, QPoint(20, 50)), 0x20);
+
+    wl_surface_destroy(surface);
+}
+
+} // namespace Compositor
+
+} // namespace Aurora
+
+QTEST_MAIN(Aurora::Compositor::tst_ShmUploader);
+
+#include "tst_shmuploader.moc"
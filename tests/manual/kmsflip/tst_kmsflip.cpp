@@ -0,0 +1,514 @@
+// Copyright (C) 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDeadlineTimer>
+#include <QtCore/QHash>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QProcess>
+#include <QtCore/QRandomGenerator>
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QVector>
+#include <QtGui/QGuiApplication>
+#include <QtGui/QOpenGLContext>
+#include <QtGui/QOpenGLFunctions>
+#include <QtGui/QScreen>
+#include <QtGui/QWindow>
+#include <QtTest/QtTest>
+
+#include <LiriAuroraPlatformHeaders/lirieglfsfunctions.h>
+
+#include <drm_fourcc.h>
+#include <gbm.h>
+
+#include <limits>
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+// Measures the page flips of the eglfs_kms device integration: frames of
+// all outputs committed one CRTC at a time, as by default, compared with a
+// single atomic commit for all of them, as with "synchronizedOutputs" in
+// the KMS configuration. Both report commit ioctls and reads of DRM events
+// per frame, besides the latency of the flips and the skew between outputs.
+//
+// Also compares the latency of vsynced flips of a fullscreen client buffer
+// on the first output with tearing flips, as allowed by clients with the
+// tearing control protocol.
+//
+// The platform takes DRM master and reads the KMS configuration once, so
+// each row runs in a renderer process of its own on the aurora-eglfs
+// platform. Run it from a VT without a compositor. Synchronized flips need
+// at least two outputs connected. The device is /dev/dri/card0 unless
+// KMSFLIP_DEVICE says otherwise.
+
+using namespace Aurora::PlatformSupport;
+
+static const int frameCount = 300;
+
+static qint64 monotonicTime()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static QString devicePath()
+{
+    return qEnvironmentVariable("KMSFLIP_DEVICE", QStringLiteral("/dev/dri/card0"));
+}
+
+// Renders frames on the screens through the platform plugin and prints
+// the timings reported by PresentationEvent
+class Renderer : public QObject
+{
+public:
+    explicit Renderer(bool tearing, bool scanout);
+    ~Renderer();
+
+    int run();
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+    struct Output {
+        QScreen *screen = nullptr;
+        QWindow *window = nullptr;
+
+        // Swap and presentation times by frame number
+        QHash<quint64, qint64> swapped;
+        QHash<quint64, qint64> presented;
+        quint64 lastPresented = 0;
+        int tearingFlips = 0;
+    };
+
+    struct Buffer {
+        gbm_bo *bo = nullptr;
+        ScanoutBuffer scanout;
+    };
+
+    bool createBuffers();
+    void fail(const char *message);
+
+    bool m_tearing = false;
+    bool m_scanout = false;
+    QVector<Output> m_outputs;
+    QOpenGLContext m_context;
+    int m_fd = -1;
+    gbm_device *m_gbm = nullptr;
+    Buffer m_buffers[2];
+};
+
+Renderer::Renderer(bool tearing, bool scanout)
+    : m_tearing(tearing)
+    , m_scanout(scanout)
+{
+    // Client buffers are only flipped on one screen
+    const QList<QScreen *> screens = scanout
+            ? QGuiApplication::screens().mid(0, 1)
+            : QGuiApplication::screens();
+
+    for (QScreen *screen : screens) {
+        Output output;
+        output.screen = screen;
+        output.window = new QWindow(screen);
+        output.window->setSurfaceType(QSurface::OpenGLSurface);
+        output.window->setGeometry(screen->geometry());
+        output.window->showFullScreen();
+        screen->installEventFilter(this);
+        m_outputs.append(output);
+    }
+}
+
+Renderer::~Renderer()
+{
+    for (Buffer &buffer : m_buffers) {
+        if (buffer.scanout.key)
+            EglFSFunctions::releaseScanoutBuffer(buffer.scanout.key);
+        if (buffer.scanout.fds[0] >= 0)
+            close(buffer.scanout.fds[0]);
+        if (buffer.bo)
+            gbm_bo_destroy(buffer.bo);
+    }
+    if (m_gbm)
+        gbm_device_destroy(m_gbm);
+    if (m_fd >= 0)
+        close(m_fd);
+
+    for (const Output &output : qAsConst(m_outputs))
+        delete output.window;
+}
+
+bool Renderer::eventFilter(QObject *watched, QEvent *event)
+{
+    if (event->type() == PresentationEvent::registeredType()) {
+        auto *e = static_cast<PresentationEvent *>(event);
+        for (Output &output : m_outputs) {
+            if (output.screen == watched) {
+                output.presented.insert(e->frame, qint64(e->tv_sec) * 1000000 + e->tv_nsec / 1000);
+                output.lastPresented = qMax(output.lastPresented, e->frame);
+                if (e->tearing)
+                    output.tearingFlips++;
+                break;
+            }
+        }
+    }
+
+    return QObject::eventFilter(watched, event);
+}
+
+/*
+    Allocates two buffers as large as the first screen that the platform
+    can flip to, as a fullscreen client would attach.
+*/
+bool Renderer::createBuffers()
+{
+    const QByteArray path = devicePath().toLocal8Bit();
+    m_fd = open(path.constData(), O_RDWR | O_CLOEXEC);
+    if (m_fd < 0)
+        return false;
+    m_gbm = gbm_create_device(m_fd);
+    if (!m_gbm)
+        return false;
+
+    const QWindow *window = m_outputs.first().window;
+    const QSize size = window->size() * window->devicePixelRatio();
+
+    for (Buffer &buffer : m_buffers) {
+        buffer.bo = gbm_bo_create(m_gbm, size.width(), size.height(), GBM_FORMAT_XRGB8888,
+                                  GBM_BO_USE_SCANOUT | GBM_BO_USE_LINEAR);
+        if (!buffer.bo)
+            return false;
+
+        buffer.scanout.key = quintptr(buffer.bo);
+        buffer.scanout.size = size;
+        buffer.scanout.drmFormat = DRM_FORMAT_XRGB8888;
+        buffer.scanout.modifier = gbm_bo_get_modifier(buffer.bo);
+        buffer.scanout.numPlanes = 1;
+        buffer.scanout.fds[0] = gbm_bo_get_fd(buffer.bo);
+        buffer.scanout.strides[0] = gbm_bo_get_stride(buffer.bo);
+        buffer.scanout.allowTearing = m_tearing;
+        if (buffer.scanout.fds[0] < 0)
+            return false;
+    }
+
+    return true;
+}
+
+void Renderer::fail(const char *message)
+{
+    fprintf(stdout, "kmsflip-fail: %s\n", message);
+    fflush(stdout);
+}
+
+int Renderer::run()
+{
+    if (!QGuiApplication::platformFunction(EglFSFunctions::getFrameTimingIdentifier())) {
+        fprintf(stdout, "kmsflip-skip: The platform plugin is not aurora-eglfs with eglfs_kms\n");
+        return 2;
+    }
+    if (m_outputs.isEmpty()) {
+        fprintf(stdout, "kmsflip-skip: No output is connected\n");
+        return 2;
+    }
+
+    if (!m_context.create()) {
+        fail("Cannot create an OpenGL context");
+        return 1;
+    }
+
+    if (m_scanout && !createBuffers()) {
+        fail("Cannot allocate buffers for scanout");
+        return 1;
+    }
+
+    Output &first = m_outputs.first();
+    const qint64 interval = EglFSFunctions::getFrameTiming(first.screen).refreshInterval;
+
+    // A client finishes its frames at any time within a refresh
+    QRandomGenerator random(42);
+
+    QVector<QHash<QScreen *, quint64>> frames;
+    int refused = 0;
+
+    // Counted for the whole device
+    const FrameTiming before = EglFSFunctions::getFrameTiming(first.screen);
+
+    for (int frame = 0; frame < frameCount; ++frame) {
+        if (m_scanout) {
+            const qint64 renderTime = interval > 0 ? random.bounded(interval) : 0;
+            const qint64 start = monotonicTime();
+            while (monotonicTime() - start < renderTime)
+                usleep(100);
+
+            if (!EglFSFunctions::setScanoutBuffer(first.screen, m_buffers[frame % 2].scanout))
+                refused++;
+        }
+
+        QHash<QScreen *, quint64> numbers;
+        for (Output &output : m_outputs) {
+            if (!m_context.makeCurrent(output.window)) {
+                fail("Cannot make the OpenGL context current");
+                return 1;
+            }
+
+            QOpenGLFunctions *gl = m_context.functions();
+            gl->glClearColor(frame % 2, 0, 1 - frame % 2, 1);
+            gl->glClear(GL_COLOR_BUFFER_BIT);
+
+            // The frame being rendered is reported with the next number
+            const quint64 number = EglFSFunctions::getFrameTiming(output.screen).renderedFrames + 1;
+            output.swapped.insert(number, monotonicTime());
+            m_context.swapBuffers(output.window);
+            numbers.insert(output.screen, number);
+        }
+        frames.append(numbers);
+
+        QDeadlineTimer deadline(1000);
+        for (const Output &output : qAsConst(m_outputs)) {
+            while (output.lastPresented < numbers.value(output.screen)) {
+                if (deadline.hasExpired()) {
+                    fail("Timed out waiting for presentation events");
+                    return 1;
+                }
+                QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+            }
+        }
+    }
+
+    const FrameTiming after = EglFSFunctions::getFrameTiming(first.screen);
+    const qint64 commits = qint64(after.commitIoctls - before.commitIoctls);
+    const qint64 eventReads = qint64(after.eventReads - before.eventReads);
+
+    qint64 latency = 0;
+    qint64 maxLatency = 0;
+    qint64 skew = 0;
+    qint64 maxSkew = 0;
+    int flips = 0;
+    int skewFrames = 0;
+    int tearingFlips = 0;
+
+    for (const QHash<QScreen *, quint64> &numbers : qAsConst(frames)) {
+        qint64 first = std::numeric_limits<qint64>::max();
+        qint64 last = 0;
+        bool presented = true;
+
+        for (const Output &output : qAsConst(m_outputs)) {
+            const quint64 number = numbers.value(output.screen);
+            // Frames replaced by a newer one before the flip were dropped
+            if (!output.presented.contains(number)) {
+                presented = false;
+                continue;
+            }
+
+            const qint64 time = output.presented.value(number);
+            const qint64 frameLatency = time - output.swapped.value(number);
+            latency += frameLatency;
+            maxLatency = qMax(maxLatency, frameLatency);
+            first = qMin(first, time);
+            last = qMax(last, time);
+            flips++;
+        }
+
+        if (presented && m_outputs.size() > 1) {
+            skew += last - first;
+            maxSkew = qMax(maxSkew, last - first);
+            skewFrames++;
+        }
+    }
+    for (const Output &output : qAsConst(m_outputs))
+        tearingFlips += output.tearingFlips;
+
+    fprintf(stdout, "kmsflip-result: %d %d %lld %lld %lld %lld %d %lld %d %lld %lld\n",
+            flips, skewFrames, latency, maxLatency, skew, maxSkew,
+            tearingFlips, interval, refused, commits, eventReads);
+    fflush(stdout);
+    return 0;
+}
+
+class tst_KmsFlip : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void flip_data();
+    void flip();
+
+    void asyncFlip_data();
+    void asyncFlip();
+
+private:
+    struct Result {
+        int flips = 0;
+        int skewFrames = 0;
+        qint64 latency = 0;
+        qint64 maxLatency = 0;
+        qint64 skew = 0;
+        qint64 maxSkew = 0;
+        int tearingFlips = 0;
+        qint64 interval = 0;
+        int refused = 0;
+        qint64 commits = 0;
+        qint64 eventReads = 0;
+        QByteArray skipped;
+    };
+
+    bool render(bool synchronized, bool tearing, bool scanout, Result *result);
+};
+
+/*
+    Runs the renderer in a process of its own with the given KMS
+    configuration, and parses what it reports into \a result. The reason
+    is in \a result when the renderer skipped the benchmark.
+*/
+bool tst_KmsFlip::render(bool synchronized, bool tearing, bool scanout, Result *result)
+{
+    QTemporaryFile config;
+    if (!config.open()) {
+        qWarning("Cannot create the KMS configuration");
+        return false;
+    }
+
+    QJsonObject object;
+    object.insert(QStringLiteral("device"), devicePath());
+    object.insert(QStringLiteral("hwcursor"), false);
+    object.insert(QStringLiteral("synchronizedOutputs"), synchronized);
+    config.write(QJsonDocument(object).toJson());
+    config.close();
+
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    environment.insert(QStringLiteral("QT_QPA_PLATFORM"), QStringLiteral("aurora-eglfs"));
+    environment.insert(QStringLiteral("QT_QPA_EGLFS_INTEGRATION"), QStringLiteral("eglfs_kms"));
+    environment.insert(QStringLiteral("QT_QPA_EGLFS_KMS_CONFIG"), config.fileName());
+    environment.insert(QStringLiteral("KMSFLIP_RENDER"), tearing ? QStringLiteral("tearing") : QStringLiteral("vsync"));
+    if (scanout)
+        environment.insert(QStringLiteral("KMSFLIP_SCANOUT"), QStringLiteral("1"));
+
+    QProcess process;
+    process.setProcessEnvironment(environment);
+    process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    process.start(QCoreApplication::applicationFilePath(), QStringList());
+    if (!process.waitForFinished(60000)) {
+        process.kill();
+        qWarning("The renderer did not finish");
+        return false;
+    }
+
+    const QList<QByteArray> lines = process.readAllStandardOutput().split('\n');
+    for (const QByteArray &line : lines) {
+        if (line.startsWith("kmsflip-skip: ")) {
+            result->skipped = line.mid(14);
+            return true;
+        } else if (line.startsWith("kmsflip-fail: ")) {
+            qWarning("%s", line.mid(14).constData());
+            return false;
+        } else if (line.startsWith("kmsflip-result: ")) {
+            long long latency, maxLatency, skew, maxSkew, interval, commits, eventReads;
+            if (sscanf(line.constData() + 16, "%d %d %lld %lld %lld %lld %d %lld %d %lld %lld",
+                       &result->flips, &result->skewFrames, &latency, &maxLatency,
+                       &skew, &maxSkew, &result->tearingFlips, &interval, &result->refused,
+                       &commits, &eventReads) != 11)
+                return false;
+            result->latency = latency;
+            result->maxLatency = maxLatency;
+            result->skew = skew;
+            result->maxSkew = maxSkew;
+            result->interval = interval;
+            result->commits = commits;
+            result->eventReads = eventReads;
+            return process.exitCode() == 0;
+        }
+    }
+
+    qWarning("The renderer reported nothing, exit code %d", process.exitCode());
+    return false;
+}
+
+void tst_KmsFlip::flip_data()
+{
+    QTest::addColumn<bool>("synchronized");
+
+    QTest::newRow("separate") << false;
+    QTest::newRow("synchronized") << true;
+}
+
+void tst_KmsFlip::flip()
+{
+    QFETCH(bool, synchronized);
+
+    Result result;
+    QVERIFY(render(synchronized, false, false, &result));
+    if (!result.skipped.isEmpty())
+        QSKIP(result.skipped.constData());
+    QVERIFY(result.flips > 0);
+
+    if (result.skewFrames == 0)
+        QSKIP("At least two outputs must be connected");
+
+    qInfo("%s: %d frames presented, flip latency %.3f ms (max %.3f ms), "
+          "skew between outputs %.3f ms (max %.3f ms), "
+          "%.2f commit ioctls and %.2f event reads per frame",
+          synchronized ? "synchronized" : "separate", result.flips,
+          qreal(result.latency) / result.flips / 1000, qreal(result.maxLatency) / 1000,
+          qreal(result.skew) / result.skewFrames / 1000, qreal(result.maxSkew) / 1000,
+          qreal(result.commits) / frameCount, qreal(result.eventReads) / frameCount);
+
+    QTest::setBenchmarkResult(qreal(result.skew) / result.skewFrames / 1000, QTest::WalltimeMilliseconds);
+}
+
+void tst_KmsFlip::asyncFlip_data()
+{
+    QTest::addColumn<bool>("async");
+
+    QTest::newRow("vsync") << false;
+    QTest::newRow("async") << true;
+}
+
+void tst_KmsFlip::asyncFlip()
+{
+    QFETCH(bool, async);
+
+    Result result;
+    QVERIFY(render(false, async, true, &result));
+    if (!result.skipped.isEmpty())
+        QSKIP(result.skipped.constData());
+    QVERIFY(result.flips > 0);
+
+    if (result.refused == frameCount)
+        QSKIP("The screen refused to flip the client buffers");
+    if (async && result.tearingFlips == 0)
+        QSKIP("The DRM device doesn't support atomic async page flips");
+
+    qInfo("%s: flip latency %.3f ms (max %.3f ms), %d tearing flips, "
+          "%d buffers refused, refresh interval %.3f ms, "
+          "%.2f commit ioctls and %.2f event reads per frame",
+          async ? "async" : "vsync",
+          qreal(result.latency) / result.flips / 1000, qreal(result.maxLatency) / 1000,
+          result.tearingFlips, result.refused, qreal(result.interval) / 1000,
+          qreal(result.commits) / frameCount, qreal(result.eventReads) / frameCount);
+
+    QTest::setBenchmarkResult(qreal(result.latency) / result.flips / 1000, QTest::WalltimeMilliseconds);
+}
+
+int main(int argc, char *argv[])
+{
+    // The renderer process, started by the benchmark
+    const QString mode = qEnvironmentVariable("KMSFLIP_RENDER");
+    if (!mode.isEmpty()) {
+        QGuiApplication app(argc, argv);
+        Renderer renderer(mode == QLatin1String("tearing"),
+                          !qEnvironmentVariableIsEmpty("KMSFLIP_SCANOUT"));
+        return renderer.run();
+    }
+
+    // The platform plugin must not take DRM master away from the renderers
+    QCoreApplication app(argc, argv);
+    tst_KmsFlip test;
+    QTEST_SET_MAIN_SOURCE_PATH
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_kmsflip.moc"
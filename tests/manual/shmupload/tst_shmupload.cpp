@@ -0,0 +1,97 @@
+// Copyright (C) 2024 Pier Luigi Fiorini <pierluigi.fiorini@gmail.com>
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#include <QtGui/QOffscreenSurface>
+#include <QtGui/QOpenGLContext>
+#include <QtGui/QOpenGLFunctions>
+#include <QtTest/QtTest>
+
+#include <LiriAuroraCompositor/private/aurorawlclientbuffer_p.h>
+
+using namespace Aurora::Compositor::Internal;
+
+class tst_ShmUpload : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void upload_data();
+    void upload();
+
+private:
+    QOffscreenSurface m_surface;
+    QOpenGLContext m_context;
+    GLuint m_texture = 0;
+};
+
+void tst_ShmUpload::initTestCase()
+{
+    m_surface.create();
+    if (!m_context.create() || !m_context.makeCurrent(&m_surface))
+        QSKIP("OpenGL is not available");
+
+    m_context.functions()->glGenTextures(1, &m_texture);
+    m_context.functions()->glBindTexture(GL_TEXTURE_2D, m_texture);
+}
+
+void tst_ShmUpload::cleanupTestCase()
+{
+    if (m_texture)
+        m_context.functions()->glDeleteTextures(1, &m_texture);
+    m_context.doneCurrent();
+}
+
+void tst_ShmUpload::upload_data()
+{
+    QTest::addColumn<QImage::Format>("format");
+    QTest::addColumn<QSize>("size");
+    QTest::addColumn<QRect>("damage");
+    QTest::addColumn<int>("mode");
+
+    // ARGB8888 and XRGB8888 as they come from wl_shm
+    const QList<QPair<QByteArray, QImage::Format>> formats = {
+        { "argb8888", QImage::Format_ARGB32_Premultiplied },
+        { "xrgb8888", QImage::Format_RGB32 },
+    };
+    const QList<QPair<QByteArray, int>> modes = {
+        { "convert", SharedMemoryBuffer::ConvertUpload },
+        { "native", SharedMemoryBuffer::NativeUpload },
+    };
+
+    for (const auto &format : formats) {
+        for (const auto &mode : modes) {
+            QTest::newRow(format.first + "-1080p-full-" + mode.first)
+                    << format.second << QSize(1920, 1080) << QRect(0, 0, 1920, 1080) << mode.second;
+            QTest::newRow(format.first + "-4k-full-" + mode.first)
+                    << format.second << QSize(3840, 2160) << QRect(0, 0, 3840, 2160) << mode.second;
+            QTest::newRow(format.first + "-4k-cursor-" + mode.first)
+                    << format.second << QSize(3840, 2160) << QRect(1200, 800, 16, 32) << mode.second;
+        }
+    }
+}
+
+void tst_ShmUpload::upload()
+{
+    QFETCH(QImage::Format, format);
+    QFETCH(QSize, size);
+    QFETCH(QRect, damage);
+    QFETCH(int, mode);
+
+    QImage image(size, format);
+    image.fill(QColor(32, 64, 128, 200));
+
+    const auto uploadMode = static_cast<SharedMemoryBuffer::UploadMode>(mode);
+    SharedMemoryBuffer::uploadImage(image, image.rect(), true, uploadMode);
+
+    QBENCHMARK {
+        SharedMemoryBuffer::uploadImage(image, damage, false, uploadMode);
+        m_context.functions()->glFinish();
+    }
+}
+
+QTEST_MAIN(tst_ShmUpload)
+
+#include "tst_shmupload.moc"